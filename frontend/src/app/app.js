@@ -24,6 +24,7 @@ import {
     APP_REQUEST_TYPE_REQUEST_PAIRING,
     APP_REQUEST_TYPE_REMOVE_PAIRING,
     APP_REQUEST_TYPE_START_DISCOVERY,
+    APP_REQUEST_TYPE_RESET_STATISTICS,
 } from '../bleclient.js';
 
 const mode = import.meta.env.VITE_MODE;
@@ -241,6 +242,22 @@ export async function stop() {
     }
 }
 
+/**
+ * Clear the iteration statistics of all running Lua threads on the device.
+ */
+export async function resetThreadStatistics() {
+    if (mode === 'dev') {
+        return;
+    } else if (mode === 'bt') {
+        await bleClient.sendRequest(APP_REQUEST_TYPE_RESET_STATISTICS, JSON.stringify({}));
+    } else if (mode === 'web') {
+        await fetch('/resetstatistics', {
+            method: 'PUT',
+            body: '',
+        });
+    }
+}
+
 /**
  * Initiate Bluetooth Classic pairing with the given device.
  * @param {string} mac - Device MAC address
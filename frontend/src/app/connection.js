@@ -184,13 +184,15 @@ function setupEventListeners({ logger, uiComponents, mapComponent, blocklyEditor
         const status = JSON.parse(new TextDecoder().decode(data));
         console.log('Got Portstatus : ' + JSON.stringify(status));
         // Update state — portstatus component subscribes and re-renders automatically
-        setState({ portStatuses: status.ports });
+        setState({ portStatuses: status.ports, programMemory: status.lua ?? null });
     });
 
     bleClient.addEventListener(APP_EVENT_TYPE_COMMAND, (data) => {
         const command = JSON.parse(new TextDecoder().decode(data));
         if (command.type === 'thread_statistics') {
-            blocklyEditor.addProfilingOverlay(command.blockid, command.min, command.avg, command.max);
+            blocklyEditor.addProfilingOverlay(command.blockid, command.min, command.avg, command.max, command.pct);
+        } else if (command.type === 'line_profile') {
+            blocklyEditor.addHotLineOverlays(command.lines, command.samples);
         } else if (command.type === 'map_points' || command.type === 'map_clear') {
             mapComponent.processUIEvent(command);
         } else {
@@ -297,7 +299,7 @@ async function _doConnect(reconnecting) {
     StatusBar.setConnected(bleClient.device?.name);
 
     // Reset component state so stale data is cleared
-    setState({ portStatuses: [], deviceList: [] });
+    setState({ portStatuses: [], programMemory: null, deviceList: [] });
 
     // Wire up BLE events
     setupEventListeners(_elements);
@@ -16,9 +16,10 @@
  *   }
  */
 
-/** @type {{ portStatuses: Array, deviceList: Array, isConnected: boolean, activeProject: string|null, projects: Array, autostartProject: string|null }} */
+/** @type {{ portStatuses: Array, programMemory: Object|null, deviceList: Array, isConnected: boolean, activeProject: string|null, projects: Array, autostartProject: string|null }} */
 const _state = {
     portStatuses: [],
+    programMemory: null,
     deviceList: [],
     isConnected: false,
     activeProject: null,
@@ -71,6 +72,7 @@ export function subscribe(key, fn) {
 export function resetState() {
     Object.assign(_state, {
         portStatuses: [],
+        programMemory: null,
         deviceList: [],
         isConnected: false,
         activeProject: null,
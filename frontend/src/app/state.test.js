@@ -9,6 +9,7 @@ describe('getState', () => {
         expect(getState('portStatuses')).toEqual([]);
         expect(getState('isConnected')).toBe(false);
         expect(getState('activeProject')).toBeNull();
+        expect(getState('programMemory')).toBeNull();
     });
 });
 
@@ -86,12 +87,13 @@ describe('subscribe', () => {
 
 describe('resetState', () => {
     it('resets all keys to their initial values', () => {
-        setState({ isConnected: true, activeProject: 'test', portStatuses: [{ id: 1 }] });
+        setState({ isConnected: true, activeProject: 'test', portStatuses: [{ id: 1 }], programMemory: { bytes: 1 } });
         resetState();
 
         expect(getState('isConnected')).toBe(false);
         expect(getState('activeProject')).toBeNull();
         expect(getState('portStatuses')).toEqual([]);
+        expect(getState('programMemory')).toBeNull();
     });
 
     it('clears all subscribers so they are not called after reset', () => {
@@ -1174,6 +1174,7 @@ export const APP_REQUEST_TYPE_READY_FOR_EVENTS = 0x0a;
 export const APP_REQUEST_TYPE_REQUEST_PAIRING = 0x0b;
 export const APP_REQUEST_TYPE_REMOVE_PAIRING = 0x0c;
 export const APP_REQUEST_TYPE_START_DISCOVERY = 0x0d;
+export const APP_REQUEST_TYPE_RESET_STATISTICS = 0x0e;
 
 export const APP_EVENT_TYPE_LOG = 0x01;
 export const APP_EVENT_TYPE_PORTSTATUS = 0x02;
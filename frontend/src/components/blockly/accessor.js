@@ -0,0 +1,21 @@
+// Sensor readers bound once at program start.
+// A block reading a sensor with constant arguments declares a top-level local
+// holding the closure of lego.accessor(), imu.accessor() or gamepad.accessor(),
+// and calls that instead of resolving port, mode and dataset on every read.
+// Blocks with the same arguments share one reader.
+
+/** Port, gamepad and number arguments that cannot change while the program runs. */
+export const CONSTANT_PORT = /^PORT\d+$/;
+export const CONSTANT_GAMEPAD = /^GAMEPAD\d+$/;
+export const CONSTANT_INDEX = /^\d+$/;
+
+/**
+ * Returns the code calling the reader created by the given Lua call.
+ * @param {object} generator the Lua generator
+ * @param {string} name desired name of the reader, unique per library and arguments
+ * @param {string} call Lua expression creating the reader, e.g. imu.accessor(YAW)
+ */
+export function readerCall(generator, name, call) {
+    const reader = generator.provideFunction_(name, ['local ' + generator.FUNCTION_NAME_PLACEHOLDER_ + ' = ' + call]);
+    return reader + '()';
+}
@@ -521,7 +521,7 @@ class BlocklyHTMLElement extends HTMLElement {
         }
     }
 
-    addProfilingOverlay(blockId, minDuration, avgDuration, maxDuration) {
+    addProfilingOverlay(blockId, minDuration, avgDuration, maxDuration, percentiles) {
         const workspace = Blockly.getMainWorkspace();
         const block = workspace.getBlockById(blockId);
 
@@ -560,9 +560,10 @@ class BlocklyHTMLElement extends HTMLElement {
         glowRect.setAttribute('opacity', '0.4');
         glowRect.style.filter = 'drop-shadow(0 0 3px ' + perfColor + ')';
 
-        // Badge container - wider for 7-digit numbers
-        const badgeWidth = 200;
-        const badgeHeight = 30;
+        // Badge container - wider for 7-digit numbers, a third row for the percentiles
+        const showPercentiles = Array.isArray(percentiles) && percentiles.length === 4;
+        const badgeWidth = showPercentiles ? 240 : 200;
+        const badgeHeight = showPercentiles ? 42 : 30;
         const badgeX = bbox.width - badgeWidth - 5;
         const badgeY = -badgeHeight - 5;
 
@@ -673,6 +674,19 @@ class BlocklyHTMLElement extends HTMLElement {
         maxValue.setAttribute('font-weight', 'bold');
         maxValue.textContent = formatMicros(maxDuration);
 
+        // Third row: p50 / p90 / p99 / p99.9, the tail is what min/avg/max hide
+        let percentileValue = null;
+        if (showPercentiles) {
+            percentileValue = document.createElementNS('http://www.w3.org/2000/svg', 'text');
+            percentileValue.setAttribute('x', col1X);
+            percentileValue.setAttribute('y', badgeY + 35);
+            percentileValue.setAttribute('fill', labelColor);
+            percentileValue.setAttribute('font-size', labelSize);
+            percentileValue.setAttribute('font-family', "'Consolas', 'Monaco', 'Courier New', monospace");
+            percentileValue.textContent =
+                'p50/90/99/99.9 ' + percentiles.map((p) => Math.round(p).toLocaleString()).join(' / ') + ' µs';
+        }
+
         // Add connecting line from badge to block
         const connector = document.createElementNS('http://www.w3.org/2000/svg', 'line');
         connector.setAttribute('x1', badgeX + badgeWidth / 2);
@@ -694,6 +708,9 @@ class BlocklyHTMLElement extends HTMLElement {
         overlay.appendChild(minValue);
         overlay.appendChild(avgValue);
         overlay.appendChild(maxValue);
+        if (percentileValue) {
+            overlay.appendChild(percentileValue);
+        }
 
         // Blockly blocks have this structure: path elements first, then other decorations
         // We insert the overlay after all existing children
@@ -707,16 +724,109 @@ class BlocklyHTMLElement extends HTMLElement {
         }
     }
 
+    /**
+     * Map the lines of the generated Lua code to the statement blocks that
+     * produced them. The code is generated a second time with a marker
+     * comment before each statement; dropping the markers again yields the
+     * same code as generateLUAPreview(), so line numbers match the program
+     * running on the hub.
+     * @returns {Array<string|null>} Block id per 1-based line number
+     */
+    generateLineMap() {
+        const previousPrefix = luaGenerator.STATEMENT_PREFIX;
+        luaGenerator.STATEMENT_PREFIX = '--@block %1\n';
+        let code;
+        try {
+            code = luaGenerator.workspaceToCode(this.workspace);
+        } finally {
+            luaGenerator.STATEMENT_PREFIX = previousPrefix;
+        }
+
+        const lineMap = [null];
+        let currentBlock = null;
+        for (const line of code.split('\n')) {
+            const marker = line.trim().match(/^--@block '(.*)'$/);
+            if (marker) {
+                currentBlock = marker[1];
+            } else {
+                lineMap.push(currentBlock);
+            }
+        }
+        return lineMap;
+    }
+
+    /**
+     * Highlight the blocks owning the hottest lines of a line_profile report.
+     * @param {Array<{src: string, line: number, n: number}>} lines - Hottest lines
+     * @param {number} totalSamples - Samples the shares are relative to
+     */
+    addHotLineOverlays(lines, totalSamples) {
+        this.workspace.getAllBlocks(false).forEach((block) => {
+            const overlay = block.getSvgRoot()?.querySelector('.hotspot-overlay');
+            if (overlay) {
+                overlay.remove();
+            }
+        });
+        if (!totalSamples) return;
+
+        // Several lines may belong to one block
+        const lineMap = this.generateLineMap();
+        const samplesPerBlock = new Map();
+        for (const line of lines) {
+            const blockId = line.src === 'program' ? lineMap[line.line] : null;
+            if (blockId) {
+                samplesPerBlock.set(blockId, (samplesPerBlock.get(blockId) || 0) + line.n);
+            }
+        }
+
+        const minimumShare = 0.05;
+        samplesPerBlock.forEach((samples, blockId) => {
+            const share = samples / totalSamples;
+            const block = this.workspace.getBlockById(blockId);
+            if (!block || share < minimumShare) return;
+
+            const blockSvg = block.getSvgRoot();
+            const bbox = blockSvg.getBBox();
+            const perfColor = this.getPerformanceColor(Math.min(share * 2, 1));
+
+            const overlay = document.createElementNS('http://www.w3.org/2000/svg', 'g');
+            overlay.classList.add('hotspot-overlay');
+
+            const outline = document.createElementNS('http://www.w3.org/2000/svg', 'rect');
+            outline.setAttribute('x', -3);
+            outline.setAttribute('y', -3);
+            outline.setAttribute('width', bbox.width + 6);
+            outline.setAttribute('height', bbox.height + 6);
+            outline.setAttribute('rx', 4);
+            outline.setAttribute('fill', 'none');
+            outline.setAttribute('stroke', perfColor);
+            outline.setAttribute('stroke-width', '2');
+            outline.setAttribute('stroke-dasharray', '4,2');
+
+            const label = document.createElementNS('http://www.w3.org/2000/svg', 'text');
+            label.setAttribute('x', -3);
+            label.setAttribute('y', -6);
+            label.setAttribute('fill', perfColor);
+            label.setAttribute('font-size', '9');
+            label.setAttribute('font-family', "'Consolas', 'Monaco', 'Courier New', monospace");
+            label.setAttribute('font-weight', 'bold');
+            label.textContent = Math.round(share * 100) + '% of samples';
+
+            overlay.appendChild(outline);
+            overlay.appendChild(label);
+            blockSvg.appendChild(overlay);
+        });
+    }
+
     removeAllProfilingOverlays() {
         const allBlocks = this.workspace.getAllBlocks(false);
 
         allBlocks.forEach((block) => {
             const blockSvg = block.getSvgRoot();
             if (blockSvg) {
-                const overlay = blockSvg.querySelector('.profile-overlay');
-                if (overlay) {
+                blockSvg.querySelectorAll('.profile-overlay, .hotspot-overlay').forEach((overlay) => {
                     overlay.remove();
-                }
+                });
             }
         });
     }
@@ -1,4 +1,5 @@
 import { colorLego } from './colors.js';
+import { CONSTANT_INDEX, CONSTANT_PORT, readerCall } from './accessor.js';
 
 // clang-format off
 export const definition = {
@@ -56,6 +57,13 @@ export const definition = {
         const modeCode = generator.valueToCode(block, 'MODE', 0);
         const datasetCode = generator.valueToCode(block, 'DATASET', 0);
 
+        // The default MODE shadow reads the current device mode and cannot be bound once
+        if (CONSTANT_PORT.test(port) && CONSTANT_INDEX.test(modeCode) && CONSTANT_INDEX.test(datasetCode)) {
+            const name = 'lego_' + port + '_' + modeCode + '_' + datasetCode;
+            const call = 'lego.accessor(' + port + ',' + modeCode + ',' + datasetCode + ')';
+            return [readerCall(generator, name, call), 0];
+        }
+
         const command = 'lego.getmodedataset(' + port + ',' + modeCode + ',' + datasetCode + ')';
         return [command, 0];
     },
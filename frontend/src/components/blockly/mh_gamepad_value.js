@@ -1,4 +1,5 @@
 import { colorGamepad } from './colors.js';
+import { CONSTANT_GAMEPAD, readerCall } from './accessor.js';
 
 // clang-format off
 export const definition = {
@@ -43,6 +44,12 @@ export const definition = {
         const gamepad = generator.valueToCode(block, 'GAMEPAD', 0);
         const value = block.getFieldValue('VALUE');
 
+        if (CONSTANT_GAMEPAD.test(gamepad)) {
+            const name = gamepad + '_' + value;
+            const command = readerCall(generator, name, 'gamepad.accessor(' + gamepad + ',' + value + ')');
+            return [command, 0];
+        }
+
         const command = 'gamepad.value(' + gamepad + ',' + value + ')';
 
         return [command, 0];
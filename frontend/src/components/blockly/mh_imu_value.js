@@ -1,4 +1,5 @@
 import { colorIMU } from './colors.js';
+import { readerCall } from './accessor.js';
 
 // clang-format off
 export const definition = {
@@ -26,9 +27,9 @@ export const definition = {
         tooltip: 'Gets a value from the IMU',
         helpUrl: '',
     },
-    generator: (block, _generator) => {
+    generator: (block, generator) => {
         const value = block.getFieldValue('VALUE');
-        const command = 'imu.value(' + value + ')';
+        const command = readerCall(generator, 'imu_' + value, 'imu.accessor(' + value + ')');
         return [command, 0];
     },
 };
@@ -9,6 +9,9 @@ class PortstatusElement extends HTMLElement {
     /** @type {function(): void} Unsubscribe from portStatuses state */
     _unsubPortStatuses = null;
 
+    /** @type {function(): void} Unsubscribe from programMemory state */
+    _unsubProgramMemory = null;
+
     connectedCallback() {
         const shadow = this.attachShadow({ mode: 'open' });
 
@@ -28,6 +31,7 @@ class PortstatusElement extends HTMLElement {
                 this.updateStatus({ ports });
             }
         });
+        this._unsubProgramMemory = subscribe('programMemory', (memory) => this.renderMemory(memory));
     }
 
     disconnectedCallback() {
@@ -36,6 +40,10 @@ class PortstatusElement extends HTMLElement {
             this._unsubPortStatuses();
             this._unsubPortStatuses = null;
         }
+        if (this._unsubProgramMemory) {
+            this._unsubProgramMemory();
+            this._unsubProgramMemory = null;
+        }
     }
 
     /**
@@ -145,6 +153,38 @@ class PortstatusElement extends HTMLElement {
             });
         }
     }
+
+    /**
+     * Render the memory of the running program, as reported with the port status.
+     * The bytes the Lua libraries take before the program starts are left out.
+     * @param {{ bytes: number, peak: number, base: number, blocks: number, objects: Object }|null} memory
+     */
+    renderMemory(memory) {
+        const container = this.shadowRoot.getElementById('programMemory');
+        if (!memory) {
+            container.innerHTML = '';
+            return;
+        }
+        const kb = (bytes) => `${(Math.max(bytes - memory.base, 0) / 1024).toFixed(1)} KB`;
+        const objects = memory.objects || {};
+        container.innerHTML = `
+                <div class="port-card">
+                    <div class="port-header">
+                        <span class="port-label">Program memory</span>
+                        <span class="memory-value">${kb(memory.bytes)} (peak ${kb(memory.peak)})</span>
+                    </div>
+                    <div class="modes-section">
+                        <div class="modes-label">Created</div>
+                        <div class="modes-list">
+                            <span class="mode-badge">${objects.table ?? 0} tables</span>
+                            <span class="mode-badge">${objects.string ?? 0} strings</span>
+                            <span class="mode-badge">${objects.function ?? 0} functions</span>
+                            <span class="mode-badge">${memory.blocks} blocks live</span>
+                        </div>
+                    </div>
+                </div>
+            `;
+    }
 }
 
 customElements.define('custom-portstatus', PortstatusElement);
@@ -291,6 +291,24 @@ async function stopCode() {
     blocklyEditor.removeAllProfilingOverlays();
 }
 
+/**
+ * Clear the thread statistics on the device, the profiling overlays show
+ * fresh numbers with the next report.
+ */
+async function resetThreadStatistics() {
+    if (mode === 'dev') {
+        showNotification('info', 'Statistics', 'Running in dev mode - no backend available');
+        return;
+    }
+    try {
+        await App.resetThreadStatistics();
+        showNotification('success', 'Statistics Reset', 'Thread statistics have been cleared');
+    } catch (error) {
+        showNotification('error', 'Statistics Error', error.message);
+    }
+    blocklyEditor.removeAllProfilingOverlays();
+}
+
 /**
  * Save the current workspace (XML and Lua) to the device.
  * @returns {Promise<boolean>} True if save was successful
@@ -553,7 +571,10 @@ document.addEventListener('DOMContentLoaded', () => {
         eventSource.addEventListener('portstatus', (event) => {
             // Update via state so portstatus component re-renders automatically
             const data = JSON.parse(event.data);
-            setState({ portStatuses: data.ports !== undefined ? data.ports : data });
+            setState({
+                portStatuses: data.ports !== undefined ? data.ports : data,
+                programMemory: data.lua ?? null,
+            });
         });
     }
 
@@ -673,6 +694,10 @@ document.addEventListener('DOMContentLoaded', () => {
         stopCode();
     });
 
+    document.getElementById('resetstatistics').addEventListener('click', () => {
+        resetThreadStatistics();
+    });
+
     // Manual save button
     document.getElementById('save').addEventListener('click', async () => {
         if (getState('activeProject')) {
@@ -13,8 +13,15 @@ function makeBlock(fields = {}) {
 }
 
 function makeGenerator(values = {}) {
+    const definitions = {};
     return {
+        definitions,
+        FUNCTION_NAME_PLACEHOLDER_: '{name}',
         valueToCode: (_block, name) => values[name] ?? '0',
+        provideFunction_: (desiredName, code) => {
+            definitions[desiredName] = code.join('\n').replace('{name}', desiredName);
+            return desiredName;
+        },
     };
 }
 
@@ -56,7 +63,7 @@ describe('lego_get_mode_dataset generator', () => {
 
     it('generates lego.getmodedataset(port, mode, dataset) expression', () => {
         const block = makeBlock();
-        const gen = makeGenerator({ PORT: 'PORT1', MODE: '0', DATASET: '0' });
+        const gen = makeGenerator({ PORT: 'PORT1', MODE: 'lego.getdevicemode(PORT1)', DATASET: '0' });
 
         const [code] = definition.generator(block, gen);
 
@@ -94,4 +101,24 @@ describe('lego_get_mode_dataset generator', () => {
         expect(code).toBe('lego.getmodedataset(p,m,d)');
         expect(order).toBe(0);
     });
+
+    it('binds a reader with lego.accessor() for constant port, mode and dataset', () => {
+        const block = makeBlock();
+        const gen = makeGenerator({ PORT: 'PORT1', MODE: '0', DATASET: '2' });
+
+        const [code, order] = definition.generator(block, gen);
+
+        expect(code).toBe('lego_PORT1_0_2()');
+        expect(order).toBe(0);
+        expect(gen.definitions.lego_PORT1_0_2).toBe('local lego_PORT1_0_2 = lego.accessor(PORT1,0,2)');
+    });
+
+    it('does not bind a reader for a mode read at runtime', () => {
+        const block = makeBlock();
+        const gen = makeGenerator({ PORT: 'PORT1', MODE: 'lego.getdevicemode(PORT1)', DATASET: '0' });
+
+        definition.generator(block, gen);
+
+        expect(gen.definitions).toEqual({});
+    });
 });
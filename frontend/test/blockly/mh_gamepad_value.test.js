@@ -11,9 +11,16 @@ function makeBlock(fields = {}, extra = {}) {
 }
 
 function makeGenerator(values = {}, statements = {}) {
+    const definitions = {};
     return {
+        definitions,
+        FUNCTION_NAME_PLACEHOLDER_: '{name}',
         valueToCode: (block, name) => values[name] ?? '',
         statementToCode: (block, name) => statements[name] ?? '',
+        provideFunction_: (desiredName, code) => {
+            definitions[desiredName] = code.join('\n').replace('{name}', desiredName);
+            return desiredName;
+        },
     };
 }
 
@@ -38,27 +45,29 @@ describe('mh_gamepad_value block definition', () => {
 });
 
 describe('mh_gamepad_value generator', () => {
-    it('generates ["gamepad.value(GAMEPAD1,GAMEPAD_LEFT_X)", 0]', () => {
+    it('generates ["GAMEPAD1_GAMEPAD_LEFT_X()", 0]', () => {
         const block = makeBlock({ VALUE: 'GAMEPAD_LEFT_X' });
         const gen = makeGenerator({ GAMEPAD: 'GAMEPAD1' });
         const result = definition.generator(block, gen);
-        expect(result[0]).toBe('gamepad.value(GAMEPAD1,GAMEPAD_LEFT_X)');
+        expect(result[0]).toBe('GAMEPAD1_GAMEPAD_LEFT_X()');
         expect(result[1]).toBe(0);
     });
 
-    it('generates ["gamepad.value(GAMEPAD1,GAMEPAD_DPAD)", 0]', () => {
+    it('binds the reader once with gamepad.accessor(GAMEPAD1,GAMEPAD_DPAD)', () => {
         const block = makeBlock({ VALUE: 'GAMEPAD_DPAD' });
         const gen = makeGenerator({ GAMEPAD: 'GAMEPAD1' });
         const result = definition.generator(block, gen);
-        expect(result[0]).toBe('gamepad.value(GAMEPAD1,GAMEPAD_DPAD)');
-        expect(result[1]).toBe(0);
+        expect(result[0]).toBe('GAMEPAD1_GAMEPAD_DPAD()');
+        expect(gen.definitions.GAMEPAD1_GAMEPAD_DPAD).toBe(
+            'local GAMEPAD1_GAMEPAD_DPAD = gamepad.accessor(GAMEPAD1,GAMEPAD_DPAD)'
+        );
     });
 
-    it('embeds gamepad and value in output', () => {
+    it('falls back to gamepad.value() for a gamepad that is not a constant', () => {
         const block = makeBlock({ VALUE: 'GAMEPAD_RIGHT_Y' });
         const gen = makeGenerator({ GAMEPAD: 'myGamepad' });
         const result = definition.generator(block, gen);
-        expect(result[0]).toContain('myGamepad');
-        expect(result[0]).toContain('GAMEPAD_RIGHT_Y');
+        expect(result[0]).toBe('gamepad.value(myGamepad,GAMEPAD_RIGHT_Y)');
+        expect(gen.definitions).toEqual({});
     });
 });
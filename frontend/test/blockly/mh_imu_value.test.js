@@ -11,9 +11,16 @@ function makeBlock(fields = {}, extra = {}) {
 }
 
 function makeGenerator(values = {}, statements = {}) {
+    const definitions = {};
     return {
+        definitions,
+        FUNCTION_NAME_PLACEHOLDER_: '{name}',
         valueToCode: (block, name) => values[name] ?? '',
         statementToCode: (block, name) => statements[name] ?? '',
+        provideFunction_: (desiredName, code) => {
+            definitions[desiredName] = code.join('\n').replace('{name}', desiredName);
+            return desiredName;
+        },
     };
 }
 
@@ -38,35 +45,43 @@ describe('mh_imu_value block definition', () => {
 });
 
 describe('mh_imu_value generator', () => {
-    it('returns ["imu.value(YAW)", 0] for VALUE=YAW', () => {
+    it('returns ["imu_YAW()", 0] for VALUE=YAW', () => {
         const block = makeBlock({ VALUE: 'YAW' });
         const gen = makeGenerator();
         const result = definition.generator(block, gen);
-        expect(result[0]).toBe('imu.value(YAW)');
+        expect(result[0]).toBe('imu_YAW()');
         expect(result[1]).toBe(0);
     });
 
-    it('returns ["imu.value(PITCH)", 0] for VALUE=PITCH', () => {
+    it('binds the reader once with imu.accessor(YAW)', () => {
+        const block = makeBlock({ VALUE: 'YAW' });
+        const gen = makeGenerator();
+        definition.generator(block, gen);
+        expect(gen.definitions.imu_YAW).toBe('local imu_YAW = imu.accessor(YAW)');
+    });
+
+    it('returns ["imu_PITCH()", 0] for VALUE=PITCH', () => {
         const block = makeBlock({ VALUE: 'PITCH' });
         const gen = makeGenerator();
         const result = definition.generator(block, gen);
-        expect(result[0]).toBe('imu.value(PITCH)');
+        expect(result[0]).toBe('imu_PITCH()');
         expect(result[1]).toBe(0);
     });
 
-    it('returns ["imu.value(ROLL)", 0] for VALUE=ROLL', () => {
+    it('returns ["imu_ROLL()", 0] for VALUE=ROLL', () => {
         const block = makeBlock({ VALUE: 'ROLL' });
         const gen = makeGenerator();
         const result = definition.generator(block, gen);
-        expect(result[0]).toBe('imu.value(ROLL)');
+        expect(result[0]).toBe('imu_ROLL()');
         expect(result[1]).toBe(0);
     });
 
-    it('returns ["imu.value(ACCELERATION_X)", 0] for VALUE=ACCELERATION_X', () => {
+    it('returns ["imu_ACCELERATION_X()", 0] for VALUE=ACCELERATION_X', () => {
         const block = makeBlock({ VALUE: 'ACCELERATION_X' });
         const gen = makeGenerator();
         const result = definition.generator(block, gen);
-        expect(result[0]).toBe('imu.value(ACCELERATION_X)');
+        expect(result[0]).toBe('imu_ACCELERATION_X()');
+        expect(gen.definitions.imu_ACCELERATION_X).toBe('local imu_ACCELERATION_X = imu.accessor(ACCELERATION_X)');
         expect(result[1]).toBe(0);
     });
 });
@@ -226,6 +226,7 @@ class BTRemote {
 	bool reqRequestPairing(const JsonDocument& requestDoc, JsonDocument& responseDoc);
 	bool reqRemovePairing(const JsonDocument& requestDoc, JsonDocument& responseDoc);
 	bool reqStartDiscovery(const JsonDocument& requestDoc, JsonDocument& responseDoc);
+	bool reqResetStatistics(const JsonDocument& requestDoc, JsonDocument& responseDoc);
 
 	void sendControlMessage(ControlMessageType type, uint8_t messageId);
 	void onRequest(std::function<void(uint8_t, uint8_t, const std::vector<uint8_t>&)> callback);
@@ -84,6 +84,7 @@ static esp_ble_adv_params_t g_adv_params = {
 #define APP_REQUEST_TYPE_REQUEST_PAIRING  0x0B
 #define APP_REQUEST_TYPE_REMOVE_PAIRING   0x0C
 #define APP_REQUEST_TYPE_START_DISCOVERY  0x0D
+#define APP_REQUEST_TYPE_RESET_STATISTICS 0x0E
 
 #define APP_EVENT_TYPE_LOG              0x01
 #define APP_EVENT_TYPE_PORTSTATUS       0x02
@@ -514,7 +515,8 @@ void BTRemote::begin(const char* deviceName) {
 				reqGetProjectFile(messageId, requestDoc);
 				return;
 			} else {
-				createJsonResponse(response, [this, appRequestType, requestDoc](JsonDocument& responseDoc) {
+				// requestDoc by reference, a Lua program in it must not be copied
+				createJsonResponse(response, [this, appRequestType, &requestDoc](JsonDocument& responseDoc) {
 					bool result = false;
 					switch (appRequestType) {
 						case APP_REQUEST_TYPE_STOP_PROGRAM:
@@ -553,6 +555,9 @@ void BTRemote::begin(const char* deviceName) {
 						case APP_REQUEST_TYPE_START_DISCOVERY:
 							result = reqStartDiscovery(requestDoc, responseDoc);
 							break;
+						case APP_REQUEST_TYPE_RESET_STATISTICS:
+							result = reqResetStatistics(requestDoc, responseDoc);
+							break;
 						default:
 							WARN("Not supported appRequestType: %d", appRequestType);
 							responseDoc["error"] = "Not supported appRequestType!";
@@ -1182,6 +1187,11 @@ bool BTRemote::reqStopProgram(const JsonDocument& requestDoc, JsonDocument& resp
 	return hub_->stopLUACode();
 }
 
+bool BTRemote::reqResetStatistics(const JsonDocument& requestDoc, JsonDocument& responseDoc) {
+	hub_->resetThreadStatistics();
+	return true;
+}
+
 bool BTRemote::reqGetProjectFile(uint8_t messageId, const JsonDocument& requestDoc) {
 	String project = requestDoc["project"].as<String>();
 	String filename = requestDoc["filename"].as<String>();
@@ -1390,9 +1400,10 @@ bool BTRemote::reqDeleteProject(const JsonDocument& requestDoc, JsonDocument& re
 }
 
 bool BTRemote::reqSyntaxCheck(const JsonDocument& requestDoc, JsonDocument& responseDoc) {
-	String luaScript = requestDoc["luaScript"].as<String>();
+	JsonString luaScript = requestDoc["luaScript"].as<JsonString>();
+	LuaBufferSource source(luaScript.c_str(), luaScript.size());
 
-	LuaCheckResult result = hub_->checkLUACode(luaScript);
+	LuaCheckResult result = hub_->checkLUACode(source);
 	responseDoc["parseTime"] = result.parseTime;
 	responseDoc["errorMessage"] = String(result.errorMessage.c_str());
 
@@ -1400,9 +1411,13 @@ bool BTRemote::reqSyntaxCheck(const JsonDocument& requestDoc, JsonDocument& resp
 }
 
 bool BTRemote::reqRun(const JsonDocument& requestDoc, JsonDocument& responseDoc) {
-	String luaScript = requestDoc["luaScript"].as<String>();
+	JsonString luaScript = requestDoc["luaScript"].as<JsonString>();
+	LuaBufferSource source(luaScript.c_str(), luaScript.size());
 
-	hub_->executeLUACode(luaScript);
+	LuaExecuteResult result = hub_->executeLUACode(source);
+	responseDoc["cached"] = result.fromCache;
+	responseDoc["parseTime"] = result.parseTime;
+	responseDoc["loadTime"] = result.loadTime;
 	return true;
 }
 
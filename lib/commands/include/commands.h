@@ -6,6 +6,9 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
 
+// Longest command including the terminating zero, longer ones are cut off
+#define COMMAND_MESSAGE_SIZE 512
+
 class Commands {
   private:
 	QueueHandle_t commandQueue_;
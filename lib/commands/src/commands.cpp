@@ -2,7 +2,6 @@
 
 #include "logging.h"
 
-#define COMMAND_MESSAGE_SIZE 512
 #define COMMAND_QUEUE_LENGTH 10
 
 Commands::Commands() {
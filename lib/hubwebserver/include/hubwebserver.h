@@ -26,6 +26,10 @@ class HubWebServer {
 	FS* fs_;
 	Megahub* hub_;
 
+	// Bodies of /syntaxcheck and /execute, filled chunk by chunk during the upload
+	LuaChunkSource syntaxCheckSource_;
+	LuaChunkSource executeSource_;
+
 	void ssdpNotify();
 
 	void announceMDNS();
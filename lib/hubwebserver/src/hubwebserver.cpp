@@ -10,6 +10,7 @@
 #include <ArduinoJson.h>
 #include <ESPmDNS.h>
 #include <WiFi.h>
+#include <new>
 
 // #define CACHE_CONTROL_HEADER_VALUE_FOR_STATIC_ASSETS "public, max-age=300, must-revalidate"
 #define CACHE_CONTROL_HEADER_VALUE_FOR_STATIC_ASSETS "no-cache, no-store, must-revalidate"
@@ -23,6 +24,17 @@ void logForwarderTask(void* param) {
 	}
 }
 
+static esp_err_t appendUploadChunk(LuaChunkSource& source, const uint8_t* data, size_t length) {
+	try {
+		source.append((const char*) data, length);
+	} catch (const std::bad_alloc& e) {
+		ERROR("webserver() - out of memory storing %u bytes of uploaded Lua code", length);
+		source.clear();
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
 HubWebServer::HubWebServer(int wsport, FS* fs, Megahub* hub, SerialLoggingOutput* loggingOutput,
                            Configuration* configuration) {
 	configuration_ = configuration;
@@ -175,6 +187,28 @@ void HubWebServer::start() {
 		return response.endSend();
 	});
 
+	server_->on("/resetstatistics", HTTP_PUT, [this](PsychicRequest* request, PsychicResponse* resp) {
+		INFO("webserver() - /resetstatistics received");
+
+		PsychicStreamResponse response(resp, "application/json");
+
+		hub_->resetThreadStatistics();
+
+		JsonDocument root;
+		root["success"] = true;
+
+		String strContent;
+		serializeJson(root, strContent);
+
+		response.setCode(200);
+		response.setContentType("application/json");
+		response.setContentLength(strContent.length());
+		response.addHeader("Cache-Control", "no-cache, must-revalidate");
+		response.beginSend();
+		response.print(strContent);
+		return response.endSend();
+	});
+
 	server_->on("/description.xml", HTTP_GET, [this](PsychicRequest* request, PsychicResponse* resp) {
 		INFO("webserver() - /description.xml received");
 
@@ -254,30 +288,11 @@ void HubWebServer::start() {
 	                                           uint8_t* data, size_t length, bool final) {
 		DEBUG("webserver() - got data chunk with position %llu and length %u", position, length);
 
-		String file = "/~syntaxcheck.lua";
-		File content;
-
+		// Chunks are kept as received and compiled from there, no SD round trip
 		if (position == 0) {
-			DEBUG("webserver() - creating file %s", file.c_str());
-			content = fs_->open(file, FILE_WRITE, true);
-		} else {
-			DEBUG("webserver() - opening file %s for append", file.c_str());
-			content = fs_->open(file, FILE_APPEND);
-		}
-
-		if (!content) {
-			WARN("webserver() - failed to access file");
-			return ESP_FAIL;
+			syntaxCheckSource_.clear();
 		}
-
-		if (!content.write(data, length)) {
-			WARN("webserver() - Failed wo write data");
-			return ESP_FAIL;
-		}
-
-		content.close();
-
-		return ESP_OK;
+		return appendUploadChunk(syntaxCheckSource_, data, length);
 	});
 
 	projectSyntaxCheckHandler->onRequest([this](PsychicRequest* request, PsychicResponse* resp) {
@@ -287,22 +302,11 @@ void HubWebServer::start() {
 
 		JsonDocument root;
 
-		String file = "/~syntaxcheck.lua";
-		File content = fs_->open(file, FILE_READ);
-		if (content) {
-			String code = content.readString();
-			content.close();
-
-			LuaCheckResult result = hub_->checkLUACode(code);
-			root["success"] = result.success;
-			root["parseTime"] = result.parseTime;
-			root["errorMessage"] = String(result.errorMessage.c_str());
-
-		} else {
-			WARN("webserver() - failed to access file");
-			root["success"] = false;
-			root["errorMessage"] = "Could not access uploaded code file";
-		}
+		LuaCheckResult result = hub_->checkLUACode(syntaxCheckSource_);
+		syntaxCheckSource_.clear();
+		root["success"] = result.success;
+		root["parseTime"] = result.parseTime;
+		root["errorMessage"] = String(result.errorMessage.c_str());
 
 		String strContent;
 		serializeJson(root, strContent);
@@ -322,30 +326,10 @@ void HubWebServer::start() {
 	                                size_t length, bool final) {
 		DEBUG("webserver() - got data chunk with position %llu and length %u", position, length);
 
-		String file = "/~execute.lua";
-		File content;
-
 		if (position == 0) {
-			DEBUG("webserver() - creating file %s", file.c_str());
-			content = fs_->open(file, FILE_WRITE, true);
-		} else {
-			DEBUG("webserver() - opening file %s for append", file.c_str());
-			content = fs_->open(file, FILE_APPEND);
+			executeSource_.clear();
 		}
-
-		if (!content) {
-			WARN("webserver() - failed to access file");
-			return ESP_FAIL;
-		}
-
-		if (!content.write(data, length)) {
-			WARN("webserver() - Failed wo write data");
-			return ESP_FAIL;
-		}
-
-		content.close();
-
-		return ESP_OK;
+		return appendUploadChunk(executeSource_, data, length);
 	});
 
 	executeHandler->onRequest([this](PsychicRequest* request, PsychicResponse* resp) {
@@ -355,20 +339,13 @@ void HubWebServer::start() {
 
 		JsonDocument root;
 
-		String file = "/~execute.lua";
-		File content = fs_->open(file, FILE_READ);
-		if (content) {
-			String code = content.readString();
-			content.close();
-
-			hub_->executeLUACode(code);
+		LuaExecuteResult result = hub_->executeLUACode(executeSource_);
+		executeSource_.clear();
 
-			root["success"] = true;
-
-		} else {
-			WARN("webserver() - failed to access file");
-			root["success"] = false;
-		}
+		root["success"] = true;
+		root["cached"] = result.fromCache;
+		root["parseTime"] = result.parseTime;
+		root["loadTime"] = result.loadTime;
 
 		String strContent;
 		serializeJson(root, strContent);
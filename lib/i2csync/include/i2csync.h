@@ -3,10 +3,80 @@
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <array>
+#include <cstdint>
+#include <functional>
 
-extern SemaphoreHandle_t i2c_global_mutex;
+// Transaction priorities, highest first. Actuation (motor and stop commands,
+// GPIO writes) is served before FIFO draining, FIFO draining before
+// diagnostics such as the port status snapshot.
+enum class I2CPriority {
+	ACTUATION = 0,
+	RECEPTION = 1,
+	DIAGNOSTICS = 2
+};
 
-#define i2c_lock()   xSemaphoreTake(i2c_global_mutex, portMAX_DELAY)
-#define i2c_unlock() xSemaphoreGive(i2c_global_mutex)
+struct I2CLatencyStats {
+	uint32_t transactions;   // executed transactions
+	uint32_t coalesced;      // submissions merged into an already queued transaction
+	uint32_t maxWaitMicros;  // worst queue wait (submit -> start of execution)
+	uint64_t totalWaitMicros; // sum of queue waits, for the average
+	uint32_t maxExecMicros;  // longest single transaction
+};
+
+// ---------------------------------------------------------------------------
+// I2CScheduler — owns the shared I2C bus. All bus access is packaged into
+// transactions that run one at a time on the scheduler task, picked from a
+// per-priority queue. Long work such as the 4-port poll is split into one
+// transaction per device, so an actuation request waits for at most one
+// device transaction instead of a whole poll cycle.
+//
+// Transactions run to completion and must not call execute() themselves;
+// calls made from within the scheduler task run inline.
+// ---------------------------------------------------------------------------
+class I2CScheduler {
+  public:
+	static I2CScheduler* instance();
+
+	// Runs op on the bus and blocks until it has completed.
+	void execute(I2CPriority priority, std::function<void()> op);
+
+	// Queues op without waiting. A non-zero coalesceKey replaces the operation
+	// of a still queued transaction with the same key, so only the latest
+	// command for e.g. one motor is sent.
+	void submit(I2CPriority priority, uintptr_t coalesceKey, std::function<void()> op);
+
+	I2CLatencyStats stats(I2CPriority priority);
+	void resetStats();
+
+  private:
+	static constexpr int queueCapacity = 16;
+	static constexpr int numPriorities = 3;
+
+	struct Transaction {
+		std::function<void()> op;
+		uintptr_t coalesceKey;
+		uint32_t enqueuedAt;
+		SemaphoreHandle_t done;
+	};
+
+	struct TransactionQueue {
+		std::array<Transaction, queueCapacity> slots;
+		int head;
+		int count;
+	};
+
+	I2CScheduler();
+
+	static void schedulerTask(void* parameter);
+	void enqueue(I2CPriority priority, uintptr_t coalesceKey, std::function<void()> op, SemaphoreHandle_t done);
+	bool dequeue(Transaction& transaction, int& priority);
+
+	std::array<TransactionQueue, numPriorities> queues_;
+	std::array<I2CLatencyStats, numPriorities> stats_;
+	SemaphoreHandle_t queueMutex_;
+	TaskHandle_t taskHandle_;
+};
 
 #endif // I2CSYNC_H
@@ -1,3 +1,165 @@
+#include <Arduino.h>
+
 #include "i2csync.h"
 
-SemaphoreHandle_t i2c_global_mutex = xSemaphoreCreateMutex();
+#include "logging.h"
+
+#include <cstring>
+
+I2CScheduler::I2CScheduler() : taskHandle_(nullptr) {
+	for (TransactionQueue& queue : queues_) {
+		queue.head = 0;
+		queue.count = 0;
+	}
+	memset(stats_.data(), 0, sizeof(I2CLatencyStats) * numPriorities);
+
+	queueMutex_ = xSemaphoreCreateMutex();
+	if (!queueMutex_) {
+		ERROR("Failed to create I2C scheduler mutex!");
+		while (true)
+			;
+	}
+
+	// Above the port service task and the periodic Lua threads, so queued
+	// transactions start as soon as the current one has finished.
+	xTaskCreate(schedulerTask, "I2CScheduler", 4096, this, 6, &taskHandle_);
+}
+
+I2CScheduler* I2CScheduler::instance() {
+	static I2CScheduler instance;
+	return &instance;
+}
+
+void I2CScheduler::execute(I2CPriority priority, std::function<void()> op) {
+	if (xTaskGetCurrentTaskHandle() == taskHandle_) {
+		op();
+		return;
+	}
+
+	// Completion semaphore lives on the caller's stack, no heap allocation
+	StaticSemaphore_t doneBuffer;
+	SemaphoreHandle_t done = xSemaphoreCreateBinaryStatic(&doneBuffer);
+	enqueue(priority, 0, std::move(op), done);
+	xSemaphoreTake(done, portMAX_DELAY);
+	vSemaphoreDelete(done);
+}
+
+void I2CScheduler::submit(I2CPriority priority, uintptr_t coalesceKey, std::function<void()> op) {
+	if (xTaskGetCurrentTaskHandle() == taskHandle_) {
+		op();
+		return;
+	}
+	enqueue(priority, coalesceKey, std::move(op), nullptr);
+}
+
+void I2CScheduler::enqueue(I2CPriority priority, uintptr_t coalesceKey, std::function<void()> op,
+                           SemaphoreHandle_t done) {
+	int p = static_cast<int>(priority);
+	TransactionQueue& queue = queues_[p];
+
+	while (true) {
+		xSemaphoreTake(queueMutex_, portMAX_DELAY);
+
+		if (coalesceKey != 0) {
+			for (int i = 0; i < queue.count; i++) {
+				Transaction& pending = queue.slots[(queue.head + i) % queueCapacity];
+				if (pending.coalesceKey == coalesceKey) {
+					// Keep the original enqueue time, the wait is measured for the slot
+					pending.op = std::move(op);
+					stats_[p].coalesced++;
+					xSemaphoreGive(queueMutex_);
+					return;
+				}
+			}
+		}
+
+		if (queue.count < queueCapacity) {
+			Transaction& slot = queue.slots[(queue.head + queue.count) % queueCapacity];
+			slot.op = std::move(op);
+			slot.coalesceKey = coalesceKey;
+			slot.enqueuedAt = micros();
+			slot.done = done;
+			queue.count++;
+			xSemaphoreGive(queueMutex_);
+			xTaskNotifyGive(taskHandle_);
+			return;
+		}
+
+		xSemaphoreGive(queueMutex_);
+		// Queue full: the scheduler is busy, back off for one tick
+		vTaskDelay(1);
+	}
+}
+
+bool I2CScheduler::dequeue(Transaction& transaction, int& priority) {
+	xSemaphoreTake(queueMutex_, portMAX_DELAY);
+	for (int p = 0; p < numPriorities; p++) {
+		TransactionQueue& queue = queues_[p];
+		if (queue.count > 0) {
+			Transaction& slot = queue.slots[queue.head];
+			transaction.op = std::move(slot.op);
+			transaction.coalesceKey = slot.coalesceKey;
+			transaction.enqueuedAt = slot.enqueuedAt;
+			transaction.done = slot.done;
+			slot.op = nullptr;
+			queue.head = (queue.head + 1) % queueCapacity;
+			queue.count--;
+			priority = p;
+			xSemaphoreGive(queueMutex_);
+			return true;
+		}
+	}
+	xSemaphoreGive(queueMutex_);
+	return false;
+}
+
+void I2CScheduler::schedulerTask(void* parameter) {
+	I2CScheduler* scheduler = static_cast<I2CScheduler*>(parameter);
+	INFO("Starting I2C scheduler task");
+
+	Transaction transaction;
+	int priority = 0;
+	while (true) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		// Re-evaluate priorities after every transaction, so a newly queued
+		// actuation request overtakes the remaining reception work.
+		while (scheduler->dequeue(transaction, priority)) {
+			uint32_t start = micros();
+			transaction.op();
+			uint32_t end = micros();
+
+			uint32_t wait = start - transaction.enqueuedAt;
+			uint32_t exec = end - start;
+			xSemaphoreTake(scheduler->queueMutex_, portMAX_DELAY);
+			I2CLatencyStats& stats = scheduler->stats_[priority];
+			stats.transactions++;
+			stats.totalWaitMicros += wait;
+			if (wait > stats.maxWaitMicros) {
+				stats.maxWaitMicros = wait;
+			}
+			if (exec > stats.maxExecMicros) {
+				stats.maxExecMicros = exec;
+			}
+			xSemaphoreGive(scheduler->queueMutex_);
+
+			transaction.op = nullptr;
+			if (transaction.done != nullptr) {
+				xSemaphoreGive(transaction.done);
+			}
+		}
+	}
+}
+
+I2CLatencyStats I2CScheduler::stats(I2CPriority priority) {
+	xSemaphoreTake(queueMutex_, portMAX_DELAY);
+	I2CLatencyStats result = stats_[static_cast<int>(priority)];
+	xSemaphoreGive(queueMutex_);
+	return result;
+}
+
+void I2CScheduler::resetStats() {
+	xSemaphoreTake(queueMutex_, portMAX_DELAY);
+	memset(stats_.data(), 0, sizeof(I2CLatencyStats) * numPriorities);
+	xSemaphoreGive(queueMutex_);
+}
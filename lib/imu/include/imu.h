@@ -3,6 +3,8 @@
 
 #include "MPU6050_6Axis_MotionApps20.h"
 
+#include <freertos/FreeRTOS.h>
+
 #include <array>
 
 class IMU {
@@ -19,8 +21,12 @@ class IMU {
 	VectorFloat gravity_; // [x, y, z]            Gravity vector
 	// float euler_[3]; // [psi, theta, phi]    Euler angle container
 	float ypr_[3]; // [yaw, pitch, roll]   Yaw/Pitch/Roll container and gravity vector
+	float accelScale_;    // raw accel units -> m/s2
+	portMUX_TYPE dataMux_; // guards aaWorld_ and ypr_ between loop() and the getters
 
 	static std::array<float, 3> applyAxisMapping(const std::array<float, 3>& raw);
+	std::array<float, 3> readAcceleration();
+	std::array<float, 3> readOrientation();
 
   public:
 	IMU();
@@ -1,6 +1,5 @@
 #include "imu.h"
 
-#include "i2csync.h"
 #include "imu_config.h"
 #include "logging.h"
 
@@ -12,6 +11,8 @@
 
 IMU::IMU() {
 	lastchecktime_ = -1;
+	dataMux_ = portMUX_INITIALIZER_UNLOCKED;
+	ypr_[0] = ypr_[1] = ypr_[2] = 0.0f;
 	mpu_.initialize();
 	if (!mpu_.testConnection()) {
 		WARN("MPU6050 connection failed");
@@ -48,6 +49,8 @@ IMU::IMU() {
 		INFO("DMP ready! Waiting for first interrupt...");
 		packetSize_ = mpu_.dmpGetFIFOPacketSize(); // Get expected DMP packet size for later comparison
 	}
+	// Reading the resolution queries the range register, so do it once here
+	accelScale_ = static_cast<float>(mpu_.get_acce_resolution() * EARTH_GRAVITY_MS2);
 }
 
 IMU::~IMU() {}
@@ -65,58 +68,49 @@ std::array<float, 3> IMU::applyAxisMapping(const std::array<float, 3>& raw) {
 	return result;
 }
 
+// The getters only read the values published by loop(), they never touch the
+// bus. The spinlock keeps the three components of a vector consistent.
+std::array<float, 3> IMU::readAcceleration() {
+	portENTER_CRITICAL(&dataMux_);
+	const std::array<float, 3> raw = {static_cast<float>(aaWorld_.x) * accelScale_,
+	                                  static_cast<float>(aaWorld_.y) * accelScale_,
+	                                  static_cast<float>(aaWorld_.z) * accelScale_};
+	portEXIT_CRITICAL(&dataMux_);
+	return raw;
+}
+
+std::array<float, 3> IMU::readOrientation() {
+	portENTER_CRITICAL(&dataMux_);
+	// ypr_[0]=yaw (Z), ypr_[1]=pitch (Y), ypr_[2]=roll (X) → map to [X, Y, Z]
+	const std::array<float, 3> raw = {ypr_[2], ypr_[1], ypr_[0]};
+	portEXIT_CRITICAL(&dataMux_);
+	return raw;
+}
+
 float IMU::getAccelerationX() {
-	i2c_lock();
-	const auto scale = static_cast<float>(mpu_.get_acce_resolution() * EARTH_GRAVITY_MS2);
-	const std::array<float, 3> raw = {static_cast<float>(aaWorld_.x) * scale, static_cast<float>(aaWorld_.y) * scale,
-	                                  static_cast<float>(aaWorld_.z) * scale};
-	const auto corrected = applyAxisMapping(raw);
-	i2c_unlock();
-	return corrected[0];
+	return applyAxisMapping(readAcceleration())[0];
 }
 
 float IMU::getAccelerationY() {
-	i2c_lock();
-	const auto scale = static_cast<float>(mpu_.get_acce_resolution() * EARTH_GRAVITY_MS2);
-	const std::array<float, 3> raw = {static_cast<float>(aaWorld_.x) * scale, static_cast<float>(aaWorld_.y) * scale,
-	                                  static_cast<float>(aaWorld_.z) * scale};
-	const auto corrected = applyAxisMapping(raw);
-	i2c_unlock();
-	return corrected[1];
+	return applyAxisMapping(readAcceleration())[1];
 }
 
 float IMU::getAccelerationZ() {
-	i2c_lock();
-	const auto scale = static_cast<float>(mpu_.get_acce_resolution() * EARTH_GRAVITY_MS2);
-	const std::array<float, 3> raw = {static_cast<float>(aaWorld_.x) * scale, static_cast<float>(aaWorld_.y) * scale,
-	                                  static_cast<float>(aaWorld_.z) * scale};
-	const auto corrected = applyAxisMapping(raw);
-	i2c_unlock();
-	return corrected[2];
+	return applyAxisMapping(readAcceleration())[2];
 }
 
 float IMU::getYaw() {
-	i2c_lock();
-	// ypr_[0]=yaw (Z), ypr_[1]=pitch (Y), ypr_[2]=roll (X) → map to [X, Y, Z]
-	const std::array<float, 3> raw = {ypr_[2], ypr_[1], ypr_[0]};
-	const auto corrected = applyAxisMapping(raw);
-	i2c_unlock();
+	const auto corrected = applyAxisMapping(readOrientation());
 	return static_cast<float>(corrected[2] * RAD_TO_DEG);
 }
 
 float IMU::getPitch() {
-	i2c_lock();
-	const std::array<float, 3> raw = {ypr_[2], ypr_[1], ypr_[0]};
-	const auto corrected = applyAxisMapping(raw);
-	i2c_unlock();
+	const auto corrected = applyAxisMapping(readOrientation());
 	return static_cast<float>(corrected[1] * RAD_TO_DEG);
 }
 
 float IMU::getRoll() {
-	i2c_lock();
-	const std::array<float, 3> raw = {ypr_[2], ypr_[1], ypr_[0]};
-	const auto corrected = applyAxisMapping(raw);
-	i2c_unlock();
+	const auto corrected = applyAxisMapping(readOrientation());
 	return static_cast<float>(corrected[0] * RAD_TO_DEG);
 }
 
@@ -134,6 +128,9 @@ void IMU::loop() {
 
 		/* Read a packet from FIFO */
 		if (mpu_.dmpGetCurrentFIFOPacket(fifoOBuffer_)) { // Get the Latest packet
+			VectorInt16 aaWorld;
+			float ypr[3];
+
 			/*Display quaternion values in easy matrix form: w x y z */
 			mpu_.dmpGetQuaternion(&q_, fifoOBuffer_);
 			/*Serial.print("quat\t");
@@ -150,7 +147,7 @@ void IMU::loop() {
 			/* Display initial world-frame acceleration, adjusted to remove gravity
 			and rotated based on known orientation from Quaternion */
 			mpu_.dmpGetAccel(&aa_, fifoOBuffer_);
-			mpu_.dmpConvertToWorldFrame(&aaWorld_, &aa_, &q_);
+			mpu_.dmpConvertToWorldFrame(&aaWorld, &aa_, &q_);
 			/*Serial.print("aworld\t");
 			Serial.print(aaWorld.x * mpu.get_acce_resolution() * EARTH_GRAVITY_MS2);
 			Serial.print("\t");
@@ -170,13 +167,20 @@ void IMU::loop() {
 			Serial.println(ggWorld.z * mpu.get_gyro_resolution() * DEG_TO_RAD);*/
 
 			/* Display Euler angles in degrees */
-			mpu_.dmpGetYawPitchRoll(ypr_, &q_, &gravity_);
+			mpu_.dmpGetYawPitchRoll(ypr, &q_, &gravity_);
 			/*Serial.print("ypr\t");
 			Serial.print(ypr[0] * RAD_TO_DEG);
 			Serial.print("\t");
 			Serial.print(ypr[1] * RAD_TO_DEG);
 			Serial.print("\t");
 			Serial.println(ypr[2] * RAD_TO_DEG);*/
+
+			portENTER_CRITICAL(&dataMux_);
+			aaWorld_ = aaWorld;
+			ypr_[0] = ypr[0];
+			ypr_[1] = ypr[1];
+			ypr_[2] = ypr[2];
+			portEXIT_CRITICAL(&dataMux_);
 		}
 	}
 }
@@ -5,6 +5,7 @@
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
+#include <atomic>
 #include <functional>
 #include <map>
 #include <string>
@@ -39,9 +40,16 @@ class InputDevices {
 	bool getGamepadState(const char* macAddress, GamepadState& state);
 	std::vector<GamepadState> getAllGamepadStates();
 
+	// The only known gamepad, nullptr if none or several are known. Entries are
+	// updated in place and never removed, so the pointer stays valid until
+	// generation() changes; single fields may be read without the mutex.
+	const GamepadState* singleGamepad();
+	uint32_t generation();
+
   private:
 	std::map<std::string, GamepadState> gamepadStates_;
 	SemaphoreHandle_t gamepadStatesMutex_;
+	std::atomic<uint32_t> generation_;
 };
 
 #endif // INPUTDEVICES_H
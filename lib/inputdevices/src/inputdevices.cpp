@@ -2,7 +2,7 @@
 
 #include "logging.h"
 
-InputDevices::InputDevices() {
+InputDevices::InputDevices() : generation_(0) {
 	gamepadStatesMutex_ = xSemaphoreCreateMutex();
 	if (!gamepadStatesMutex_) {
 		ERROR("Failed to create gamepad states mutex");
@@ -42,9 +42,29 @@ std::vector<GamepadState> InputDevices::getAllGamepadStates() {
 	return states;
 }
 
+const GamepadState* InputDevices::singleGamepad() {
+	const GamepadState* state = nullptr;
+
+	if (xSemaphoreTake(gamepadStatesMutex_, pdMS_TO_TICKS(100)) == pdTRUE) {
+		if (gamepadStates_.size() == 1) {
+			state = &gamepadStates_.begin()->second;
+		}
+		xSemaphoreGive(gamepadStatesMutex_);
+	} else {
+		WARN("Failed to acquire mutex for gamepad states");
+	}
+
+	return state;
+}
+
+uint32_t InputDevices::generation() {
+	return generation_.load(std::memory_order_acquire);
+}
+
 void InputDevices::registerGamepadState(std::string macAddress, GamepadState state) {
 	if (xSemaphoreTake(gamepadStatesMutex_, pdMS_TO_TICKS(100)) == pdTRUE) {
 		gamepadStates_[macAddress] = state;
+		generation_++;
 		INFO("Gamepad state initialized for device: %s", macAddress.c_str());
 		xSemaphoreGive(gamepadStatesMutex_);
 	}
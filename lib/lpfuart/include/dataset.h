@@ -10,6 +10,16 @@ class Dataset {
 	Dataset();
 	void readData(Format::FormatType type, const uint8_t* payload);
 
+	// Store a decoded value; used by the DatasetCodec specializations
+	void setIntValue(Format::FormatType type, int value) {
+		formatType_ = type;
+		intValue_ = value;
+	}
+	void setFloatValue(float value) {
+		formatType_ = Format::FormatType::DATAFLOAT;
+		floatValue_ = value;
+	}
+
 	int getDataAsInt();
 	float getDataAsFloat();
 	Format::FormatType getType();
@@ -0,0 +1,103 @@
+#ifndef DESCRIPTORCACHE_H
+#define DESCRIPTORCACHE_H
+
+#include <Arduino.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One mode as described by the INFO frames of the handshake
+struct ModeDescriptor {
+	std::string name;
+	std::string units;
+	float pctMin;
+	float pctMax;
+	float siMin;
+	float siMax;
+	uint8_t inputTypes;  // bit n set = Mode::InputOutputType n supported
+	uint8_t outputTypes;
+	bool hasFormat;
+	uint8_t datasets;
+	uint8_t formatType;
+	uint8_t figures;
+	uint8_t decimals;
+
+	bool operator==(const ModeDescriptor& other) const;
+	bool operator!=(const ModeDescriptor& other) const { return !(*this == other); }
+};
+
+// Everything a device announces during the handshake after CMD_VERSION
+struct DeviceDescriptor {
+	static const int maxModes = 16;
+	static const int maxModeCombos = 8;
+
+	int deviceId;
+	std::string fwVersion;
+	int numModes;
+	int numModeCombos;
+	std::array<uint16_t, maxModeCombos> modeCombos;
+	std::array<ModeDescriptor, maxModes> modes;
+
+	bool operator==(const DeviceDescriptor& other) const;
+	bool operator!=(const DeviceDescriptor& other) const { return !(*this == other); }
+};
+
+struct DescriptorCacheStats {
+	uint32_t hits;       // handshakes that found an entry for their device and firmware
+	uint32_t misses;     // handshakes without an entry
+	uint32_t mismatches; // entries dropped because the device announced something else
+};
+
+// ---------------------------------------------------------------------------
+// DescriptorCache — remembers the mode descriptors of devices seen before,
+// keyed by device ID and firmware version. A device that re-attaches after a
+// cable glitch is fully described as soon as it has sent CMD_VERSION, so INFO
+// frames lost to checksum errors at 2400 baud no longer leave modes without a
+// format.
+//
+// The cache lives in RAM. serialize()/deserialize() produce and read back a
+// versioned binary image for persistence; the owner of the storage does the
+// file I/O, never the port service task.
+// ---------------------------------------------------------------------------
+class DescriptorCache {
+  public:
+	static const int maxEntries = 8;
+
+	static DescriptorCache* instance();
+
+	// Copies the entry for deviceId/fwVersion into out, returns false on a miss
+	bool lookup(int deviceId, const std::string& fwVersion, DeviceDescriptor& out);
+	// Adds or replaces the entry; the oldest entry is evicted when full
+	void store(const DeviceDescriptor& descriptor);
+	// Drops the entry after the device announced different descriptors
+	void invalidate(int deviceId, const std::string& fwVersion);
+	void clear();
+
+	// True if entries changed since the last serialize()
+	bool dirty();
+	void serialize(std::vector<uint8_t>& out);
+	// Replaces all entries with the given image. Returns false and leaves the
+	// cache untouched if the image is truncated, corrupt or of another version.
+	bool deserialize(const uint8_t* data, size_t size);
+
+	DescriptorCacheStats stats();
+
+  private:
+	DescriptorCache();
+
+	int find(int deviceId, const std::string& fwVersion);
+
+	static const uint8_t imageVersion = 1;
+
+	SemaphoreHandle_t mutex_;
+	std::vector<DeviceDescriptor> entries_; // oldest first
+	bool dirty_;
+	DescriptorCacheStats stats_;
+};
+
+#endif // DESCRIPTORCACHE_H
@@ -0,0 +1,86 @@
+#ifndef FRAMEDECODER_H
+#define FRAMEDECODER_H
+
+#include "dataset.h"
+#include "format.h"
+
+#include <cstdint>
+#include <cstring>
+
+// ---------------------------------------------------------------------------
+// Compile-time DATA frame decoders.
+//
+// The frame layout of a mode is fixed by its FORMAT INFO message, so the
+// decoder is resolved once in Mode::setFormat() and every DATA frame is then
+// decoded by a single indirect call into a fully specialized loop: no switch
+// on the format type, no heap allocation, no string formatting.
+// ---------------------------------------------------------------------------
+
+template <Format::FormatType T>
+struct DatasetCodec;
+
+template <>
+struct DatasetCodec<Format::FormatType::DATA8> {
+	static constexpr int size = 1;
+	static void decode(const uint8_t* payload, Dataset& dataset) {
+		// 8-bit signed integer
+		dataset.setIntValue(Format::FormatType::DATA8, static_cast<int8_t>(payload[0]));
+	}
+};
+
+template <>
+struct DatasetCodec<Format::FormatType::DATA16> {
+	static constexpr int size = 2;
+	static void decode(const uint8_t* payload, Dataset& dataset) {
+		// 16-bit signed integer little endian
+		int16_t value;
+		std::memcpy(&value, payload, sizeof(value));
+		dataset.setIntValue(Format::FormatType::DATA16, value);
+	}
+};
+
+template <>
+struct DatasetCodec<Format::FormatType::DATA32> {
+	static constexpr int size = 4;
+	static void decode(const uint8_t* payload, Dataset& dataset) {
+		// 32-bit signed integer little endian
+		int32_t value;
+		std::memcpy(&value, payload, sizeof(value));
+		dataset.setIntValue(Format::FormatType::DATA32, value);
+	}
+};
+
+template <>
+struct DatasetCodec<Format::FormatType::DATAFLOAT> {
+	static constexpr int size = 4;
+	static void decode(const uint8_t* payload, Dataset& dataset) {
+		// 32-bit little endian IEEE 754 floating point
+		float value;
+		std::memcpy(&value, payload, sizeof(value));
+		dataset.setFloatValue(value);
+	}
+};
+
+// Decodes `datasets` consecutive values of type T into out[0..datasets-1].
+using FrameDecoder = void (*)(const uint8_t* payload, int datasets, Dataset* out);
+
+template <Format::FormatType T>
+void decodeFrame(const uint8_t* payload, int datasets, Dataset* out) {
+	for (int i = 0; i < datasets; i++) {
+		DatasetCodec<T>::decode(payload, out[i]);
+		payload += DatasetCodec<T>::size;
+	}
+}
+
+struct FrameLayout {
+	FrameDecoder decoder; // nullptr for unsupported format types
+	int datasetSize;      // bytes per dataset
+};
+
+FrameLayout frameLayoutFor(Format::FormatType type);
+
+// Renders payload as "AA BB CC" into out (always NUL-terminated, truncated if
+// out is too small). Only used on diagnostic paths.
+void formatPayloadHex(const uint8_t* payload, int payloadSize, char* out, int outSize);
+
+#endif // FRAMEDECODER_H
@@ -3,11 +3,13 @@
 
 #include <Arduino.h>
 
+#include "descriptorcache.h"
 #include "lumpparser.h"
 #include "mode.h"
 #include "serialio.h"
 
 #include <array>
+#include <atomic>
 #include <memory>
 #include <string>
 
@@ -35,25 +37,55 @@ class MotorPWMController;
 
 class LegoDevice {
   public:
+	static const int maxModeCombos = 8;
+	// Datasets that fit into one combi setup message (CMD payload of 16 bytes)
+	static const int maxCombiEntries = 15;
+
 	LegoDevice(SerialIO* serialIO, uint8_t deviceIndex = 255);
 	~LegoDevice();
 
 	void markAsHandshakeComplete();
-	void parseIncomingData();
+	int parseIncomingData();
 	void setDeviceIdAndName(int deviceId, std::string& name);
 	void initNumberOfModes(int numModes);
 	void setSerialSpeed(long serialSpeed);
 	void setVersions(std::string& fwVersion, std::string& hwVersion);
 	Mode* getMode(int index);
 	int getSelectedModeIndex();
+	// Changes whenever the modes are reset or a handshake completes. Mode and
+	// Dataset pointers obtained at one generation are valid until the next.
+	uint32_t layoutGeneration();
+	// Starts the switch to data mode by acknowledging the handshake. The rest
+	// (baud switch, mode selection) is advanced by loop() without blocking.
 	void finishHandshake();
 	void sendAck();
 	void sendNack();
 	void sendSync();
 	bool isHandshakeComplete();
 	void needsKeepAlive();
-	void selectMode(int modeIndex);
-	void selectSpeed(long speed);
+
+	// Outbound commands are queued and written by loop() in the next
+	// inter-frame gap, so callers on other tasks never touch the UART. Each
+	// returns a ticket for waitForCommand(), 0 if rejected or the queue is full.
+	uint32_t selectMode(int modeIndex);
+	uint32_t selectSpeed(long speed);
+
+	// Mode combinations reported by INFO_MODE_COMBOS during the handshake,
+	// each a bitmask of modes that can be streamed together
+	void setModeCombos(const uint16_t* combos, int count);
+	int numModeCombos();
+	uint16_t getModeCombo(int index);
+
+	// Streams all datasets of the given modes in one DATA frame. The modes must
+	// be part of one reported combination. Returns 0 if not supported.
+	uint32_t selectCombi(const int* modes, int count);
+
+	// Blocks the calling task until the command was written to the UART or,
+	// with acknowledged set, until the device streams the selected mode.
+	// Commands are acknowledged in order; a later select supersedes an earlier
+	// one. Returns false on timeout or if a device reset dropped the command.
+	bool waitForCommand(uint32_t ticket, uint32_t timeoutMs, bool acknowledged);
+	bool isCombiActive();
 	bool fullyInitialized();
 	bool isInDataMode();
 	void switchToDataMode();
@@ -66,7 +98,13 @@ class LegoDevice {
 	void digitalWrite(int pin, int value);
 
 	void initialize();
-	void loop();
+	// Runs one service cycle: drains the UART (unless drainRx is false), then
+	// drives handshake completion, keep-alive and the no-data watchdog.
+	// Returns the number of bytes read from the UART.
+	int loop(bool drainRx = true);
+
+	void enableRxInterrupt();
+	bool hasPendingData();
 
 	std::string name();
 	int numModes();
@@ -81,8 +119,8 @@ class LegoDevice {
 	// Default implementation looks up Mode* and calls mode->processDataPacket().
 	virtual void onDataFrame(int mode, const uint8_t* payload, int payloadSize);
 
-	// Called by LumpParser for combi-mode DATA bursts.
-	// Default: delegates to onDataFrame().
+	// Called from onDataFrame() while a combi mode is active. Splits the
+	// combined payload into the Datasets of the configured modes.
 	virtual void onCombiDataFrame(int mode, const uint8_t* payload, int payloadSize);
 
 	// Called by LumpParser immediately after a validated DATA frame is dispatched.
@@ -91,11 +129,27 @@ class LegoDevice {
 	void onDataFrameDispatched();
 
   private:
+	// Steps between the device's handshake ACK and data mode. Each step is
+	// advanced by loop() once its time has come, so a device being plugged in
+	// never stalls the service task for the other ports.
+	enum class HandshakeStep {
+		IDLE,         // INFO phase, or already in data mode
+		ACK_SENT,     // waiting for our ACK to leave the transmitter
+		BAUD_SETTLING // UART reprogrammed, waiting for the line to settle
+	};
+
+	void advanceHandshake(unsigned long now);
+	// Descriptor cache: a hit is applied when CMD_VERSION arrives and checked
+	// against what the device announced when its ACK arrives.
+	void captureDescriptor(DeviceDescriptor& out);
+	void applyDescriptor(const DeviceDescriptor& descriptor);
+	bool reconcileDescriptorCache();
+	int discardIncomingData();
 	int getDefaultMode();
 	void logParserStats();
 	// Device-specific fan-out: distributes combined-mode frames to individual mode slots.
 	// Returns true if the frame was fully handled (caller must skip generic processDataPacket).
-	bool distributeCombinedFrame(int mode, const uint8_t* payload, int payloadSize);
+	bool distributeCombinedFrame(int mode, const uint8_t* payload, int payloadSize, uint32_t timestamp);
 
 	long serialSpeed_;
 	std::array<Mode, 16> modes_;
@@ -107,15 +161,88 @@ class LegoDevice {
 	LumpParser parser_;
 	std::unique_ptr<SerialIO> serialIO_;
 	bool handshakeComplete_;
+	HandshakeStep handshakeStep_;
+	std::unique_ptr<DeviceDescriptor> cachedDescriptor_; // applied cache entry, until the handshake ends
+	unsigned long handshakeStepSince_;
 	unsigned long lastKeepAliveCheck_;
 	bool inDataMode_;
 	bool firstDataFrameReceived_; // false until first DATA frame arrives after mode entry
 	unsigned long lastReceivedDataInMillis_;
 	int selectedMode_;
 	unsigned long lastParserStatsLog_;
+	std::array<uint16_t, maxModeCombos> modeCombos_;
+	int numModeCombos_;
+
+	// Active combi layout: (mode, dataset) in payload order
+	struct CombiEntry {
+		uint8_t mode;
+		uint8_t dataset;
+	};
+	std::array<CombiEntry, maxCombiEntries> combiEntries_;
+	int numCombiEntries_;
+	int combiFrameSize_; // payload size of a combined DATA frame, padded like on the wire
+	bool combiActive_;
+
+	// Outbound command queue. Producers on any task append under txMux_, the
+	// port service task writes the head in the inter-frame gap and applies the
+	// command's state change at that moment, so frame parsing never sees a
+	// layout that does not match the device.
+	enum class TxAction : uint8_t {
+		NONE,
+		SELECT_MODE,
+		SELECT_COMBI
+	};
+	static const int maxTxCommandLength = 1 + 16 + 1; // header, largest LUMP payload, checksum
+	struct TxCommand {
+		uint32_t ticket;
+		unsigned long queuedAt;
+		TxAction action;
+		int8_t mode;
+		uint8_t length;
+		uint8_t bytes[maxTxCommandLength];
+		uint8_t numCombiEntries;
+		uint8_t combiFrameSize;
+		std::array<CombiEntry, maxCombiEntries> combiEntries;
+	};
+	static const int txQueueCapacity = 8;
+	// Same gap as the keep-alive NACK; a command is sent regardless once it
+	// waited txMaxDelayMs, e.g. while a device streams without pause.
+	static const int txGapMs = 4;
+	static const int txMaxDelayMs = 20;
+
+	void buildSelectMode(int modeIndex, TxCommand& out);
+	uint32_t enqueueCommand(TxCommand& command);
+	void serviceTxQueue(unsigned long now);
+	void writeCommand(const TxCommand& command);
+	void acknowledgeCommand();
+	void dropQueuedCommands();
+
+	portMUX_TYPE txMux_;
+	std::array<TxCommand, txQueueCapacity> txQueue_;
+	int txHead_;
+	int txCount_;
+	uint32_t nextTicket_;
+	std::atomic<uint32_t> txWrittenTicket_;
+	std::atomic<uint32_t> txAckedTicket_;
+	std::atomic<uint32_t> txDroppedTicket_;
+	// Service task only: the select waiting for its first DATA frame, and the
+	// newest command without an acknowledgement written after it
+	uint32_t awaitingAckTicket_;
+	int awaitingAckMode_;
+	uint32_t ackFollowerTicket_;
+
+	std::atomic<uint32_t> layoutGeneration_;
+
 	uint8_t deviceIndex_;               // Device slot index (0-3) for PWM controller, 255 if unassigned
 	MotorPWMController* pwmController_; // Injected PWM controller instance
 
+	// Handshake timing in milliseconds. The ACK is held for at least
+	// ackSettleMs, like the former blocking delay; if the transmitter never
+	// reports idle the switch happens anyway after ackTimeoutMs.
+	static const int ackSettleMs = 10;
+	static const int ackTimeoutMs = 50;
+	static const int baudSettleMs = 10;
+
 	// Protocol constants needed for outgoing messages
 	// (retained here since protocolstate.h is removed)
 	static const int lumpMsgTypeCmd = 0x40;
@@ -123,6 +250,8 @@ class LegoDevice {
 	static const int lumpMsgSize4 = 2 << 3;
 	static const int lumpCmdSpeed = 0x2;
 	static const int lumpCmdSelect = 0x3;
+	static const int lumpCmdWrite = 0x4;
+	static const int lumpCombiSetup = 0x20; // first CMD_WRITE byte, low bits = combination index
 	static const int lumpCmdExtMode = 0x06;
 	static const int lumpSysSync = 0x0;
 	static const int lumpSysNack = 0x2;
@@ -5,7 +5,10 @@
 
 #include "dataset.h"
 #include "format.h"
+#include "framedecoder.h"
+#include "samplering.h"
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
@@ -23,8 +26,12 @@ class Mode {
 	Mode();
 	~Mode();
 
+	// An INFO_MAPPING frame or a cached descriptor announces the full set, not additions
+	void clearTypes();
 	void registerInputType(InputOutputType inputType);
 	void registerOutputType(InputOutputType outputType);
+	bool supportsInputType(InputOutputType inputType);
+	bool supportsOutputType(InputOutputType outputType);
 	void setName(const std::string& name);
 	void setUnits(const std::string& units);
 	void setPctMinMax(float min, float max);
@@ -40,11 +47,27 @@ class Mode {
 
 	void reset();
 
-	void processDataPacket(const uint8_t* payload, int payloadSize);
+	// Returns true if the payload matched the format and was decoded
+	bool processDataPacket(const uint8_t* payload, int payloadSize);
+	// Decodes a single dataset from a combined frame; returns the number of
+	// bytes consumed, 0 if the mode has no usable format or index is invalid
+	int decodeDataset(int index, const uint8_t* payload);
+	int getDatasetSize();
+
+	// Optional sample history. Once enabled it stays allocated for the
+	// lifetime of the mode slot, also across device resets, so readers
+	// never see it disappear.
+	SampleRing* enableSampleRing(int capacity);
+	SampleRing* getSampleRing();
+	void recordSample(uint32_t timestampMicros);
+	// nullptr if the format has no dataset with this index
 	Dataset* getDataset(int index);
 	Format* getFormat();
 
   private:
+	// LUMP payloads are at most 32 bytes: "XX " per byte plus NUL
+	static const int maxPayloadHexLength = 32 * 3 + 1;
+
 	std::string name_;
 	std::string units_;
 	float pctMin_;
@@ -55,6 +78,12 @@ class Mode {
 	bool inputTypes_[5];
 	bool outputTypes_[5];
 	std::vector<Dataset> datasets_;
+	// Resolved from format_ in setFormat(), so DATA frames decode without
+	// inspecting the format type
+	FrameDecoder decoder_;
+	int datasetSize_;
+	int frameSize_;
+	std::atomic<SampleRing*> sampleRing_;
 };
 
 #endif // MODE_H
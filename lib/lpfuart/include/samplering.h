@@ -0,0 +1,71 @@
+#ifndef SAMPLERING_H
+#define SAMPLERING_H
+
+#include "dataset.h"
+#include "format.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// One decoded DATA frame of a mode, with the time it was received
+struct Sample {
+	static const int maxValues = 8;
+
+	uint32_t index;           // running sample number, equals the reader cursor
+	uint32_t timestampMicros; // micros() when the frame was dispatched
+	uint32_t intervalMicros;  // since the previous sample of the ring, 0 for the first; wrap-safe
+	Format::FormatType type;
+	uint8_t count;            // number of valid entries in raw
+	int32_t raw[maxValues];   // integer value, or IEEE 754 bits for DATAFLOAT
+
+	bool isFloat() const { return type == Format::FormatType::DATAFLOAT; }
+	int intValue(int i) const;
+	float floatValue(int i) const;
+};
+
+// ---------------------------------------------------------------------------
+// SampleRing — fixed-capacity history of the DATA frames of one mode.
+//
+// Single writer (the port service task), any number of readers. Every slot
+// carries its own sequence counter (seqlock): the writer makes it odd while
+// the slot is being overwritten, readers retry if it was odd or changed while
+// copying. A reader therefore never sees a frame with datasets from two
+// different DATA messages, and the writer never waits for a reader.
+// ---------------------------------------------------------------------------
+class SampleRing {
+  public:
+	static const int defaultCapacity = 32;
+	static const int maxCapacity = 256;
+
+	explicit SampleRing(int capacity);
+
+	// Writer side, port service task only
+	void push(uint32_t timestampMicros, Format::FormatType type, Dataset* datasets, int count);
+
+	// Copies up to maxSamples samples with index >= cursor into out, oldest
+	// first, and advances cursor past them. Samples already overwritten are
+	// skipped and added to lost.
+	int read(uint32_t& cursor, Sample* out, int maxSamples, uint32_t& lost);
+
+	// Number of samples ever pushed; the cursor value that reads nothing old
+	uint32_t head() const { return head_.load(std::memory_order_acquire); }
+	int capacity() const { return capacity_; }
+
+  private:
+	struct Slot {
+		std::atomic<uint32_t> sequence;
+		Sample sample;
+	};
+
+	static const int maxReadRetries = 4;
+
+	std::unique_ptr<Slot[]> slots_;
+	int capacity_;
+	std::atomic<uint32_t> head_;
+	// Writer side only
+	bool hasPrevious_;
+	uint32_t previousMicros_;
+};
+
+#endif // SAMPLERING_H
@@ -10,9 +10,39 @@ class SerialIO {
 	virtual int available() = 0;
 	virtual int readByte() = 0;
 	virtual void sendByte(int byteData) = 0;
+
+	// Bulk transfer. Reads up to maxLength bytes that are already buffered and
+	// returns the number of bytes read; writes all length bytes. The default
+	// implementations fall back to the per-byte calls, adapters sitting behind a
+	// shared bus should override them with a single burst transaction.
+	virtual int readBytes(uint8_t* buffer, int maxLength) {
+		int count = 0;
+		while (count < maxLength && available() > 0) {
+			buffer[count++] = (uint8_t) readByte();
+		}
+		return count;
+	}
+	virtual void writeBytes(const uint8_t* buffer, int length) {
+		for (int i = 0; i < length; i++) {
+			sendByte(buffer[i]);
+		}
+	}
+
+	// Reprograms the UART to the given speed. Does not wait: bytes still in the
+	// transmitter are lost, so callers poll txIdle() first and give the line a
+	// moment to settle afterwards.
 	virtual void switchToBaudrate(long serialSpeed) = 0;
 	virtual void flush() = 0;
+	// True once every queued byte has left the transmitter. The non-blocking
+	// counterpart of flush().
+	virtual bool txIdle() { return true; }
 	virtual uint32_t uartOverrunCount() { return 0; }
+
+	// Interrupt-driven reception. enableRxInterrupt() arms the UART's RX interrupt
+	// output; rxPending() reports whether received data is waiting. The default
+	// has no interrupt source and falls back to available().
+	virtual void enableRxInterrupt() {}
+	virtual bool rxPending() { return available() > 0; }
 	virtual void pollDiagnostics() {}
 
 	virtual void setM1(bool status) = 0;
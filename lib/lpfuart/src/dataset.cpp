@@ -1,49 +1,21 @@
 #include "dataset.h"
 
+#include "framedecoder.h"
+
 #include "logging.h"
 
 #include <cstdint>
-#include <cstring>
 
 Dataset::Dataset() : formatType_(Format::FormatType::UNKNOWN), intValue_(0), floatValue_(0.0f) {}
 
 void Dataset::readData(Format::FormatType type, const uint8_t* payload) {
 	formatType_ = type;
-	switch (type) {
-		case Format::FormatType::DATA8: {
-			DEBUG("Parsing DATA8");
-			// 8-bit signed integer
-			intValue_ = static_cast<int8_t>(payload[0]);
-			break;
-		}
-		case Format::FormatType::DATA16: {
-			DEBUG("Parsing DATA16");
-			// 16-bit signed integer little endian
-			int16_t value16;
-			std::memcpy(&value16, payload, 2);
-			intValue_ = value16;
-			break;
-		}
-		case Format::FormatType::DATA32: {
-			DEBUG("Parsing DATA32");
-			// 32-bit signed integer little endian
-			int32_t value32;
-			std::memcpy(&value32, payload, 4);
-			intValue_ = value32;
-			break;
-		}
-		case Format::FormatType::DATAFLOAT: {
-			DEBUG("Parsing DATAFLOAT");
-			// 32-bot little endian IEEE 754 floating point
-			float valueFloat;
-			std::memcpy(&valueFloat, payload, 4);
-			floatValue_ = valueFloat;
-			break;
-		}
-		default:
-			WARN("Unsupported data format");
-			break;
+	FrameLayout layout = frameLayoutFor(type);
+	if (layout.decoder == nullptr) {
+		WARN("Unsupported data format");
+		return;
 	}
+	layout.decoder(payload, 1, this);
 }
 
 int Dataset::getDataAsInt() {
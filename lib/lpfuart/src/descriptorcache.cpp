@@ -0,0 +1,284 @@
+#include "descriptorcache.h"
+
+#include "logging.h"
+
+#include <cstring>
+
+namespace {
+
+const uint8_t imageMagic[] = {'L', 'D', 'C'};
+
+void writeU8(std::vector<uint8_t>& out, uint8_t v) {
+	out.push_back(v);
+}
+
+void writeU16(std::vector<uint8_t>& out, uint16_t v) {
+	out.push_back((uint8_t) (v & 0xFF));
+	out.push_back((uint8_t) (v >> 8));
+}
+
+void writeFloat(std::vector<uint8_t>& out, float f) {
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	for (int i = 0; i < 4; i++) {
+		out.push_back((uint8_t) (bits >> (i * 8)));
+	}
+}
+
+void writeString(std::vector<uint8_t>& out, const std::string& s) {
+	size_t len = s.size() < 255 ? s.size() : 255;
+	out.push_back((uint8_t) len);
+	out.insert(out.end(), s.begin(), s.begin() + len);
+}
+
+// Bounds-checked reader; once a read runs past the end, ok stays false and
+// every further read returns zero.
+struct ImageReader {
+	const uint8_t* data;
+	size_t size;
+	size_t pos;
+	bool ok;
+
+	uint8_t u8() {
+		if (pos + 1 > size) {
+			ok = false;
+			return 0;
+		}
+		return data[pos++];
+	}
+	uint16_t u16() {
+		uint16_t lo = u8();
+		uint16_t hi = u8();
+		return (uint16_t) (lo | (hi << 8));
+	}
+	float f32() {
+		uint32_t bits = 0;
+		for (int i = 0; i < 4; i++) {
+			bits |= (uint32_t) u8() << (i * 8);
+		}
+		float f;
+		memcpy(&f, &bits, sizeof(f));
+		return f;
+	}
+	std::string str() {
+		size_t len = u8();
+		if (!ok || pos + len > size) {
+			ok = false;
+			return "";
+		}
+		std::string s((const char*) &data[pos], len);
+		pos += len;
+		return s;
+	}
+};
+
+uint8_t imageChecksum(const uint8_t* data, size_t size) {
+	uint8_t sum = 0xFF;
+	for (size_t i = 0; i < size; i++) {
+		sum ^= data[i];
+	}
+	return sum;
+}
+
+} // namespace
+
+bool ModeDescriptor::operator==(const ModeDescriptor& other) const {
+	return name == other.name && units == other.units && pctMin == other.pctMin && pctMax == other.pctMax &&
+	       siMin == other.siMin && siMax == other.siMax && inputTypes == other.inputTypes &&
+	       outputTypes == other.outputTypes && hasFormat == other.hasFormat && datasets == other.datasets &&
+	       formatType == other.formatType && figures == other.figures && decimals == other.decimals;
+}
+
+bool DeviceDescriptor::operator==(const DeviceDescriptor& other) const {
+	if (deviceId != other.deviceId || fwVersion != other.fwVersion || numModes != other.numModes ||
+	    numModeCombos != other.numModeCombos) {
+		return false;
+	}
+	for (int i = 0; i < numModeCombos; i++) {
+		if (modeCombos[i] != other.modeCombos[i]) {
+			return false;
+		}
+	}
+	for (int i = 0; i < numModes; i++) {
+		if (modes[i] != other.modes[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+DescriptorCache::DescriptorCache() : dirty_(false) {
+	mutex_ = xSemaphoreCreateMutex();
+	memset(&stats_, 0, sizeof(stats_));
+	entries_.reserve(maxEntries);
+}
+
+DescriptorCache* DescriptorCache::instance() {
+	static DescriptorCache instance;
+	return &instance;
+}
+
+int DescriptorCache::find(int deviceId, const std::string& fwVersion) {
+	for (size_t i = 0; i < entries_.size(); i++) {
+		if (entries_[i].deviceId == deviceId && entries_[i].fwVersion == fwVersion) {
+			return (int) i;
+		}
+	}
+	return -1;
+}
+
+bool DescriptorCache::lookup(int deviceId, const std::string& fwVersion, DeviceDescriptor& out) {
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	int index = find(deviceId, fwVersion);
+	if (index >= 0) {
+		out = entries_[index];
+		stats_.hits++;
+	} else {
+		stats_.misses++;
+	}
+	xSemaphoreGive(mutex_);
+	return index >= 0;
+}
+
+void DescriptorCache::store(const DeviceDescriptor& descriptor) {
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	int index = find(descriptor.deviceId, descriptor.fwVersion);
+	if (index >= 0) {
+		entries_.erase(entries_.begin() + index);
+	} else if ((int) entries_.size() >= maxEntries) {
+		entries_.erase(entries_.begin());
+	}
+	entries_.push_back(descriptor);
+	dirty_ = true;
+	xSemaphoreGive(mutex_);
+}
+
+void DescriptorCache::invalidate(int deviceId, const std::string& fwVersion) {
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	int index = find(deviceId, fwVersion);
+	if (index >= 0) {
+		entries_.erase(entries_.begin() + index);
+		stats_.mismatches++;
+		dirty_ = true;
+	}
+	xSemaphoreGive(mutex_);
+}
+
+void DescriptorCache::clear() {
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	dirty_ = dirty_ || !entries_.empty();
+	entries_.clear();
+	xSemaphoreGive(mutex_);
+}
+
+bool DescriptorCache::dirty() {
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	bool result = dirty_;
+	xSemaphoreGive(mutex_);
+	return result;
+}
+
+DescriptorCacheStats DescriptorCache::stats() {
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	DescriptorCacheStats result = stats_;
+	xSemaphoreGive(mutex_);
+	return result;
+}
+
+void DescriptorCache::serialize(std::vector<uint8_t>& out) {
+	out.clear();
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	out.insert(out.end(), imageMagic, imageMagic + sizeof(imageMagic));
+	writeU8(out, imageVersion);
+	writeU8(out, (uint8_t) entries_.size());
+	for (const DeviceDescriptor& d : entries_) {
+		writeU16(out, (uint16_t) d.deviceId);
+		writeString(out, d.fwVersion);
+		writeU8(out, (uint8_t) d.numModes);
+		writeU8(out, (uint8_t) d.numModeCombos);
+		for (int i = 0; i < d.numModeCombos; i++) {
+			writeU16(out, d.modeCombos[i]);
+		}
+		for (int i = 0; i < d.numModes; i++) {
+			const ModeDescriptor& m = d.modes[i];
+			writeString(out, m.name);
+			writeString(out, m.units);
+			writeFloat(out, m.pctMin);
+			writeFloat(out, m.pctMax);
+			writeFloat(out, m.siMin);
+			writeFloat(out, m.siMax);
+			writeU8(out, m.inputTypes);
+			writeU8(out, m.outputTypes);
+			writeU8(out, m.hasFormat ? 1 : 0);
+			writeU8(out, m.datasets);
+			writeU8(out, m.formatType);
+			writeU8(out, m.figures);
+			writeU8(out, m.decimals);
+		}
+	}
+	dirty_ = false;
+	xSemaphoreGive(mutex_);
+	writeU8(out, imageChecksum(out.data(), out.size()));
+}
+
+bool DescriptorCache::deserialize(const uint8_t* data, size_t size) {
+	if (size < sizeof(imageMagic) + 3 || memcmp(data, imageMagic, sizeof(imageMagic)) != 0) {
+		WARN("Descriptor cache image has no valid header, ignoring");
+		return false;
+	}
+	if (imageChecksum(data, size - 1) != data[size - 1]) {
+		WARN("Descriptor cache image checksum mismatch, ignoring");
+		return false;
+	}
+
+	ImageReader in{data, size - 1, sizeof(imageMagic), true};
+	if (in.u8() != imageVersion) {
+		WARN("Descriptor cache image has an unsupported version, ignoring");
+		return false;
+	}
+	int count = in.u8();
+	std::vector<DeviceDescriptor> loaded;
+	loaded.reserve(count);
+	for (int e = 0; e < count && in.ok; e++) {
+		DeviceDescriptor d{};
+		d.deviceId = in.u16();
+		d.fwVersion = in.str();
+		d.numModes = in.u8();
+		d.numModeCombos = in.u8();
+		if (d.numModes > DeviceDescriptor::maxModes || d.numModeCombos > DeviceDescriptor::maxModeCombos) {
+			in.ok = false;
+			break;
+		}
+		for (int i = 0; i < d.numModeCombos; i++) {
+			d.modeCombos[i] = in.u16();
+		}
+		for (int i = 0; i < d.numModes; i++) {
+			ModeDescriptor& m = d.modes[i];
+			m.name = in.str();
+			m.units = in.str();
+			m.pctMin = in.f32();
+			m.pctMax = in.f32();
+			m.siMin = in.f32();
+			m.siMax = in.f32();
+			m.inputTypes = in.u8();
+			m.outputTypes = in.u8();
+			m.hasFormat = in.u8() != 0;
+			m.datasets = in.u8();
+			m.formatType = in.u8();
+			m.figures = in.u8();
+			m.decimals = in.u8();
+		}
+		loaded.push_back(d);
+	}
+	if (!in.ok || in.pos != in.size || (int) loaded.size() > maxEntries) {
+		WARN("Descriptor cache image is truncated or corrupt, ignoring");
+		return false;
+	}
+
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	entries_ = std::move(loaded);
+	dirty_ = false;
+	xSemaphoreGive(mutex_);
+	INFO("Loaded %d cached device descriptors", count);
+	return true;
+}
@@ -0,0 +1,38 @@
+#include "framedecoder.h"
+
+FrameLayout frameLayoutFor(Format::FormatType type) {
+	switch (type) {
+		case Format::FormatType::DATA8:
+			return {decodeFrame<Format::FormatType::DATA8>, DatasetCodec<Format::FormatType::DATA8>::size};
+		case Format::FormatType::DATA16:
+			return {decodeFrame<Format::FormatType::DATA16>, DatasetCodec<Format::FormatType::DATA16>::size};
+		case Format::FormatType::DATA32:
+			return {decodeFrame<Format::FormatType::DATA32>, DatasetCodec<Format::FormatType::DATA32>::size};
+		case Format::FormatType::DATAFLOAT:
+			return {decodeFrame<Format::FormatType::DATAFLOAT>, DatasetCodec<Format::FormatType::DATAFLOAT>::size};
+		default:
+			return {nullptr, 0};
+	}
+}
+
+void formatPayloadHex(const uint8_t* payload, int payloadSize, char* out, int outSize) {
+	static const char hexChars[] = "0123456789ABCDEF";
+	if (outSize <= 0) {
+		return;
+	}
+	int pos = 0;
+	for (int i = 0; i < payloadSize; ++i) {
+		// Separator, 2 chars, room for the NUL
+		int needed = (i > 0) ? 3 : 2;
+		if (pos + needed >= outSize) {
+			break;
+		}
+		int v = payload[i] & 0xFF;
+		if (i > 0) {
+			out[pos++] = ' ';
+		}
+		out[pos++] = hexChars[(v >> 4) & 0xF];
+		out[pos++] = hexChars[v & 0xF];
+	}
+	out[pos] = '\0';
+}
@@ -4,11 +4,21 @@
 #include "logging.h"
 #include "motorpwmcontroller.h"
 
+#include <cstring>
+
+static_assert(LegoDevice::maxModeCombos == DeviceDescriptor::maxModeCombos, "mode combo limits must match");
+
 LegoDevice::LegoDevice(SerialIO* serialIO, uint8_t deviceIndex)
     : serialSpeed_(2400), numModes_(-1), deviceId_(-1), fwVersion_(""), hwVersion_(""), parser_(this),
-      serialIO_(serialIO), handshakeComplete_(false), lastKeepAliveCheck_(0), inDataMode_(false),
+      serialIO_(serialIO), handshakeComplete_(false), handshakeStep_(HandshakeStep::IDLE),
+      handshakeStepSince_(0), lastKeepAliveCheck_(0), inDataMode_(false),
       firstDataFrameReceived_(false), lastReceivedDataInMillis_(0), selectedMode_(-1), lastParserStatsLog_(0),
-      deviceIndex_(deviceIndex), pwmController_(nullptr) {}
+      numModeCombos_(0), numCombiEntries_(0), combiFrameSize_(0), combiActive_(false), txHead_(0), txCount_(0),
+      nextTicket_(1), txWrittenTicket_(0), txAckedTicket_(0), txDroppedTicket_(0), awaitingAckTicket_(0),
+      awaitingAckMode_(-1), ackFollowerTicket_(0), layoutGeneration_(0), deviceIndex_(deviceIndex),
+      pwmController_(nullptr) {
+	txMux_ = portMUX_INITIALIZER_UNLOCKED;
+}
 
 void LegoDevice::reset() {
 	INFO("Performing a device reset");
@@ -24,14 +34,21 @@ void LegoDevice::reset() {
 	fwVersion_ = "";
 	hwVersion_ = "";
 	handshakeComplete_ = false;
+	handshakeStep_ = HandshakeStep::IDLE;
+	cachedDescriptor_.reset();
 	inDataMode_ = false;
 	firstDataFrameReceived_ = false;
+	numModeCombos_ = 0;
+	combiActive_ = false;
+	numCombiEntries_ = 0;
+	dropQueuedCommands();
 
 	parser_.reset();
 
 	for (int i = 0; i < 16; i++) {
 		modes_[i].reset();
 	}
+	layoutGeneration_++;
 
 	serialSpeed_ = 2400;
 	selectedMode_ = -1;
@@ -54,20 +71,122 @@ bool LegoDevice::isHandshakeComplete() {
 }
 
 void LegoDevice::markAsHandshakeComplete() {
+	if (!reconcileDescriptorCache()) {
+		// Fall back to a full parse. Without our ACK the device starts its
+		// handshake over, and the stale entry is gone by then.
+		reset();
+		return;
+	}
 	handshakeComplete_ = true;
+	layoutGeneration_++;
+}
+
+void LegoDevice::captureDescriptor(DeviceDescriptor& out) {
+	out.deviceId = deviceId_;
+	out.fwVersion = fwVersion_;
+	out.numModes = numModes_;
+	out.numModeCombos = numModeCombos_;
+	for (int i = 0; i < numModeCombos_; i++) {
+		out.modeCombos[i] = modeCombos_[i];
+	}
+	for (int i = 0; i < numModes_; i++) {
+		Mode& mode = modes_[i];
+		ModeDescriptor& m = out.modes[i];
+		m.name = mode.getName();
+		m.units = mode.getUnits();
+		m.pctMin = mode.getPctMin();
+		m.pctMax = mode.getPctMax();
+		m.siMin = mode.getSiMin();
+		m.siMax = mode.getSiMax();
+		m.inputTypes = 0;
+		m.outputTypes = 0;
+		for (int t = 0; t <= static_cast<int>(Mode::InputOutputType::SUPPORTS_NULL); t++) {
+			if (mode.supportsInputType(static_cast<Mode::InputOutputType>(t))) {
+				m.inputTypes |= 1 << t;
+			}
+			if (mode.supportsOutputType(static_cast<Mode::InputOutputType>(t))) {
+				m.outputTypes |= 1 << t;
+			}
+		}
+		Format* format = mode.getFormat();
+		m.hasFormat = format != nullptr;
+		m.datasets = format ? format->getDatasets() : 0;
+		m.formatType = format ? static_cast<uint8_t>(format->getFormatType()) : 0;
+		m.figures = format ? format->getFigures() : 0;
+		m.decimals = format ? format->getDecimals() : 0;
+	}
+}
+
+void LegoDevice::applyDescriptor(const DeviceDescriptor& descriptor) {
+	for (int i = 0; i < descriptor.numModes; i++) {
+		const ModeDescriptor& m = descriptor.modes[i];
+		Mode& mode = modes_[i];
+		mode.setName(m.name);
+		mode.setUnits(m.units);
+		mode.setPctMinMax(m.pctMin, m.pctMax);
+		mode.setSiMinMax(m.siMin, m.siMax);
+		mode.clearTypes();
+		for (int t = 0; t <= static_cast<int>(Mode::InputOutputType::SUPPORTS_NULL); t++) {
+			if (m.inputTypes & (1 << t)) {
+				mode.registerInputType(static_cast<Mode::InputOutputType>(t));
+			}
+			if (m.outputTypes & (1 << t)) {
+				mode.registerOutputType(static_cast<Mode::InputOutputType>(t));
+			}
+		}
+		if (m.hasFormat) {
+			mode.setFormat(std::make_unique<Format>(m.datasets, Format::forId(m.formatType), m.figures, m.decimals));
+		}
+	}
+	setModeCombos(descriptor.modeCombos.data(), descriptor.numModeCombos);
+}
+
+bool LegoDevice::reconcileDescriptorCache() {
+	if (fwVersion_.empty()) {
+		// No CMD_VERSION, nothing to key an entry on
+		return true;
+	}
+	std::unique_ptr<DeviceDescriptor> current(new DeviceDescriptor());
+	captureDescriptor(*current);
+
+	if (cachedDescriptor_) {
+		// INFO frames overwrite the applied entry; any difference means the
+		// device is not what the cache remembers
+		bool matches = *current == *cachedDescriptor_;
+		cachedDescriptor_.reset();
+		if (!matches) {
+			WARN("Device %d announced descriptors that differ from the cache, restarting handshake", deviceId_);
+			DescriptorCache::instance()->invalidate(deviceId_, fwVersion_);
+		}
+		return matches;
+	}
+
+	// Only complete descriptions are cached, a handshake that lost a FORMAT
+	// frame would otherwise be replayed on every re-attach
+	for (int i = 0; i < numModes_; i++) {
+		if (!current->modes[i].hasFormat) {
+			WARN("Mode %d of device %d has no format, not caching its descriptors", i, deviceId_);
+			return true;
+		}
+	}
+	DescriptorCache::instance()->store(*current);
+	return true;
 }
 
-void LegoDevice::parseIncomingData() {
-	int count = 0;
+int LegoDevice::parseIncomingData() {
 	// Poll diagnostic counters (e.g. FIFO overrun) once per batch, not per byte.
 	serialIO_->pollDiagnostics();
-	// Read a maximum of 64 bytes per call to bound latency.
-	// Increased from 32 to 64 to empty FIFO faster and reduce overrun probability
-	// when motor noise generates spurious bytes.
-	while (serialIO_->available() > 0 && count++ < 64) {
+	// Drain the FIFO in one burst (up to 64 bytes, the SC16IS752 FIFO depth) and
+	// hand the whole burst to the parser at once. Reading byte by byte costs one
+	// bus transaction per byte, which is what let the FIFOs overrun with four
+	// ports streaming at 115200 baud.
+	uint8_t rx[64];
+	int count = serialIO_->readBytes(rx, sizeof(rx));
+	if (count > 0) {
 		lastReceivedDataInMillis_ = millis();
-		parser_.feedByte((uint8_t) serialIO_->readByte());
+		parser_.feedBytes(rx, count);
 	}
+	return count;
 }
 
 void LegoDevice::setDeviceIdAndName(int deviceId, std::string& name) {
@@ -91,6 +210,30 @@ void LegoDevice::setVersions(std::string& fwVersion, std::string& hwVersion) {
 	this->hwVersion_ = hwVersion;
 	INFO("Device firmware version: %s", fwVersion.c_str());
 	INFO("Device hardware version: %s", hwVersion.c_str());
+
+	// CMD_VERSION is the last message before the INFO frames. With a cache hit
+	// the modes are fully described from here on, whatever INFO frames get lost.
+	cachedDescriptor_.reset();
+	if (deviceId_ == -1 || numModes_ <= 0) {
+		return;
+	}
+	std::unique_ptr<DeviceDescriptor> cached(new DeviceDescriptor());
+	if (!DescriptorCache::instance()->lookup(deviceId_, fwVersion_, *cached)) {
+		return;
+	}
+	if (cached->numModes != numModes_) {
+		WARN("Cached descriptors of device %d have %d modes instead of %d, ignoring", deviceId_, cached->numModes,
+		     numModes_);
+		DescriptorCache::instance()->invalidate(deviceId_, fwVersion_);
+		return;
+	}
+	INFO("Using cached descriptors for device %d firmware %s", deviceId_, fwVersion_.c_str());
+	applyDescriptor(*cached);
+	cachedDescriptor_ = std::move(cached);
+}
+
+uint32_t LegoDevice::layoutGeneration() {
+	return layoutGeneration_.load(std::memory_order_acquire);
 }
 
 Mode* LegoDevice::getMode(int index) {
@@ -100,20 +243,59 @@ Mode* LegoDevice::getMode(int index) {
 	return &modes_[index];
 }
 
+int LegoDevice::discardIncomingData() {
+	uint8_t rx[64];
+	return serialIO_->readBytes(rx, sizeof(rx));
+}
+
 void LegoDevice::finishHandshake() {
 	INFO("Finishing handshake and switching to %ld baud", serialSpeed_);
 
 	sendAck();
-	delay(10);
-	serialIO_->switchToBaudrate(serialSpeed_);
-	delay(10);
-	parser_.clearBuffer(); // discard stale bytes from 2400-baud phase
+	handshakeStep_ = HandshakeStep::ACK_SENT;
+	handshakeStepSince_ = millis();
+}
+
+void LegoDevice::advanceHandshake(unsigned long now) {
+	unsigned long elapsed = now - handshakeStepSince_;
+	switch (handshakeStep_) {
+		case HandshakeStep::IDLE:
+			finishHandshake();
+			break;
+		case HandshakeStep::ACK_SENT:
+			// The device changes its speed as soon as it has seen our ACK, reprogramming
+			// our side earlier would garble the ACK on the wire.
+			if (elapsed < ackSettleMs || (elapsed < ackTimeoutMs && !serialIO_->txIdle())) {
+				break;
+			}
+			serialIO_->switchToBaudrate(serialSpeed_);
+			handshakeStep_ = HandshakeStep::BAUD_SETTLING;
+			handshakeStepSince_ = now;
+			break;
+		case HandshakeStep::BAUD_SETTLING: {
+			if (elapsed < baudSettleMs) {
+				break;
+			}
+			parser_.clearBuffer(); // discard stale bytes from 2400-baud phase
+			handshakeStep_ = HandshakeStep::IDLE;
+			int defaultMode = getDefaultMode();
+			INFO("Setting default mode %d for deviceId 0x%04x", defaultMode, deviceId_);
+			// Written directly, ahead of anything queued while the handshake ran
+			TxCommand select;
+			buildSelectMode(defaultMode, select);
+			select.ticket = 0;
+			writeCommand(select);
+			switchToDataMode();
+			break;
+		}
+	}
 }
 
 void LegoDevice::sendAck() {
 	DEBUG("Sending ACK message to Lego device");
+	// No flush: advanceHandshake() polls txIdle() instead of blocking until the
+	// byte is out, which takes more than 4 ms at 2400 baud.
 	serialIO_->sendByte(lumpSysAck);
-	serialIO_->flush();
 }
 
 void LegoDevice::sendNack() {
@@ -143,79 +325,284 @@ void LegoDevice::needsKeepAlive() {
 	}
 }
 
-void LegoDevice::selectMode(int modeIndex) {
+uint32_t LegoDevice::selectMode(int modeIndex) {
+	TxCommand command;
+	buildSelectMode(modeIndex, command);
+	return enqueueCommand(command);
+}
+
+void LegoDevice::buildSelectMode(int modeIndex, TxCommand& out) {
 	INFO("Selecting mode %d", modeIndex);
+	out.action = TxAction::SELECT_MODE;
+	out.mode = (int8_t) modeIndex;
 	// TODO: Check if this is a powered up device, and if this code is correct as it is!
 	if (false) {
 		if (modeIndex >= 8) {
 			INFO("Using Ext-Mode 8");
-			int command = lumpMsgTypeCmd | lumpCmdExtMode | lumpMsgSize1;
-			int ext = lumpExtMode8;
-			int checksum = 0xff ^ command ^ ext;
-			serialIO_->sendByte(command);
-			serialIO_->sendByte(ext);
-			serialIO_->sendByte(checksum);
-			serialIO_->flush();
-
-			int idxToSend = modeIndex -= 8;
-			command = lumpMsgTypeCmd | lumpCmdSelect | lumpMsgSize1;
-			checksum = 0xff ^ command ^ idxToSend;
-			serialIO_->sendByte(command);
-			serialIO_->sendByte(idxToSend);
-			serialIO_->sendByte(checksum);
-			serialIO_->flush();
+			int idxToSend = modeIndex - 8;
+			uint8_t extCommand = lumpMsgTypeCmd | lumpCmdExtMode | lumpMsgSize1;
+			uint8_t ext = lumpExtMode8;
+			uint8_t command = lumpMsgTypeCmd | lumpCmdSelect | lumpMsgSize1;
+			uint8_t checksum = 0xff ^ command ^ idxToSend;
+			uint8_t extChecksum = 0xff ^ extCommand ^ ext;
+			const uint8_t message[] = {extCommand, ext, extChecksum, command, (uint8_t) idxToSend, checksum};
+			memcpy(out.bytes, message, sizeof(message));
+			out.length = sizeof(message);
 
 			INFO("Sending select mode command: 0x%02X 0x%02X 0x%02X", command, idxToSend, checksum);
 
 		} else {
 			INFO("Using Ext-Mode 0");
-			int command = lumpMsgTypeCmd | lumpCmdExtMode | lumpMsgSize1;
-			int ext = lumpExtMode0;
-			int checksum = 0xff ^ command ^ ext;
-			serialIO_->sendByte(command);
-			serialIO_->sendByte(ext);
-			serialIO_->sendByte(checksum);
-
-			command = lumpMsgTypeCmd | lumpCmdSelect | lumpMsgSize1;
-			checksum = 0xff ^ command ^ modeIndex;
-			serialIO_->sendByte(command);
-			serialIO_->sendByte(modeIndex);
-			serialIO_->sendByte(checksum);
-			serialIO_->flush();
+			uint8_t extCommand = lumpMsgTypeCmd | lumpCmdExtMode | lumpMsgSize1;
+			uint8_t ext = lumpExtMode0;
+			uint8_t command = lumpMsgTypeCmd | lumpCmdSelect | lumpMsgSize1;
+			uint8_t checksum = 0xff ^ command ^ modeIndex;
+			uint8_t extChecksum = 0xff ^ extCommand ^ ext;
+			const uint8_t message[] = {extCommand, ext, extChecksum, command, (uint8_t) modeIndex, checksum};
+			memcpy(out.bytes, message, sizeof(message));
+			out.length = sizeof(message);
 
 			INFO("Sending select mode command: 0x%02X 0x%02X 0x%02X", command, modeIndex, checksum);
 		}
 	} else {
 		INFO("Using standard CMD_SELECT for non powered up devices");
-		int command = lumpMsgTypeCmd | lumpCmdSelect | lumpMsgSize1;
-		int checksum = 0xff ^ command ^ modeIndex;
-		serialIO_->sendByte(command);
-		serialIO_->sendByte(modeIndex);
-		serialIO_->sendByte(checksum);
-		serialIO_->flush();
+		uint8_t command = lumpMsgTypeCmd | lumpCmdSelect | lumpMsgSize1;
+		uint8_t checksum = 0xff ^ command ^ modeIndex;
+		const uint8_t message[] = {command, (uint8_t) modeIndex, checksum};
+		memcpy(out.bytes, message, sizeof(message));
+		out.length = sizeof(message);
 		INFO("Sending select mode command: 0x%02X 0x%02X 0x%02X", command, modeIndex, checksum);
 	}
+}
+
+void LegoDevice::setModeCombos(const uint16_t* combos, int count) {
+	numModeCombos_ = count > maxModeCombos ? maxModeCombos : count;
+	for (int i = 0; i < numModeCombos_; i++) {
+		modeCombos_[i] = combos[i];
+	}
+}
+
+int LegoDevice::numModeCombos() {
+	return numModeCombos_;
+}
+
+uint16_t LegoDevice::getModeCombo(int index) {
+	if (index < 0 || index >= numModeCombos_) {
+		return 0;
+	}
+	return modeCombos_[index];
+}
+
+bool LegoDevice::isCombiActive() {
+	return combiActive_;
+}
+
+uint32_t LegoDevice::selectCombi(const int* modes, int count) {
+	if (count < 1) {
+		WARN("selectCombi: no modes given");
+		return 0;
+	}
 
-	selectedMode_ = modeIndex;
+	std::array<CombiEntry, maxCombiEntries> entries;
+	int numEntries = 0;
+	int dataSize = 0;
+	uint16_t requested = 0;
+	for (int i = 0; i < count; i++) {
+		Mode* mode = getMode(modes[i]);
+		if (mode == nullptr || mode->getFormat() == nullptr || mode->getDatasetSize() == 0) {
+			WARN("selectCombi: mode %d has no usable format", modes[i]);
+			return 0;
+		}
+		requested |= (uint16_t) (1 << modes[i]);
+		for (int d = 0; d < mode->getFormat()->getDatasets(); d++) {
+			if (numEntries == maxCombiEntries) {
+				WARN("selectCombi: more than %d datasets requested", maxCombiEntries);
+				return 0;
+			}
+			entries[numEntries++] = {(uint8_t) modes[i], (uint8_t) d};
+			dataSize += mode->getDatasetSize();
+		}
+	}
+	if (dataSize > 32) {
+		WARN("selectCombi: combined payload of %d bytes exceeds 32 bytes", dataSize);
+		return 0;
+	}
+
+	int comboIndex = -1;
+	for (int i = 0; i < numModeCombos_; i++) {
+		if ((modeCombos_[i] & requested) == requested) {
+			comboIndex = i;
+			break;
+		}
+	}
+	if (comboIndex < 0) {
+		WARN("selectCombi: device does not support mode combination 0x%04X", requested);
+		return 0;
+	}
+
+	// CMD_WRITE: combi setup byte, then (mode << 4 | dataset) per value in the
+	// order the values shall appear in the DATA frame. LUMP payloads are a
+	// power of two, unused bytes are zero.
+	int payloadSize = 1;
+	int sizeCode = 0;
+	while (payloadSize < 1 + numEntries) {
+		payloadSize <<= 1;
+		sizeCode++;
+	}
+	TxCommand command;
+	uint8_t* message = command.bytes;
+	memset(message, 0, maxTxCommandLength);
+	message[0] = lumpMsgTypeCmd | (sizeCode << 3) | lumpCmdWrite;
+	message[1] = lumpCombiSetup | comboIndex;
+	for (int i = 0; i < numEntries; i++) {
+		message[2 + i] = (entries[i].mode << 4) | entries[i].dataset;
+	}
+	uint8_t checksum = 0xff;
+	for (int i = 0; i < 1 + payloadSize; i++) {
+		checksum ^= message[i];
+	}
+	message[1 + payloadSize] = checksum;
+	command.length = 2 + payloadSize;
+
+	int frameSize = 1;
+	while (frameSize < dataSize) {
+		frameSize <<= 1;
+	}
+
+	INFO("Selecting combi mode 0x%04X (combination %d) with %d datasets", requested, comboIndex, numEntries);
+	// The layout travels with the command and is applied by the port service
+	// when it writes it, so no frame is ever split with a half-updated layout.
+	command.action = TxAction::SELECT_COMBI;
+	command.mode = -1;
+	command.combiEntries = entries;
+	command.numCombiEntries = (uint8_t) numEntries;
+	command.combiFrameSize = (uint8_t) frameSize;
+	return enqueueCommand(command);
 }
 
-void LegoDevice::selectSpeed(long speed) {
+uint32_t LegoDevice::selectSpeed(long speed) {
 	INFO("Selecting speed %ld", speed);
-	int command = lumpMsgTypeCmd | lumpCmdSpeed | lumpMsgSize4;
-	int byte0 = (speed >> 0) & 0xFF;
-	int byte1 = (speed >> 8) & 0xFF;
-	int byte2 = (speed >> 16) & 0xFF;
-	int byte3 = (speed >> 24) & 0xFF;
-	int checksum = 0xff ^ command ^ byte0 ^ byte1 ^ byte2 ^ byte3;
-
-	serialIO_->sendByte(command);
-	serialIO_->sendByte(byte0);
-	serialIO_->sendByte(byte1);
-	serialIO_->sendByte(byte2);
-	serialIO_->sendByte(byte3);
-	serialIO_->sendByte(checksum);
-	serialIO_->flush();
-	INFO("Sending select speed command");
+	uint8_t command = lumpMsgTypeCmd | lumpCmdSpeed | lumpMsgSize4;
+	uint8_t byte0 = (speed >> 0) & 0xFF;
+	uint8_t byte1 = (speed >> 8) & 0xFF;
+	uint8_t byte2 = (speed >> 16) & 0xFF;
+	uint8_t byte3 = (speed >> 24) & 0xFF;
+	uint8_t checksum = 0xff ^ command ^ byte0 ^ byte1 ^ byte2 ^ byte3;
+
+	const uint8_t message[] = {command, byte0, byte1, byte2, byte3, checksum};
+	TxCommand tx;
+	tx.action = TxAction::NONE;
+	tx.mode = -1;
+	memcpy(tx.bytes, message, sizeof(message));
+	tx.length = sizeof(message);
+	INFO("Queueing select speed command");
+	return enqueueCommand(tx);
+}
+
+uint32_t LegoDevice::enqueueCommand(TxCommand& command) {
+	uint32_t ticket = 0;
+	portENTER_CRITICAL(&txMux_);
+	if (txCount_ < txQueueCapacity) {
+		ticket = nextTicket_++;
+		command.ticket = ticket;
+		command.queuedAt = millis();
+		txQueue_[(txHead_ + txCount_) % txQueueCapacity] = command;
+		txCount_++;
+	}
+	portEXIT_CRITICAL(&txMux_);
+	if (ticket == 0) {
+		WARN("Command queue full, dropping command 0x%02X", command.bytes[0]);
+	}
+	return ticket;
+}
+
+void LegoDevice::serviceTxQueue(unsigned long now) {
+	TxCommand command;
+	bool ready = false;
+	portENTER_CRITICAL(&txMux_);
+	if (txCount_ > 0) {
+		// Signed, the head may have been queued after now was taken
+		long waited = (long) (now - txQueue_[txHead_].queuedAt);
+		if (now - lastReceivedDataInMillis_ >= txGapMs || waited >= txMaxDelayMs) {
+			command = txQueue_[txHead_];
+			txHead_ = (txHead_ + 1) % txQueueCapacity;
+			txCount_--;
+			ready = true;
+		}
+	}
+	portEXIT_CRITICAL(&txMux_);
+	if (ready) {
+		writeCommand(command);
+	}
+}
+
+void LegoDevice::writeCommand(const TxCommand& command) {
+	switch (command.action) {
+		case TxAction::SELECT_MODE:
+			selectedMode_ = command.mode;
+			combiActive_ = false;
+			break;
+		case TxAction::SELECT_COMBI:
+			combiEntries_ = command.combiEntries;
+			numCombiEntries_ = command.numCombiEntries;
+			combiFrameSize_ = command.combiFrameSize;
+			combiActive_ = true;
+			break;
+		case TxAction::NONE:
+			break;
+	}
+	// No flush: the SC16IS752 transmits on its own, and the next gap check
+	// is based on received bytes anyway
+	serialIO_->writeBytes(command.bytes, command.length);
+
+	if (command.ticket == 0) {
+		return;
+	}
+	txWrittenTicket_ = command.ticket;
+	if (command.action == TxAction::NONE) {
+		// Nothing to wait for from the device, unless an earlier select is
+		// still unacknowledged
+		if (awaitingAckTicket_ == 0) {
+			txAckedTicket_ = command.ticket;
+		} else {
+			ackFollowerTicket_ = command.ticket;
+		}
+	} else {
+		awaitingAckTicket_ = command.ticket;
+		awaitingAckMode_ = command.mode;
+		ackFollowerTicket_ = 0;
+	}
+}
+
+void LegoDevice::acknowledgeCommand() {
+	txAckedTicket_ = ackFollowerTicket_ > awaitingAckTicket_ ? ackFollowerTicket_ : awaitingAckTicket_;
+	awaitingAckTicket_ = 0;
+	ackFollowerTicket_ = 0;
+}
+
+void LegoDevice::dropQueuedCommands() {
+	portENTER_CRITICAL(&txMux_);
+	txHead_ = 0;
+	txCount_ = 0;
+	txDroppedTicket_ = nextTicket_ - 1;
+	portEXIT_CRITICAL(&txMux_);
+	awaitingAckTicket_ = 0;
+	ackFollowerTicket_ = 0;
+}
+
+bool LegoDevice::waitForCommand(uint32_t ticket, uint32_t timeoutMs, bool acknowledged) {
+	if (ticket == 0) {
+		return false;
+	}
+	const std::atomic<uint32_t>& done = acknowledged ? txAckedTicket_ : txWrittenTicket_;
+	unsigned long start = millis();
+	while (done.load() < ticket) {
+		if (txDroppedTicket_.load() >= ticket || millis() - start >= timeoutMs) {
+			return false;
+		}
+		vTaskDelay(pdMS_TO_TICKS(1));
+	}
+	return true;
 }
 
 bool LegoDevice::isInDataMode() {
@@ -238,19 +625,16 @@ void LegoDevice::switchToDataMode() {
 }
 
 void LegoDevice::setMotorSpeed(int speed) {
-	i2c_lock();
 	INFO("Setting motor speed to %d", speed);
-	if (speed == 0) {
-		serialIO_->setM1(false);
-		serialIO_->setM2(false);
-	} else if (speed > 0) {
-		serialIO_->setM1(false);
-		serialIO_->setM2(true);
-	} else if (speed < 0) {
-		serialIO_->setM1(true);
-		serialIO_->setM2(false);
-	}
-	i2c_unlock();
+	bool m1 = speed < 0;
+	bool m2 = speed > 0;
+	// Fire-and-forget at actuation priority. Keyed by device, so a burst of
+	// speed changes collapses into the most recent one while queued.
+	SerialIO* serialIO = serialIO_.get();
+	I2CScheduler::instance()->submit(I2CPriority::ACTUATION, reinterpret_cast<uintptr_t>(this), [serialIO, m1, m2]() {
+		serialIO->setM1(m1);
+		serialIO->setM2(m2);
+	});
 	/*
 
 	// Check if PWM controller is injected
@@ -313,17 +697,22 @@ void LegoDevice::logParserStats() {
 	    s.invalidSizeBytes, serialIO_->uartOverrunCount());
 }
 
-void LegoDevice::loop() {
-	parseIncomingData();
+int LegoDevice::loop(bool drainRx) {
+	int received = 0;
+	if (drainRx) {
+		// Whatever arrives while the UART is being reprogrammed is line noise,
+		// drop it instead of letting the parser count checksum errors.
+		received = handshakeStep_ == HandshakeStep::BAUD_SETTLING ? discardIncomingData() : parseIncomingData();
+	}
 
 	if (isHandshakeComplete() && !isInDataMode()) {
-		finishHandshake();
-		int defaultMode = getDefaultMode();
-		INFO("Setting default mode %d for deviceId 0x%04x", defaultMode, deviceId_);
-		selectMode(getDefaultMode());
-		switchToDataMode();
+		advanceHandshake(millis());
 	} else if (isInDataMode()) {
 		unsigned long now = millis();
+		// Queued commands go out in the inter-frame gap, like the keep-alive NACK
+		// below, so they never interleave with an incoming DATA burst.
+		serviceTxQueue(now);
+
 		// Keep-alive: send NACK every 50 ms, but only when we are at least 4 ms past
 		// the last received byte.  parseIncomingData() sets lastReceivedDataInMillis_
 		// each time it reads bytes from the FIFO; when the FIFO was empty the value
@@ -351,7 +740,7 @@ void LegoDevice::loop() {
 			// No data within timeout — assume device was unplugged
 			WARN("Didn't receive data for some time, performing a device reset");
 			reset();
-			return;
+			return received;
 		}
 
 		// Log parser statistics every 5 seconds in data mode
@@ -371,25 +760,31 @@ void LegoDevice::loop() {
 			lastLoggedOverrunCount = currentOverruns;
 		}
 	}
+	return received;
+}
+
+void LegoDevice::enableRxInterrupt() {
+	serialIO_->enableRxInterrupt();
+}
+
+bool LegoDevice::hasPendingData() {
+	return serialIO_->rxPending();
 }
 
 void LegoDevice::setPinMode(int pin, int mode) {
-	i2c_lock();
-	serialIO_->setPinMode(pin, mode);
-	i2c_unlock();
+	I2CScheduler::instance()->execute(I2CPriority::ACTUATION, [this, pin, mode]() { serialIO_->setPinMode(pin, mode); });
 }
 
 int LegoDevice::digitalRead(int pin) {
-	i2c_lock();
-	int value = serialIO_->digitalRead(pin);
-	i2c_unlock();
+	int value = 0;
+	I2CScheduler::instance()->execute(I2CPriority::ACTUATION,
+	                                  [this, pin, &value]() { value = serialIO_->digitalRead(pin); });
 	return value;
 }
 
 void LegoDevice::digitalWrite(int pin, int value) {
-	i2c_lock();
-	serialIO_->digitalWrite(pin, value);
-	i2c_unlock();
+	I2CScheduler::instance()->execute(I2CPriority::ACTUATION,
+	                                  [this, pin, value]() { serialIO_->digitalWrite(pin, value); });
 }
 
 std::string LegoDevice::name() {
@@ -417,7 +812,18 @@ void LegoDevice::onDataFrame(int mode, const uint8_t* payload, int payloadSize)
 	// the frame (e.g. SPEC1 on the Color+Distance sensor), skip the generic
 	// processDataPacket path.  Mode 8 has no FORMAT descriptor from the handshake,
 	// so calling processDataPacket on it would always emit a spurious WARN.
-	if (distributeCombinedFrame(mode, payload, payloadSize)) {
+	if (combiActive_ && payloadSize == combiFrameSize_) {
+		if (awaitingAckTicket_ != 0 && awaitingAckMode_ == -1) {
+			acknowledgeCommand();
+		}
+		onCombiDataFrame(mode, payload, payloadSize);
+		return;
+	}
+	if (awaitingAckTicket_ != 0 && !combiActive_ && mode == awaitingAckMode_) {
+		acknowledgeCommand();
+	}
+	uint32_t timestamp = micros();
+	if (distributeCombinedFrame(mode, payload, payloadSize, timestamp)) {
 		return;
 	}
 	Mode* m = getMode(mode);
@@ -425,10 +831,12 @@ void LegoDevice::onDataFrame(int mode, const uint8_t* payload, int payloadSize)
 		WARN("onDataFrame: invalid mode %d", mode);
 		return;
 	}
-	m->processDataPacket(payload, payloadSize);
+	if (m->processDataPacket(payload, payloadSize)) {
+		m->recordSample(timestamp);
+	}
 }
 
-bool LegoDevice::distributeCombinedFrame(int mode, const uint8_t* payload, int payloadSize) {
+bool LegoDevice::distributeCombinedFrame(int mode, const uint8_t* payload, int payloadSize, uint32_t timestamp) {
 	switch (deviceId_) {
 		case DEVICEID_BOOST_COLOR_DISTANCE_SENSOR: {
 			// SPEC1 (mode 8): 4 × DATA8 combined frame.
@@ -469,8 +877,8 @@ bool LegoDevice::distributeCombinedFrame(int mode, const uint8_t* payload, int p
 			};
 			for (const auto& entry : mapping) {
 				Mode* subMode = getMode(entry.modeIdx);
-				if (subMode != nullptr) {
-					subMode->processDataPacket(&payload[entry.byteIdx], 1);
+				if (subMode != nullptr && subMode->processDataPacket(&payload[entry.byteIdx], 1)) {
+					subMode->recordSample(timestamp);
 				}
 			}
 			return true;
@@ -481,7 +889,25 @@ bool LegoDevice::distributeCombinedFrame(int mode, const uint8_t* payload, int p
 }
 
 void LegoDevice::onCombiDataFrame(int mode, const uint8_t* payload, int payloadSize) {
-	onDataFrame(mode, payload, payloadSize);
+	uint32_t timestamp = micros();
+	uint16_t touched = 0;
+	int offset = 0;
+	for (int i = 0; i < numCombiEntries_; i++) {
+		const CombiEntry& entry = combiEntries_[i];
+		Mode* m = getMode(entry.mode);
+		int size = m != nullptr ? m->getDatasetSize() : 0;
+		if (size == 0 || offset + size > payloadSize) {
+			WARN("Combi frame on mode %d does not match layout at entry %d, ignoring", mode, i);
+			return;
+		}
+		offset += m->decodeDataset(entry.dataset, &payload[offset]);
+		touched |= (uint16_t) (1 << entry.mode);
+	}
+	for (int i = 0; i < 16; i++) {
+		if (touched & (1 << i)) {
+			modes_[i].recordSample(timestamp);
+		}
+	}
 }
 
 void LegoDevice::onDataFrameDispatched() {
@@ -649,6 +649,9 @@ void LumpParser::dispatchFrame(uint8_t header, const uint8_t* payload, int paylo
 				uint8_t inputFlags = payload[1];
 				uint8_t outputFlags = payload[2];
 
+				// Replaces what a cached descriptor applied, so a difference shows in the reconciliation
+				modeObj->clearTypes();
+
 				if (inputFlags & 128) {
 					modeObj->registerInputType(Mode::InputOutputType::SUPPORTS_NULL);
 				}
@@ -685,11 +688,20 @@ void LumpParser::dispatchFrame(uint8_t header, const uint8_t* payload, int paylo
 
 			case LUMP_INFO_MODE_COMBOS: {
 				INFO("Parsing LUMP_INFO_MODE_COMBOS");
-				INFO("Got Info Mode Combos for mode %d, payload size %d", mode, payloadSize);
-				for (int i = 0; i < payloadSize; i++) {
-					DEBUG("  Byte %d = 0x%02X", i, payload[i]);
+				// payload[1..] = list of uint16 LE mode bitmasks, one per supported
+				// combination, terminated by a zero mask or the end of the payload
+				uint16_t combos[LegoDevice::maxModeCombos];
+				int numCombos = 0;
+				for (int i = 1; i + 1 < payloadSize && numCombos < LegoDevice::maxModeCombos; i += 2) {
+					uint16_t mask = (uint16_t) (payload[i] | (payload[i + 1] << 8));
+					if (mask == 0) {
+						break;
+					}
+					DEBUG("  Combination %d = 0x%04X", numCombos, mask);
+					combos[numCombos++] = mask;
 				}
-				// No action yet — combi-mode support is a future extension
+				INFO("Got %d mode combinations", numCombos);
+				device_->setModeCombos(combos, numCombos);
 				break;
 			}
 
@@ -2,7 +2,9 @@
 
 #include "logging.h"
 
-Mode::Mode() : pctMin_(0.0f), pctMax_(100.0f), siMin_(0.0f), siMax_(1023.0f) {
+Mode::Mode()
+    : pctMin_(0.0f), pctMax_(100.0f), siMin_(0.0f), siMax_(1023.0f), decoder_(nullptr), datasetSize_(0),
+      frameSize_(0), sampleRing_(nullptr) {
 	name_ = "";
 	units_ = "";
 	for (int i = 0; i < 5; i++) {
@@ -11,11 +13,16 @@ Mode::Mode() : pctMin_(0.0f), pctMax_(100.0f), siMin_(0.0f), siMax_(1023.0f) {
 	}
 }
 
-Mode::~Mode() {}
+Mode::~Mode() {
+	delete sampleRing_.load();
+}
 
 void Mode::reset() {
 	format_.reset();
 	datasets_.clear();
+	decoder_ = nullptr;
+	datasetSize_ = 0;
+	frameSize_ = 0;
 
 	pctMin_ = 0.0f;
 	pctMax_ = 100.0;
@@ -23,6 +30,10 @@ void Mode::reset() {
 	siMax_ = 1023.0f;
 	name_ = "";
 	units_ = "";
+	clearTypes();
+}
+
+void Mode::clearTypes() {
 	for (int i = 0; i < 5; i++) {
 		inputTypes_[i] = false;
 		outputTypes_[i] = false;
@@ -37,6 +48,14 @@ void Mode::registerOutputType(InputOutputType outputType) {
 	outputTypes_[static_cast<int>(outputType)] = true;
 }
 
+bool Mode::supportsInputType(InputOutputType inputType) {
+	return inputTypes_[static_cast<int>(inputType)];
+}
+
+bool Mode::supportsOutputType(InputOutputType outputType) {
+	return outputTypes_[static_cast<int>(outputType)];
+}
+
 void Mode::setName(const std::string& name) {
 	this->name_ = name;
 }
@@ -58,6 +77,14 @@ void Mode::setSiMinMax(float min, float max) {
 void Mode::setFormat(std::unique_ptr<Format> format) {
 	format_ = std::move(format);
 	datasets_.assign(format_->getDatasets(), Dataset{});
+
+	FrameLayout layout = frameLayoutFor(format_->getFormatType());
+	decoder_ = layout.decoder;
+	datasetSize_ = layout.datasetSize;
+	frameSize_ = format_->getDatasets() * layout.datasetSize;
+	if (decoder_ == nullptr) {
+		WARN("Unknown format type in mode : %d, data messages will be ignored", format_->getFormatType());
+	}
 }
 
 std::string Mode::getName() {
@@ -84,69 +111,77 @@ float Mode::getSiMax() {
 	return siMax_;
 }
 
-void Mode::processDataPacket(const uint8_t* payload, int payloadSize) {
+bool Mode::processDataPacket(const uint8_t* payload, int payloadSize) {
+	// Hot path: runs for every DATA frame on every port, so it must not
+	// allocate. The hex dump is only rendered when a frame is rejected.
+	if (decoder_ == nullptr) {
+		if (format_ == nullptr) {
+			WARN("Not fully initialized yet!");
+		}
+		return false;
+	}
 
-	if (format_ == nullptr) {
-		WARN("Not fully initialized yet!");
-		return;
+	if (payloadSize != frameSize_) {
+		char payloadHex[maxPayloadHexLength];
+		formatPayloadHex(payload, payloadSize, payloadHex, sizeof(payloadHex));
+		WARN("Got data %s, expecting %d datasets of type %d, but wrong size. Expected %d, got %d", payloadHex,
+		     format_->getDatasets(), format_->getFormatType(), frameSize_, payloadSize);
+		return false;
 	}
 
-	const char hexChars[] = "0123456789ABCDEF";
-	std::string payloadHex;
-	payloadHex.reserve(payloadSize * 3); // 2 chars + space per byte
+	decoder_(payload, format_->getDatasets(), datasets_.data());
+	return true;
+}
 
-	for (int i = 0; i < payloadSize; ++i) {
-		int v = payload[i] & 0xFF;
-		payloadHex.push_back(hexChars[(v >> 4) & 0xF]);
-		payloadHex.push_back(hexChars[v & 0xF]);
-		if (i + 1 < payloadSize) {
-			payloadHex.push_back(' ');
-		}
+int Mode::decodeDataset(int index, const uint8_t* payload) {
+	if (decoder_ == nullptr || index < 0 || index >= (int) datasets_.size()) {
+		return 0;
 	}
+	decoder_(payload, 1, &datasets_[index]);
+	return datasetSize_;
+}
 
-	int datasetSize = 0;
-	switch (format_->getFormatType()) {
-		case Format::FormatType::DATA8: {
-			datasetSize = 1;
-			break;
-		}
-		case Format::FormatType::DATA16: {
-			datasetSize = 2;
-			break;
-		}
-		case Format::FormatType::DATA32: {
-			datasetSize = 4;
-			break;
-		}
-		case Format::FormatType::DATAFLOAT: {
-			datasetSize = 4;
-			break;
-		}
-		default:
-			WARN("Unknown format type in mode : %d, ignoring data message", format_->getFormatType());
-			return;
+int Mode::getDatasetSize() {
+	return datasetSize_;
+}
+
+SampleRing* Mode::enableSampleRing(int capacity) {
+	SampleRing* ring = sampleRing_.load(std::memory_order_acquire);
+	if (ring != nullptr) {
+		return ring;
 	}
+	if (capacity < 1) {
+		capacity = SampleRing::defaultCapacity;
+	} else if (capacity > SampleRing::maxCapacity) {
+		capacity = SampleRing::maxCapacity;
+	}
+	// Two Lua threads may enable the same mode concurrently, the loser
+	// discards its ring and uses the published one
+	SampleRing* created = new SampleRing(capacity);
+	SampleRing* expected = nullptr;
+	if (!sampleRing_.compare_exchange_strong(expected, created, std::memory_order_acq_rel)) {
+		delete created;
+		return expected;
+	}
+	return created;
+}
 
-	DEBUG("Got data %s, expecting %d datasets of type %d", payloadHex.c_str(), format_->getDatasets(),
-	      format_->getFormatType());
+SampleRing* Mode::getSampleRing() {
+	return sampleRing_.load(std::memory_order_acquire);
+}
 
-	int expectedSize = format_->getDatasets() * datasetSize;
-	if (expectedSize != payloadSize) {
-		WARN("Got data %s, expecting %d datasets of type %d, but wrong size. Expected %d, got %d", payloadHex.c_str(),
-		     format_->getDatasets(), format_->getFormatType(), expectedSize, payloadSize);
+void Mode::recordSample(uint32_t timestampMicros) {
+	SampleRing* ring = sampleRing_.load(std::memory_order_acquire);
+	if (ring == nullptr || format_ == nullptr) {
 		return;
 	}
-
-	const uint8_t* startPtr = payload;
-	for (int i = 0; i < format_->getDatasets(); i++) {
-		DEBUG("Got data %s, expecting %d datasets of type %d, parsing dataset %d", payloadHex.c_str(),
-		      format_->getDatasets(), format_->getFormatType(), i);
-		datasets_[i].readData(format_->getFormatType(), startPtr);
-		startPtr += datasetSize;
-	}
+	ring->push(timestampMicros, format_->getFormatType(), datasets_.data(), format_->getDatasets());
 }
 
 Dataset* Mode::getDataset(int index) {
+	if (index < 0 || index >= (int) datasets_.size()) {
+		return nullptr;
+	}
 	return &datasets_[index];
 }
 
@@ -156,10 +156,11 @@ void MotorPWMController::updateMotorState(uint8_t index, bool shouldBeOn, bool d
 	}
 
 	// State changed - update motor via I2C
-	i2c_lock();
-	state.device->getSerialIO()->setM1(desiredM1);
-	state.device->getSerialIO()->setM2(desiredM2);
-	i2c_unlock();
+	SerialIO* serialIO = state.device->getSerialIO();
+	I2CScheduler::instance()->execute(I2CPriority::ACTUATION, [serialIO, desiredM1, desiredM2]() {
+		serialIO->setM1(desiredM1);
+		serialIO->setM2(desiredM2);
+	});
 
 	// Update cached state
 	state.currentM1 = desiredM1;
@@ -0,0 +1,101 @@
+#include "samplering.h"
+
+#include <cstring>
+
+int Sample::intValue(int i) const {
+	if (isFloat()) {
+		return (int) floatValue(i);
+	}
+	return raw[i];
+}
+
+float Sample::floatValue(int i) const {
+	if (isFloat()) {
+		float value;
+		std::memcpy(&value, &raw[i], sizeof(value));
+		return value;
+	}
+	return (float) raw[i];
+}
+
+SampleRing::SampleRing(int capacity)
+    : slots_(new Slot[capacity]), capacity_(capacity), head_(0), hasPrevious_(false), previousMicros_(0) {
+	for (int i = 0; i < capacity_; i++) {
+		slots_[i].sequence.store(0, std::memory_order_relaxed);
+		slots_[i].sample.index = 0;
+		slots_[i].sample.count = 0;
+	}
+}
+
+void SampleRing::push(uint32_t timestampMicros, Format::FormatType type, Dataset* datasets, int count) {
+	uint32_t index = head_.load(std::memory_order_relaxed);
+	Slot& slot = slots_[index % capacity_];
+
+	uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+	slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	Sample& sample = slot.sample;
+	sample.index = index;
+	sample.timestampMicros = timestampMicros;
+	// Unsigned difference, correct across the wrap of micros() after ~71.6 minutes
+	sample.intervalMicros = hasPrevious_ ? timestampMicros - previousMicros_ : 0;
+	sample.type = type;
+	sample.count = count > Sample::maxValues ? Sample::maxValues : count;
+	for (int i = 0; i < sample.count; i++) {
+		if (type == Format::FormatType::DATAFLOAT) {
+			float value = datasets[i].getDataAsFloat();
+			std::memcpy(&sample.raw[i], &value, sizeof(value));
+		} else {
+			sample.raw[i] = datasets[i].getDataAsInt();
+		}
+	}
+
+	slot.sequence.store(sequence + 2, std::memory_order_release);
+	head_.store(index + 1, std::memory_order_release);
+	hasPrevious_ = true;
+	previousMicros_ = timestampMicros;
+}
+
+int SampleRing::read(uint32_t& cursor, Sample* out, int maxSamples, uint32_t& lost) {
+	uint32_t head = head_.load(std::memory_order_acquire);
+	uint32_t from = cursor;
+
+	// Unsigned distance, so the 32 bit wrap of the sample counter is harmless.
+	// A cursor ahead of head (stale or made up) restarts at head.
+	uint32_t pending = head - from;
+	if (pending > (uint32_t) INT32_MAX) {
+		from = head;
+		pending = 0;
+	}
+	if (pending > (uint32_t) capacity_) {
+		lost += pending - capacity_;
+		from = head - capacity_;
+	}
+
+	int copied = 0;
+	while (from != head && copied < maxSamples) {
+		Slot& slot = slots_[from % capacity_];
+		bool ok = false;
+		for (int attempt = 0; attempt < maxReadRetries && !ok; attempt++) {
+			uint32_t before = slot.sequence.load(std::memory_order_acquire);
+			if (before & 1) {
+				continue;
+			}
+			out[copied] = slot.sample;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			uint32_t after = slot.sequence.load(std::memory_order_relaxed);
+			ok = before == after;
+		}
+		// The slot may have been reused for a newer sample in the meantime
+		if (ok && out[copied].index == from) {
+			copied++;
+		} else {
+			lost++;
+		}
+		from++;
+	}
+
+	cursor = from;
+	return copied;
+}
@@ -121,8 +121,12 @@
 
 /*
 @@ LUA_32BITS enables Lua with 32-bit integers and 32-bit floats.
+** Megahub default: the ESP32 FPU is single precision only, doubles are
+** soft-float. Build with -DLUA_32BITS=0 for 64-bit integers and doubles.
 */
+#if !defined(LUA_32BITS)
 #define LUA_32BITS	1
+#endif
 
 
 /*
@@ -795,16 +799,21 @@
 */
 
 // Lua Thread Safety!!!!
-// On ESP32 (ESP-IDF), use a FreeRTOS mutex so Lua is safe across RTOS tasks.
+// On ESP32 (ESP-IDF), every state has a FreeRTOS mutex of its own, kept by
+// its LuaHeap (the user data of the allocator), so Lua is safe across RTOS
+// tasks. Threads of one state exclude each other, separate states run in
+// parallel on both cores. States without a LuaHeap (the syntax check) are
+// used by one task only and not locked.
 // On native/host (unit-test builds), no locking is needed — tests are single-threaded.
 #if defined(ESP_PLATFORM)
-#include <freertos/FreeRTOS.h>
-#include <freertos/semphr.h>
-
-extern SemaphoreHandle_t lua_global_mutex;
-
-#define lua_lock(L)    xSemaphoreTake(lua_global_mutex, portMAX_DELAY)
-#define lua_unlock(L)  xSemaphoreGive(lua_global_mutex)
+void luaheap_lock(void *ud);
+void luaheap_unlock(void *ud);
+
+#define lua_lock(L)    luaheap_lock(G(L)->ud)
+#define lua_unlock(L)  luaheap_unlock(G(L)->ud)
+// lua_close() takes the lock and never gives it back, as the state is gone
+// afterwards. Closing a state while others keep running must release it.
+#define luai_userstateclose(L)  lua_unlock(L)
 #else
 #define lua_lock(L)    ((void)(L))
 #define lua_unlock(L)  ((void)(L))
@@ -37,19 +37,27 @@
 
 /*
 ** these libs are loaded by lua.c and are readily available to any Lua
-** program
+** program. Firmware build profiles leave out the ones they have no use
+** for with LUA_WITHOUT_IO, LUA_WITHOUT_OS and LUA_WITHOUT_DEBUG, which
+** saves their tables in every state.
 */
 static const luaL_Reg loadedlibs[] = {
   {LUA_GNAME, luaopen_base},
   {LUA_LOADLIBNAME, luaopen_package},
   {LUA_COLIBNAME, luaopen_coroutine},
   {LUA_TABLIBNAME, luaopen_table},
+#if !defined(LUA_WITHOUT_IO)
   {LUA_IOLIBNAME, luaopen_io},
+#endif
+#if !defined(LUA_WITHOUT_OS)
   {LUA_OSLIBNAME, luaopen_os},
+#endif
   {LUA_STRLIBNAME, luaopen_string},
   {LUA_MATHLIBNAME, luaopen_math},
   {LUA_UTF8LIBNAME, luaopen_utf8},
+#if !defined(LUA_WITHOUT_DEBUG)
   {LUA_DBLIBNAME, luaopen_debug},
+#endif
   {NULL, NULL}
 };
 
@@ -0,0 +1,64 @@
+#ifndef BYTECODECACHE_H
+#define BYTECODECACHE_H
+
+#include "lua.hpp"
+#include "luasource.h"
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <cstdint>
+#include <vector>
+
+struct BytecodeCacheStats {
+	uint32_t hits;     // programs started from cached bytecode
+	uint32_t misses;   // programs compiled from source
+	uint32_t rejected; // cache files dropped as stale, corrupt or unloadable
+	uint32_t stores;   // compiled programs written to the cache
+};
+
+// ---------------------------------------------------------------------------
+// BytecodeCache — keeps the lua_dump() of programs that were compiled before,
+// so running the same program again skips lexing and parsing.
+//
+// Entries are files in one directory on the SD card, named after a 64-bit
+// FNV-1a hash of the firmware revision and the source text. Each file starts
+// with a header repeating the firmware revision, the Lua version and the
+// source length and hash; an entry that does not match all of them is
+// rejected and removed. The bytecode itself is checked once more by
+// lundump.c when it is loaded.
+// ---------------------------------------------------------------------------
+class BytecodeCache {
+  public:
+	static const int maxEntries = 16;
+
+	BytecodeCache(FS* fs, const char* directory, const char* firmwareRevision);
+
+	// Pushes the cached main function of source onto L. Returns false and
+	// pushes nothing on a miss or if the entry was rejected.
+	bool load(lua_State* L, LuaSource& source);
+	// Dumps the function on top of L (left in place) as the entry for source.
+	// Evicts another entry when the directory already holds maxEntries.
+	void store(lua_State* L, LuaSource& source);
+
+	BytecodeCacheStats stats();
+
+  private:
+	uint64_t keyOf(LuaSource& source);
+	String pathOf(uint64_t key);
+	void writeHeader(std::vector<uint8_t>& out, uint64_t key, size_t length);
+	void evictIfFull(const String& keep);
+
+	static const uint8_t imageVersion = 1;
+
+	FS* fs_;
+	String directory_;
+	String firmwareRevision_;
+	SemaphoreHandle_t mutex_;
+	BytecodeCacheStats stats_;
+};
+
+#endif // BYTECODECACHE_H
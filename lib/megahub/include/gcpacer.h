@@ -0,0 +1,71 @@
+#ifndef GCPACER_H
+#define GCPACER_H
+
+#include "lua.hpp"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <atomic>
+
+// ---------------------------------------------------------------------------
+// GcPacer — garbage collection policy of the Lua state, chosen per program.
+// By default Lua's incremental collector runs whenever an allocation has
+// paid enough debt, which may be in the middle of a control loop iteration.
+//
+// With a budget set, the collection work is done between the iterations of
+// the Lua threads instead: after the thread function returned and before the
+// thread sleeps, a cycle is advanced in small steps until the budget is used
+// up. A cycle starts once the heap has grown to pause percent of the live
+// data after the previous one. If the heap grows to twice the threshold, the
+// iterations fell behind and the cycle is finished at once.
+//
+// The automatic collector stays on with twice the pause as a backstop: a
+// thread looping on its own, a long main chunk or an isolated thread never
+// end an iteration, and without it the heap would grow until an allocation
+// fails. While iterations keep up it does not start a cycle of its own, and
+// a cycle they left open is credited the growth up to the backstop, so it
+// does not step inside the iterations either.
+//
+// Threads ending an iteration while another one is collecting skip their
+// turn instead of waiting. Every program starts with Lua's defaults.
+// ---------------------------------------------------------------------------
+class GcPacer {
+  public:
+	static const int defaultPause = 200;
+	static const int defaultStepMul = 100;
+	static const int defaultStepSize = 13; // log2 of the bytes of work per step
+	static const int pacedStepSize = 10;   // smaller steps keep within the budget
+
+	static GcPacer* instance();
+
+	// Lua's incremental collector with default parameters, no budget
+	void reset(lua_State* L);
+	// Parameters 0 keep the current value
+	void incremental(lua_State* L, int pause, int stepMul);
+	void generational(lua_State* L, int minorMul, int majorMul);
+	bool isGenerational();
+	// Collector work between iterations, at most the given time per iteration.
+	// 0 hands the work back to the automatic collector.
+	void setBudget(lua_State* L, unsigned long budgetMicros);
+	bool paced() const { return budgetMicros_.load() > 0; }
+
+	// Called after an iteration returned, before the thread sleeps. Returns the
+	// time spent collecting, 0 without a budget.
+	unsigned long afterIteration(lua_State* L);
+
+  private:
+	GcPacer();
+
+	void applyIncremental(lua_State* L);
+
+	SemaphoreHandle_t mutex_;
+	std::atomic<unsigned long> budgetMicros_;
+	bool generational_;
+	int pause_;
+	int stepMul_;
+	bool inCycle_;
+	int thresholdKb_;
+};
+
+#endif // GCPACER_H
@@ -0,0 +1,67 @@
+#ifndef LINEPROFILER_H
+#define LINEPROFILER_H
+
+#include "lua.hpp"
+
+#include <Arduino.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <atomic>
+#include <cstdint>
+
+// ---------------------------------------------------------------------------
+// LineProfiler — sampling profiler for the Lua threads started with
+// profiling enabled. A count hook fires every N VM instructions and
+// attributes one sample to the line being executed, so a line's share of
+// the samples is its share of the instructions run. Time spent inside a C
+// function (e.g. lego.getmodedataset()) is not sampled itself, the Lua
+// lines calling it in a loop show up instead.
+//
+// Samples are aggregated by chunk:line in a fixed-size table and the hottest
+// lines are streamed to the IDE as a line_profile command. Hooks of
+// different tasks may run at the same time; a sample that finds the table
+// locked, or full, is counted as dropped instead of waiting.
+// ---------------------------------------------------------------------------
+class LineProfiler {
+  public:
+	static const int tableSize = 32;
+	static const int reportedLines = 8;
+	static const unsigned long reportIntervalMs = 10000;
+
+	static LineProfiler* instance();
+
+	// Samples every given number of VM instructions, 0 disables the profiler
+	void enable(int sampleInstructions);
+	bool enabled() const { return sampleInstructions_ > 0; }
+
+	// Installs the sampling hook on a thread, no-op while disabled
+	void attach(lua_State* thread);
+	// Clears all samples, e.g. when a new program starts
+	void reset();
+
+	void record(const char* source, const char* chunk, int line, int function);
+	// Queues a line_profile command once per report interval
+	void reportIfDue(unsigned long nowMillis);
+
+  private:
+	struct Entry {
+		const char* source; // identity of the chunk, nullptr for a free slot
+		char chunk[24];
+		int line;
+		int function; // line the function is defined at, 0 for the main chunk
+		uint32_t samples;
+	};
+
+	LineProfiler();
+
+	SemaphoreHandle_t mutex_;
+	int sampleInstructions_;
+	Entry entries_[tableSize];
+	uint32_t totalSamples_;
+	std::atomic<uint32_t> droppedSamples_;
+	unsigned long lastReport_;
+};
+
+#endif // LINEPROFILER_H
@@ -0,0 +1,39 @@
+#ifndef LUABINDINGS_H
+#define LUABINDINGS_H
+
+#include "lua.hpp"
+
+class Megahub;
+class InputDevices;
+
+// ---------------------------------------------------------------------------
+// LuaBindingContext — the native objects the C bindings of the Lua libraries
+// work on. The main Lua state keeps a pointer to it in its extra space
+// (LUA_EXTRASPACE), which Lua copies into every thread created afterwards.
+// A binding thus reaches the hub with two loads instead of a registry lookup
+// by string key on every call.
+// ---------------------------------------------------------------------------
+struct LuaBindingContext {
+	Megahub* hub;
+	InputDevices* inputDevices;
+	void* leds; // CRGB array of fastled.addleds(), nullptr before
+};
+
+// Must be called on the main state before any thread is created from it
+inline void setBindingContext(lua_State* L, LuaBindingContext* context) {
+	*(LuaBindingContext**) lua_getextraspace(L) = context;
+}
+
+inline LuaBindingContext* getBindingContext(lua_State* L) {
+	return *(LuaBindingContext**) lua_getextraspace(L);
+}
+
+inline Megahub* getMegaHubRef(lua_State* L) {
+	return getBindingContext(L)->hub;
+}
+
+inline InputDevices* getInputDevicesRef(lua_State* L) {
+	return getBindingContext(L)->inputDevices;
+}
+
+#endif // LUABINDINGS_H
@@ -0,0 +1,115 @@
+#ifndef LUACHANNEL_H
+#define LUACHANNEL_H
+
+#include "lua.hpp"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <atomic>
+#include <cstdint>
+
+class LuaScheduler;
+
+// ---------------------------------------------------------------------------
+// LuaChannel — bounded ring of numbers, booleans and short strings between
+// Lua threads, see hub.channel(). Any number of tasks may push and pop at
+// the same time without a lock: every slot carries a sequence number that
+// tells whether it is free for the push at a position (twice the position)
+// or filled for the pop (one more), and the positions are claimed with a
+// compare-and-swap (Vyukov's bounded queue, doubled so one slot works too).
+// The capacity is rounded up to a power of two.
+//
+// In latest mode a push to a full ring drops the oldest values instead of
+// failing, with capacity 1 the channel always holds the last value sent.
+//
+// receive() blocks on a task notification until a value arrives. The
+// waiting task registers itself, the next push takes the registration and
+// notifies it with wakeValue. There is one registration, a channel has one
+// waiting receiver; tryReceive() works from any number of tasks. A thread
+// stop (value 1) ends the wait as well. A notification arriving after the
+// wait ended stays pending with wakeValue, which the thread loops and wait()
+// do not take for a stop.
+//
+// A coroutine of the LuaScheduler cannot block its task. It registers with
+// waitFor() and yields, the next push calls LuaScheduler::wake() instead.
+//
+// Channels are created by handle, 1 to maxChannels, and deleted all at once
+// before the next program starts. If threads of the previous program are
+// still running, the channels are abandoned instead: the handles are free
+// for the next program, the memory stays with the threads that may use it.
+// ---------------------------------------------------------------------------
+class LuaChannel {
+  public:
+	static const int maxChannels = 16;
+	static const size_t maxCapacity = 256;
+	static const size_t maxStringLength = 31;
+	static const uint32_t wakeValue = 2;
+
+	struct Value {
+		uint8_t type; // LUA_TNUMBER, LUA_TBOOLEAN or LUA_TSTRING
+		bool isInteger;
+		uint8_t length;
+		union {
+			lua_Integer integer;
+			lua_Number number;
+			bool boolean;
+		};
+		char string[maxStringLength];
+	};
+
+	// Returns the handle, 0 if all channels are in use
+	static int create(size_t capacity, bool latest);
+	// nullptr for handles not created by the running program
+	static LuaChannel* get(lua_Integer handle);
+	// Only once all threads of the previous program stopped
+	static void resetAll();
+	// Frees the handles without deleting the channels
+	static void abandonAll();
+
+	// Reads the value at the index. Returns nullptr on success, otherwise
+	// why the value cannot be sent.
+	static const char* toValue(lua_State* L, int index, Value& value);
+	static void push(lua_State* L, const Value& value);
+
+	// False if the ring is full, latest mode always succeeds
+	bool send(const Value& value);
+	// False if the ring is empty
+	bool tryReceive(Value& value);
+	// Waits up to timeout for a value. False on timeout or if the thread was
+	// stopped meanwhile.
+	bool receive(Value& value, TickType_t timeout);
+	// Registers a suspended coroutine for the next push, look again with
+	// tryReceive() afterwards. cancelWait() removes the registration if it
+	// is still the one of the coroutine.
+	void waitFor(LuaScheduler* scheduler, uint32_t coroutineId);
+	void cancelWait(uint32_t coroutineId);
+
+	uint32_t dropped() const { return dropped_.load(); }
+
+  private:
+	struct Slot {
+		std::atomic<uint32_t> sequence;
+		Value value;
+	};
+
+	LuaChannel(size_t capacity, bool latest);
+	~LuaChannel();
+
+	bool tryPush(const Value& value);
+	void wakeReceiver();
+
+	Slot* slots_;
+	uint32_t mask_;
+	bool latest_;
+	std::atomic<uint32_t> pushPos_;
+	std::atomic<uint32_t> popPos_;
+	std::atomic<TaskHandle_t> receiver_;
+	std::atomic<LuaScheduler*> scheduler_;
+	std::atomic<uint32_t> waitingCoroutine_;
+	std::atomic<uint32_t> dropped_;
+
+	static std::atomic<LuaChannel*> channels_[maxChannels];
+};
+
+#endif // LUACHANNEL_H
@@ -0,0 +1,102 @@
+#ifndef LUAHEAP_H
+#define LUAHEAP_H
+
+#include "lua.hpp"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// ---------------------------------------------------------------------------
+// LuaHeap — allocator of the Lua state. Most Lua objects are small (strings,
+// tables, closures, upvalues) and churn constantly, so blocks up to
+// maxPooledSize bytes come from segregated size classes kept in an arena of
+// internal RAM. Each class takes 1 KB slabs from the arena on demand and
+// keeps freed blocks in a free list. A block never carries a header: Lua
+// passes the old size on every free and realloc, which gives its class.
+//
+// Larger blocks, and small ones once the arena is used up, spill to PSRAM
+// (or the default heap on boards without it). Slabs stay with their class
+// for the lifetime of the state.
+//
+// Every program runs on a state of its own, so the counters are the memory
+// accounting of the running program. Lua passes the type of a new object in
+// place of the old size, which gives the objects created per type for free.
+//
+// Lua calls the allocator with its lock held, except for the string buffers
+// of lauxlib, which C functions of different tasks resize at the same time.
+// The free lists and counters are guarded by a spinlock for that.
+//
+// The heap also holds that lock: lua_lock() of luaconf.h takes the mutex of
+// the heap of the state, so every state is locked on its own.
+// ---------------------------------------------------------------------------
+class LuaHeap {
+  public:
+	static const int numClasses = 8;
+	static const size_t maxPooledSize = 128;
+	static const size_t slabSize = 1024;
+
+	struct Stats {
+		size_t arenaSize;
+		size_t arenaUsed;               // bytes carved into slabs
+		size_t classBytes[numClasses];  // bytes of the live blocks per class
+		size_t spilledBytes;            // bytes of the live blocks outside the arena
+		size_t liveBytes;               // sum of the live blocks
+		size_t peakBytes;               // highest sum of the live blocks
+		uint32_t liveBlocks;            // blocks allocated and not freed yet
+		uint32_t spills;                // small blocks that found the arena full
+		uint32_t objects[LUA_NUMTYPES]; // objects created per basic type (LUA_TTABLE, ...)
+	};
+
+	// The arena is left out if it cannot be allocated, all blocks spill then
+	LuaHeap(size_t arenaSize, uint32_t spillCaps);
+	~LuaHeap();
+
+	// lua_Alloc, the user data is the LuaHeap
+	static void* allocate(void* ud, void* ptr, size_t osize, size_t nsize);
+
+	static size_t classSize(int sizeClass);
+	void stats(Stats& out);
+
+	// lua_lock() and lua_unlock() of the state, the user data is the LuaHeap
+	static void lock(void* ud);
+	static void unlock(void* ud);
+
+  private:
+	static int sizeClassOf(size_t size);
+
+	bool contains(void* ptr) const { return ptr >= arena_ && ptr < arenaEnd_; }
+	// tag is the type of a new object, 0 for other blocks
+	void* allocateBlock(size_t size, int tag);
+	void freeBlock(void* ptr, size_t size);
+	void* reallocateBlock(void* ptr, size_t osize, size_t nsize);
+	void* takeBlock(int sizeClass);
+	// Moves the live byte counts of a class, or of the spilled blocks for -1
+	void account(int sizeClass, size_t removed, size_t added);
+	// A new live block, with the type of the object it holds
+	void countBlock(int tag);
+
+	uint8_t* arena_;
+	uint8_t* arenaEnd_;
+	size_t arenaSize_;
+	size_t arenaUsed_;
+	uint32_t spillCaps_;
+	portMUX_TYPE mux_;
+	SemaphoreHandle_t stateLock_;
+
+	void* freeLists_[numClasses];
+	uint8_t* slabCursor_[numClasses]; // next never used block of the current slab
+	uint8_t* slabEnd_[numClasses];
+
+	size_t classBytes_[numClasses];
+	size_t spilledBytes_;
+	size_t liveBytes_;
+	size_t peakBytes_;
+	uint32_t liveBlocks_;
+	uint32_t spills_;
+	uint32_t objects_[LUA_NUMTYPES];
+};
+
+#endif // LUAHEAP_H
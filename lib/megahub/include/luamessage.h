@@ -0,0 +1,44 @@
+#ifndef LUAMESSAGE_H
+#define LUAMESSAGE_H
+
+#include "lua.hpp"
+
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// LuaValueCopy — a Lua value taken out of one state to be pushed into
+// another one. Isolated threads run on states of their own, so
+// hub.startisolated() copies nothing but plain data into them as upvalues:
+// nil, booleans, numbers, strings and tables of those. Tables are copied
+// field by field, without metatable. Functions, userdata and threads stay in
+// their state. Values exchanged at runtime go through LuaChannel.
+// ---------------------------------------------------------------------------
+class LuaValueCopy {
+  public:
+	// Nesting limit of tables, also stops cyclic ones
+	static const int maxDepth = 8;
+
+	LuaValueCopy();
+
+	// Copies the value at the index. Returns nullptr on success, otherwise
+	// what could not be copied, the copy is incomplete then.
+	const char* copyFrom(lua_State* L, int index);
+	void push(lua_State* L) const;
+
+	bool isNil() const { return type_ == LUA_TNIL; }
+
+  private:
+	const char* copyFrom(lua_State* L, int index, int depth);
+
+	int type_;
+	bool boolean_;
+	bool isInteger_;
+	lua_Integer integer_;
+	lua_Number number_;
+	std::string string_;
+	std::vector<LuaValueCopy> keys_;
+	std::vector<LuaValueCopy> values_;
+};
+
+#endif // LUAMESSAGE_H
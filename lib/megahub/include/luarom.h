@@ -0,0 +1,47 @@
+#ifndef LUAROM_H
+#define LUAROM_H
+
+#include "lua.hpp"
+
+// ---------------------------------------------------------------------------
+// LuaRom — the libraries and constants of the firmware, described in const
+// arrays that stay in flash instead of being copied into every Lua state.
+//
+// install() gives the global table an __index hook. The first read of a
+// library name creates an empty table whose own hook resolves its
+// functions from the luaL_Reg array; the first read of a constant pushes
+// its value. Either way the result is stored in the table it was looked up
+// in, so later reads are plain table hits and only what the program
+// actually uses takes RAM. Assigning a global of the same name replaces it
+// as before; pairs() lists only what was used so far.
+//
+// A library table is also registered in package.loaded when it is created,
+// so error messages and tracebacks name its functions as before, and a
+// package.preload loader lets require() find the libraries not used yet.
+//
+// The arrays are sorted by name for the binary search, install() aborts if
+// they are not. They end with a nullptr name and must live as long as the
+// state.
+// ---------------------------------------------------------------------------
+class LuaRom {
+  public:
+	struct Library {
+		const char* name;
+		const luaL_Reg* (*functions)();
+	};
+
+	struct Constant {
+		const char* name;
+		lua_Integer value;
+	};
+
+	static void install(lua_State* L, const Library* libraries, const Constant* constants);
+
+  private:
+	static int globalIndex(lua_State* L);
+	static int libraryIndex(lua_State* L);
+	static int requireLibrary(lua_State* L);
+	static void pushLibrary(lua_State* L, const char* name, const luaL_Reg* functions);
+};
+
+#endif // LUAROM_H
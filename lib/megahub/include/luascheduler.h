@@ -0,0 +1,104 @@
+#ifndef LUASCHEDULER_H
+#define LUASCHEDULER_H
+
+#include "lua.hpp"
+#include "threadstatistics.h"
+
+#include <Arduino.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <cstdint>
+#include <vector>
+
+class Megahub;
+
+// ---------------------------------------------------------------------------
+// LuaScheduler — runs the loops started by hub.startthread() as Lua
+// coroutines inside one FreeRTOS task, instead of one task per loop.
+//
+// Coroutines wait in a ready queue ordered by the time they want to run
+// next. The scheduler resumes the earliest one once it is due and sleeps
+// until then otherwise. wait() inside a coroutine yields back to the
+// scheduler with a wake-up time, so sleeping loops cost neither a stack nor
+// a context switch. A finished iteration is queued again 1 ms later, like the
+// vTaskDelay() between iterations of a thread task.
+//
+// hub.recv() suspends a coroutine until its timeout instead, and the
+// channel calls wake() on the next push to make it due at once.
+//
+// Only the scheduler task resumes and closes coroutines. stop(), stopAll()
+// and wake() may be called from any task; they flag the coroutine and wake
+// the scheduler, which removes or requeues it before picking the next one to
+// run. stopAll() returns only after the removed coroutines are closed, so
+// the program state may be closed next.
+// ---------------------------------------------------------------------------
+class LuaScheduler {
+  public:
+	static const unsigned long iterationGapMs = 1;
+
+	LuaScheduler(Megahub* hub, int stackSize);
+	virtual ~LuaScheduler();
+
+	// Pops the function on top of L and schedules it as a new coroutine.
+	// Returns an id for stop(), never 0.
+	uint32_t add(lua_State* L, const String& name, const String& blockId, bool profiling);
+	void stop(uint32_t id);
+	// Stops all coroutines and waits until the scheduler removed them. Returns
+	// false if one was still running after the timeout.
+	bool stopAll();
+
+	// Called by wait(). Returns true if L is the running coroutine and may
+	// yield; the scheduler then resumes it after the given time.
+	bool sleep(lua_State* L, unsigned long ms);
+	// Called by hub.recv(). Like sleep(), but wake() ends the wait early.
+	// Returns the id of the running coroutine, 0 if L may not yield.
+	uint32_t suspend(lua_State* L, unsigned long timeoutMs);
+	// Makes a suspended coroutine due now. Ids of coroutines that stopped
+	// meanwhile or are not suspended are ignored.
+	void wake(uint32_t id);
+
+	void loop();
+
+  private:
+	struct Coroutine {
+		uint32_t id;
+		uint32_t sequence; // FIFO order among equal deadlines
+		lua_State* thread;
+		int threadRef;
+		int functionRef;
+		String name;
+		String blockId;
+		bool profiling;
+		bool stopRequested;
+		bool inIteration;
+		bool suspended; // by suspend(), only the scheduler task writes it
+		bool woken;     // wake() while it was running, guarded by the mutex
+		unsigned long wakeAt;
+		unsigned long iterationStart;
+		ThreadStatistics statistics;
+	};
+
+	static bool runsLater(const Coroutine* a, const Coroutine* b);
+
+	void push(Coroutine* coroutine);
+	Coroutine* popDue(unsigned long now, TickType_t& sleepTicks);
+	void removeStopped();
+	// Returns false if the coroutine finished for good
+	bool resume(Coroutine* coroutine);
+	// Counted in closing_ by the caller, which stopAll() waits for
+	void close(Coroutine* coroutine);
+
+	Megahub* hub_;
+	std::vector<Coroutine*> ready_; // binary heap, earliest wakeAt on top
+	SemaphoreHandle_t mutex_;
+	TaskHandle_t taskHandle_;
+	Coroutine* current_;
+	int closing_; // taken out of ready_ or current_, close() not returned yet
+	uint32_t nextId_;
+	uint32_t nextSequence_;
+	bool stopPending_;
+};
+
+#endif // LUASCHEDULER_H
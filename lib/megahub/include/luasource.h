@@ -0,0 +1,64 @@
+#ifndef LUASOURCE_H
+#define LUASOURCE_H
+
+#include "lua.hpp"
+
+#include <cstddef>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// LuaSource — program text handed to lua_load() piece by piece through
+// LuaSource::reader, so uploads are compiled as they were received instead of
+// being joined into one String first.
+// ---------------------------------------------------------------------------
+class LuaSource {
+  public:
+	virtual ~LuaSource() {}
+
+	// Starts over at the first piece; lua_load() and the bytecode cache key
+	// both walk the source
+	virtual void rewind() = 0;
+	// Returns the next non-empty piece, nullptr when the source is exhausted
+	virtual const char* next(size_t& size) = 0;
+	virtual size_t length() = 0;
+
+	// lua_Reader for lua_load(L, LuaSource::reader, &source, ...)
+	static const char* reader(lua_State* L, void* data, size_t* size);
+};
+
+// One contiguous buffer owned by the caller, e.g. a string inside a JsonDocument
+class LuaBufferSource : public LuaSource {
+  public:
+	LuaBufferSource(const char* data, size_t length);
+
+	void rewind() override;
+	const char* next(size_t& size) override;
+	size_t length() override;
+
+  private:
+	const char* data_;
+	size_t length_;
+	bool consumed_;
+};
+
+// Upload chunks in arrival order, each kept in its own allocation
+class LuaChunkSource : public LuaSource {
+  public:
+	LuaChunkSource();
+
+	// Throws std::bad_alloc when the heap is exhausted
+	void append(const char* data, size_t length);
+	// Drops all chunks and frees their memory
+	void clear();
+
+	void rewind() override;
+	const char* next(size_t& size) override;
+	size_t length() override;
+
+  private:
+	std::vector<std::vector<char>> chunks_;
+	size_t length_;
+	size_t position_;
+};
+
+#endif // LUASOURCE_H
@@ -1,16 +1,38 @@
 #ifndef MEGAHUB_H
 #define MEGAHUB_H
 
+#include "bytecodecache.h"
 #include "imu.h"
 #include "inputdevices.h"
 #include "legodevice.h"
 #include "logging.h"
 #include "lua.hpp"
+#include "luabindings.h"
+#include "luaheap.h"
+#include "luascheduler.h"
+#include "luasource.h"
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
+#include <atomic>
 #include <memory>
 
+// FreeRTOS task priorities. Lua program code stays below LEGO port reception,
+// which in turn stays below the I2C bus scheduler task.
+#define LUA_THREAD_PRIORITY       1
+#define LUA_PERIODIC_PRIORITY_MIN 2
+#define LUA_PERIODIC_PRIORITY_MAX 4
+#define PORT_SERVICE_PRIORITY     5
+
+// Internal RAM reserved for the small blocks of the Lua heap
+#ifndef LUA_HEAP_ARENA_SIZE
+#define LUA_HEAP_ARENA_SIZE (32 * 1024)
+#endif
+// The same for the heap of every thread started by hub.startisolated()
+#ifndef LUA_ISOLATED_HEAP_ARENA_SIZE
+#define LUA_ISOLATED_HEAP_ARENA_SIZE (8 * 1024)
+#endif
+
 #define PORT1 1
 #define PORT2 2
 #define PORT3 3
@@ -70,16 +92,41 @@ struct LuaCheckResult {
 	String errorMessage;
 };
 
+struct LuaExecuteResult {
+	bool success;
+	bool fromCache; // started from cached bytecode instead of the source
+	int parseTime;  // compiling the source, 0 when started from the cache
+	int loadTime;   // loading the cached bytecode, 0 when compiled
+	String errorMessage;
+};
+
 class Megahub {
   public:
 	Megahub(InputDevices* inputDevices, LegoDevice* device1, LegoDevice* device2, LegoDevice* device3,
 	        LegoDevice* device4, IMU* imu);
 	virtual ~Megahub();
 
-	void loop();
+	// Switches reception of the two ports served by one SC16IS752 to its IRQ
+	// line on the given GPIO. May be called once per SC16IS752; without it the
+	// port service task polls the FIFOs at an adaptive rate.
+	void enablePortInterrupt(int gpio, int channelAPort, int channelBPort);
+	void notifyPortInterruptFromISR();
+	void portServiceLoop();
 
 	LegoDevice* port(int num);
 	IMU* imu();
+	// Heap of the running program's Lua state, only valid while it runs
+	LuaHeap* luaHeap();
+	// Snapshot of the running program's memory, and of the fresh state before
+	// the program started, i.e. what the libraries take
+	void programMemory(LuaHeap::Stats& out, LuaHeap::Stats& base);
+
+	// A Lua state with all libraries on a heap of its own, for a thread of
+	// hub.startisolated(). The caller owns both and deletes the heap only
+	// after closing the state. nullptr if out of memory.
+	lua_State* newIsolatedState(LuaHeap*& heap);
+	// False for the states of isolated threads
+	bool isProgramState(lua_State* L);
 
 	String deviceUid();
 	String name();
@@ -88,36 +135,86 @@ class Megahub {
 	String version();
 	String serialnumber();
 
-	LuaCheckResult checkLUACode(String luaCode);
-	void executeLUACode(String luaCode);
+	// Programs started by executeLUACode() are compiled once and then loaded
+	// from this cache. Takes ownership; without it every run is compiled.
+	void enableBytecodeCache(BytecodeCache* cache);
+
+	// Runs the loops of hub.startthread() as coroutines of one scheduler task
+	// with the given stack size, instead of one FreeRTOS task each.
+	void enableCooperativeThreads(int stackSize);
+	// nullptr unless cooperative threads are enabled
+	LuaScheduler* scheduler();
+
+	// Samples the Lua threads started with profiling enabled every given
+	// number of VM instructions and streams their hottest lines to the IDE.
+	void enableLineProfiler(int sampleInstructions);
+
+	LuaCheckResult checkLUACode(LuaSource& luaCode);
+	LuaExecuteResult executeLUACode(LuaSource& luaCode);
 	bool stopLUACode();
+	// Clears the iteration statistics and line profile of all running Lua threads
+	void resetThreadStatistics();
 
 	void setPinMode(int pin, int mode);
 	int digitalReadFrom(int pin);
 	void digitalWriteTo(int pin, int value);
 
 	void registerThread(TaskHandle_t handle);
-	void stopRunningThreads();
+	// Called by a thread task as its last step, it must not touch Lua afterwards
+	void threadTaskExited();
+	// Returns false if a thread is still running after the stop timeout
+	bool stopRunningThreads();
 	void stopThread(TaskHandle_t handle);
-	void notifyThreadExitedAbnormally();
+	// Removes only the crashed task, the others still have to be stopped. nullptr for a coroutine.
+	void notifyThreadExitedAbnormally(TaskHandle_t handle);
+	// Periodic threads get rate-monotonic priorities, the shorter the period the
+	// higher the priority within LUA_PERIODIC_PRIORITY_MIN..MAX
+	void registerPeriodicThread(TaskHandle_t handle, unsigned long periodMs);
+	void unregisterPeriodicThread(TaskHandle_t handle);
 
   private:
+	struct PeriodicThread {
+		TaskHandle_t handle;
+		unsigned long periodMs;
+	};
+
 	void reinitializeDevices();
+	void assignPeriodicPriorities();
+	int servicePorts(bool onlyPending);
 	std::unique_ptr<InputDevices> inputdevices_;
 	std::unique_ptr<LegoDevice> device1_;
 	std::unique_ptr<LegoDevice> device2_;
 	std::unique_ptr<LegoDevice> device3_;
 	std::unique_ptr<LegoDevice> device4_;
 	std::unique_ptr<IMU> imu_;
+	std::unique_ptr<BytecodeCache> bytecodeCache_;
+	std::unique_ptr<LuaScheduler> scheduler_;
+	std::unique_ptr<LuaHeap> luaHeap_;
 
 	lua_State* globalLuaState_;
 	lua_State* currentprogramstate_;
+	LuaBindingContext bindingContext_;
 
 	lua_State* newLuaState();
+	// Opens the libraries and globals of the bindings in a new state on the heap
+	lua_State* openLuaState(LuaHeap* heap);
+	// Closes the Lua state of the previous program and everything it left
+	// behind (globals, registry references, userdata) and creates a fresh one.
+	// No thread of the old state may run anymore.
+	void replaceLuaState();
 
 	std::vector<TaskHandle_t> runningThreads_;
+	std::vector<PeriodicThread> periodicThreads_;
 	SemaphoreHandle_t runningThreadsMutex_{nullptr};
+	// Thread tasks started and not yet exited, registered ones or not
+	std::atomic<int> threadTasks_{0};
+	// Guards replacing the Lua state against readers of its heap
+	SemaphoreHandle_t luaStateMutex_{nullptr};
+	LuaHeap::Stats luaBase_;
 	String deviceUid_;
+
+	TaskHandle_t portServiceTaskHandle_{nullptr};
+	volatile bool portInterruptEnabled_{false};
 };
 
 #endif // MEGAHUB_H
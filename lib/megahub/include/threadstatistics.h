@@ -0,0 +1,110 @@
+#ifndef THREADSTATISTICS_H
+#define THREADSTATISTICS_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// LatencyHistogram — log-linear histogram of durations in microseconds, in
+// the style of HDR histograms. Values below 16 µs get a bucket each; above,
+// every power of two is split into 8 buckets, so a bucket is at most 12.5%
+// wide. Memory is fixed at construction, values beyond ~134 s fall into the
+// last bucket.
+// ---------------------------------------------------------------------------
+class LatencyHistogram {
+  public:
+	static const int linearBuckets = 16;
+	static const int subBucketBits = 3;
+	static const int maxExponent = 26;
+	static const int bucketCount = linearBuckets + (maxExponent - 3) * (1 << subBucketBits);
+
+	LatencyHistogram();
+
+	void record(uint32_t micros);
+	void reset();
+
+	uint32_t count() const { return total_; }
+	// Highest value of the bucket holding the given quantile in 1/1000 (990 = p99),
+	// capped at the recorded maximum
+	uint32_t percentile(uint32_t perMille) const;
+
+	static int bucketOf(uint32_t micros);
+	static uint32_t bucketLowest(int bucket);
+	static uint32_t bucketHighest(int bucket);
+
+	// Non-empty buckets as a flat [lowest, count, lowest, count, ...] array
+	void serialize(JsonArray target) const;
+
+  private:
+	std::vector<uint32_t> counts_;
+	uint32_t total_;
+	uint32_t max_;
+};
+
+// ---------------------------------------------------------------------------
+// ThreadStatistics — iteration timing of one Lua thread. With profiling
+// enabled it is streamed to the IDE as a thread_statistics command.
+//
+// Periodic threads also count their releases: the jitter of the observed
+// period against the nominal one, and the deadlines missed because an
+// iteration ran into the next release. Releases skipped after such an
+// overrun count as missed deadlines only, not as jitter.
+//
+// With a collector budget, the time collecting after each iteration is
+// tracked as well; it is not part of the iteration duration.
+//
+// requestReset() clears the statistics of all threads. Each thread clears
+// its own with the next recorded iteration, so no locking is needed.
+// ---------------------------------------------------------------------------
+class ThreadStatistics {
+  public:
+	static const unsigned long reportIntervalMs = 10000;
+
+	ThreadStatistics();
+
+	static void requestReset();
+
+	// Marks the thread as periodic, the statistics then include the release counters
+	void setPeriod(unsigned long periodMicros);
+
+	void record(unsigned long durationMicros);
+	// Start of a periodic iteration, given the start of the previous one and
+	// the number of periods between them (1 plus the releases skipped)
+	void recordRelease(unsigned long startMicros, unsigned long previousStartMicros, unsigned long periods);
+	void recordMissedDeadlines(unsigned long count);
+	// Collector work done between two iterations, see GcPacer
+	void recordGc(unsigned long durationMicros);
+	// Queues a thread_statistics command once per report interval
+	void reportIfDue(const String& blockId, unsigned long nowMillis);
+	void log();
+
+  private:
+	static std::atomic<uint32_t> resetGeneration_;
+
+	void resetIfRequested();
+
+	uint32_t generation_;
+
+	unsigned long minDuration_;
+	unsigned long maxDuration_;
+	float avgDuration_;
+	bool firstIteration_;
+	unsigned long lastReport_;
+	LatencyHistogram histogram_;
+
+	unsigned long periodMicros_;
+	unsigned long releases_;
+	unsigned long missedDeadlines_;
+	unsigned long maxJitter_;
+	float avgJitter_;
+
+	unsigned long maxGc_;
+	float avgGc_;
+	bool gcRecorded_;
+};
+
+#endif // THREADSTATISTICS_H
@@ -0,0 +1,188 @@
+#include "bytecodecache.h"
+
+#include "logging.h"
+
+#include <cstring>
+
+namespace {
+
+const uint8_t imageMagic[] = {'L', 'B', 'C'};
+
+const uint64_t fnvOffsetBasis = 0xcbf29ce484222325ULL;
+const uint64_t fnvPrime = 0x100000001b3ULL;
+
+uint64_t fnv1a(uint64_t hash, const void* data, size_t length) {
+	const uint8_t* p = (const uint8_t*) data;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= p[i];
+		hash *= fnvPrime;
+	}
+	return hash;
+}
+
+void writeU8(std::vector<uint8_t>& out, uint8_t v) {
+	out.push_back(v);
+}
+
+void writeU32(std::vector<uint8_t>& out, uint32_t v) {
+	for (int i = 0; i < 4; i++) {
+		out.push_back((uint8_t) (v >> (i * 8)));
+	}
+}
+
+void writeU64(std::vector<uint8_t>& out, uint64_t v) {
+	for (int i = 0; i < 8; i++) {
+		out.push_back((uint8_t) (v >> (i * 8)));
+	}
+}
+
+int appendChunk(lua_State* L, const void* p, size_t size, void* ud) {
+	std::vector<uint8_t>* out = (std::vector<uint8_t>*) ud;
+	const uint8_t* bytes = (const uint8_t*) p;
+	out->insert(out->end(), bytes, bytes + size);
+	return 0;
+}
+
+} // namespace
+
+BytecodeCache::BytecodeCache(FS* fs, const char* directory, const char* firmwareRevision)
+    : fs_(fs), directory_(directory), firmwareRevision_(firmwareRevision) {
+	mutex_ = xSemaphoreCreateMutex();
+	memset(&stats_, 0, sizeof(stats_));
+}
+
+uint64_t BytecodeCache::keyOf(LuaSource& source) {
+	uint64_t hash = fnv1a(fnvOffsetBasis, firmwareRevision_.c_str(), firmwareRevision_.length());
+	source.rewind();
+	size_t size;
+	for (const char* piece = source.next(size); piece != nullptr; piece = source.next(size)) {
+		hash = fnv1a(hash, piece, size);
+	}
+	source.rewind();
+	return hash;
+}
+
+String BytecodeCache::pathOf(uint64_t key) {
+	char name[20];
+	snprintf(name, sizeof(name), "/%08lx%08lx", (unsigned long) (key >> 32), (unsigned long) (key & 0xFFFFFFFF));
+	return directory_ + name;
+}
+
+void BytecodeCache::writeHeader(std::vector<uint8_t>& out, uint64_t key, size_t length) {
+	out.insert(out.end(), imageMagic, imageMagic + sizeof(imageMagic));
+	writeU8(out, imageVersion);
+	writeU8(out, (uint8_t) firmwareRevision_.length());
+	out.insert(out.end(), firmwareRevision_.c_str(), firmwareRevision_.c_str() + firmwareRevision_.length());
+	writeU32(out, LUA_VERSION_NUM);
+	writeU32(out, (uint32_t) length);
+	writeU64(out, key);
+}
+
+bool BytecodeCache::load(lua_State* L, LuaSource& source) {
+	uint64_t key = keyOf(source);
+	String path = pathOf(key);
+
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	File file = fs_->open(path, FILE_READ);
+	if (!file) {
+		stats_.misses++;
+		xSemaphoreGive(mutex_);
+		return false;
+	}
+	std::vector<uint8_t> image(file.size());
+	size_t read = file.read(image.data(), image.size());
+	file.close();
+
+	std::vector<uint8_t> expected;
+	writeHeader(expected, key, source.length());
+	bool valid = read == image.size() && image.size() > expected.size() &&
+	             memcmp(image.data(), expected.data(), expected.size()) == 0;
+	if (valid) {
+		int status = luaL_loadbufferx(L, (const char*) image.data() + expected.size(), image.size() - expected.size(),
+		                              "=program", "b");
+		if (status != LUA_OK) {
+			WARN("Cached bytecode %s does not load: %s", path.c_str(), lua_tostring(L, -1));
+			lua_pop(L, 1);
+			valid = false;
+		}
+	}
+	if (valid) {
+		stats_.hits++;
+	} else {
+		WARN("Dropping stale or corrupt bytecode cache entry %s", path.c_str());
+		fs_->remove(path);
+		stats_.rejected++;
+		stats_.misses++;
+	}
+	xSemaphoreGive(mutex_);
+	return valid;
+}
+
+void BytecodeCache::store(lua_State* L, LuaSource& source) {
+	uint64_t key = keyOf(source);
+	String path = pathOf(key);
+
+	std::vector<uint8_t> image;
+	writeHeader(image, key, source.length());
+	// Debug info is kept, runtime errors still report line numbers
+	if (lua_dump(L, appendChunk, &image, 0) != 0) {
+		WARN("Cannot dump compiled program, not caching it");
+		return;
+	}
+
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	fs_->mkdir(directory_);
+	evictIfFull(path);
+	File file = fs_->open(path, FILE_WRITE, true);
+	if (!file) {
+		WARN("Cannot write bytecode cache entry %s", path.c_str());
+	} else {
+		size_t written = file.write(image.data(), image.size());
+		file.close();
+		if (written != image.size()) {
+			WARN("Short write to bytecode cache entry %s, removing it", path.c_str());
+			fs_->remove(path);
+		} else {
+			stats_.stores++;
+			INFO("Cached bytecode of program as %s (%d bytes)", path.c_str(), (int) image.size());
+		}
+	}
+	xSemaphoreGive(mutex_);
+}
+
+void BytecodeCache::evictIfFull(const String& keep) {
+	File dir = fs_->open(directory_);
+	if (!dir || !dir.isDirectory()) {
+		return;
+	}
+	int count = 0;
+	String victim;
+	File entry = dir.openNextFile();
+	while (entry) {
+		if (!entry.isDirectory()) {
+			String path = directory_ + "/" + String(entry.name());
+			if (path != keep) {
+				count++;
+				if (victim.length() == 0) {
+					victim = path;
+				}
+			}
+		}
+		entry.close();
+		entry = dir.openNextFile();
+	}
+	dir.close();
+
+	// FAT has no reliable timestamps without an RTC, so any other entry goes
+	if (count >= maxEntries && victim.length() > 0) {
+		INFO("Bytecode cache full, evicting %s", victim.c_str());
+		fs_->remove(victim);
+	}
+}
+
+BytecodeCacheStats BytecodeCache::stats() {
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	BytecodeCacheStats result = stats_;
+	xSemaphoreGive(mutex_);
+	return result;
+}
@@ -0,0 +1,136 @@
+#include "gcpacer.h"
+
+#include "logging.h"
+
+#include <Arduino.h>
+#include <algorithm>
+
+// Lua keeps the pause as a byte of pause / 4
+static const int maxPause = 1000;
+// Growth beyond the threshold after which a cycle is finished past the budget
+static const int maxBehindKb = 256;
+
+GcPacer::GcPacer()
+    : mutex_(nullptr), budgetMicros_(0), generational_(false), pause_(defaultPause), stepMul_(defaultStepMul),
+      inCycle_(false), thresholdKb_(0) {
+	mutex_ = xSemaphoreCreateMutex();
+	if (!mutex_) {
+		ESP_LOGE("GcPacer", "Failed to create mutex");
+		abort();
+	}
+}
+
+GcPacer* GcPacer::instance() {
+	static GcPacer instance;
+	return &instance;
+}
+
+void GcPacer::applyIncremental(lua_State* L) {
+	if (budgetMicros_ > 0) {
+		// The automatic collector stays on as a backstop for loops that never
+		// end an iteration, but only starts a cycle at twice the pause, where
+		// afterIteration() would finish one at once anyway
+		lua_gc(L, LUA_GCINC, std::min(pause_ * 2, maxPause), stepMul_, pacedStepSize);
+	} else {
+		lua_gc(L, LUA_GCINC, pause_, stepMul_, defaultStepSize);
+	}
+	lua_gc(L, LUA_GCRESTART);
+}
+
+void GcPacer::reset(lua_State* L) {
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	budgetMicros_ = 0;
+	generational_ = false;
+	pause_ = defaultPause;
+	stepMul_ = defaultStepMul;
+	inCycle_ = false;
+	applyIncremental(L);
+	xSemaphoreGive(mutex_);
+}
+
+void GcPacer::incremental(lua_State* L, int pause, int stepMul) {
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	generational_ = false;
+	if (pause > 0) {
+		pause_ = std::min(pause, maxPause);
+	}
+	if (stepMul > 0) {
+		stepMul_ = stepMul;
+	}
+	applyIncremental(L);
+	xSemaphoreGive(mutex_);
+	INFO("Lua collector incremental, pause %d%%, step multiplier %d%%", pause_, stepMul_);
+}
+
+void GcPacer::generational(lua_State* L, int minorMul, int majorMul) {
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	// Young collections are short already, and cannot be split into steps
+	budgetMicros_ = 0;
+	generational_ = true;
+	inCycle_ = false;
+	lua_gc(L, LUA_GCGEN, minorMul, majorMul);
+	lua_gc(L, LUA_GCRESTART);
+	xSemaphoreGive(mutex_);
+	INFO("Lua collector generational");
+}
+
+bool GcPacer::isGenerational() {
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	bool generational = generational_;
+	xSemaphoreGive(mutex_);
+	return generational;
+}
+
+void GcPacer::setBudget(lua_State* L, unsigned long budgetMicros) {
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	budgetMicros_ = budgetMicros;
+	inCycle_ = false;
+	thresholdKb_ = lua_gc(L, LUA_GCCOUNT) * pause_ / 100;
+	applyIncremental(L);
+	xSemaphoreGive(mutex_);
+	INFO("Lua collector paced with %lu µs between iterations", budgetMicros);
+}
+
+unsigned long GcPacer::afterIteration(lua_State* L) {
+	unsigned long budget = budgetMicros_.load();
+	if (budget == 0) {
+		return 0;
+	}
+	if (xSemaphoreTake(mutex_, 0) != pdTRUE) {
+		// Another thread is collecting
+		return 0;
+	}
+
+	unsigned long start = micros();
+	int countKb = lua_gc(L, LUA_GCCOUNT);
+	if (!inCycle_ && countKb >= thresholdKb_) {
+		inCycle_ = true;
+	}
+	if (inCycle_) {
+		// Backstop: at twice the threshold the iterations fell behind, the cycle
+		// is finished now regardless of the budget
+		int behindKb = std::min(thresholdKb_ * 2, thresholdKb_ + maxBehindKb);
+		bool behind = countKb >= behindKb;
+		do {
+			if (lua_gc(L, LUA_GCSTEP, 0)) {
+				// Cycle complete, the next one starts once the heap has grown by the pause
+				inCycle_ = false;
+				thresholdKb_ = lua_gc(L, LUA_GCCOUNT) * pause_ / 100;
+				break;
+			}
+		} while (behind || micros() - start < budget);
+		if (inCycle_) {
+			// The automatic collector would take the next step of the open cycle
+			// after a few allocations. A negative step credits it the growth up
+			// to the backstop instead, it only steps in if no iteration does.
+			int roomKb = behindKb - lua_gc(L, LUA_GCCOUNT);
+			if (roomKb > 0) {
+				lua_gc(L, LUA_GCSTEP, -roomKb);
+			}
+		}
+	}
+	unsigned long duration = micros() - start;
+
+	xSemaphoreGive(mutex_);
+	return duration;
+}
@@ -4,13 +4,13 @@
 #include <map>
 #include <string>
 
-extern Megahub* getMegaHubRef(lua_State* L);
-
-// PID controller state structure
+// PID controller state structure. Single precision like the Lua numbers, the
+// ESP32 FPU has no double support. Time is kept in raw millis() so dt stays
+// exact and survives the 49.7 day wraparound.
 struct PIDState {
-	double integral;
-	double prevError;
-	double prevTime;
+	float integral;
+	float prevError;
+	uint32_t prevTimeMs;
 };
 
 // Global state storage for PID controllers
@@ -42,8 +42,7 @@ static portMUX_TYPE drMux = portMUX_INITIALIZER_UNLOCKED;
  */
 int alg_init_pid(lua_State* luaState) {
 	std::string handle = "pid_" + std::to_string(pidHandleCounter++);
-	double now = millis() / 1000.0;
-	pidStates[handle] = PIDState{0.0, 0.0, now};
+	pidStates[handle] = PIDState{0.0f, 0.0f, (uint32_t) millis()};
 	lua_pushstring(luaState, handle.c_str());
 	return 1;
 }
@@ -69,15 +68,15 @@ int alg_init_pid(lua_State* luaState) {
 int alg_compute_pid(lua_State* luaState) {
 	// Get parameters from Lua stack
 	const char* handle = luaL_checkstring(luaState, 1);
-	double setpoint = luaL_checknumber(luaState, 2);
-	double pv = luaL_checknumber(luaState, 3);
-	double kp = luaL_checknumber(luaState, 4);
-	double ki = luaL_checknumber(luaState, 5);
-	double kd = luaL_checknumber(luaState, 6);
-	double outMin = luaL_checknumber(luaState, 7);
-	double outMax = luaL_checknumber(luaState, 8);
+	float setpoint = (float) luaL_checknumber(luaState, 2);
+	float pv = (float) luaL_checknumber(luaState, 3);
+	float kp = (float) luaL_checknumber(luaState, 4);
+	float ki = (float) luaL_checknumber(luaState, 5);
+	float kd = (float) luaL_checknumber(luaState, 6);
+	float outMin = (float) luaL_checknumber(luaState, 7);
+	float outMax = (float) luaL_checknumber(luaState, 8);
 
-	double now = millis() / 1000.0; // Convert to seconds
+	uint32_t now = millis();
 
 	// Check if state exists
 	auto it = pidStates.find(handle);
@@ -88,29 +87,30 @@ int alg_compute_pid(lua_State* luaState) {
 	}
 
 	PIDState& state = it->second;
-	double dt = now - state.prevTime;
+	// Unsigned difference, correct across the millis() wraparound
+	uint32_t elapsedMs = now - state.prevTimeMs;
 
-	// Prevent division by zero or negative dt
-	// Also skip first iteration (dt too small)
-	if (dt <= 0.001) { // 1ms minimum
-		DEBUG("PID controller '%s': dt too small (%.6f), returning 0", handle, dt);
+	// Prevent division by zero, also skip first iteration (dt too small)
+	if (elapsedMs <= 1) { // 1ms minimum
+		DEBUG("PID controller '%s': dt too small (%u ms), returning 0", handle, elapsedMs);
 		lua_pushnumber(luaState, 0.0);
 		return 1;
 	}
+	float dt = (float) elapsedMs / 1000.0f; // Convert to seconds
 
 	// Calculate error
-	double error = setpoint - pv;
+	float error = setpoint - pv;
 
 	// Proportional term
-	double pTerm = kp * error;
+	float pTerm = kp * error;
 
 	// Integral term with anti-windup
 	state.integral += error * dt;
 
 	// Anti-windup: prevent integral from growing when output is saturated
 	// Back-calculate integral limit based on current output
-	double preOutput = pTerm + ki * state.integral;
-	if (ki != 0.0) { // Avoid division by zero
+	float preOutput = pTerm + ki * state.integral;
+	if (ki != 0.0f) { // Avoid division by zero
 		if (preOutput > outMax) {
 			state.integral = (outMax - pTerm) / ki;
 		} else if (preOutput < outMin) {
@@ -118,14 +118,14 @@ int alg_compute_pid(lua_State* luaState) {
 		}
 	}
 
-	double iTerm = ki * state.integral;
+	float iTerm = ki * state.integral;
 
 	// Derivative term (derivative on measurement to avoid setpoint kick)
-	double derivative = (error - state.prevError) / dt;
-	double dTerm = kd * derivative;
+	float derivative = (error - state.prevError) / dt;
+	float dTerm = kd * derivative;
 
 	// Calculate total output
-	double output = pTerm + iTerm + dTerm;
+	float output = pTerm + iTerm + dTerm;
 
 	// Clamp output to range
 	if (output > outMax) {
@@ -136,7 +136,7 @@ int alg_compute_pid(lua_State* luaState) {
 
 	// Update state for next iteration
 	state.prevError = error;
-	state.prevTime = now;
+	state.prevTimeMs = now;
 
 	DEBUG("PID '%s': SP=%.2f PV=%.2f Err=%.2f P=%.2f I=%.2f D=%.2f Out=%.2f", handle, setpoint, pv, error, pTerm, iTerm,
 	      dTerm, output);
@@ -159,8 +159,7 @@ int alg_reset_pid(lua_State* luaState) {
 
 	auto it = pidStates.find(handle);
 	if (it != pidStates.end()) {
-		double now = millis() / 1000.0;
-		it->second = {0.0, 0.0, now};
+		it->second = {0.0f, 0.0f, (uint32_t) millis()};
 		DEBUG("PID controller '%s' reset", handle);
 	} else {
 		WARN("PID controller '%s' not found for reset", handle);
@@ -206,6 +205,20 @@ int alg_init_dr(lua_State* luaState) {
 	return 1;
 }
 
+// Encoder ticks as exact integers. A float holds ticks exactly only up to 2^24,
+// and luaL_checknumber would round larger counts before the delta is taken.
+static int32_t checkTicks(lua_State* luaState, int index) {
+	if (lua_isinteger(luaState, index)) {
+		return (int32_t) lua_tointeger(luaState, index);
+	}
+	return (int32_t) luaL_checknumber(luaState, index);
+}
+
+// Tick delta that stays correct when a counter wraps around
+static int32_t tickDelta(int32_t ticks, int32_t prevTicks) {
+	return (int32_t) ((uint32_t) ticks - (uint32_t) prevTicks);
+}
+
 /**
  * Dead Reckoning Update
  *
@@ -213,8 +226,8 @@ int alg_init_dr(lua_State* luaState) {
  */
 int alg_update_dr(lua_State* luaState) {
 	const char* handle = luaL_checkstring(luaState, 1);
-	float leftTicks = (float) luaL_checknumber(luaState, 2);
-	float rightTicks = (float) luaL_checknumber(luaState, 3);
+	int32_t leftTicks = checkTicks(luaState, 2);
+	int32_t rightTicks = checkTicks(luaState, 3);
 	float yawDeg = (float) luaL_checknumber(luaState, 4);
 	float wheelbase = (float) luaL_checknumber(luaState, 5);
 	float mPerTick = (float) luaL_checknumber(luaState, 6);
@@ -225,8 +238,8 @@ int alg_update_dr(lua_State* luaState) {
 	auto& state = drStates[handle];
 
 	if (!state.initialized) {
-		state.prevLeftTicks = (int32_t) leftTicks;
-		state.prevRightTicks = (int32_t) rightTicks;
+		state.prevLeftTicks = leftTicks;
+		state.prevRightTicks = rightTicks;
 		state.prevYawDeg = yawDeg;
 		state.x = state.y = state.heading = 0.0F;
 		state.initialized = true;
@@ -235,8 +248,8 @@ int alg_update_dr(lua_State* luaState) {
 	}
 
 	// 1. Wheel distances
-	float deltaLeft = (leftTicks - (float) state.prevLeftTicks) * mPerTick;
-	float deltaRight = (rightTicks - (float) state.prevRightTicks) * mPerTick;
+	float deltaLeft = (float) tickDelta(leftTicks, state.prevLeftTicks) * mPerTick;
+	float deltaRight = (float) tickDelta(rightTicks, state.prevRightTicks) * mPerTick;
 	float dCenter = (deltaLeft + deltaRight) / 2.0F;
 
 	// 2. Wheel-derived heading change
@@ -263,8 +276,8 @@ int alg_update_dr(lua_State* luaState) {
 	state.y += dCenter * sinf(state.heading);
 
 	// 7. Store for next call
-	state.prevLeftTicks = (int32_t) leftTicks;
-	state.prevRightTicks = (int32_t) rightTicks;
+	state.prevLeftTicks = leftTicks;
+	state.prevRightTicks = rightTicks;
 	state.prevYawDeg = yawDeg;
 
 	taskEXIT_CRITICAL(&drMux);
@@ -834,11 +847,11 @@ int alg_clear_all_kalman(lua_State* luaState) {
 // ---------- Map / Scale ----------
 
 int alg_map(lua_State* luaState) {
-	double value = luaL_checknumber(luaState, 1);
-	double inMin = luaL_checknumber(luaState, 2);
-	double inMax = luaL_checknumber(luaState, 3);
-	double outMin = luaL_checknumber(luaState, 4);
-	double outMax = luaL_checknumber(luaState, 5);
+	float value = (float) luaL_checknumber(luaState, 1);
+	float inMin = (float) luaL_checknumber(luaState, 2);
+	float inMax = (float) luaL_checknumber(luaState, 3);
+	float outMin = (float) luaL_checknumber(luaState, 4);
+	float outMax = (float) luaL_checknumber(luaState, 5);
 
 	if (inMax == inMin) {
 		WARN("alg.map: inMax == inMin (%.4f), returning outMin", inMin);
@@ -846,7 +859,7 @@ int alg_map(lua_State* luaState) {
 		return 1;
 	}
 
-	double result = outMin + (value - inMin) * (outMax - outMin) / (inMax - inMin);
+	float result = outMin + (value - inMin) * (outMax - outMin) / (inMax - inMin);
 	lua_pushnumber(luaState, result);
 	return 1;
 }
@@ -887,8 +900,8 @@ void alg_reset_all_states() {
  * Algorithm library registration
  * Exports the library as "alg" to Lua
  */
-int alg_library(lua_State* luaState) {
-	const luaL_Reg algfunctions[] = {
+const luaL_Reg* alg_library() {
+	static const luaL_Reg algfunctions[] = {
 	    {	       "initPID",             alg_init_pid},
 	    {        "computePID",          alg_compute_pid},
 	    {	      "resetPID",            alg_reset_pid},
@@ -917,6 +930,5 @@ int alg_library(lua_State* luaState) {
 	    {    "clearAllKalman",     alg_clear_all_kalman},
 	    {	            NULL,	                 NULL}
     };
-	luaL_newlib(luaState, algfunctions);
-	return 1;
+	return algfunctions;
 }
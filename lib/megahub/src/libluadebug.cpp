@@ -1,7 +1,5 @@
 #include "megahub.h"
 
-extern Megahub* getMegaHubRef(lua_State* L);
-
 int debug_freeheap(lua_State* luaState) {
 
 	long value = ESP.getFreeHeap();
@@ -12,11 +10,47 @@ int debug_freeheap(lua_State* luaState) {
 	return 1;
 }
 
-int debug_library(lua_State* luaState) {
-	const luaL_Reg hubfunctions[] = {
+int debug_luaheap(lua_State* luaState) {
+
+	// Snapshot first, building the table allocates from the heap itself. Every
+	// state has a heap of its own, an isolated thread sees its own one.
+	void* heap = nullptr;
+	lua_getallocf(luaState, &heap);
+	LuaHeap::Stats stats;
+	((LuaHeap*) heap)->stats(stats);
+
+	lua_createtable(luaState, 0, 8);
+	lua_pushinteger(luaState, stats.arenaSize);
+	lua_setfield(luaState, -2, "arena");
+	lua_pushinteger(luaState, stats.arenaUsed);
+	lua_setfield(luaState, -2, "arenaUsed");
+	lua_pushinteger(luaState, stats.spilledBytes);
+	lua_setfield(luaState, -2, "spilled");
+	lua_pushinteger(luaState, stats.spills);
+	lua_setfield(luaState, -2, "spills");
+	lua_pushinteger(luaState, stats.liveBytes);
+	lua_setfield(luaState, -2, "live");
+	lua_pushinteger(luaState, stats.peakBytes);
+	lua_setfield(luaState, -2, "peak");
+	lua_pushinteger(luaState, stats.liveBlocks);
+	lua_setfield(luaState, -2, "blocks");
+
+	// Live bytes per size class, keyed by the block size
+	lua_createtable(luaState, 0, LuaHeap::numClasses);
+	for (int i = 0; i < LuaHeap::numClasses; i++) {
+		lua_pushinteger(luaState, stats.classBytes[i]);
+		lua_rawseti(luaState, -2, LuaHeap::classSize(i));
+	}
+	lua_setfield(luaState, -2, "classes");
+
+	return 1;
+}
+
+const luaL_Reg* debug_library() {
+	static const luaL_Reg hubfunctions[] = {
 	    {"freeHeap", debug_freeheap},
+	    { "luaHeap",  debug_luaheap},
         {      NULL,           NULL}
     };
-	luaL_newlib(luaState, hubfunctions);
-	return 1;
+	return hubfunctions;
 }
@@ -2,10 +2,6 @@
 
 #include <FastLED.h>
 
-#define FASTLEDREF_NAME "FASTLEDREF"
-
-extern Megahub* getMegaHubRef(lua_State* L);
-
 int fastled_show(lua_State* luaState) {
 	DEBUG("FastLED show");
 
@@ -30,11 +26,7 @@ int fastled_set(lua_State* luaState) {
 	int g = lua_tointeger(luaState, 3);
 	int b = lua_tointeger(luaState, 4);
 
-	lua_getfield(luaState, LUA_REGISTRYINDEX, FASTLEDREF_NAME);
-	void** userdata = (void**) lua_touserdata(luaState, -1);
-	lua_pop(luaState, 1);
-
-	CRGB* leds = (CRGB*) (userdata ? *userdata : nullptr);
+	CRGB* leds = (CRGB*) getBindingContext(luaState)->leds;
 	if (leds != nullptr) {
 		leds[index] = CRGB(r, g, b);
 	} else {
@@ -53,12 +45,10 @@ int fastled_addleds(lua_State* luaState) {
 
 	if (type == NEOPIXEL_TYPE) {
 		// Free any existing LED array before re-allocating
-		lua_getfield(luaState, LUA_REGISTRYINDEX, FASTLEDREF_NAME);
-		void** existingUserdata = (void**) lua_touserdata(luaState, -1);
-		lua_pop(luaState, 1);
-		if (existingUserdata && *existingUserdata) {
-			delete[] static_cast<CRGB*>(*existingUserdata);
-			*existingUserdata = nullptr;
+		LuaBindingContext* context = getBindingContext(luaState);
+		if (context->leds != nullptr) {
+			delete[] static_cast<CRGB*>(context->leds);
+			context->leds = nullptr;
 		}
 
 		CRGB* leds = new CRGB[numleds];
@@ -93,9 +83,7 @@ int fastled_addleds(lua_State* luaState) {
 				return 0;
 		}
 
-		void** userdata = (void**) lua_newuserdata(luaState, sizeof(void*));
-		*userdata = leds;
-		lua_setfield(luaState, LUA_REGISTRYINDEX, FASTLEDREF_NAME);
+		context->leds = leds;
 
 	} else {
 		WARN("FastLED addleds called with unknown type %d", type);
@@ -105,14 +93,13 @@ int fastled_addleds(lua_State* luaState) {
 	return 0;
 }
 
-int fastled_library(lua_State* luaState) {
-	const luaL_Reg hubfunctions[] = {
+const luaL_Reg* fastled_library() {
+	static const luaL_Reg hubfunctions[] = {
 	    {   "show",    fastled_show},
 	    {  "clear",   fastled_clear},
 	    {"addleds", fastled_addleds},
 	    {    "set",     fastled_set},
 	    {     NULL,            NULL}
     };
-	luaL_newlib(luaState, hubfunctions);
-	return 1;
+	return hubfunctions;
 }
@@ -2,7 +2,8 @@
 #include "logging.h"
 #include "megahub.h"
 
-extern InputDevices* getInputDevicesRef(lua_State* L);
+#include <atomic>
+#include <new>
 
 int gamepad_value(lua_State* luaState) {
 
@@ -186,14 +187,109 @@ int gamepad_buttonraw(lua_State* luaState) {
 	return 1;
 }
 
-int gamepad_library(lua_State* luaState) {
-	const luaL_Reg hubfunctions[] = {
+static int gamepad_leftx(const GamepadState* state) {
+	return state->leftStickX;
+}
+
+static int gamepad_lefty(const GamepadState* state) {
+	return state->leftStickY;
+}
+
+static int gamepad_rightx(const GamepadState* state) {
+	return state->rightStickX;
+}
+
+static int gamepad_righty(const GamepadState* state) {
+	return state->rightStickY;
+}
+
+static int gamepad_dpad(const GamepadState* state) {
+	return state->dpad;
+}
+
+// State of a reader returned by gamepad.accessor(), the only upvalue of the closure.
+// The gamepad entry is looked up again only when a gamepad gets registered.
+struct GamepadAccessor {
+	InputDevices* inputDevices;
+	int (*getter)(const GamepadState*);
+	const GamepadState* state; // nullptr unless exactly one gamepad is known
+	std::atomic<uint32_t> generation;
+};
+
+static void gamepad_resolveaccessor(GamepadAccessor* accessor, uint32_t generation) {
+	accessor->state = accessor->inputDevices->singleGamepad();
+	accessor->generation.store(generation, std::memory_order_release);
+}
+
+static int gamepad_readaccessor(lua_State* luaState) {
+	GamepadAccessor* accessor = (GamepadAccessor*) lua_touserdata(luaState, lua_upvalueindex(1));
+
+	uint32_t generation = accessor->inputDevices->generation();
+	if (accessor->generation.load(std::memory_order_acquire) != generation) {
+		gamepad_resolveaccessor(accessor, generation);
+	}
+
+	const GamepadState* state = accessor->state;
+	if (state != nullptr && state->connected) {
+		lua_pushnumber(luaState, accessor->getter(state));
+		return 1;
+	}
+
+	// Number 0, like gamepad.value()
+	lua_pushnumber(luaState, 0);
+	return 1;
+}
+
+int gamepad_accessor(lua_State* luaState) {
+
+	int gamepadIndex = luaL_checkinteger(luaState, 1);
+	int value = luaL_checkinteger(luaState, 2);
+
+	if (gamepadIndex != GAMEPAD1) {
+		return luaL_argerror(luaState, 1, "unsupported gamepad");
+	}
+
+	int (*getter)(const GamepadState*) = nullptr;
+	switch (value) {
+		case GAMEPAD_LEFT_X:
+			getter = gamepad_leftx;
+			break;
+		case GAMEPAD_LEFT_Y:
+			getter = gamepad_lefty;
+			break;
+		case GAMEPAD_RIGHT_X:
+			getter = gamepad_rightx;
+			break;
+		case GAMEPAD_RIGHT_Y:
+			getter = gamepad_righty;
+			break;
+		case GAMEPAD_DPAD:
+			getter = gamepad_dpad;
+			break;
+		default:
+			return luaL_argerror(luaState, 2, "unsupported gamepad value");
+	}
+
+	InputDevices* inputDevices = getInputDevicesRef(luaState);
+
+	GamepadAccessor* accessor = (GamepadAccessor*) lua_newuserdatauv(luaState, sizeof(GamepadAccessor), 0);
+	new (accessor) GamepadAccessor();
+	accessor->inputDevices = inputDevices;
+	accessor->getter = getter;
+	gamepad_resolveaccessor(accessor, inputDevices->generation());
+
+	lua_pushcclosure(luaState, gamepad_readaccessor, 1);
+	return 1;
+}
+
+const luaL_Reg* gamepad_library() {
+	static const luaL_Reg hubfunctions[] = {
 	    {        "value",         gamepad_value},
 	    {    "connected",     gamepad_connected},
 	    {"buttonpressed", gamepad_buttonpressed},
 	    {   "buttonsraw",     gamepad_buttonraw},
+	    {     "accessor",      gamepad_accessor},
 	    {	       NULL,	              NULL}
     };
-	luaL_newlib(luaState, hubfunctions);
-	return 1;
+	return hubfunctions;
 }
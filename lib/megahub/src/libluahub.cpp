@@ -1,18 +1,37 @@
 #include "commands.h"
+#include "gcpacer.h"
+#include "lineprofiler.h"
+#include "luachannel.h"
+#include "luamessage.h"
+#include "luascheduler.h"
 #include "megahub.h"
+#include "threadstatistics.h"
 
 #include <ArduinoJson.h>
+#include <string>
+#include <vector>
+
+// Returned by hub.startthread(), either a FreeRTOS task or a scheduler coroutine
+struct HubThreadHandle {
+	TaskHandle_t task;
+	uint32_t coroutineId;
+};
 
 struct HubThreadParams {
 	lua_State* mainstate;
 	lua_State* threadstate;
 	int function_ref_index;
+	int thread_ref_index;
 	Megahub* hub;
 	String blockId;
 	bool profiling;
+	unsigned long periodMs;
+	LuaHeap* heap; // isolated threads only, the heap of their own state
 };
 
-extern Megahub* getMegaHubRef(lua_State* L);
+// hub.startperiodic() and hub.startisolated() have no stack size parameter, this is the Blockly default for threads
+#define PERIODIC_THREAD_STACK_SIZE 4096
+#define ISOLATED_THREAD_STACK_SIZE 4096
 
 void hub_thread_task(void* parameters) {
 	HubThreadParams* params = (HubThreadParams*) parameters;
@@ -21,16 +40,7 @@ void hub_thread_task(void* parameters) {
 	lua_State* threadState = params->threadstate;
 	INFO("Starting thread task");
 
-	// Statistics variables (in microseconds)
-	unsigned long minDuration = ULONG_MAX;
-	unsigned long maxDuration = 0;
-	double avgDuration = 0.0;
-	const double alpha = 0.01; // Smoothing factor for exponential moving average
-	bool firstIteration = true;
-
-	// Timer for periodic operations (every 10 seconds)
-	unsigned long lastPeriodicOp = millis();
-	const unsigned long periodicInterval = 10000; // 10 seconds in milliseconds
+	ThreadStatistics statistics;
 
 	bool exitedAbnormally = false;
 
@@ -63,62 +73,64 @@ void hub_thread_task(void* parameters) {
 		}
 
 		// Compute iteration duration and update statistics
-		unsigned long duration = micros() - start;
+		statistics.record(micros() - start);
 
-		if (duration < minDuration) {
-			minDuration = duration;
-		}
-		if (duration > maxDuration) {
-			maxDuration = duration;
-		}
-
-		// Exponential moving average (no counter needed, avoids overflow)
-		if (firstIteration) {
-			avgDuration = (double) duration;
-			firstIteration = false;
-		} else {
-			avgDuration = alpha * (double) duration + (1.0 - alpha) * avgDuration;
+		// Collector work between iterations, outside the measured duration. The
+		// pacer works on the program state, isolated ones collect on their own.
+		GcPacer* pacer = GcPacer::instance();
+		if (params->heap == nullptr && pacer->paced()) {
+			statistics.recordGc(pacer->afterIteration(threadState));
 		}
 
 		if (params->profiling) {
 			// Periodic operation every 10 seconds in case of profiling is enabled
-			unsigned long now = millis();
-			if (now - lastPeriodicOp >= periodicInterval) {
-				lastPeriodicOp = now;
-
-				JsonDocument doc;
-				doc["type"] = "thread_statistics";
-				doc["blockid"] = params->blockId;
-				doc["min"] = minDuration;
-				doc["max"] = maxDuration;
-				doc["avg"] = avgDuration;
-
-				String strCommand;
-				serializeJson(doc, strCommand);
-
-				// Enqueue command
-				Commands::instance()->queue(strCommand);
-			}
+			statistics.reportIfDue(params->blockId, millis());
 		}
 
 		// Give the scheduler some time - this could also be done by including a wait() call into the Lua script....
 		vTaskDelay(pdMS_TO_TICKS(1));
 	}
 
-	INFO("Thread stats - min: %lu µs, max: %lu µs, avg: %.2f µs", minDuration, maxDuration, avgDuration);
+	statistics.log();
 
-	lua_closethread(threadState, params->mainstate);
+	if (params->heap != nullptr) {
+		// Isolated thread, the state and its heap are its own
+		lua_close(threadState);
+		delete params->heap;
+	} else {
+		lua_closethread(threadState, params->mainstate);
+		luaL_unref(threadState, LUA_REGISTRYINDEX, params->function_ref_index);
+		luaL_unref(threadState, LUA_REGISTRYINDEX, params->thread_ref_index);
+	}
 	Megahub* hubRef = params->hub;
 	delete params;
 	INFO("Done with thread");
 	if (exitedAbnormally) {
-		hubRef->notifyThreadExitedAbnormally();
+		hubRef->notifyThreadExitedAbnormally(xTaskGetCurrentTaskHandle());
 	}
+	hubRef->threadTaskExited();
 	vTaskDelete(NULL);
 }
 
+// For a thread task that could not be created, nothing has run on its thread yet
+static void hub_release_params(lua_State* luaState, HubThreadParams* params) {
+	luaL_unref(luaState, LUA_REGISTRYINDEX, params->function_ref_index);
+	luaL_unref(luaState, LUA_REGISTRYINDEX, params->thread_ref_index);
+	delete params;
+}
+
+// Threads and the collector policy belong to the program, isolated threads
+// get the same libraries but may not use them
+static void checkProgramState(lua_State* luaState) {
+	if (!getMegaHubRef(luaState)->isProgramState(luaState)) {
+		luaL_error(luaState, "not available in isolated threads");
+	}
+}
+
 int hub_startthread(lua_State* luaState) {
 
+	checkProgramState(luaState);
+
 	String threadName = lua_tostring(luaState, 1);
 	String blockId = lua_tostring(luaState, 2);
 	int stackSize = lua_tointeger(luaState, 3);
@@ -128,28 +140,478 @@ int hub_startthread(lua_State* luaState) {
 
 	Megahub* hub = getMegaHubRef(luaState);
 
+	HubThreadHandle* udata = (HubThreadHandle*) lua_newuserdata(luaState, sizeof(HubThreadHandle));
+	udata->task = NULL;
+	udata->coroutineId = 0;
+
+	LuaScheduler* scheduler = hub->scheduler();
+	if (scheduler != nullptr) {
+		// Cooperative mode, the function becomes a coroutine of the scheduler task. The stack size is not needed.
+		INFO("Scheduling thread %s as coroutine", threadName.c_str());
+		lua_pushvalue(luaState, 5);
+		udata->coroutineId = scheduler->add(luaState, threadName, blockId, profiling);
+		return 1;
+	}
+
 	// Create new thread environment
 	HubThreadParams* params = new HubThreadParams();
 	params->mainstate = luaState;
+	lua_pushvalue(luaState, 5);
 	params->function_ref_index = luaL_ref(luaState, LUA_REGISTRYINDEX);
 	params->threadstate = lua_newthread(luaState);
+	// Anchored in the registry, the handle userdata is the return value
+	params->thread_ref_index = luaL_ref(luaState, LUA_REGISTRYINDEX);
 	params->hub = hub;
 	params->blockId = blockId;
 	params->profiling = profiling;
+	params->periodMs = 0;
+	params->heap = nullptr;
+	if (profiling) {
+		LineProfiler::instance()->attach(params->threadstate);
+	}
 
 	INFO("Starting thread %s with stack size %d", threadName.c_str(), stackSize);
 
 	TaskHandle_t taskHandle = NULL;
 
-	// Create the task
-	xTaskCreate(hub_thread_task, threadName.c_str(), stackSize, (void*) params, 1,
-	            &taskHandle // Store task handle for cancellation
-	);
+	// Create the task, the handle is kept for cancellation
+	if (xTaskCreate(hub_thread_task, threadName.c_str(), stackSize, (void*) params, LUA_THREAD_PRIORITY,
+	                &taskHandle) != pdPASS) {
+		hub_release_params(luaState, params);
+		return luaL_error(luaState, "cannot start thread %s", threadName.c_str());
+	}
+
+	hub->registerThread(taskHandle);
+
+	udata->task = taskHandle;
+	return 1;
+}
+
+void hub_periodic_task(void* parameters) {
+	HubThreadParams* params = (HubThreadParams*) parameters;
+
+	lua_State* threadState = params->threadstate;
+	INFO("Starting periodic thread task with period %lu ms", params->periodMs);
+
+	// Registered and unregistered by the task itself, so a task that ended early never stays in the list
+	params->hub->registerPeriodicThread(xTaskGetCurrentTaskHandle(), params->periodMs);
+
+	ThreadStatistics statistics;
+	statistics.setPeriod(params->periodMs * 1000);
+
+	const TickType_t period = pdMS_TO_TICKS(params->periodMs) > 0 ? pdMS_TO_TICKS(params->periodMs) : 1;
+	TickType_t lastWake = xTaskGetTickCount();
+	unsigned long previousStart = 0;
+	unsigned long periodsSincePrevious = 1;
+
+	bool exitedAbnormally = false;
+
+	while (true) {
+
+		// Check for cancelation
+		uint32_t notificationValue = 0;
+		if (xTaskNotifyWait(0, 0, &notificationValue, 0) == pdTRUE) {
+			if (notificationValue == 1) {
+				INFO("Periodic thread task will be canceled");
+				break;
+			}
+		}
+
+		unsigned long start = micros();
+		statistics.recordRelease(start, previousStart, periodsSincePrevious);
+		previousStart = start;
+		periodsSincePrevious = 1;
+
+		lua_rawgeti(threadState, LUA_REGISTRYINDEX, params->function_ref_index);
+		int result = lua_pcall(threadState, 0, 0, 0);
+
+		if (result != LUA_OK) {
+			const char* error_msg = lua_tostring(threadState, -1);
+			WARN("Error processing Lua function : %s", error_msg);
+			lua_pop(threadState, 1);
+			exitedAbnormally = true;
+			break;
+		}
+
+		statistics.record(micros() - start);
+
+		// Collector work before the next release, within the budget
+		GcPacer* pacer = GcPacer::instance();
+		if (pacer->paced()) {
+			statistics.recordGc(pacer->afterIteration(threadState));
+		}
+
+		if (params->profiling) {
+			statistics.reportIfDue(params->blockId, millis());
+		}
+
+		// The deadline is the next release. An iteration that ran past it skips
+		// the releases already over instead of running them back to back.
+		TickType_t elapsed = xTaskGetTickCount() - lastWake;
+		if (elapsed >= period) {
+			TickType_t missed = elapsed / period;
+			statistics.recordMissedDeadlines(missed);
+			lastWake += missed * period;
+			periodsSincePrevious += missed;
+		}
+		lastWake += period;
+
+		// Waits for the release on the notification, so a stop ends the wait
+		// at once instead of after up to a whole period. A channel wake also
+		// ends it, the loop then waits for the rest.
+		bool stopped = false;
+		while (!stopped) {
+			TickType_t remaining = lastWake - xTaskGetTickCount();
+			if ((int32_t) remaining <= 0) {
+				break;
+			}
+			uint32_t value = 0;
+			stopped = xTaskNotifyWait(0, 0, &value, remaining) == pdTRUE && value == 1;
+		}
+		if (stopped) {
+			INFO("Periodic thread task will be canceled");
+			break;
+		}
+	}
+
+	statistics.log();
+
+	lua_closethread(threadState, params->mainstate);
+	luaL_unref(threadState, LUA_REGISTRYINDEX, params->function_ref_index);
+	luaL_unref(threadState, LUA_REGISTRYINDEX, params->thread_ref_index);
+	Megahub* hubRef = params->hub;
+	delete params;
+	hubRef->unregisterPeriodicThread(xTaskGetCurrentTaskHandle());
+	INFO("Done with periodic thread");
+	if (exitedAbnormally) {
+		hubRef->notifyThreadExitedAbnormally(xTaskGetCurrentTaskHandle());
+	}
+	hubRef->threadTaskExited();
+	vTaskDelete(NULL);
+}
+
+int hub_startperiodic(lua_State* luaState) {
+
+	checkProgramState(luaState);
+
+	String threadName = luaL_checkstring(luaState, 1);
+	lua_Integer periodMs = luaL_checkinteger(luaState, 2);
+	luaL_checktype(luaState, 3, LUA_TFUNCTION);
+	String blockId = luaL_optstring(luaState, 4, threadName.c_str());
+	bool profiling = lua_toboolean(luaState, 5);
+
+	luaL_argcheck(luaState, periodMs > 0, 2, "period must be positive");
+
+	Megahub* hub = getMegaHubRef(luaState);
+
+	// Same handle as hub.startthread(). Periodic threads always get their own
+	// task, even with the scheduler, as only a preemptive task keeps the rate.
+	HubThreadHandle* udata = (HubThreadHandle*) lua_newuserdata(luaState, sizeof(HubThreadHandle));
+	udata->task = NULL;
+	udata->coroutineId = 0;
+
+	HubThreadParams* params = new HubThreadParams();
+	params->mainstate = luaState;
+	lua_pushvalue(luaState, 3);
+	params->function_ref_index = luaL_ref(luaState, LUA_REGISTRYINDEX);
+	params->threadstate = lua_newthread(luaState);
+	params->thread_ref_index = luaL_ref(luaState, LUA_REGISTRYINDEX);
+	params->hub = hub;
+	params->blockId = blockId;
+	params->profiling = profiling;
+	params->periodMs = (unsigned long) periodMs;
+	params->heap = nullptr;
+	if (profiling) {
+		LineProfiler::instance()->attach(params->threadstate);
+	}
+
+	INFO("Starting periodic thread %s with period %lu ms", threadName.c_str(), params->periodMs);
+
+	TaskHandle_t taskHandle = NULL;
+
+	// Starts at the lowest periodic priority, the task registers itself for the final one
+	if (xTaskCreate(hub_periodic_task, threadName.c_str(), PERIODIC_THREAD_STACK_SIZE, (void*) params,
+	                LUA_PERIODIC_PRIORITY_MIN, &taskHandle) != pdPASS) {
+		hub_release_params(luaState, params);
+		return luaL_error(luaState, "cannot start periodic thread %s", threadName.c_str());
+	}
+
+	hub->registerThread(taskHandle);
+
+	udata->task = taskHandle;
+	return 1;
+}
+
+// What hub.startisolated() takes from the program state into the new one.
+// Kept on the heap, a Lua error must not skip the destructors.
+struct IsolatedTransfer {
+	std::string name; // chunk name for error messages
+	std::string bytecode;
+	std::vector<LuaValueCopy> upvalues;
+	std::vector<bool> environment; // upvalue is the global table of the program
+};
+
+static int hub_dump_writer(lua_State* luaState, const void* data, size_t size, void* ud) {
+	((std::string*) ud)->append((const char*) data, size);
+	return 0;
+}
+
+// Returns nullptr or the upvalue that could not be copied, the message is left on the stack
+static const char* hub_collect_upvalues(lua_State* luaState, int function, IsolatedTransfer* transfer) {
+	for (int i = 1;; i++) {
+		const char* name = lua_getupvalue(luaState, function, i);
+		if (name == nullptr) {
+			return nullptr;
+		}
+		lua_pushglobaltable(luaState);
+		bool environment = lua_rawequal(luaState, -1, -2);
+		lua_pop(luaState, 1);
+		transfer->environment.push_back(environment);
+		transfer->upvalues.emplace_back();
+		bool function = lua_isfunction(luaState, -1);
+		const char* error = environment ? nullptr : transfer->upvalues.back().copyFrom(luaState, -1);
+		lua_pop(luaState, 1);
+		if (error != nullptr && function) {
+			// Also the readers of lego.accessor() and friends, Blockly declares them as locals of the program
+			lua_pushfstring(luaState,
+			                "upvalue '%s' is a function and cannot be copied, create functions and sensor readers "
+			                "inside the isolated function",
+			                name);
+			return lua_tostring(luaState, -1);
+		}
+		if (error != nullptr) {
+			lua_pushfstring(luaState, "upvalue '%s' cannot be copied, %s", name, error);
+			return lua_tostring(luaState, -1);
+		}
+	}
+}
+
+// Runs protected in the isolated state, a memory error there must not reach
+// its panic handler: loads the function, sets its upvalues and returns its
+// reference in the registry
+static int hub_setup_isolated(lua_State* isolated) {
+	IsolatedTransfer* transfer = (IsolatedTransfer*) lua_touserdata(isolated, 1);
+	if (luaL_loadbufferx(isolated, transfer->bytecode.data(), transfer->bytecode.size(), transfer->name.c_str(),
+	                     "b") != LUA_OK) {
+		return lua_error(isolated);
+	}
+	for (size_t i = 0; i < transfer->upvalues.size(); i++) {
+		if (transfer->environment[i]) {
+			lua_pushglobaltable(isolated);
+		} else {
+			transfer->upvalues[i].push(isolated);
+		}
+		lua_setupvalue(isolated, -2, (int) i + 1);
+	}
+	lua_pushinteger(isolated, luaL_ref(isolated, LUA_REGISTRYINDEX));
+	return 1;
+}
+
+int hub_startisolated(lua_State* luaState) {
+
+	checkProgramState(luaState);
+
+	String threadName = luaL_checkstring(luaState, 1);
+	lua_Integer core = luaL_checkinteger(luaState, 2);
+	luaL_checktype(luaState, 3, LUA_TFUNCTION);
+	String blockId = luaL_optstring(luaState, 4, threadName.c_str());
+	bool profiling = lua_toboolean(luaState, 5);
+
+	luaL_argcheck(luaState, core >= 0 && core < portNUM_PROCESSORS, 2, "no such core");
+	luaL_argcheck(luaState, !lua_iscfunction(luaState, 3), 3, "Lua function expected");
+
+	Megahub* hub = getMegaHubRef(luaState);
+
+	// The function goes over as bytecode with debug information, for error
+	// messages and the line profiler. Upvalues are copied once, the global
+	// table of the program becomes the one of the new state.
+	IsolatedTransfer* transfer = new IsolatedTransfer();
+	transfer->name = threadName.c_str();
+	lua_pushvalue(luaState, 3);
+	lua_dump(luaState, hub_dump_writer, &transfer->bytecode, 0);
+	lua_pop(luaState, 1);
+	const char* error = hub_collect_upvalues(luaState, 3, transfer);
+	if (error != nullptr) {
+		delete transfer;
+		return lua_error(luaState);
+	}
+
+	// Everything that may raise an error in the program state comes before
+	// the isolated state, an error after it would leak the state and its heap
+	HubThreadHandle* udata = (HubThreadHandle*) lua_newuserdata(luaState, sizeof(HubThreadHandle));
+	udata->task = NULL;
+	udata->coroutineId = 0;
+
+	LuaHeap* heap = nullptr;
+	lua_State* isolated = hub->newIsolatedState(heap);
+	if (isolated == nullptr) {
+		delete transfer;
+		return luaL_error(luaState, "not enough memory for an isolated state");
+	}
+	lua_pushcfunction(isolated, hub_setup_isolated);
+	lua_pushlightuserdata(isolated, transfer);
+	int status = lua_pcall(isolated, 1, 1, 0);
+	delete transfer;
+	if (status != LUA_OK) {
+		WARN("Cannot load isolated thread %s : %s", threadName.c_str(), lua_tostring(isolated, -1));
+		lua_close(isolated);
+		delete heap;
+		return luaL_error(luaState, "cannot load the function into an isolated state");
+	}
+	int functionRef = (int) lua_tointeger(isolated, -1);
+	lua_pop(isolated, 1);
+
+	// The thread runs on the main thread of its state, which closes with it
+	HubThreadParams* params = new HubThreadParams();
+	params->mainstate = isolated;
+	params->function_ref_index = functionRef;
+	params->threadstate = isolated;
+	params->thread_ref_index = LUA_NOREF;
+	params->hub = hub;
+	params->blockId = blockId;
+	params->profiling = profiling;
+	params->periodMs = 0;
+	params->heap = heap;
+	if (profiling) {
+		LineProfiler::instance()->attach(isolated);
+	}
+
+	INFO("Starting isolated thread %s on core %d", threadName.c_str(), (int) core);
+
+	TaskHandle_t taskHandle = NULL;
+	if (xTaskCreatePinnedToCore(hub_thread_task, threadName.c_str(), ISOLATED_THREAD_STACK_SIZE, (void*) params,
+	                            LUA_THREAD_PRIORITY, &taskHandle, (BaseType_t) core) != pdPASS) {
+		lua_close(isolated);
+		delete heap;
+		delete params;
+		return luaL_error(luaState, "cannot start isolated thread %s", threadName.c_str());
+	}
 
 	hub->registerThread(taskHandle);
 
-	TaskHandle_t* udata = (TaskHandle_t*) lua_newuserdata(luaState, sizeof(TaskHandle_t*));
-	*udata = taskHandle;
+	udata->task = taskHandle;
+	return 1;
+}
+
+// hub.channel() hands out integer handles, so isolated threads get them
+// copied like any other number. Channels are the only way between the
+// program and its isolated threads.
+int hub_channel(lua_State* luaState) {
+
+	static const char* const modes[] = {"queue", "latest", NULL};
+	lua_Integer capacity = luaL_checkinteger(luaState, 1);
+	int mode = luaL_checkoption(luaState, 2, "queue", modes);
+
+	luaL_argcheck(luaState, capacity >= 1 && capacity <= (lua_Integer) LuaChannel::maxCapacity, 1,
+	              "capacity must be 1 to 256");
+
+	int handle = LuaChannel::create((size_t) capacity, mode == 1);
+	if (handle == 0) {
+		return luaL_error(luaState, "no more than %d channels", LuaChannel::maxChannels);
+	}
+	lua_pushinteger(luaState, handle);
+	return 1;
+}
+
+static LuaChannel* checkChannel(lua_State* luaState, int arg) {
+	LuaChannel* channel = LuaChannel::get(luaL_checkinteger(luaState, arg));
+	luaL_argcheck(luaState, channel != nullptr, arg, "no such channel");
+	return channel;
+}
+
+int hub_push(lua_State* luaState) {
+
+	LuaChannel* channel = checkChannel(luaState, 1);
+	LuaChannel::Value value;
+	const char* error = LuaChannel::toValue(luaState, 2, value);
+	if (error != nullptr) {
+		return luaL_argerror(luaState, 2, error);
+	}
+
+	lua_pushboolean(luaState, channel->send(value));
+	return 1;
+}
+
+int hub_pop(lua_State* luaState) {
+
+	LuaChannel* channel = checkChannel(luaState, 1);
+	LuaChannel::Value value;
+	if (channel->tryReceive(value)) {
+		LuaChannel::push(luaState, value);
+	} else {
+		lua_pushnil(luaState);
+	}
+	return 1;
+}
+
+// A scheduler coroutine must not block the scheduler task. hub.recv() yields
+// instead and looks again each time it is resumed, until the deadline.
+static int hub_recv_continue(lua_State* luaState, int status, lua_KContext deadline);
+
+// Registers the coroutine with the channel and yields until a push wakes it,
+// the deadline passes or it is stopped. The id stays on the stack for the
+// continuation.
+static int hub_recv_suspend(lua_State* luaState, LuaChannel* channel, LuaScheduler* scheduler, uint32_t id,
+                            unsigned long deadline) {
+	channel->waitFor(scheduler, id);
+	LuaChannel::Value value;
+	if (channel->tryReceive(value)) {
+		channel->cancelWait(id);
+		LuaChannel::push(luaState, value);
+		return 1;
+	}
+	lua_settop(luaState, 2);
+	lua_pushinteger(luaState, id);
+	return lua_yieldk(luaState, 0, (lua_KContext) deadline, hub_recv_continue);
+}
+
+static int hub_recv_continue(lua_State* luaState, int status, lua_KContext deadline) {
+
+	LuaChannel* channel = checkChannel(luaState, 1);
+	channel->cancelWait((uint32_t) lua_tointeger(luaState, 3));
+
+	LuaChannel::Value value;
+	if (channel->tryReceive(value)) {
+		LuaChannel::push(luaState, value);
+		return 1;
+	}
+
+	// Woken without a value left, another receiver took it first
+	long remaining = (long) ((unsigned long) deadline - millis());
+	LuaScheduler* scheduler = getMegaHubRef(luaState)->scheduler();
+	uint32_t id = remaining > 0 ? scheduler->suspend(luaState, (unsigned long) remaining) : 0;
+	if (id != 0) {
+		return hub_recv_suspend(luaState, channel, scheduler, id, (unsigned long) deadline);
+	}
+	lua_pushnil(luaState);
+	return 1;
+}
+
+int hub_recv(lua_State* luaState) {
+
+	LuaChannel* channel = checkChannel(luaState, 1);
+	lua_Integer timeoutMs = luaL_checkinteger(luaState, 2);
+	luaL_argcheck(luaState, timeoutMs >= 0, 2, "timeout must not be negative");
+
+	LuaChannel::Value value;
+	if (channel->tryReceive(value)) {
+		LuaChannel::push(luaState, value);
+		return 1;
+	}
+
+	// Coroutines yield to the scheduler until a push makes them due again
+	LuaScheduler* scheduler = getMegaHubRef(luaState)->scheduler();
+	uint32_t id = timeoutMs > 0 && scheduler != nullptr ? scheduler->suspend(luaState, (unsigned long) timeoutMs) : 0;
+	if (id != 0) {
+		return hub_recv_suspend(luaState, channel, scheduler, id, millis() + (unsigned long) timeoutMs);
+	}
+
+	// Thread tasks block until a push notifies them
+	if (timeoutMs > 0 && channel->receive(value, pdMS_TO_TICKS(timeoutMs))) {
+		LuaChannel::push(luaState, value);
+	} else {
+		lua_pushnil(luaState);
+	}
 	return 1;
 }
 
@@ -157,12 +619,19 @@ int hub_stopthread(lua_State* luaState) {
 
 	INFO("Stopping thread");
 
-	TaskHandle_t* task_handle = (TaskHandle_t*) lua_touserdata(luaState, 1);
+	HubThreadHandle* handle = (HubThreadHandle*) lua_touserdata(luaState, 1);
 
-	if (*task_handle != NULL) {
-		Megahub* hub = getMegaHubRef(luaState);
-		hub->stopThread(*task_handle);
-		*task_handle = NULL;
+	if (handle == nullptr) {
+		return 0;
+	}
+	Megahub* hub = getMegaHubRef(luaState);
+	if (handle->task != NULL) {
+		hub->stopThread(handle->task);
+		handle->task = NULL;
+	}
+	if (handle->coroutineId != 0 && hub->scheduler() != nullptr) {
+		hub->scheduler()->stop(handle->coroutineId);
+		handle->coroutineId = 0;
 	}
 
 	return 0;
@@ -248,17 +717,56 @@ int hub_set_pin_mode(lua_State* luaState) {
 	return 0;
 }
 
-int hub_library(lua_State* luaState) {
-	const luaL_Reg hubfunctions[] = {
+int hub_gcmode(lua_State* luaState) {
+
+	checkProgramState(luaState);
+
+	static const char* const modes[] = {"incremental", "generational", NULL};
+	int mode = luaL_checkoption(luaState, 1, NULL, modes);
+	int first = luaL_optinteger(luaState, 2, 0);
+	int second = luaL_optinteger(luaState, 3, 0);
+
+	if (mode == 0) {
+		GcPacer::instance()->incremental(luaState, first, second);
+	} else {
+		GcPacer::instance()->generational(luaState, first, second);
+	}
+	return 0;
+}
+
+int hub_gcpace(lua_State* luaState) {
+
+	checkProgramState(luaState);
+
+	lua_Integer budgetMicros = luaL_checkinteger(luaState, 1);
+	luaL_argcheck(luaState, budgetMicros >= 0, 1, "budget must not be negative");
+
+	GcPacer* pacer = GcPacer::instance();
+	if (budgetMicros > 0 && pacer->isGenerational()) {
+		return luaL_error(luaState, "collector pacing needs the incremental mode");
+	}
+	pacer->setBudget(luaState, (unsigned long) budgetMicros);
+	return 0;
+}
+
+const luaL_Reg* hub_library() {
+	static const luaL_Reg hubfunctions[] = {
 	    {  "startthread",   hub_startthread},
+	    {"startperiodic", hub_startperiodic},
+	    {"startisolated", hub_startisolated},
 	    {   "stopthread",    hub_stopthread},
+	    {      "channel",       hub_channel},
+	    {         "push",          hub_push},
+	    {          "pop",           hub_pop},
+	    {         "recv",          hub_recv},
 	    {	     "init",          hub_init},
 	    {"setmotorspeed", hub_setmotorspeed},
 	    {      "pinMode",  hub_set_pin_mode},
 	    {  "digitalRead",   hub_digitalread},
 	    { "digitalWrite",  hub_digitalwrite},
+	    {       "gcmode",        hub_gcmode},
+	    {       "gcpace",        hub_gcpace},
 	    {	       NULL,              NULL}
     };
-	luaL_newlib(luaState, hubfunctions);
-	return 1;
+	return hubfunctions;
 }
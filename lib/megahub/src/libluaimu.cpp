@@ -1,7 +1,5 @@
 #include "megahub.h"
 
-extern Megahub* getMegaHubRef(lua_State* L);
-
 int imu_value(lua_State* luaState) {
 
 	int value = lua_tointeger(luaState, 1);
@@ -35,11 +33,60 @@ int imu_value(lua_State* luaState) {
 	return 1;
 }
 
-int imu_library(lua_State* luaState) {
-	const luaL_Reg hubfunctions[] = {
-	    {"value", imu_value},
-        {   NULL,      NULL}
-    };
-	luaL_newlib(luaState, hubfunctions);
+// Reader returned by imu.accessor(), the only upvalue of the closure. The IMU
+// is fixed on the board, so the getter never needs to be resolved again.
+struct ImuAccessor {
+	IMU* imu;
+	float (IMU::*getter)();
+};
+
+static int imu_readaccessor(lua_State* luaState) {
+	ImuAccessor* accessor = (ImuAccessor*) lua_touserdata(luaState, lua_upvalueindex(1));
+	lua_pushnumber(luaState, (accessor->imu->*accessor->getter)());
+	return 1;
+}
+
+int imu_accessor(lua_State* luaState) {
+
+	int value = luaL_checkinteger(luaState, 1);
+
+	float (IMU::*getter)() = nullptr;
+	switch (value) {
+		case YAW:
+			getter = &IMU::getYaw;
+			break;
+		case PITCH:
+			getter = &IMU::getPitch;
+			break;
+		case ROLL:
+			getter = &IMU::getRoll;
+			break;
+		case ACCELERATION_X:
+			getter = &IMU::getAccelerationX;
+			break;
+		case ACCELERATION_Y:
+			getter = &IMU::getAccelerationY;
+			break;
+		case ACCELERATION_Z:
+			getter = &IMU::getAccelerationZ;
+			break;
+		default:
+			return luaL_argerror(luaState, 1, "not supported IMU value");
+	}
+
+	ImuAccessor* accessor = (ImuAccessor*) lua_newuserdatauv(luaState, sizeof(ImuAccessor), 0);
+	accessor->imu = getMegaHubRef(luaState)->imu();
+	accessor->getter = getter;
+
+	lua_pushcclosure(luaState, imu_readaccessor, 1);
 	return 1;
 }
+
+const luaL_Reg* imu_library() {
+	static const luaL_Reg hubfunctions[] = {
+	    {   "value",    imu_value},
+	    {"accessor", imu_accessor},
+        {      NULL,         NULL}
+    };
+	return hubfunctions;
+}
@@ -1,6 +1,7 @@
 #include "megahub.h"
 
-extern Megahub* getMegaHubRef(lua_State* L);
+#include <atomic>
+#include <new>
 
 int lego_getdevicemode(lua_State* luaState) {
 
@@ -92,25 +93,234 @@ int lego_select_mode(lua_State* luaState) {
 
 	Megahub* megahub = getMegaHubRef(luaState);
 	LegoDevice* device = megahub->port(port);
-	if (device != nullptr) {
-		device->selectMode(mode);
+	if (device == nullptr) {
+		WARN("Could not get device for port %d", port);
+		lua_pushboolean(luaState, false);
+		return 1;
+	}
+
+	// Only queues the command; with a timeout, wait until the device streams the mode
+	uint32_t ticket = device->selectMode(mode);
+	if (lua_isnoneornil(luaState, 3)) {
+		lua_pushboolean(luaState, ticket != 0);
 	} else {
+		uint32_t timeoutMs = (uint32_t) luaL_checkinteger(luaState, 3);
+		lua_pushboolean(luaState, device->waitForCommand(ticket, timeoutMs, true));
+	}
+	return 1;
+}
+
+int lego_select_combi(lua_State* luaState) {
+
+	int port = luaL_checkinteger(luaState, 1);
+	luaL_checktype(luaState, 2, LUA_TTABLE);
+
+	int count = (int) lua_rawlen(luaState, 2);
+	if (count < 1 || count > 16) {
+		return luaL_argerror(luaState, 2, "expected a list of 1 to 16 mode indices");
+	}
+	int modes[16];
+	for (int i = 0; i < count; i++) {
+		lua_rawgeti(luaState, 2, i + 1);
+		modes[i] = (int) luaL_checkinteger(luaState, -1);
+		lua_pop(luaState, 1);
+	}
+
+	DEBUG("Setting port %d to combi mode with %d modes", port, count);
+
+	Megahub* megahub = getMegaHubRef(luaState);
+	LegoDevice* device = megahub->port(port);
+	if (device == nullptr) {
 		WARN("Could not get device for port %d", port);
+		lua_pushboolean(luaState, false);
+		return 1;
+	}
+
+	uint32_t ticket = device->selectCombi(modes, count);
+	if (lua_isnoneornil(luaState, 3)) {
+		lua_pushboolean(luaState, ticket != 0);
+	} else {
+		uint32_t timeoutMs = (uint32_t) luaL_checkinteger(luaState, 3);
+		lua_pushboolean(luaState, device->waitForCommand(ticket, timeoutMs, true));
+	}
+	return 1;
+}
+
+static Mode* lego_checkmode(lua_State* luaState, int port, int modeIndex) {
+	Megahub* megahub = getMegaHubRef(luaState);
+	LegoDevice* device = megahub->port(port);
+	if (device == nullptr) {
+		WARN("Could not get device for port %d", port);
+		return nullptr;
+	}
+	Mode* mode = device->getMode(modeIndex);
+	if (mode == nullptr) {
+		WARN("Could not get mode %d for port %d", modeIndex, port);
+	}
+	return mode;
+}
+
+int lego_recordsamples(lua_State* luaState) {
+
+	int port = luaL_checkinteger(luaState, 1);
+	int modeIndex = luaL_checkinteger(luaState, 2);
+	int capacity = luaL_optinteger(luaState, 3, SampleRing::defaultCapacity);
+
+	DEBUG("Recording samples of mode %d of port %d", modeIndex, port);
+
+	Mode* mode = lego_checkmode(luaState, port, modeIndex);
+	if (mode == nullptr) {
+		lua_pushinteger(luaState, 0);
+		lua_pushinteger(luaState, 0);
+		return 2;
+	}
+	SampleRing* ring = mode->enableSampleRing(capacity);
+	lua_pushinteger(luaState, ring->capacity());
+	// Start cursor: only samples recorded from now on
+	lua_pushinteger(luaState, ring->head());
+	return 2;
+}
+
+int lego_readsamples(lua_State* luaState) {
+
+	int port = luaL_checkinteger(luaState, 1);
+	int modeIndex = luaL_checkinteger(luaState, 2);
+	uint32_t cursor = (uint32_t) luaL_optinteger(luaState, 3, 0);
+
+	DEBUG("Reading samples of mode %d of port %d from %u", modeIndex, port, cursor);
+
+	lua_newtable(luaState);
+
+	uint32_t lost = 0;
+	Mode* mode = lego_checkmode(luaState, port, modeIndex);
+	SampleRing* ring = mode != nullptr ? mode->getSampleRing() : nullptr;
+	if (ring != nullptr) {
+		// Drain in batches to keep the copy buffer small on the Lua task stack
+		Sample batch[8];
+		int n = 0;
+		int copied;
+		do {
+			copied = ring->read(cursor, batch, 8, lost);
+			for (int i = 0; i < copied; i++) {
+				const Sample& sample = batch[i];
+				lua_createtable(luaState, sample.count, 1);
+				// An interval instead of the timestamp, micros() would not fit a 32 bit Lua integer
+				lua_pushinteger(luaState, sample.intervalMicros);
+				lua_setfield(luaState, -2, "dt");
+				for (int v = 0; v < sample.count; v++) {
+					if (sample.isFloat()) {
+						lua_pushnumber(luaState, sample.floatValue(v));
+					} else {
+						lua_pushinteger(luaState, sample.intValue(v));
+					}
+					lua_rawseti(luaState, -2, v + 1);
+				}
+				lua_rawseti(luaState, -2, ++n);
+			}
+		} while (copied == 8);
+	} else if (mode != nullptr) {
+		WARN("Mode %d of port %d is not recording samples, call lego.recordsamples() first", modeIndex, port);
+	}
+
+	lua_pushinteger(luaState, cursor);
+	lua_pushinteger(luaState, lost);
+	return 3;
+}
+
+// State of a reader returned by lego.accessor(), the only upvalue of the closure.
+// Closures may be called from several Lua tasks at once; the dataset pointer is
+// written before the generation it belongs to.
+struct LegoAccessor {
+	LegoDevice* device;
+	int port;
+	int modeIndex;
+	int datasetIndex;
+	Dataset* dataset; // nullptr while the device has no such dataset
+	std::atomic<uint32_t> generation;
+};
+
+static void lego_resolveaccessor(LegoAccessor* accessor, uint32_t generation) {
+	Dataset* dataset = nullptr;
+	// Before the handshake completes the modes are still being described, the
+	// completion starts a new generation anyway
+	if (accessor->device->isHandshakeComplete()) {
+		Mode* mode = accessor->device->getMode(accessor->modeIndex);
+		dataset = mode != nullptr ? mode->getDataset(accessor->datasetIndex) : nullptr;
+		if (dataset == nullptr) {
+			WARN("Could not get dataset %d for mode %d of port %d", accessor->datasetIndex, accessor->modeIndex,
+			     accessor->port);
+		}
+	}
+	accessor->dataset = dataset;
+	accessor->generation.store(generation, std::memory_order_release);
+}
+
+static int lego_readaccessor(lua_State* luaState) {
+	LegoAccessor* accessor = (LegoAccessor*) lua_touserdata(luaState, lua_upvalueindex(1));
+
+	// Unplugging or replacing the device starts a new generation
+	uint32_t generation = accessor->device->layoutGeneration();
+	if (accessor->generation.load(std::memory_order_acquire) != generation) {
+		lego_resolveaccessor(accessor, generation);
+	}
+
+	Dataset* dataset = accessor->dataset;
+	if (dataset != nullptr) {
+		switch (dataset->getType()) {
+			case Format::FormatType::DATAFLOAT:
+				lua_pushnumber(luaState, dataset->getDataAsFloat());
+				return 1;
+			case Format::FormatType::DATA8:
+			case Format::FormatType::DATA16:
+			case Format::FormatType::DATA32:
+				lua_pushnumber(luaState, dataset->getDataAsInt());
+				return 1;
+			default:
+				// No data frame received yet, like lego.getmodedataset()
+				break;
+		}
 	}
 
 	lua_pushinteger(luaState, 0);
 	return 1;
+}
+
+int lego_accessor(lua_State* luaState) {
+
+	int port = luaL_checkinteger(luaState, 1);
+	int modeIndex = luaL_checkinteger(luaState, 2);
+	int datasetIndex = luaL_checkinteger(luaState, 3);
+
+	DEBUG("Creating accessor for dataset %d of mode %d of port %d", datasetIndex, modeIndex, port);
 
-	return 0;
+	Megahub* megahub = getMegaHubRef(luaState);
+	LegoDevice* device = megahub->port(port);
+	if (device == nullptr) {
+		return luaL_argerror(luaState, 1, "unknown port");
+	}
+
+	LegoAccessor* accessor = (LegoAccessor*) lua_newuserdatauv(luaState, sizeof(LegoAccessor), 0);
+	new (accessor) LegoAccessor();
+	accessor->device = device;
+	accessor->port = port;
+	accessor->modeIndex = modeIndex;
+	accessor->datasetIndex = datasetIndex;
+	lego_resolveaccessor(accessor, device->layoutGeneration());
+
+	lua_pushcclosure(luaState, lego_readaccessor, 1);
+	return 1;
 }
 
-int lego_library(lua_State* luaState) {
-	const luaL_Reg hubfunctions[] = {
+const luaL_Reg* lego_library() {
+	static const luaL_Reg hubfunctions[] = {
 	    { "getdevicemode",  lego_getdevicemode},
 	    {"getmodedataset", lego_getmodedataset},
+	    {      "accessor",       lego_accessor},
 	    {    "selectmode",    lego_select_mode},
+	    {   "selectcombi",   lego_select_combi},
+	    { "recordsamples",  lego_recordsamples},
+	    {   "readsamples",    lego_readsamples},
 	    {	        NULL,	            NULL}
     };
-	luaL_newlib(luaState, hubfunctions);
-	return 1;
+	return hubfunctions;
 }
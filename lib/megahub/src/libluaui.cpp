@@ -3,8 +3,7 @@
 
 #include <ArduinoJson.h>
 #include <array>
-
-extern Megahub* getMegaHubRef(lua_State* L);
+#include <cmath>
 
 // Map pose ring buffer for BLE throttling
 struct MapPose {
@@ -35,9 +34,19 @@ int ui_show_value(lua_State* luaState) {
 	if (lua_isboolean(luaState, 3)) {
 		bool boolvalue = lua_toboolean(luaState, 3);
 		doc["value"] = boolvalue;
+	} else if (lua_isinteger(luaState, 3)) {
+		doc["value"] = lua_tointeger(luaState, 3);
 	} else if (lua_isnumber(luaState, 3)) {
-		double numvalue = lua_tonumber(luaState, 3);
-		doc["value"] = numvalue;
+		lua_Number numvalue = lua_tonumber(luaState, 3);
+		if (std::isfinite(numvalue)) {
+			// Significant digits of lua_Number only, widening a float to double
+			// would serialize 0.1 as 0.10000000149011612
+			char buffer[32];
+			lua_number2str(buffer, sizeof(buffer), numvalue);
+			doc["value"] = serialized(String(buffer));
+		} else {
+			doc["value"] = numvalue;
+		}
 	} else if (lua_isstring(luaState, 3)) {
 		const char* strvalue = lua_tostring(luaState, 3);
 		doc["value"] = strvalue;
@@ -114,13 +123,12 @@ int ui_map_clear(lua_State* luaState) {
 	return 0;
 }
 
-int ui_library(lua_State* luaState) {
-	const luaL_Reg hubfunctions[] = {
+const luaL_Reg* ui_library() {
+	static const luaL_Reg hubfunctions[] = {
 	    {"showvalue", ui_show_value},
         { "mappoint",  ui_map_point},
         { "mapclear",  ui_map_clear},
         {       NULL,          NULL}
     };
-	luaL_newlib(luaState, hubfunctions);
-	return 1;
+	return hubfunctions;
 }
@@ -0,0 +1,151 @@
+#include "lineprofiler.h"
+
+#include "commands.h"
+#include "logging.h"
+
+#include <ArduinoJson.h>
+#include <algorithm>
+#include <cstring>
+
+static void line_profiler_hook(lua_State* L, lua_Debug* ar) {
+	if (ar->event != LUA_HOOKCOUNT) {
+		return;
+	}
+	if (!lua_getinfo(L, "Sl", ar) || ar->currentline <= 0) {
+		return;
+	}
+	LineProfiler* profiler = LineProfiler::instance();
+	profiler->record(ar->source, ar->short_src, ar->currentline, ar->linedefined);
+	profiler->reportIfDue(millis());
+}
+
+LineProfiler::LineProfiler() : mutex_(nullptr), sampleInstructions_(0), totalSamples_(0), droppedSamples_(0) {
+	mutex_ = xSemaphoreCreateMutex();
+	if (!mutex_) {
+		ESP_LOGE("LineProfiler", "Failed to create mutex");
+		abort();
+	}
+	memset(entries_, 0, sizeof(entries_));
+	lastReport_ = millis();
+}
+
+LineProfiler* LineProfiler::instance() {
+	static LineProfiler instance;
+	return &instance;
+}
+
+void LineProfiler::enable(int sampleInstructions) {
+	INFO("Sampling profiled Lua threads every %d instructions", sampleInstructions);
+	sampleInstructions_ = sampleInstructions;
+}
+
+void LineProfiler::attach(lua_State* thread) {
+	if (!enabled()) {
+		return;
+	}
+	lua_sethook(thread, line_profiler_hook, LUA_MASKCOUNT, sampleInstructions_);
+}
+
+void LineProfiler::reset() {
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	memset(entries_, 0, sizeof(entries_));
+	totalSamples_ = 0;
+	droppedSamples_ = 0;
+	lastReport_ = millis();
+	xSemaphoreGive(mutex_);
+}
+
+void LineProfiler::record(const char* source, const char* chunk, int line, int function) {
+	if (xSemaphoreTake(mutex_, 0) != pdTRUE) {
+		// Another hook holds the table, never block the Lua thread for a sample
+		droppedSamples_++;
+		return;
+	}
+
+	// Open addressing, the source pointer is stable as long as the program runs
+	uint32_t hash = ((uint32_t) (uintptr_t) source >> 2) * 31u + (uint32_t) line;
+	for (int probe = 0; probe < tableSize; probe++) {
+		Entry& entry = entries_[(hash + probe) % tableSize];
+		if (entry.source == source && entry.line == line) {
+			entry.samples++;
+			totalSamples_++;
+			xSemaphoreGive(mutex_);
+			return;
+		}
+		if (entry.source == nullptr) {
+			entry.source = source;
+			strlcpy(entry.chunk, chunk, sizeof(entry.chunk));
+			entry.line = line;
+			entry.function = function;
+			entry.samples = 1;
+			totalSamples_++;
+			xSemaphoreGive(mutex_);
+			return;
+		}
+	}
+
+	// Table full, the line cannot be tracked
+	droppedSamples_++;
+	xSemaphoreGive(mutex_);
+}
+
+void LineProfiler::reportIfDue(unsigned long nowMillis) {
+	if (nowMillis - lastReport_ < reportIntervalMs) {
+		return;
+	}
+	if (xSemaphoreTake(mutex_, 0) != pdTRUE) {
+		// Reported by the next sample
+		return;
+	}
+	lastReport_ = nowMillis;
+
+	Entry hottest[reportedLines];
+	int count = 0;
+	for (int i = 0; i < tableSize; i++) {
+		const Entry& entry = entries_[i];
+		if (entry.source == nullptr) {
+			continue;
+		}
+		// Insertion into the short list of the hottest lines so far
+		int position = count < reportedLines ? count++ : reportedLines;
+		while (position > 0 && hottest[position - 1].samples < entry.samples) {
+			if (position < reportedLines) {
+				hottest[position] = hottest[position - 1];
+			}
+			position--;
+		}
+		if (position < reportedLines) {
+			hottest[position] = entry;
+		}
+	}
+	uint32_t totalSamples = totalSamples_;
+	uint32_t droppedSamples = droppedSamples_.load();
+	xSemaphoreGive(mutex_);
+
+	if (totalSamples == 0) {
+		return;
+	}
+
+	JsonDocument doc;
+	doc["type"] = "line_profile";
+	doc["samples"] = totalSamples;
+	doc["dropped"] = droppedSamples;
+	JsonArray lines = doc["lines"].to<JsonArray>();
+	for (int i = 0; i < count; i++) {
+		JsonObject line = lines.add<JsonObject>();
+		line["src"] = hottest[i].chunk;
+		line["line"] = hottest[i].line;
+		line["fn"] = hottest[i].function;
+		line["n"] = hottest[i].samples;
+	}
+	// Long chunk names may not fit, the coldest lines are left out first
+	while (lines.size() > 0 && measureJson(doc) >= COMMAND_MESSAGE_SIZE) {
+		lines.remove(lines.size() - 1);
+	}
+
+	String strCommand;
+	serializeJson(doc, strCommand);
+
+	// Enqueue command
+	Commands::instance()->queue(strCommand);
+}
@@ -0,0 +1,244 @@
+#include "luachannel.h"
+
+#include "logging.h"
+#include "luascheduler.h"
+
+#include <cstring>
+
+std::atomic<LuaChannel*> LuaChannel::channels_[LuaChannel::maxChannels];
+
+LuaChannel::LuaChannel(size_t capacity, bool latest)
+    : slots_(nullptr), mask_(0), latest_(latest), pushPos_(0), popPos_(0), receiver_(nullptr), scheduler_(nullptr),
+      waitingCoroutine_(0), dropped_(0) {
+	uint32_t size = 1;
+	while (size < capacity) {
+		size <<= 1;
+	}
+	slots_ = new Slot[size];
+	for (uint32_t i = 0; i < size; i++) {
+		slots_[i].sequence.store(2 * i, std::memory_order_relaxed);
+	}
+	mask_ = size - 1;
+}
+
+LuaChannel::~LuaChannel() {
+	delete[] slots_;
+}
+
+int LuaChannel::create(size_t capacity, bool latest) {
+	LuaChannel* channel = new LuaChannel(capacity, latest);
+	for (int i = 0; i < maxChannels; i++) {
+		LuaChannel* expected = nullptr;
+		if (channels_[i].compare_exchange_strong(expected, channel)) {
+			INFO("Created channel %d with %d slots%s", i + 1, (int) channel->mask_ + 1, latest ? ", latest mode" : "");
+			return i + 1;
+		}
+	}
+	delete channel;
+	return 0;
+}
+
+LuaChannel* LuaChannel::get(lua_Integer handle) {
+	if (handle < 1 || handle > maxChannels) {
+		return nullptr;
+	}
+	return channels_[handle - 1].load(std::memory_order_acquire);
+}
+
+void LuaChannel::resetAll() {
+	for (int i = 0; i < maxChannels; i++) {
+		LuaChannel* channel = channels_[i].exchange(nullptr);
+		if (channel != nullptr) {
+			if (channel->dropped() > 0) {
+				INFO("Channel %d dropped %u values", i + 1, (unsigned) channel->dropped());
+			}
+			delete channel;
+		}
+	}
+}
+
+void LuaChannel::abandonAll() {
+	int abandoned = 0;
+	for (int i = 0; i < maxChannels; i++) {
+		if (channels_[i].exchange(nullptr) != nullptr) {
+			abandoned++;
+		}
+	}
+	if (abandoned > 0) {
+		WARN("Abandoned %d channels still in use by running threads", abandoned);
+	}
+}
+
+const char* LuaChannel::toValue(lua_State* L, int index, Value& value) {
+	switch (lua_type(L, index)) {
+		case LUA_TNUMBER:
+			value.type = LUA_TNUMBER;
+			value.isInteger = lua_isinteger(L, index);
+			if (value.isInteger) {
+				value.integer = lua_tointeger(L, index);
+			} else {
+				value.number = lua_tonumber(L, index);
+			}
+			return nullptr;
+		case LUA_TBOOLEAN:
+			value.type = LUA_TBOOLEAN;
+			value.boolean = lua_toboolean(L, index);
+			return nullptr;
+		case LUA_TSTRING: {
+			size_t length = 0;
+			const char* data = lua_tolstring(L, index, &length);
+			if (length > maxStringLength) {
+				return "string longer than 31 bytes";
+			}
+			value.type = LUA_TSTRING;
+			value.length = (uint8_t) length;
+			memcpy(value.string, data, length);
+			return nullptr;
+		}
+		default:
+			return "only numbers, booleans and short strings can be sent";
+	}
+}
+
+void LuaChannel::push(lua_State* L, const Value& value) {
+	switch (value.type) {
+		case LUA_TNUMBER:
+			if (value.isInteger) {
+				lua_pushinteger(L, value.integer);
+			} else {
+				lua_pushnumber(L, value.number);
+			}
+			break;
+		case LUA_TBOOLEAN:
+			lua_pushboolean(L, value.boolean);
+			break;
+		default:
+			lua_pushlstring(L, value.string, value.length);
+			break;
+	}
+}
+
+bool LuaChannel::tryPush(const Value& value) {
+	uint32_t pos = pushPos_.load(std::memory_order_relaxed);
+	Slot* slot;
+	while (true) {
+		slot = &slots_[pos & mask_];
+		uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+		int32_t diff = (int32_t) (sequence - 2 * pos);
+		if (diff == 0) {
+			// Free for this position, claim it
+			if (pushPos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			// Still holds the value of the previous round
+			return false;
+		} else {
+			// Another task claimed it first
+			pos = pushPos_.load(std::memory_order_relaxed);
+		}
+	}
+	slot->value = value;
+	slot->sequence.store(2 * pos + 1, std::memory_order_release);
+	return true;
+}
+
+bool LuaChannel::tryReceive(Value& value) {
+	uint32_t pos = popPos_.load(std::memory_order_relaxed);
+	Slot* slot;
+	while (true) {
+		slot = &slots_[pos & mask_];
+		uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+		int32_t diff = (int32_t) (sequence - (2 * pos + 1));
+		if (diff == 0) {
+			if (popPos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			// Not filled yet
+			return false;
+		} else {
+			pos = popPos_.load(std::memory_order_relaxed);
+		}
+	}
+	value = slot->value;
+	// Free for the push one round later
+	slot->sequence.store(2 * (pos + mask_ + 1), std::memory_order_release);
+	return true;
+}
+
+bool LuaChannel::send(const Value& value) {
+	while (!tryPush(value)) {
+		if (!latest_) {
+			return false;
+		}
+		Value oldest;
+		if (tryReceive(oldest)) {
+			dropped_++;
+		}
+	}
+	wakeReceiver();
+	return true;
+}
+
+void LuaChannel::wakeReceiver() {
+	// Pairs with the fence in receive(): either the receiver sees the value,
+	// or this sees the receiver
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (receiver_.load(std::memory_order_relaxed) != nullptr) {
+		TaskHandle_t receiver = receiver_.exchange(nullptr);
+		if (receiver != nullptr) {
+			// Never replaces a pending stop
+			xTaskNotify(receiver, wakeValue, eSetValueWithoutOverwrite);
+		}
+	}
+	if (waitingCoroutine_.load(std::memory_order_relaxed) != 0) {
+		uint32_t coroutineId = waitingCoroutine_.exchange(0);
+		if (coroutineId != 0) {
+			scheduler_.load(std::memory_order_relaxed)->wake(coroutineId);
+		}
+	}
+}
+
+void LuaChannel::waitFor(LuaScheduler* scheduler, uint32_t coroutineId) {
+	scheduler_.store(scheduler, std::memory_order_relaxed);
+	waitingCoroutine_.store(coroutineId, std::memory_order_release);
+	// Pairs with the fence in wakeReceiver(), as in receive()
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void LuaChannel::cancelWait(uint32_t coroutineId) {
+	uint32_t expected = coroutineId;
+	waitingCoroutine_.compare_exchange_strong(expected, 0);
+}
+
+bool LuaChannel::receive(Value& value, TickType_t timeout) {
+	if (tryReceive(value)) {
+		return true;
+	}
+
+	TaskHandle_t self = xTaskGetCurrentTaskHandle();
+	TickType_t start = xTaskGetTickCount();
+	bool received = false;
+	while (true) {
+		// Registered before looking again, a push in between notifies
+		receiver_.store(self, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (tryReceive(value)) {
+			received = true;
+			break;
+		}
+		TickType_t elapsed = xTaskGetTickCount() - start;
+		if (elapsed >= timeout) {
+			break;
+		}
+		if (ulTaskNotifyTake(pdTRUE, timeout - elapsed) == 1) {
+			// Stopped, set again for the thread loop, which only stops once it sees it
+			xTaskNotify(self, 1, eSetValueWithOverwrite);
+			break;
+		}
+	}
+	TaskHandle_t expected = self;
+	receiver_.compare_exchange_strong(expected, nullptr);
+	return received;
+}
@@ -0,0 +1,241 @@
+#include "luaheap.h"
+
+#include "logging.h"
+
+#include <algorithm>
+#include <cstring>
+#include <esp_heap_caps.h>
+
+static const size_t classSizes[LuaHeap::numClasses] = {16, 24, 32, 40, 48, 64, 96, 128};
+
+// Size class by size in 8 byte steps, 0..128 bytes
+static const uint8_t classBySteps[] = {0, 0, 0, 1, 2, 3, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7};
+
+// Pseudo class of the blocks outside the arena
+static const int spilled = -1;
+
+LuaHeap::LuaHeap(size_t arenaSize, uint32_t spillCaps)
+    : arena_(nullptr), arenaEnd_(nullptr), arenaSize_(0), arenaUsed_(0), spillCaps_(spillCaps), spilledBytes_(0),
+      liveBytes_(0), peakBytes_(0), liveBlocks_(0), spills_(0) {
+	mux_ = portMUX_INITIALIZER_UNLOCKED;
+	stateLock_ = xSemaphoreCreateMutex();
+	if (!stateLock_) {
+		ESP_LOGE("LuaHeap", "Failed to create state lock");
+		abort();
+	}
+	for (int i = 0; i < numClasses; i++) {
+		freeLists_[i] = nullptr;
+		slabCursor_[i] = nullptr;
+		slabEnd_[i] = nullptr;
+		classBytes_[i] = 0;
+	}
+	for (int i = 0; i < LUA_NUMTYPES; i++) {
+		objects_[i] = 0;
+	}
+
+	arena_ = (uint8_t*) heap_caps_malloc(arenaSize, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+	if (arena_ == nullptr) {
+		WARN("Could not reserve %d bytes of internal RAM for the Lua heap, all blocks spill", (int) arenaSize);
+		return;
+	}
+	arenaEnd_ = arena_ + arenaSize;
+	arenaSize_ = arenaSize;
+	INFO("Lua heap with %d bytes of internal RAM for blocks up to %d bytes", (int) arenaSize, (int) maxPooledSize);
+}
+
+LuaHeap::~LuaHeap() {
+	heap_caps_free(arena_);
+	vSemaphoreDelete(stateLock_);
+}
+
+void LuaHeap::lock(void* ud) {
+	if (ud != nullptr) {
+		xSemaphoreTake(((LuaHeap*) ud)->stateLock_, portMAX_DELAY);
+	}
+}
+
+void LuaHeap::unlock(void* ud) {
+	if (ud != nullptr) {
+		xSemaphoreGive(((LuaHeap*) ud)->stateLock_);
+	}
+}
+
+// Called by the Lua core, see luaconf.h
+extern "C" void luaheap_lock(void* ud) {
+	LuaHeap::lock(ud);
+}
+
+extern "C" void luaheap_unlock(void* ud) {
+	LuaHeap::unlock(ud);
+}
+
+size_t LuaHeap::classSize(int sizeClass) {
+	return classSizes[sizeClass];
+}
+
+int LuaHeap::sizeClassOf(size_t size) {
+	return classBySteps[(size + 7) >> 3];
+}
+
+void* LuaHeap::allocate(void* ud, void* ptr, size_t osize, size_t nsize) {
+	LuaHeap* heap = (LuaHeap*) ud;
+	if (ptr == nullptr) {
+		// osize is the type of the new object here, not a size
+		return nsize == 0 ? nullptr : heap->allocateBlock(nsize, (int) osize);
+	}
+	if (nsize == 0) {
+		heap->freeBlock(ptr, osize);
+		return nullptr;
+	}
+	return heap->reallocateBlock(ptr, osize, nsize);
+}
+
+void* LuaHeap::takeBlock(int sizeClass) {
+	void* block = freeLists_[sizeClass];
+	if (block != nullptr) {
+		freeLists_[sizeClass] = *(void**) block;
+		return block;
+	}
+
+	size_t size = classSizes[sizeClass];
+	if (slabCursor_[sizeClass] == nullptr || slabCursor_[sizeClass] + size > slabEnd_[sizeClass]) {
+		if (arenaUsed_ + slabSize > arenaSize_) {
+			return nullptr;
+		}
+		slabCursor_[sizeClass] = arena_ + arenaUsed_;
+		slabEnd_[sizeClass] = slabCursor_[sizeClass] + slabSize;
+		arenaUsed_ += slabSize;
+	}
+	block = slabCursor_[sizeClass];
+	slabCursor_[sizeClass] += size;
+	return block;
+}
+
+void LuaHeap::account(int sizeClass, size_t removed, size_t added) {
+	if (sizeClass >= 0) {
+		classBytes_[sizeClass] = classBytes_[sizeClass] - removed + added;
+	} else {
+		spilledBytes_ = spilledBytes_ - removed + added;
+	}
+	liveBytes_ = liveBytes_ - removed + added;
+	if (liveBytes_ > peakBytes_) {
+		peakBytes_ = liveBytes_;
+	}
+}
+
+void LuaHeap::countBlock(int tag) {
+	liveBlocks_++;
+	// Variant bits cleared, upvalues and prototypes are no basic type
+	int type = tag & 0x0F;
+	if (tag > 0 && type < LUA_NUMTYPES) {
+		objects_[type]++;
+	}
+}
+
+void* LuaHeap::allocateBlock(size_t size, int tag) {
+	if (size <= maxPooledSize) {
+		int sizeClass = sizeClassOf(size);
+		portENTER_CRITICAL(&mux_);
+		void* block = takeBlock(sizeClass);
+		if (block != nullptr) {
+			account(sizeClass, 0, classSizes[sizeClass]);
+			countBlock(tag);
+		}
+		portEXIT_CRITICAL(&mux_);
+		if (block != nullptr) {
+			return block;
+		}
+	}
+
+	void* block = heap_caps_malloc(size, spillCaps_);
+	if (block != nullptr) {
+		portENTER_CRITICAL(&mux_);
+		account(spilled, 0, size);
+		countBlock(tag);
+		if (size <= maxPooledSize) {
+			spills_++;
+		}
+		portEXIT_CRITICAL(&mux_);
+	}
+	return block;
+}
+
+void LuaHeap::freeBlock(void* ptr, size_t size) {
+	if (!contains(ptr)) {
+		heap_caps_free(ptr);
+		portENTER_CRITICAL(&mux_);
+		account(spilled, size, 0);
+		liveBlocks_--;
+		portEXIT_CRITICAL(&mux_);
+		return;
+	}
+
+	int sizeClass = sizeClassOf(size);
+	portENTER_CRITICAL(&mux_);
+	*(void**) ptr = freeLists_[sizeClass];
+	freeLists_[sizeClass] = ptr;
+	account(sizeClass, classSizes[sizeClass], 0);
+	liveBlocks_--;
+	portEXIT_CRITICAL(&mux_);
+}
+
+void* LuaHeap::reallocateBlock(void* ptr, size_t osize, size_t nsize) {
+	if (contains(ptr)) {
+		if (nsize <= maxPooledSize && sizeClassOf(nsize) == sizeClassOf(osize)) {
+			// Still fits the block
+			return ptr;
+		}
+	} else if (nsize > maxPooledSize) {
+		void* block = heap_caps_realloc(ptr, nsize, spillCaps_);
+		if (block != nullptr) {
+			portENTER_CRITICAL(&mux_);
+			account(spilled, osize, nsize);
+			portEXIT_CRITICAL(&mux_);
+		}
+		return block;
+	}
+
+	// Moves between a class and another class or the spill heap
+	void* block = allocateBlock(nsize, 0);
+	if (block == nullptr) {
+		if (nsize > osize) {
+			return nullptr;
+		}
+		// Lua relies on shrinking to succeed. The old block is large enough, from
+		// now on it is freed as a block of the smaller class.
+		if (contains(ptr)) {
+			int oldClass = sizeClassOf(osize);
+			int newClass = sizeClassOf(nsize);
+			portENTER_CRITICAL(&mux_);
+			account(oldClass, classSizes[oldClass], 0);
+			account(newClass, 0, classSizes[newClass]);
+			portEXIT_CRITICAL(&mux_);
+		} else {
+			portENTER_CRITICAL(&mux_);
+			account(spilled, osize, nsize);
+			portEXIT_CRITICAL(&mux_);
+		}
+		return ptr;
+	}
+	memcpy(block, ptr, std::min(osize, nsize));
+	freeBlock(ptr, osize);
+	return block;
+}
+
+void LuaHeap::stats(Stats& out) {
+	portENTER_CRITICAL(&mux_);
+	out.arenaSize = arenaSize_;
+	out.arenaUsed = arenaUsed_;
+	for (int i = 0; i < numClasses; i++) {
+		out.classBytes[i] = classBytes_[i];
+	}
+	out.spilledBytes = spilledBytes_;
+	out.liveBytes = liveBytes_;
+	out.peakBytes = peakBytes_;
+	out.liveBlocks = liveBlocks_;
+	out.spills = spills_;
+	for (int i = 0; i < LUA_NUMTYPES; i++) {
+		out.objects[i] = objects_[i];
+	}
+	portEXIT_CRITICAL(&mux_);
+}
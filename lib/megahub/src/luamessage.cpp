@@ -0,0 +1,94 @@
+#include "luamessage.h"
+
+#include "logging.h"
+
+LuaValueCopy::LuaValueCopy()
+    : type_(LUA_TNIL), boolean_(false), isInteger_(false), integer_(0), number_(0) {}
+
+const char* LuaValueCopy::copyFrom(lua_State* L, int index) {
+	return copyFrom(L, lua_absindex(L, index), 0);
+}
+
+const char* LuaValueCopy::copyFrom(lua_State* L, int index, int depth) {
+	type_ = lua_type(L, index);
+	switch (type_) {
+		case LUA_TNIL:
+			return nullptr;
+		case LUA_TBOOLEAN:
+			boolean_ = lua_toboolean(L, index);
+			return nullptr;
+		case LUA_TNUMBER:
+			isInteger_ = lua_isinteger(L, index);
+			if (isInteger_) {
+				integer_ = lua_tointeger(L, index);
+			} else {
+				number_ = lua_tonumber(L, index);
+			}
+			return nullptr;
+		case LUA_TSTRING: {
+			size_t length = 0;
+			const char* data = lua_tolstring(L, index, &length);
+			string_.assign(data, length);
+			return nullptr;
+		}
+		case LUA_TTABLE:
+			break;
+		default:
+			type_ = LUA_TNIL;
+			return "only nil, booleans, numbers, strings and tables can be copied";
+	}
+
+	if (depth >= maxDepth) {
+		type_ = LUA_TNIL;
+		return "table nested too deep or cyclic";
+	}
+	luaL_checkstack(L, 2, "copying table");
+	lua_pushnil(L);
+	while (lua_next(L, index) != 0) {
+		// Key at -2, value at -1. Only strings are read as strings, so the key
+		// lua_next() needs is never converted in place.
+		int top = lua_gettop(L);
+		keys_.emplace_back();
+		values_.emplace_back();
+		const char* error = keys_.back().copyFrom(L, top - 1, depth + 1);
+		if (error == nullptr) {
+			error = values_.back().copyFrom(L, top, depth + 1);
+		}
+		if (error != nullptr) {
+			lua_pop(L, 2);
+			return error;
+		}
+		lua_pop(L, 1);
+	}
+	return nullptr;
+}
+
+void LuaValueCopy::push(lua_State* L) const {
+	switch (type_) {
+		case LUA_TBOOLEAN:
+			lua_pushboolean(L, boolean_);
+			break;
+		case LUA_TNUMBER:
+			if (isInteger_) {
+				lua_pushinteger(L, integer_);
+			} else {
+				lua_pushnumber(L, number_);
+			}
+			break;
+		case LUA_TSTRING:
+			lua_pushlstring(L, string_.data(), string_.size());
+			break;
+		case LUA_TTABLE:
+			luaL_checkstack(L, 3, "pushing table");
+			lua_createtable(L, 0, (int) keys_.size());
+			for (size_t i = 0; i < keys_.size(); i++) {
+				keys_[i].push(L);
+				values_[i].push(L);
+				lua_rawset(L, -3);
+			}
+			break;
+		default:
+			lua_pushnil(L);
+			break;
+	}
+}
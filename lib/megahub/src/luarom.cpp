@@ -0,0 +1,128 @@
+#include "luarom.h"
+
+#include "logging.h"
+
+#include <Arduino.h>
+#include <cstring>
+
+// Number of entries before the nullptr name, aborts if they are not sorted
+template <typename Entry> static int countSorted(const Entry* entries) {
+	int count = 0;
+	for (; entries[count].name != nullptr; count++) {
+		if (count > 0 && strcmp(entries[count - 1].name, entries[count].name) >= 0) {
+			ESP_LOGE("LuaRom", "%s is not sorted after %s", entries[count].name, entries[count - 1].name);
+			abort();
+		}
+	}
+	return count;
+}
+
+// Index of the entry with the given name, -1 if there is none
+template <typename Entry> static int findSorted(const Entry* entries, int count, const char* name) {
+	int low = 0;
+	int high = count - 1;
+	while (low <= high) {
+		int middle = (low + high) / 2;
+		int order = strcmp(entries[middle].name, name);
+		if (order == 0) {
+			return middle;
+		}
+		if (order < 0) {
+			low = middle + 1;
+		} else {
+			high = middle - 1;
+		}
+	}
+	return -1;
+}
+
+void LuaRom::install(lua_State* L, const Library* libraries, const Constant* constants) {
+	int libraryCount = countSorted(libraries);
+	int constantCount = countSorted(constants);
+
+	lua_pushglobaltable(L);
+	lua_createtable(L, 0, 1);
+	lua_pushlightuserdata(L, (void*) libraries);
+	lua_pushinteger(L, libraryCount);
+	lua_pushlightuserdata(L, (void*) constants);
+	lua_pushinteger(L, constantCount);
+	lua_pushcclosure(L, globalIndex, 4);
+	lua_setfield(L, -2, "__index");
+	lua_setmetatable(L, -2);
+	lua_pop(L, 1);
+
+	// require() finds the libraries through the global table
+	luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+	for (int i = 0; i < libraryCount; i++) {
+		lua_pushcfunction(L, requireLibrary);
+		lua_setfield(L, -2, libraries[i].name);
+	}
+	lua_pop(L, 1);
+}
+
+void LuaRom::pushLibrary(lua_State* L, const char* name, const luaL_Reg* functions) {
+	lua_createtable(L, 0, 0);
+	lua_createtable(L, 0, 1);
+	lua_pushlightuserdata(L, (void*) functions);
+	lua_pushcclosure(L, libraryIndex, 1);
+	lua_setfield(L, -2, "__index");
+	lua_setmetatable(L, -2);
+
+	// Like luaL_requiref, error messages and tracebacks name the functions after it
+	luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+	lua_pushvalue(L, -2);
+	lua_setfield(L, -2, name);
+	lua_pop(L, 1);
+}
+
+// __index of the global table: table, key
+int LuaRom::globalIndex(lua_State* L) {
+	if (lua_type(L, 2) != LUA_TSTRING) {
+		return 0;
+	}
+	const char* key = lua_tostring(L, 2);
+
+	const Library* libraries = (const Library*) lua_touserdata(L, lua_upvalueindex(1));
+	int library = findSorted(libraries, (int) lua_tointeger(L, lua_upvalueindex(2)), key);
+	if (library >= 0) {
+		pushLibrary(L, libraries[library].name, libraries[library].functions());
+	} else {
+		const Constant* constants = (const Constant*) lua_touserdata(L, lua_upvalueindex(3));
+		int constant = findSorted(constants, (int) lua_tointeger(L, lua_upvalueindex(4)), key);
+		if (constant < 0) {
+			return 0;
+		}
+		lua_pushinteger(L, constants[constant].value);
+	}
+
+	// Kept, the next read does not get here
+	lua_pushvalue(L, 2);
+	lua_pushvalue(L, -2);
+	lua_rawset(L, 1);
+	return 1;
+}
+
+// __index of a library table: table, key
+int LuaRom::libraryIndex(lua_State* L) {
+	if (lua_type(L, 2) != LUA_TSTRING) {
+		return 0;
+	}
+	const char* key = lua_tostring(L, 2);
+	const luaL_Reg* functions = (const luaL_Reg*) lua_touserdata(L, lua_upvalueindex(1));
+	for (const luaL_Reg* function = functions; function->name != nullptr; function++) {
+		if (strcmp(function->name, key) == 0) {
+			lua_pushcfunction(L, function->func);
+			lua_pushvalue(L, 2);
+			lua_pushvalue(L, -2);
+			lua_rawset(L, 1);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// package.preload loader: name
+int LuaRom::requireLibrary(lua_State* L) {
+	lua_getglobal(L, luaL_checkstring(L, 1));
+	return 1;
+}
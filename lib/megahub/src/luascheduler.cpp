@@ -0,0 +1,333 @@
+#include "luascheduler.h"
+
+#include "gcpacer.h"
+#include "lineprofiler.h"
+#include "logging.h"
+#include "megahub.h"
+
+#include <algorithm>
+
+// stopAll() polls until the scheduler removed all coroutines. A coroutine is
+// only removed once it yields or finishes its iteration.
+#define SCHEDULER_STOP_POLL_MS    10
+#define SCHEDULER_STOP_TIMEOUT_MS 1000
+
+static void lua_scheduler_task(void* parameters) {
+	LuaScheduler* scheduler = (LuaScheduler*) parameters;
+	INFO("Starting Lua scheduler task");
+	scheduler->loop();
+	vTaskDelete(NULL);
+}
+
+LuaScheduler::LuaScheduler(Megahub* hub, int stackSize)
+    : hub_(hub), mutex_(nullptr), taskHandle_(nullptr), current_(nullptr), closing_(0), nextId_(1),
+      nextSequence_(0), stopPending_(false) {
+	mutex_ = xSemaphoreCreateMutex();
+	if (!mutex_) {
+		ESP_LOGE("LuaScheduler", "Failed to create mutex");
+		abort();
+	}
+	ready_.reserve(8);
+
+	// Same priority as the thread tasks it replaces
+	xTaskCreate(lua_scheduler_task, "LuaScheduler", stackSize, (void*) this, LUA_THREAD_PRIORITY, &taskHandle_);
+}
+
+LuaScheduler::~LuaScheduler() {
+	stopAll();
+	if (taskHandle_) {
+		vTaskDelete(taskHandle_);
+		taskHandle_ = nullptr;
+	}
+	if (mutex_) {
+		vSemaphoreDelete(mutex_);
+		mutex_ = nullptr;
+	}
+}
+
+bool LuaScheduler::runsLater(const Coroutine* a, const Coroutine* b) {
+	// Wrap-safe, millis() overflows after ~49.7 days
+	long diff = (long) (a->wakeAt - b->wakeAt);
+	if (diff != 0) {
+		return diff > 0;
+	}
+	return (int32_t) (a->sequence - b->sequence) > 0;
+}
+
+void LuaScheduler::push(Coroutine* coroutine) {
+	coroutine->sequence = nextSequence_++;
+	ready_.push_back(coroutine);
+	std::push_heap(ready_.begin(), ready_.end(), runsLater);
+}
+
+uint32_t LuaScheduler::add(lua_State* L, const String& name, const String& blockId, bool profiling) {
+	Coroutine* coroutine = new Coroutine();
+	coroutine->name = name;
+	coroutine->blockId = blockId;
+	coroutine->profiling = profiling;
+	coroutine->stopRequested = false;
+	coroutine->inIteration = false;
+	coroutine->suspended = false;
+	coroutine->woken = false;
+	coroutine->iterationStart = 0;
+	coroutine->wakeAt = millis();
+
+	// Both the coroutine and its function are anchored in the registry until close()
+	coroutine->thread = lua_newthread(L);
+	coroutine->threadRef = luaL_ref(L, LUA_REGISTRYINDEX);
+	coroutine->functionRef = luaL_ref(L, LUA_REGISTRYINDEX);
+	if (profiling) {
+		LineProfiler::instance()->attach(coroutine->thread);
+	}
+
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	coroutine->id = nextId_++;
+	if (nextId_ == 0) {
+		nextId_ = 1;
+	}
+	uint32_t id = coroutine->id;
+	push(coroutine);
+	xSemaphoreGive(mutex_);
+
+	xTaskNotifyGive(taskHandle_);
+	return id;
+}
+
+void LuaScheduler::stop(uint32_t id) {
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	for (Coroutine* coroutine : ready_) {
+		if (coroutine->id == id) {
+			coroutine->stopRequested = true;
+		}
+	}
+	if (current_ != nullptr && current_->id == id) {
+		current_->stopRequested = true;
+	}
+	stopPending_ = true;
+	xSemaphoreGive(mutex_);
+
+	xTaskNotifyGive(taskHandle_);
+}
+
+bool LuaScheduler::stopAll() {
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	for (Coroutine* coroutine : ready_) {
+		coroutine->stopRequested = true;
+	}
+	if (current_ != nullptr) {
+		current_->stopRequested = true;
+	}
+	bool hadCoroutines = !ready_.empty() || current_ != nullptr || closing_ > 0;
+	stopPending_ = true;
+	xSemaphoreGive(mutex_);
+
+	if (!hadCoroutines || xTaskGetCurrentTaskHandle() == taskHandle_) {
+		return true;
+	}
+
+	xTaskNotifyGive(taskHandle_);
+	for (int waited = 0; waited < SCHEDULER_STOP_TIMEOUT_MS; waited += SCHEDULER_STOP_POLL_MS) {
+		vTaskDelay(pdMS_TO_TICKS(SCHEDULER_STOP_POLL_MS));
+		xSemaphoreTake(mutex_, portMAX_DELAY);
+		// A coroutine being closed still uses the program state
+		bool empty = ready_.empty() && current_ == nullptr && closing_ == 0;
+		xSemaphoreGive(mutex_);
+		if (empty) {
+			return true;
+		}
+	}
+	WARN("Lua coroutines did not stop within %d milliseconds", SCHEDULER_STOP_TIMEOUT_MS);
+	return false;
+}
+
+bool LuaScheduler::sleep(lua_State* L, unsigned long ms) {
+	// Only the coroutine itself yields to the scheduler. Other tasks, nested
+	// coroutines and calls across a C boundary fall back to a blocking wait.
+	if (xTaskGetCurrentTaskHandle() != taskHandle_ || current_ == nullptr || current_->thread != L ||
+	    !lua_isyieldable(L)) {
+		return false;
+	}
+	current_->wakeAt = millis() + ms;
+	current_->suspended = false;
+	return true;
+}
+
+uint32_t LuaScheduler::suspend(lua_State* L, unsigned long timeoutMs) {
+	if (!sleep(L, timeoutMs)) {
+		return 0;
+	}
+	current_->suspended = true;
+	return current_->id;
+}
+
+void LuaScheduler::wake(uint32_t id) {
+	bool found = false;
+
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	for (Coroutine* coroutine : ready_) {
+		if (coroutine->id == id && coroutine->suspended) {
+			coroutine->wakeAt = millis();
+			found = true;
+		}
+	}
+	if (found) {
+		std::make_heap(ready_.begin(), ready_.end(), runsLater);
+	} else if (current_ != nullptr && current_->id == id) {
+		// Not yielded yet, requeued as due once it does
+		current_->woken = true;
+		found = true;
+	}
+	xSemaphoreGive(mutex_);
+
+	if (found) {
+		xTaskNotifyGive(taskHandle_);
+	}
+}
+
+void LuaScheduler::removeStopped() {
+	std::vector<Coroutine*> stopped;
+
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	if (stopPending_) {
+		stopPending_ = false;
+		auto end = std::partition(ready_.begin(), ready_.end(), [](Coroutine* c) { return !c->stopRequested; });
+		stopped.assign(end, ready_.end());
+		ready_.erase(end, ready_.end());
+		std::make_heap(ready_.begin(), ready_.end(), runsLater);
+		closing_ += (int) stopped.size();
+	}
+	xSemaphoreGive(mutex_);
+
+	for (Coroutine* coroutine : stopped) {
+		INFO("Coroutine %s will be canceled", coroutine->name.c_str());
+		close(coroutine);
+	}
+}
+
+LuaScheduler::Coroutine* LuaScheduler::popDue(unsigned long now, TickType_t& sleepTicks) {
+	Coroutine* coroutine = nullptr;
+
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	if (ready_.empty()) {
+		sleepTicks = portMAX_DELAY;
+	} else {
+		long remaining = (long) (ready_.front()->wakeAt - now);
+		if (remaining > 0) {
+			sleepTicks = pdMS_TO_TICKS(remaining);
+			if (sleepTicks == 0) {
+				sleepTicks = 1;
+			}
+		} else {
+			std::pop_heap(ready_.begin(), ready_.end(), runsLater);
+			coroutine = ready_.back();
+			ready_.pop_back();
+			coroutine->woken = false;
+			current_ = coroutine;
+		}
+	}
+	xSemaphoreGive(mutex_);
+
+	return coroutine;
+}
+
+bool LuaScheduler::resume(Coroutine* coroutine) {
+	lua_State* thread = coroutine->thread;
+
+	if (!coroutine->inIteration) {
+		// Next iteration of the loop, the function is called again from the start
+		coroutine->inIteration = true;
+		coroutine->iterationStart = micros();
+		lua_rawgeti(thread, LUA_REGISTRYINDEX, coroutine->functionRef);
+	}
+
+	// Yielding without wait(), e.g. coroutine.yield(), gives the others a turn
+	coroutine->wakeAt = millis();
+
+	int results = 0;
+	int result = lua_resume(thread, nullptr, 0, &results);
+
+	if (result == LUA_YIELD) {
+		lua_pop(thread, results);
+		return true;
+	}
+
+	if (result != LUA_OK) {
+		const char* error_msg = lua_tostring(thread, -1);
+		WARN("Error processing Lua function : %s", error_msg);
+		lua_pop(thread, 1);
+		return false;
+	}
+
+	lua_pop(thread, results);
+	coroutine->inIteration = false;
+	coroutine->suspended = false;
+
+	// Compute iteration duration and update statistics
+	coroutine->statistics.record(micros() - coroutine->iterationStart);
+
+	// Collector work between iterations, outside the measured duration
+	GcPacer* pacer = GcPacer::instance();
+	if (pacer->paced()) {
+		coroutine->statistics.recordGc(pacer->afterIteration(thread));
+	}
+	if (coroutine->profiling) {
+		coroutine->statistics.reportIfDue(coroutine->blockId, millis());
+	}
+
+	coroutine->wakeAt = millis() + iterationGapMs;
+	return true;
+}
+
+void LuaScheduler::close(Coroutine* coroutine) {
+	coroutine->statistics.log();
+
+	lua_State* thread = coroutine->thread;
+	lua_closethread(thread, nullptr);
+	luaL_unref(thread, LUA_REGISTRYINDEX, coroutine->functionRef);
+	// Releases the coroutine itself, thread must not be used afterwards
+	luaL_unref(thread, LUA_REGISTRYINDEX, coroutine->threadRef);
+
+	INFO("Done with coroutine %s", coroutine->name.c_str());
+	delete coroutine;
+
+	xSemaphoreTake(mutex_, portMAX_DELAY);
+	closing_--;
+	xSemaphoreGive(mutex_);
+}
+
+void LuaScheduler::loop() {
+	while (true) {
+		removeStopped();
+
+		TickType_t sleepTicks = 0;
+		Coroutine* coroutine = popDue(millis(), sleepTicks);
+		if (coroutine == nullptr) {
+			// Woken early by add(), stop() and wake()
+			ulTaskNotifyTake(pdTRUE, sleepTicks);
+			continue;
+		}
+
+		bool alive = resume(coroutine);
+
+		xSemaphoreTake(mutex_, portMAX_DELAY);
+		current_ = nullptr;
+		bool keep = alive && !coroutine->stopRequested;
+		if (keep) {
+			if (coroutine->woken && coroutine->suspended) {
+				coroutine->wakeAt = millis();
+			}
+			push(coroutine);
+		} else {
+			closing_++;
+		}
+		xSemaphoreGive(mutex_);
+
+		if (!keep) {
+			close(coroutine);
+			if (!alive) {
+				// A coroutine has no task of its own in the list of running threads
+				hub_->notifyThreadExitedAbnormally(nullptr);
+			}
+		}
+	}
+}
@@ -0,0 +1,64 @@
+#include "luasource.h"
+
+const char* LuaSource::reader(lua_State* L, void* data, size_t* size) {
+	LuaSource* source = (LuaSource*) data;
+	const char* piece = source->next(*size);
+	if (piece == nullptr) {
+		*size = 0;
+	}
+	return piece;
+}
+
+LuaBufferSource::LuaBufferSource(const char* data, size_t length) : data_(data), length_(length), consumed_(false) {}
+
+void LuaBufferSource::rewind() {
+	consumed_ = false;
+}
+
+const char* LuaBufferSource::next(size_t& size) {
+	if (consumed_ || length_ == 0 || data_ == nullptr) {
+		size = 0;
+		return nullptr;
+	}
+	consumed_ = true;
+	size = length_;
+	return data_;
+}
+
+size_t LuaBufferSource::length() {
+	return length_;
+}
+
+LuaChunkSource::LuaChunkSource() : length_(0), position_(0) {}
+
+void LuaChunkSource::append(const char* data, size_t length) {
+	if (length == 0) {
+		return;
+	}
+	chunks_.emplace_back(data, data + length);
+	length_ += length;
+}
+
+void LuaChunkSource::clear() {
+	std::vector<std::vector<char>>().swap(chunks_);
+	length_ = 0;
+	position_ = 0;
+}
+
+void LuaChunkSource::rewind() {
+	position_ = 0;
+}
+
+const char* LuaChunkSource::next(size_t& size) {
+	if (position_ >= chunks_.size()) {
+		size = 0;
+		return nullptr;
+	}
+	const std::vector<char>& chunk = chunks_[position_++];
+	size = chunk.size();
+	return chunk.data();
+}
+
+size_t LuaChunkSource::length() {
+	return length_;
+}
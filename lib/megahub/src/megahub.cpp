@@ -4,22 +4,38 @@
 
 #include "YDLidar.h"
 #include "commands.h"
+#include "gcpacer.h"
 #include "gitrevision.h"
 #include "i2csync.h"
+#include "lineprofiler.h"
+#include "luachannel.h"
+#include "luarom.h"
 #include "portstatus.h"
+#include "threadstatistics.h"
 
 #include <ArduinoJson.h>
+#include <algorithm>
 #include <esp_heap_caps.h>
 #include <esp_mac.h>
+#include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
 
-#define MEGAHUBREF_NAME      "MEGAHUBTHISREF"
-#define INPUTDEVICESREF_NAME "MEGAHUBINPUTDEVICESREF"
+TaskHandle_t statusReporterTaskHandle = NULL;
 
-SemaphoreHandle_t lua_global_mutex = nullptr;
+// Port service timing. Without an IRQ line the FIFOs are polled, starting at
+// the minimum interval after data arrived and doubling while all ports stay
+// idle. The maximum must stay below the time a 64 byte FIFO needs to fill at
+// 115200 baud (~5.5 ms). With an IRQ line the task sleeps until notified, but
+// still wakes at the timer interval to drive keep-alive and timeouts.
+#define PORT_SERVICE_MIN_POLL_MS 1
+#define PORT_SERVICE_MAX_POLL_MS 4
+#define PORT_SERVICE_TIMER_MS    5
 
-TaskHandle_t statusReporterTaskHandle = NULL;
+// A stopped thread task exits once its iteration or wait() returns. The Lua
+// state is only replaced after all of them did.
+#define THREAD_STOP_POLL_MS    10
+#define THREAD_STOP_TIMEOUT_MS 1000
 
 // Snapshot structures for status reporting - uses fixed-size arrays to avoid heap allocations
 // during lock-held section for minimal i2c lock time
@@ -138,20 +154,6 @@ static void deviceSnapshotToJson(const DeviceSnapshot& snap, int portId, JsonArr
 	}
 }
 
-Megahub* getMegaHubRef(lua_State* L) {
-	lua_getfield(L, LUA_REGISTRYINDEX, MEGAHUBREF_NAME);
-	void** userdata = (void**) lua_touserdata(L, -1);
-	lua_pop(L, 1); // Clean up stack
-	return (Megahub*) (userdata ? *userdata : NULL);
-}
-
-InputDevices* getInputDevicesRef(lua_State* L) {
-	lua_getfield(L, LUA_REGISTRYINDEX, INPUTDEVICESREF_NAME);
-	void** userdata = (void**) lua_touserdata(L, -1);
-	lua_pop(L, 1); // Clean up stack
-	return (InputDevices*) (userdata ? *userdata : NULL);
-}
-
 void status_reporter_task(void* parameters) {
 	Megahub* hub = (Megahub*) parameters;
 	INFO("Starting task reporter task");
@@ -163,13 +165,13 @@ void status_reporter_task(void* parameters) {
 	while (true) {
 		DEBUG("Sending Portstatus");
 
-		// Phase 1: Fast snapshot capture under i2c lock
-		i2c_lock();
-		captureDeviceSnapshot(hub->port(PORT1), snapshot.ports[0]);
-		captureDeviceSnapshot(hub->port(PORT2), snapshot.ports[1]);
-		captureDeviceSnapshot(hub->port(PORT3), snapshot.ports[2]);
-		captureDeviceSnapshot(hub->port(PORT4), snapshot.ports[3]);
-		i2c_unlock();
+		// Phase 1: Fast snapshot capture as a low priority bus transaction
+		I2CScheduler::instance()->execute(I2CPriority::DIAGNOSTICS, [hub]() {
+			captureDeviceSnapshot(hub->port(PORT1), snapshot.ports[0]);
+			captureDeviceSnapshot(hub->port(PORT2), snapshot.ports[1]);
+			captureDeviceSnapshot(hub->port(PORT3), snapshot.ports[2]);
+			captureDeviceSnapshot(hub->port(PORT4), snapshot.ports[3]);
+		});
 
 		// Phase 2: JSON construction without lock
 		JsonDocument status;
@@ -179,6 +181,23 @@ void status_reporter_task(void* parameters) {
 			deviceSnapshotToJson(snapshot.ports[i], i + 1, ports);
 		}
 
+		// Memory of the running program, counted from its fresh Lua state
+		LuaHeap::Stats memory;
+		LuaHeap::Stats base;
+		hub->programMemory(memory, base);
+		JsonObject lua = status["lua"].to<JsonObject>();
+		lua["bytes"] = memory.liveBytes;
+		lua["peak"] = memory.peakBytes;
+		lua["base"] = base.liveBytes;
+		lua["blocks"] = memory.liveBlocks;
+		// Created by the program, the libraries are left out
+		JsonObject objects = lua["objects"].to<JsonObject>();
+		objects["table"] = memory.objects[LUA_TTABLE] - base.objects[LUA_TTABLE];
+		objects["string"] = memory.objects[LUA_TSTRING] - base.objects[LUA_TSTRING];
+		objects["function"] = memory.objects[LUA_TFUNCTION] - base.objects[LUA_TFUNCTION];
+		objects["userdata"] = memory.objects[LUA_TUSERDATA] - base.objects[LUA_TUSERDATA];
+		objects["thread"] = memory.objects[LUA_TTHREAD] - base.objects[LUA_TTHREAD];
+
 		// Serialize directly to char[] — avoids one heap allocation vs. String target.
 		// Static to avoid stack overflow (task stack is 4096 bytes; buffer is 6144 bytes).
 		static char strContent[6144];
@@ -194,21 +213,32 @@ void status_reporter_task(void* parameters) {
 	vTaskDelete(NULL);
 }
 
-extern int hub_library(lua_State* luaState);
+void port_service_task(void* parameters) {
+	Megahub* hub = (Megahub*) parameters;
+	INFO("Starting port service task");
+	hub->portServiceLoop();
+	vTaskDelete(NULL);
+}
+
+static void IRAM_ATTR port_irq_handler(void* arg) {
+	((Megahub*) arg)->notifyPortInterruptFromISR();
+}
+
+extern const luaL_Reg* hub_library();
 
-extern int fastled_library(lua_State* luaState);
+extern const luaL_Reg* fastled_library();
 
-extern int imu_library(lua_State* luaState);
+extern const luaL_Reg* imu_library();
 
-extern int debug_library(lua_State* luaState);
+extern const luaL_Reg* debug_library();
 
-extern int ui_library(lua_State* luaState);
+extern const luaL_Reg* ui_library();
 
-extern int lego_library(lua_State* luaState);
+extern const luaL_Reg* lego_library();
 
-extern int gamepad_library(lua_State* luaState);
+extern const luaL_Reg* gamepad_library();
 
-extern int alg_library(lua_State* luaState);
+extern const luaL_Reg* alg_library();
 extern void alg_reset_all_states();
 
 int global_wait(lua_State* luaState) {
@@ -216,15 +246,28 @@ int global_wait(lua_State* luaState) {
 
 	DEBUG("Waiting for %d milliseconds", delay);
 
-	const int SLICE_MS = 10;
-	int remaining = delay;
-	while (remaining > 0) {
-		int slice = (remaining < SLICE_MS) ? remaining : SLICE_MS;
-		// Check for cancellation via task notification
-		if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(slice)) > 0) {
-			break; // Cancelled
+	// Inside a scheduler coroutine the delay yields, the scheduler runs the other loops meanwhile
+	LuaScheduler* scheduler = getMegaHubRef(luaState)->scheduler();
+	if (scheduler != nullptr && scheduler->sleep(luaState, delay > 0 ? delay : 0)) {
+		return lua_yield(luaState, 0);
+	}
+
+	// Waits for the whole delay, only a stop (value 1) ends it early. A channel
+	// wake-up that came after hub.recv() returned ends the notification wait
+	// but not the delay, the loop then waits for the rest.
+	TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(delay > 0 ? delay : 0);
+	while (true) {
+		TickType_t remaining = deadline - xTaskGetTickCount();
+		if ((int32_t) remaining <= 0) {
+			break;
+		}
+		uint32_t value = 0;
+		if (xTaskNotifyWait(0, 0, &value, remaining) == pdTRUE && value == 1) {
+			// Cancelled, receiving the notification cleared it. Set again for the
+			// thread loop, which only stops once it sees it.
+			xTaskNotify(xTaskGetCurrentTaskHandle(), 1, eSetValueWithOverwrite);
+			break;
 		}
-		remaining -= slice;
 	}
 
 	return 0;
@@ -241,229 +284,205 @@ int global_print(lua_State* luaState) {
 }
 
 int global_millis(lua_State* luaState) {
-	long ms = millis();
+#if LUA_MAXINTEGER > INT32_MAX
+	// 64-bit integers, the 64-bit uptime never wraps
+	lua_Integer ms = (lua_Integer) (esp_timer_get_time() / 1000);
+#else
+	// 32-bit integers wrap to negative after ~24.8 days. Lua integer arithmetic
+	// wraps the same way, so "millis() - start" stays correct across it.
+	lua_Integer ms = (lua_Integer) (int32_t) millis();
+#endif
 
-	DEBUG("Current time is %ld milliseconds", ms);
+	DEBUG("Current time is %ld milliseconds", (long) ms);
 
 	lua_pushinteger(luaState, ms);
 
 	return 1;
 }
 
+static uint32_t luaSpillCaps() {
+	// Small blocks come from the internal RAM arena of the Lua heap, larger
+	// ones spill to PSRAM if there is any
 #ifdef BOARD_HAS_PSRAM
-static void* psram_lua_alloc(void* ud, void* ptr, size_t osize, size_t nsize) {
-	(void) ud;
-	(void) osize;
-	if (nsize == 0) {
-		heap_caps_free(ptr);
-		return nullptr;
+	if (ESP.getPsramSize() > 0) {
+		INFO("Lua heap spilling to PSRAM (%d bytes PSRAM available)", ESP.getPsramSize());
+		return MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT;
 	}
-	return heap_caps_realloc(ptr, nsize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-}
+	INFO("Lua heap spilling to the default heap (PSRAM configured but not detected)");
+#else
+	INFO("Lua heap spilling to the default heap");
 #endif
+	return MALLOC_CAP_8BIT;
+}
 
 lua_State* Megahub::newLuaState() {
 	INFO("Creating new Lua state");
-	lua_State* ls;
-#ifdef BOARD_HAS_PSRAM
-	if (ESP.getPsramSize() > 0) {
-		ls = lua_newstate(psram_lua_alloc, nullptr);
-		INFO("Lua state using PSRAM allocator (%d bytes PSRAM available)", ESP.getPsramSize());
-	} else {
-		ls = luaL_newstate();
-		INFO("Lua state using default allocator (PSRAM configured but not detected)");
+	unsigned long start = micros();
+	// The arena of the closed state goes first, two of them may not fit into internal RAM
+	luaHeap_.reset();
+	luaHeap_.reset(new LuaHeap(LUA_HEAP_ARENA_SIZE, luaSpillCaps()));
+	lua_State* ls = openLuaState(luaHeap_.get());
+
+	// The program's own memory is counted from here
+	luaHeap_->stats(luaBase_);
+
+	INFO("Finished creating new Lua state in %lu us, %d bytes used", micros() - start, (int) luaBase_.liveBytes);
+
+	return ls;
+}
+
+lua_State* Megahub::newIsolatedState(LuaHeap*& heap) {
+	INFO("Creating isolated Lua state");
+	heap = new LuaHeap(LUA_ISOLATED_HEAP_ARENA_SIZE, luaSpillCaps());
+	lua_State* ls = openLuaState(heap);
+	if (ls == nullptr) {
+		delete heap;
+		heap = nullptr;
+	}
+	return ls;
+}
+
+bool Megahub::isProgramState(lua_State* L) {
+	lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+	bool program = lua_tothread(L, -1) == globalLuaState_;
+	lua_pop(L, 1);
+	return program;
+}
+
+lua_State* Megahub::openLuaState(LuaHeap* heap) {
+	lua_State* ls = lua_newstate(LuaHeap::allocate, heap);
+	if (ls == nullptr) {
+		WARN("Not enough memory for a Lua state");
+		return nullptr;
 	}
-#else
-	ls = luaL_newstate();
-	INFO("Lua state using default allocator");
-#endif
 
 	INFO("Opening standard Lua libraries");
 	luaL_openlibs(ls);
 
-	INFO("Registering custom libraries and functions");
-	// Register custom librariey
-	luaL_requiref(ls, "hub", hub_library, 1);
-	lua_pop(ls, 1); // remove lib from stack
-	luaL_requiref(ls, "fastled", fastled_library, 1);
-	lua_pop(ls, 1); // remove lib from stack
-	luaL_requiref(ls, "imu", imu_library, 1);
-	lua_pop(ls, 1); // remove lib from stack
-	luaL_requiref(ls, "ui", ui_library, 1);
-	lua_pop(ls, 1); // remove lib from stack
-	luaL_requiref(ls, "deb", debug_library, 1);
-	lua_pop(ls, 1); // remove lib from stack
-	luaL_requiref(ls, "lego", lego_library, 1);
-	lua_pop(ls, 1); // remove lib from stack
-	luaL_requiref(ls, "gamepad", gamepad_library, 1);
-	lua_pop(ls, 1); // remove lib from stack
-	luaL_requiref(ls, "alg", alg_library, 1);
-	lua_pop(ls, 1); // remove lib from stack
-
 	// And also global functions
 	lua_register(ls, "wait", global_wait);
 	lua_register(ls, "print", global_print);
 	lua_register(ls, "millis", global_millis);
 
-	// The self reference
-	void** userdata = (void**) lua_newuserdata(ls, sizeof(void*));
-	*userdata = this;
-	lua_setfield(ls, LUA_REGISTRYINDEX, MEGAHUBREF_NAME);
-
-	// Input devices reference
-	void** inputdevicesuserdata = (void**) lua_newuserdata(ls, sizeof(void*));
-	*inputdevicesuserdata = inputdevices_.get();
-	lua_setfield(ls, LUA_REGISTRYINDEX, INPUTDEVICESREF_NAME);
-
-	// Globals
-	lua_pushinteger(ls, PORT1);
-	lua_setglobal(ls, "PORT1");
-	lua_pushinteger(ls, PORT2);
-	lua_setglobal(ls, "PORT2");
-	lua_pushinteger(ls, PORT3);
-	lua_setglobal(ls, "PORT3");
-	lua_pushinteger(ls, PORT4);
-	lua_setglobal(ls, "PORT4");
-
-	lua_pushinteger(ls, GPIO_NUM_13);
-	lua_setglobal(ls, "GPIO13");
-	lua_pushinteger(ls, GPIO_NUM_16);
-	lua_setglobal(ls, "GPIO16");
-	lua_pushinteger(ls, GPIO_NUM_17);
-	lua_setglobal(ls, "GPIO17");
-	lua_pushinteger(ls, GPIO_NUM_25);
-	lua_setglobal(ls, "GPIO25");
-	lua_pushinteger(ls, GPIO_NUM_26);
-	lua_setglobal(ls, "GPIO26");
-	lua_pushinteger(ls, GPIO_NUM_27);
-	lua_setglobal(ls, "GPIO27");
-	lua_pushinteger(ls, GPIO_NUM_32);
-	lua_setglobal(ls, "GPIO32");
-	lua_pushinteger(ls, GPIO_NUM_33);
-	lua_setglobal(ls, "GPIO33");
-	lua_pushinteger(ls, GPIO_NUM_34);
-	lua_setglobal(ls, "GPIO34");
-	lua_pushinteger(ls, GPIO_NUM_35);
-	lua_setglobal(ls, "GPIO35");
-	lua_pushinteger(ls, GPIO_NUM_36);
-	lua_setglobal(ls, "GPIO36");
-	lua_pushinteger(ls, GPIO_NUM_39);
-	lua_setglobal(ls, "GPIO39");
-
-	lua_pushinteger(ls, UART1_GP4);
-	lua_setglobal(ls, "UART1_GP4");
-	lua_pushinteger(ls, UART1_GP5);
-	lua_setglobal(ls, "UART1_GP5");
-	lua_pushinteger(ls, UART1_GP6);
-	lua_setglobal(ls, "UART1_GP6");
-	lua_pushinteger(ls, UART1_GP7);
-	lua_setglobal(ls, "UART1_GP7");
-
-	lua_pushinteger(ls, UART2_GP4);
-	lua_setglobal(ls, "UART2_GP4");
-	lua_pushinteger(ls, UART2_GP5);
-	lua_setglobal(ls, "UART2_GP5");
-	lua_pushinteger(ls, UART2_GP6);
-	lua_setglobal(ls, "UART2_GP6");
-	lua_pushinteger(ls, UART2_GP7);
-	lua_setglobal(ls, "UART2_GP7");
-
-	lua_pushinteger(ls, PINMODE_INPUT);
-	lua_setglobal(ls, "PINMODE_INPUT");
-	lua_pushinteger(ls, PINMODE_INPUT_PULLUP);
-	lua_setglobal(ls, "PINMODE_INPUT_PULLUP");
-	lua_pushinteger(ls, PINMODE_INPUT_PULLDOWN);
-	lua_setglobal(ls, "PINMODE_INPUT_PULLDOWN");
-	lua_pushinteger(ls, PINMODE_OUTPUT);
-	lua_setglobal(ls, "PINMODE_OUTPUT");
-
-	// IMU
-	lua_pushinteger(ls, YAW);
-	lua_setglobal(ls, "YAW");
-	lua_pushinteger(ls, PITCH);
-	lua_setglobal(ls, "PITCH");
-	lua_pushinteger(ls, ROLL);
-	lua_setglobal(ls, "ROLL");
-	lua_pushinteger(ls, ACCELERATION_X);
-	lua_setglobal(ls, "ACCELERATION_X");
-	lua_pushinteger(ls, ACCELERATION_Y);
-	lua_setglobal(ls, "ACCELERATION_Y");
-	lua_pushinteger(ls, ACCELERATION_Z);
-	lua_setglobal(ls, "ACCELERATION_Z");
-
-	// FastLED constants
-	lua_pushinteger(ls, NEOPIXEL_TYPE);
-	lua_setglobal(ls, "NEOPIXEL");
-
-	// UI constants
-	lua_pushinteger(ls, FORMAT_SIMPLE);
-	lua_setglobal(ls, "FORMAT_SIMPLE");
-
-	// Gamepad
-	lua_pushinteger(ls, GAMEPAD1);
-	lua_setglobal(ls, "GAMEPAD1");
-	lua_pushinteger(ls, GAMEPAD_BUTTON_1);
-	lua_setglobal(ls, "GAMEPAD_BUTTON_1");
-	lua_pushinteger(ls, GAMEPAD_BUTTON_2);
-	lua_setglobal(ls, "GAMEPAD_BUTTON_2");
-	lua_pushinteger(ls, GAMEPAD_BUTTON_3);
-	lua_setglobal(ls, "GAMEPAD_BUTTON_3");
-	lua_pushinteger(ls, GAMEPAD_BUTTON_4);
-	lua_setglobal(ls, "GAMEPAD_BUTTON_4");
-	lua_pushinteger(ls, GAMEPAD_BUTTON_5);
-	lua_setglobal(ls, "GAMEPAD_BUTTON_5");
-	lua_pushinteger(ls, GAMEPAD_BUTTON_6);
-	lua_setglobal(ls, "GAMEPAD_BUTTON_6");
-	lua_pushinteger(ls, GAMEPAD_BUTTON_7);
-	lua_setglobal(ls, "GAMEPAD_BUTTON_7");
-	lua_pushinteger(ls, GAMEPAD_BUTTON_8);
-	lua_setglobal(ls, "GAMEPAD_BUTTON_8");
-	lua_pushinteger(ls, GAMEPAD_BUTTON_9);
-	lua_setglobal(ls, "GAMEPAD_BUTTON_9");
-	lua_pushinteger(ls, GAMEPAD_BUTTON_10);
-	lua_setglobal(ls, "GAMEPAD_BUTTON_10");
-	lua_pushinteger(ls, GAMEPAD_BUTTON_11);
-	lua_setglobal(ls, "GAMEPAD_BUTTON_11");
-	lua_pushinteger(ls, GAMEPAD_BUTTON_12);
-	lua_setglobal(ls, "GAMEPAD_BUTTON_12");
-	lua_pushinteger(ls, GAMEPAD_BUTTON_13);
-	lua_setglobal(ls, "GAMEPAD_BUTTON_13");
-	lua_pushinteger(ls, GAMEPAD_BUTTON_14);
-	lua_setglobal(ls, "GAMEPAD_BUTTON_14");
-	lua_pushinteger(ls, GAMEPAD_BUTTON_15);
-	lua_setglobal(ls, "GAMEPAD_BUTTON_15");
-	lua_pushinteger(ls, GAMEPAD_BUTTON_16);
-	lua_setglobal(ls, "GAMEPAD_BUTTON_16");
-
-	lua_pushinteger(ls, GAMEPAD_LEFT_X);
-	lua_setglobal(ls, "GAMEPAD_LEFT_X");
-	lua_pushinteger(ls, GAMEPAD_LEFT_Y);
-	lua_setglobal(ls, "GAMEPAD_LEFT_Y");
-	lua_pushinteger(ls, GAMEPAD_RIGHT_X);
-	lua_setglobal(ls, "GAMEPAD_RIGHT_X");
-	lua_pushinteger(ls, GAMEPAD_RIGHT_Y);
-	lua_setglobal(ls, "GAMEPAD_RIGHT_Y");
-	lua_pushinteger(ls, GAMEPAD_DPAD);
-	lua_setglobal(ls, "GAMEPAD_DPAD");
-
-	INFO("Finished creating new Lua state");
+	// Hub and input devices for the bindings, inherited by all threads created from this state.
+	// The LEDs stay registered with FastLED, they outlive the state of a program.
+	bindingContext_.hub = this;
+	bindingContext_.inputDevices = inputdevices_.get();
+	setBindingContext(ls, &bindingContext_);
+
+	INFO("Registering custom libraries and constants");
+	// Resolved from flash on first use, see LuaRom. Both arrays must stay sorted by name.
+	static const LuaRom::Library libraries[] = {
+	    {    "alg",     alg_library},
+	    {    "deb",   debug_library},
+	    {"fastled", fastled_library},
+	    {"gamepad", gamepad_library},
+	    {    "hub",     hub_library},
+	    {    "imu",     imu_library},
+	    {   "lego",    lego_library},
+	    {     "ui",      ui_library},
+	    {  nullptr,         nullptr}
+    };
+	static const LuaRom::Constant constants[] = {
+	    {        "ACCELERATION_X",         ACCELERATION_X},
+	    {        "ACCELERATION_Y",         ACCELERATION_Y},
+	    {        "ACCELERATION_Z",         ACCELERATION_Z},
+	    {         "FORMAT_SIMPLE",          FORMAT_SIMPLE},
+	    {              "GAMEPAD1",               GAMEPAD1},
+	    {      "GAMEPAD_BUTTON_1",       GAMEPAD_BUTTON_1},
+	    {     "GAMEPAD_BUTTON_10",      GAMEPAD_BUTTON_10},
+	    {     "GAMEPAD_BUTTON_11",      GAMEPAD_BUTTON_11},
+	    {     "GAMEPAD_BUTTON_12",      GAMEPAD_BUTTON_12},
+	    {     "GAMEPAD_BUTTON_13",      GAMEPAD_BUTTON_13},
+	    {     "GAMEPAD_BUTTON_14",      GAMEPAD_BUTTON_14},
+	    {     "GAMEPAD_BUTTON_15",      GAMEPAD_BUTTON_15},
+	    {     "GAMEPAD_BUTTON_16",      GAMEPAD_BUTTON_16},
+	    {      "GAMEPAD_BUTTON_2",       GAMEPAD_BUTTON_2},
+	    {      "GAMEPAD_BUTTON_3",       GAMEPAD_BUTTON_3},
+	    {      "GAMEPAD_BUTTON_4",       GAMEPAD_BUTTON_4},
+	    {      "GAMEPAD_BUTTON_5",       GAMEPAD_BUTTON_5},
+	    {      "GAMEPAD_BUTTON_6",       GAMEPAD_BUTTON_6},
+	    {      "GAMEPAD_BUTTON_7",       GAMEPAD_BUTTON_7},
+	    {      "GAMEPAD_BUTTON_8",       GAMEPAD_BUTTON_8},
+	    {      "GAMEPAD_BUTTON_9",       GAMEPAD_BUTTON_9},
+	    {          "GAMEPAD_DPAD",           GAMEPAD_DPAD},
+	    {        "GAMEPAD_LEFT_X",         GAMEPAD_LEFT_X},
+	    {        "GAMEPAD_LEFT_Y",         GAMEPAD_LEFT_Y},
+	    {       "GAMEPAD_RIGHT_X",        GAMEPAD_RIGHT_X},
+	    {       "GAMEPAD_RIGHT_Y",        GAMEPAD_RIGHT_Y},
+	    {                "GPIO13",            GPIO_NUM_13},
+	    {                "GPIO16",            GPIO_NUM_16},
+	    {                "GPIO17",            GPIO_NUM_17},
+	    {                "GPIO25",            GPIO_NUM_25},
+	    {                "GPIO26",            GPIO_NUM_26},
+	    {                "GPIO27",            GPIO_NUM_27},
+	    {                "GPIO32",            GPIO_NUM_32},
+	    {                "GPIO33",            GPIO_NUM_33},
+	    {                "GPIO34",            GPIO_NUM_34},
+	    {                "GPIO35",            GPIO_NUM_35},
+	    {                "GPIO36",            GPIO_NUM_36},
+	    {                "GPIO39",            GPIO_NUM_39},
+	    {              "NEOPIXEL",          NEOPIXEL_TYPE},
+	    {         "PINMODE_INPUT",          PINMODE_INPUT},
+	    {"PINMODE_INPUT_PULLDOWN", PINMODE_INPUT_PULLDOWN},
+	    {  "PINMODE_INPUT_PULLUP",   PINMODE_INPUT_PULLUP},
+	    {        "PINMODE_OUTPUT",         PINMODE_OUTPUT},
+	    {                 "PITCH",                  PITCH},
+	    {                 "PORT1",                  PORT1},
+	    {                 "PORT2",                  PORT2},
+	    {                 "PORT3",                  PORT3},
+	    {                 "PORT4",                  PORT4},
+	    {                  "ROLL",                   ROLL},
+	    {             "UART1_GP4",              UART1_GP4},
+	    {             "UART1_GP5",              UART1_GP5},
+	    {             "UART1_GP6",              UART1_GP6},
+	    {             "UART1_GP7",              UART1_GP7},
+	    {             "UART2_GP4",              UART2_GP4},
+	    {             "UART2_GP5",              UART2_GP5},
+	    {             "UART2_GP6",              UART2_GP6},
+	    {             "UART2_GP7",              UART2_GP7},
+	    {                   "YAW",                    YAW},
+	    {                 nullptr,                      0}
+    };
+	LuaRom::install(ls, libraries, constants);
 
 	return ls;
 }
 
+void Megahub::replaceLuaState() {
+	xSemaphoreTake(luaStateMutex_, portMAX_DELAY);
+	LuaHeap::Stats before;
+	luaHeap_->stats(before);
+
+	INFO("Closing Lua state of the previous program");
+	currentprogramstate_ = nullptr;
+	// Runs the finalizers, the heap must outlive the state
+	lua_close(globalLuaState_);
+	globalLuaState_ = newLuaState();
+	xSemaphoreGive(luaStateMutex_);
+
+	INFO("Reclaimed %d bytes of Lua memory, peak was %d bytes", (int) before.liveBytes, (int) before.peakBytes);
+}
+
+void Megahub::programMemory(LuaHeap::Stats& out, LuaHeap::Stats& base) {
+	xSemaphoreTake(luaStateMutex_, portMAX_DELAY);
+	luaHeap_->stats(out);
+	base = luaBase_;
+	xSemaphoreGive(luaStateMutex_);
+}
+
 Megahub::Megahub(InputDevices* inputDevices, LegoDevice* device1, LegoDevice* device2, LegoDevice* device3,
                  LegoDevice* device4, IMU* imu)
     : inputdevices_(inputDevices), device1_(device1), device2_(device2), device3_(device3), device4_(device4),
       imu_(imu) {
 
-	// Initialize lua_global_mutex (global, created once per application lifetime)
-	lua_global_mutex = xSemaphoreCreateMutex();
-	if (!lua_global_mutex) {
-		ESP_LOGE("Megahub", "Failed to create lua_global_mutex");
-		// Cannot safely proceed without mutex
+	luaStateMutex_ = xSemaphoreCreateMutex();
+	if (!luaStateMutex_) {
+		ESP_LOGE("Megahub", "Failed to create luaStateMutex_");
 		abort();
 	}
 
+	bindingContext_.leds = nullptr;
 	globalLuaState_ = newLuaState();
 
 	currentprogramstate_ = nullptr;
@@ -491,6 +510,11 @@ Megahub::Megahub(InputDevices* inputDevices, LegoDevice* device1, LegoDevice* de
 
 	// Create the task
 	xTaskCreate(status_reporter_task, "PortStatus", 4096, (void*) this, 1, &statusReporterTaskHandle);
+
+	// LEGO port reception runs in its own task and blocks between service cycles,
+	// so it no longer spins in the Arduino loop. Priority is above the Lua threads,
+	// periodic ones included, to keep FIFO draining ahead of program code.
+	xTaskCreate(port_service_task, "PortService", 4096, (void*) this, PORT_SERVICE_PRIORITY, &portServiceTaskHandle_);
 }
 
 Megahub::~Megahub() {
@@ -498,21 +522,94 @@ Megahub::~Megahub() {
 		vTaskDelete(statusReporterTaskHandle);
 		statusReporterTaskHandle = nullptr;
 	}
+	if (portServiceTaskHandle_) {
+		vTaskDelete(portServiceTaskHandle_);
+		portServiceTaskHandle_ = nullptr;
+	}
+	scheduler_.reset();
 	lua_close(globalLuaState_);
 	if (runningThreadsMutex_) {
 		vSemaphoreDelete(runningThreadsMutex_);
 		runningThreadsMutex_ = nullptr;
 	}
+	if (luaStateMutex_) {
+		vSemaphoreDelete(luaStateMutex_);
+		luaStateMutex_ = nullptr;
+	}
+}
+
+int Megahub::servicePorts(bool onlyPending) {
+	// With an IRQ line, only channels whose IIR reports pending data are drained;
+	// the others still run their timers (keep-alive, watchdog) without touching
+	// the bus. Every device is its own transaction, so pending actuation
+	// requests are served between two ports instead of after the whole sweep.
+	LegoDevice* devices[] = {device1_.get(), device2_.get(), device3_.get(), device4_.get()};
+	I2CScheduler* bus = I2CScheduler::instance();
+	int received = 0;
+	for (LegoDevice* device : devices) {
+		bus->execute(I2CPriority::RECEPTION, [device, onlyPending, &received]() {
+			bool drain = !onlyPending || device->hasPendingData();
+			received += device->loop(drain);
+		});
+	}
+	bus->execute(I2CPriority::RECEPTION, [this]() { imu_->loop(); });
+	return received;
+}
+
+void Megahub::enablePortInterrupt(int gpio, int channelAPort, int channelBPort) {
+	LegoDevice* channelA = port(channelAPort);
+	LegoDevice* channelB = port(channelBPort);
+	if (channelA == nullptr || channelB == nullptr) {
+		return;
+	}
+	INFO("Enabling LEGO port interrupt for ports %d and %d on GPIO %d", channelAPort, channelBPort, gpio);
+	// Only the chip driving this line. The ports of a chip without IRQ line keep
+	// reporting through available() and are drained by the timer pass.
+	I2CScheduler::instance()->execute(I2CPriority::RECEPTION, [channelA, channelB]() {
+		channelA->enableRxInterrupt();
+		channelB->enableRxInterrupt();
+	});
+
+	// The SC16IS752 IRQ output is active low and open drain
+	pinMode(gpio, INPUT_PULLUP);
+	attachInterruptArg(gpio, port_irq_handler, this, FALLING);
+	portInterruptEnabled_ = true;
+}
+
+void IRAM_ATTR Megahub::notifyPortInterruptFromISR() {
+	if (portServiceTaskHandle_ == nullptr) {
+		return;
+	}
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
+	vTaskNotifyGiveFromISR(portServiceTaskHandle_, &higherPriorityTaskWoken);
+	if (higherPriorityTaskWoken) {
+		portYIELD_FROM_ISR();
+	}
 }
 
-void Megahub::loop() {
-	i2c_lock();
-	device1_->loop();
-	device2_->loop();
-	device3_->loop();
-	device4_->loop();
-	imu_->loop();
-	i2c_unlock();
+void Megahub::portServiceLoop() {
+	int pollInterval = PORT_SERVICE_MIN_POLL_MS;
+	while (true) {
+		if (portInterruptEnabled_) {
+			// Woken by the IRQ or by the timer. The timer pass doubles as a safety
+			// sweep over the IIRs in case an edge was missed. Drain until no channel
+			// reports pending data, so the shared IRQ line is released and the next
+			// byte produces a fresh edge.
+			ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(PORT_SERVICE_TIMER_MS));
+			for (int round = 0; round < 4; round++) {
+				if (servicePorts(true) == 0) {
+					break;
+				}
+			}
+		} else {
+			if (servicePorts(false) > 0) {
+				pollInterval = PORT_SERVICE_MIN_POLL_MS;
+			} else if (pollInterval < PORT_SERVICE_MAX_POLL_MS) {
+				pollInterval *= 2;
+			}
+			vTaskDelay(pdMS_TO_TICKS(pollInterval));
+		}
+	}
 }
 
 LegoDevice* Megahub::port(int num) {
@@ -536,6 +633,10 @@ IMU* Megahub::imu() {
 	return imu_.get();
 }
 
+LuaHeap* Megahub::luaHeap() {
+	return luaHeap_.get();
+}
+
 String Megahub::deviceUid() {
 	return deviceUid_;
 }
@@ -560,17 +661,26 @@ String Megahub::serialnumber() {
 	return deviceUid();
 }
 
-LuaCheckResult Megahub::checkLUACode(String luaCode) {
+LuaCheckResult Megahub::checkLUACode(LuaSource& luaCode) {
 	INFO("Performing syntax check for Lua code of size %d", luaCode.length());
 	LuaCheckResult result;
 
 	long startTime = millis();
 
+	// A bare state of its own, parsing needs no libraries, and the program
+	// state may be replaced by a run meanwhile
 	INFO("Creating temporary Lua state for syntax check");
-	lua_State* tempState = lua_newthread(globalLuaState_);
+	lua_State* tempState = luaL_newstate();
+	if (tempState == nullptr) {
+		result.success = false;
+		result.parseTime = 0;
+		result.errorMessage = String("not enough memory");
+		return result;
+	}
 
 	INFO("Starting to parse Lua code (just compile, no execution)");
-	int luaResult = luaL_loadstring(tempState, luaCode.c_str());
+	luaCode.rewind();
+	int luaResult = lua_load(tempState, LuaSource::reader, &luaCode, "=program", "t");
 
 	long endTime = millis();
 
@@ -587,7 +697,7 @@ LuaCheckResult Megahub::checkLUACode(String luaCode) {
 	}
 
 	INFO("Closing temporary Lua state for syntax check");
-	lua_closethread(tempState, globalLuaState_);
+	lua_close(tempState);
 
 	INFO("Syntax check completed in %ld milliseconds with result %s", result.parseTime,
 	     result.success ? "success" : "failure");
@@ -595,13 +705,36 @@ LuaCheckResult Megahub::checkLUACode(String luaCode) {
 	return result;
 }
 
-void Megahub::executeLUACode(String luaCode) {
-	INFO("Executing Lua code of size %d", luaCode.length());
+void Megahub::enableBytecodeCache(BytecodeCache* cache) {
+	bytecodeCache_.reset(cache);
+}
 
-	stopRunningThreads();
+void Megahub::enableCooperativeThreads(int stackSize) {
+	INFO("Enabling cooperative Lua threads with scheduler stack size %d", stackSize);
+	scheduler_.reset(new LuaScheduler(this, stackSize));
+}
+
+LuaScheduler* Megahub::scheduler() {
+	return scheduler_.get();
+}
 
-	if (currentprogramstate_ != nullptr) {
-		INFO("Closing existing Lua program state");
+void Megahub::enableLineProfiler(int sampleInstructions) {
+	LineProfiler::instance()->enable(sampleInstructions);
+}
+
+LuaExecuteResult Megahub::executeLUACode(LuaSource& luaCode) {
+	INFO("Executing Lua code of size %d", luaCode.length());
+	LuaExecuteResult result;
+	result.fromCache = false;
+	result.parseTime = 0;
+	result.loadTime = 0;
+
+	bool stopped = stopRunningThreads();
+	if (stopped) {
+		// Globals, registry references and userdata of the previous program go with its state
+		replaceLuaState();
+	} else if (currentprogramstate_ != nullptr) {
+		WARN("Lua threads still running, the state of the previous program is kept");
 		lua_closethread(currentprogramstate_, globalLuaState_);
 		currentprogramstate_ = nullptr;
 	}
@@ -610,35 +743,83 @@ void Megahub::executeLUACode(String luaCode) {
 	// Must happen after stopping threads (which may hold handles) and before
 	// creating the new program thread.
 	alg_reset_all_states();
+	// Samples refer to the chunks of the previous program
+	LineProfiler::instance()->reset();
+	// Collector settings are per program
+	GcPacer::instance()->reset(globalLuaState_);
+	// Channels of the previous program and its isolated threads
+	if (stopped) {
+		LuaChannel::resetAll();
+	} else {
+		// Threads still running may use their channels, they are leaked like the old state
+		LuaChannel::abandonAll();
+	}
 
 	long startTime = millis();
 
 	INFO("Creating Lua state");
 	currentprogramstate_ = lua_newthread(globalLuaState_);
 
-	INFO("Executing Lua code");
-	int luaResult = luaL_dostring(currentprogramstate_, luaCode.c_str());
+	int luaResult = LUA_OK;
+	if (bytecodeCache_ && bytecodeCache_->load(currentprogramstate_, luaCode)) {
+		result.fromCache = true;
+		result.loadTime = millis() - startTime;
+		INFO("Loaded cached bytecode in %d milliseconds", result.loadTime);
+	} else {
+		// Text only, precompiled chunks from clients are not accepted
+		luaCode.rewind();
+		luaResult = lua_load(currentprogramstate_, LuaSource::reader, &luaCode, "=program", "t");
+		result.parseTime = millis() - startTime;
+		INFO("Parsed Lua code in %d milliseconds", result.parseTime);
+	}
+
+	bool compiled = luaResult == LUA_OK && !result.fromCache;
+	if (luaResult == LUA_OK) {
+		if (compiled && bytecodeCache_) {
+			// Keep a reference to the main function, it is dumped once the program runs
+			lua_pushvalue(currentprogramstate_, -1);
+		}
+		INFO("Executing Lua code");
+		luaResult = lua_pcall(currentprogramstate_, 0, 0, 0);
+	}
 
 	long time = millis() - startTime;
 
 	if (luaResult != LUA_OK) {
 		INFO("Lua execution failed with error %s", lua_tostring(currentprogramstate_, -1));
+		result.errorMessage = String(lua_tostring(currentprogramstate_, -1));
 		lua_pop(currentprogramstate_, 1);
 		reinitializeDevices();
 	}
+	if (compiled && bytecodeCache_) {
+		// Cached only after a successful run, a program failing at startup is compiled again next time
+		if (luaResult == LUA_OK) {
+			bytecodeCache_->store(currentprogramstate_, luaCode);
+		}
+		lua_pop(currentprogramstate_, 1);
+	}
+	result.success = luaResult == LUA_OK;
 
 	INFO("Execution completed in %ld milliseconds", time);
+	return result;
 }
 
 bool Megahub::stopLUACode() {
 	INFO("Stopping Lua code execution");
 
-	stopRunningThreads();
+	if (stopRunningThreads()) {
+		replaceLuaState();
+	}
 	reinitializeDevices();
 
 	return true;
 }
 
+void Megahub::resetThreadStatistics() {
+	ThreadStatistics::requestReset();
+	LineProfiler::instance()->reset();
+}
+
 int Megahub::digitalReadFrom(int pin) {
 	int value = 0;
 	switch (pin) {
@@ -757,12 +938,19 @@ void Megahub::setPinMode(int pin, int mode) {
 }
 
 void Megahub::registerThread(TaskHandle_t handle) {
+	threadTasks_++;
 	xSemaphoreTake(runningThreadsMutex_, portMAX_DELAY);
 	runningThreads_.push_back(handle);
 	xSemaphoreGive(runningThreadsMutex_);
 }
 
-void Megahub::stopRunningThreads() {
+void Megahub::threadTaskExited() {
+	// May run before registerThread() if the task ended right away, the count
+	// is only read once both happened
+	threadTasks_--;
+}
+
+bool Megahub::stopRunningThreads() {
 	xSemaphoreTake(runningThreadsMutex_, portMAX_DELAY);
 	for (int i = 0; i < (int) runningThreads_.size(); i++) {
 		INFO("Stopping thread #%d", i);
@@ -772,9 +960,28 @@ void Megahub::stopRunningThreads() {
 	runningThreads_.clear();
 	xSemaphoreGive(runningThreadsMutex_);
 
-	if (hadThreads) {
-		vTaskDelay(pdMS_TO_TICKS(100));
+	// Also waits for tasks no longer in the list, e.g. stopped by hub.stopthread()
+	// but still finishing an iteration
+	bool stopped = true;
+	if (hadThreads || threadTasks_.load() > 0) {
+		stopped = false;
+		for (int waited = 0; waited < THREAD_STOP_TIMEOUT_MS; waited += THREAD_STOP_POLL_MS) {
+			vTaskDelay(pdMS_TO_TICKS(THREAD_STOP_POLL_MS));
+			if (threadTasks_.load() <= 0) {
+				stopped = true;
+				break;
+			}
+		}
+		if (!stopped) {
+			WARN("%d Lua thread tasks did not stop within %d milliseconds", threadTasks_.load(),
+			     THREAD_STOP_TIMEOUT_MS);
+		}
+	}
+
+	if (scheduler_ && !scheduler_->stopAll()) {
+		stopped = false;
 	}
+	return stopped;
 }
 
 void Megahub::stopThread(TaskHandle_t handle) {
@@ -785,6 +992,39 @@ void Megahub::stopThread(TaskHandle_t handle) {
 	xSemaphoreGive(runningThreadsMutex_);
 }
 
+void Megahub::registerPeriodicThread(TaskHandle_t handle, unsigned long periodMs) {
+	xSemaphoreTake(runningThreadsMutex_, portMAX_DELAY);
+	periodicThreads_.push_back({handle, periodMs});
+	assignPeriodicPriorities();
+	xSemaphoreGive(runningThreadsMutex_);
+}
+
+void Megahub::unregisterPeriodicThread(TaskHandle_t handle) {
+	xSemaphoreTake(runningThreadsMutex_, portMAX_DELAY);
+	periodicThreads_.erase(std::remove_if(periodicThreads_.begin(), periodicThreads_.end(),
+	                                      [handle](const PeriodicThread& t) { return t.handle == handle; }),
+	                       periodicThreads_.end());
+	assignPeriodicPriorities();
+	xSemaphoreGive(runningThreadsMutex_);
+}
+
+void Megahub::assignPeriodicPriorities() {
+	// Rate-monotonic, the shortest period gets LUA_PERIODIC_PRIORITY_MAX and
+	// every longer period one level less. Equal periods share a level, and
+	// when there are more periods than levels the longest ones share the lowest.
+	std::vector<PeriodicThread> byPeriod = periodicThreads_;
+	std::sort(byPeriod.begin(), byPeriod.end(),
+	          [](const PeriodicThread& a, const PeriodicThread& b) { return a.periodMs < b.periodMs; });
+
+	UBaseType_t priority = LUA_PERIODIC_PRIORITY_MAX;
+	for (size_t i = 0; i < byPeriod.size(); i++) {
+		if (i > 0 && byPeriod[i].periodMs != byPeriod[i - 1].periodMs && priority > LUA_PERIODIC_PRIORITY_MIN) {
+			priority--;
+		}
+		vTaskPrioritySet(byPeriod[i].handle, priority);
+	}
+}
+
 void Megahub::reinitializeDevices() {
 	INFO("Reinitializing LEGO devices");
 	device1_->initialize();
@@ -793,10 +1033,10 @@ void Megahub::reinitializeDevices() {
 	device4_->initialize();
 }
 
-void Megahub::notifyThreadExitedAbnormally() {
+void Megahub::notifyThreadExitedAbnormally(TaskHandle_t handle) {
 	INFO("Lua thread exited abnormally, reinitializing LEGO devices");
 	xSemaphoreTake(runningThreadsMutex_, portMAX_DELAY);
-	runningThreads_.clear();
+	runningThreads_.erase(std::remove(runningThreads_.begin(), runningThreads_.end(), handle), runningThreads_.end());
 	xSemaphoreGive(runningThreadsMutex_);
 	reinitializeDevices();
 }
@@ -0,0 +1,245 @@
+#include "threadstatistics.h"
+
+#include "commands.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <climits>
+
+// Smoothing factor for the exponential moving average
+static const float averageAlpha = 0.01f;
+
+LatencyHistogram::LatencyHistogram() : counts_(bucketCount, 0), total_(0), max_(0) {}
+
+int LatencyHistogram::bucketOf(uint32_t micros) {
+	if (micros < (uint32_t) linearBuckets) {
+		return (int) micros;
+	}
+	int exponent = 31 - __builtin_clz(micros);
+	if (exponent > maxExponent) {
+		return bucketCount - 1;
+	}
+	int subBucket = (micros >> (exponent - subBucketBits)) & ((1 << subBucketBits) - 1);
+	return linearBuckets + (exponent - 4) * (1 << subBucketBits) + subBucket;
+}
+
+uint32_t LatencyHistogram::bucketLowest(int bucket) {
+	if (bucket < linearBuckets) {
+		return (uint32_t) bucket;
+	}
+	int exponent = 4 + (bucket - linearBuckets) / (1 << subBucketBits);
+	uint32_t subBucket = (bucket - linearBuckets) % (1 << subBucketBits);
+	return ((1u << subBucketBits) + subBucket) << (exponent - subBucketBits);
+}
+
+uint32_t LatencyHistogram::bucketHighest(int bucket) {
+	if (bucket < linearBuckets) {
+		return (uint32_t) bucket;
+	}
+	if (bucket == bucketCount - 1) {
+		return UINT32_MAX;
+	}
+	return bucketLowest(bucket + 1) - 1;
+}
+
+void LatencyHistogram::record(uint32_t micros) {
+	counts_[bucketOf(micros)]++;
+	total_++;
+	if (micros > max_) {
+		max_ = micros;
+	}
+}
+
+void LatencyHistogram::reset() {
+	std::fill(counts_.begin(), counts_.end(), 0);
+	total_ = 0;
+	max_ = 0;
+}
+
+uint32_t LatencyHistogram::percentile(uint32_t perMille) const {
+	if (total_ == 0) {
+		return 0;
+	}
+	// Rank of the value at the quantile, 1-based, rounded up
+	uint32_t rank = (uint32_t) (((uint64_t) total_ * perMille + 999) / 1000);
+	if (rank < 1) {
+		rank = 1;
+	}
+
+	uint32_t seen = 0;
+	for (int i = 0; i < bucketCount; i++) {
+		seen += counts_[i];
+		if (seen >= rank) {
+			uint32_t highest = bucketHighest(i);
+			return highest < max_ ? highest : max_;
+		}
+	}
+	return max_;
+}
+
+void LatencyHistogram::serialize(JsonArray target) const {
+	for (int i = 0; i < bucketCount; i++) {
+		if (counts_[i] > 0) {
+			target.add(bucketLowest(i));
+			target.add(counts_[i]);
+		}
+	}
+}
+
+std::atomic<uint32_t> ThreadStatistics::resetGeneration_(0);
+
+ThreadStatistics::ThreadStatistics()
+    : generation_(resetGeneration_.load()), minDuration_(ULONG_MAX), maxDuration_(0), avgDuration_(0.0f),
+      firstIteration_(true), lastReport_(millis()), periodMicros_(0), releases_(0), missedDeadlines_(0),
+      maxJitter_(0), avgJitter_(0.0f), maxGc_(0), avgGc_(0.0f), gcRecorded_(false) {}
+
+void ThreadStatistics::requestReset() {
+	INFO("Resetting thread statistics");
+	resetGeneration_++;
+}
+
+void ThreadStatistics::resetIfRequested() {
+	uint32_t generation = resetGeneration_.load();
+	if (generation == generation_) {
+		return;
+	}
+	generation_ = generation;
+
+	minDuration_ = ULONG_MAX;
+	maxDuration_ = 0;
+	avgDuration_ = 0.0f;
+	firstIteration_ = true;
+	histogram_.reset();
+
+	releases_ = 0;
+	missedDeadlines_ = 0;
+	maxJitter_ = 0;
+	avgJitter_ = 0.0f;
+
+	maxGc_ = 0;
+	avgGc_ = 0.0f;
+	gcRecorded_ = false;
+}
+
+void ThreadStatistics::setPeriod(unsigned long periodMicros) {
+	periodMicros_ = periodMicros;
+}
+
+void ThreadStatistics::record(unsigned long durationMicros) {
+	resetIfRequested();
+
+	if (durationMicros < minDuration_) {
+		minDuration_ = durationMicros;
+	}
+	if (durationMicros > maxDuration_) {
+		maxDuration_ = durationMicros;
+	}
+	histogram_.record(durationMicros);
+
+	// Exponential moving average (no counter needed, avoids overflow)
+	if (firstIteration_) {
+		avgDuration_ = (float) durationMicros;
+		firstIteration_ = false;
+	} else {
+		avgDuration_ = averageAlpha * (float) durationMicros + (1.0f - averageAlpha) * avgDuration_;
+	}
+}
+
+void ThreadStatistics::recordRelease(unsigned long startMicros, unsigned long previousStartMicros,
+                                     unsigned long periods) {
+	resetIfRequested();
+
+	releases_++;
+	if (releases_ == 1) {
+		// No previous release to compare with
+		return;
+	}
+
+	// Measured against the release it was scheduled for
+	long deviation = (long) (startMicros - previousStartMicros - periods * periodMicros_);
+	unsigned long jitter = deviation < 0 ? -deviation : deviation;
+	if (jitter > maxJitter_) {
+		maxJitter_ = jitter;
+	}
+	if (releases_ == 2) {
+		avgJitter_ = (float) jitter;
+	} else {
+		avgJitter_ = averageAlpha * (float) jitter + (1.0f - averageAlpha) * avgJitter_;
+	}
+}
+
+void ThreadStatistics::recordMissedDeadlines(unsigned long count) {
+	missedDeadlines_ += count;
+}
+
+void ThreadStatistics::recordGc(unsigned long durationMicros) {
+	resetIfRequested();
+
+	if (durationMicros > maxGc_) {
+		maxGc_ = durationMicros;
+	}
+	// Iterations without collector work count as 0, the average is per iteration
+	if (!gcRecorded_) {
+		avgGc_ = (float) durationMicros;
+		gcRecorded_ = true;
+	} else {
+		avgGc_ = averageAlpha * (float) durationMicros + (1.0f - averageAlpha) * avgGc_;
+	}
+}
+
+void ThreadStatistics::reportIfDue(const String& blockId, unsigned long nowMillis) {
+	if (nowMillis - lastReport_ < reportIntervalMs) {
+		return;
+	}
+	lastReport_ = nowMillis;
+
+	JsonDocument doc;
+	doc["type"] = "thread_statistics";
+	doc["blockid"] = blockId;
+	doc["min"] = minDuration_;
+	doc["max"] = maxDuration_;
+	doc["avg"] = avgDuration_;
+	doc["count"] = histogram_.count();
+	JsonArray percentiles = doc["pct"].to<JsonArray>();
+	percentiles.add(histogram_.percentile(500));
+	percentiles.add(histogram_.percentile(900));
+	percentiles.add(histogram_.percentile(990));
+	percentiles.add(histogram_.percentile(999));
+	histogram_.serialize(doc["hist"].to<JsonArray>());
+	if (periodMicros_ > 0) {
+		doc["period"] = periodMicros_;
+		doc["releases"] = releases_;
+		doc["missed"] = missedDeadlines_;
+		doc["jitter_avg"] = avgJitter_;
+		doc["jitter_max"] = maxJitter_;
+	}
+	if (gcRecorded_) {
+		doc["gc_avg"] = avgGc_;
+		doc["gc_max"] = maxGc_;
+	}
+	if (measureJson(doc) >= COMMAND_MESSAGE_SIZE) {
+		// Too widely spread for one command, the percentiles still tell the tail
+		doc.remove("hist");
+	}
+
+	String strCommand;
+	serializeJson(doc, strCommand);
+
+	// Enqueue command
+	Commands::instance()->queue(strCommand);
+}
+
+void ThreadStatistics::log() {
+	INFO("Thread stats - min: %lu µs, max: %lu µs, avg: %.2f µs", minDuration_, maxDuration_, avgDuration_);
+	INFO("Thread stats - count: %lu, p50: %lu µs, p90: %lu µs, p99: %lu µs, p99.9: %lu µs",
+	     (unsigned long) histogram_.count(), (unsigned long) histogram_.percentile(500),
+	     (unsigned long) histogram_.percentile(900), (unsigned long) histogram_.percentile(990),
+	     (unsigned long) histogram_.percentile(999));
+	if (periodMicros_ > 0) {
+		INFO("Period stats - period: %lu µs, releases: %lu, missed: %lu, jitter avg: %.2f µs, max: %lu µs",
+		     periodMicros_, releases_, missedDeadlines_, avgJitter_, maxJitter_);
+	}
+	if (gcRecorded_) {
+		INFO("Collector stats - between iterations avg: %.2f µs, max: %lu µs", avgGc_, maxGc_);
+	}
+}
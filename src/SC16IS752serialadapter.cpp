@@ -12,6 +12,7 @@ SC16IS752SerialAdapter::SC16IS752SerialAdapter(SC16IS752* hardwareserial, SC16IS
 	m1pin_ = m1pin;
 	m2pin_ = m2pin;
 	i2cAddress_ = i2cAddress;
+	rxInterruptEnabled_ = false;
 
 	hardwareserial_->pinMode(m1pin, OUTPUT);
 	hardwareserial_->pinMode(m2pin, OUTPUT);
@@ -65,21 +66,105 @@ uint8_t SC16IS752SerialAdapter::readRegisterDirect(uint8_t channel, uint8_t reg_
 	return result;
 }
 
+void SC16IS752SerialAdapter::writeRegisterDirect(uint8_t channel, uint8_t reg_addr, uint8_t value) {
+	Wire.beginTransmission(i2cAddress_);
+	Wire.write((reg_addr << 3 | channel << 1));
+	Wire.write(value);
+	Wire.endTransmission(1);
+}
+
+void SC16IS752SerialAdapter::enableRxInterrupt() {
+	uint8_t ch = (channel_ == CHANNEL_A) ? SC16IS752_CHANNEL_A : SC16IS752_CHANNEL_B;
+	// IER bit 0: RHR interrupt. With the FIFO enabled this also covers the RX
+	// timeout, so a frame shorter than the trigger level still raises IRQ.
+	uint8_t ier = readRegisterDirect(ch, SC16IS750_REG_IER);
+	writeRegisterDirect(ch, SC16IS750_REG_IER, ier | 0x01);
+	rxInterruptEnabled_ = true;
+}
+
+bool SC16IS752SerialAdapter::rxPending() {
+	if (!rxInterruptEnabled_) {
+		return available() > 0;
+	}
+	uint8_t ch = (channel_ == CHANNEL_A) ? SC16IS752_CHANNEL_A : SC16IS752_CHANNEL_B;
+	// IIR bit 0 is low while an interrupt is pending on this channel. Both
+	// channels share one IRQ line, so this tells us which one to drain.
+	return (readRegisterDirect(ch, SC16IS750_REG_IIR) & 0x01) == 0;
+}
+
 void SC16IS752SerialAdapter::sendByte(int byteData) {
 
 	// INFO("Sending output : %s", this->formatByte(byteData).c_str());
 	hardwareserial_->write(channel_ == CHANNEL_A ? SC16IS752_CHANNEL_A : SC16IS752_CHANNEL_B, byteData);
 }
 
+int SC16IS752SerialAdapter::readBytes(uint8_t* buffer, int maxLength) {
+	uint8_t ch = (channel_ == CHANNEL_A) ? SC16IS752_CHANNEL_A : SC16IS752_CHANNEL_B;
+
+	// One RXLVL read tells us how many bytes are waiting. The RHR sub-address is
+	// not auto-incremented by the SC16IS752, so a single multi-byte read of RHR
+	// drains that many bytes from the FIFO in one I2C transaction instead of one
+	// available()/read() pair per byte.
+	int level = readRegisterDirect(ch, SC16IS750_REG_RXLVL);
+	int toRead = level < maxLength ? level : maxLength;
+	if (toRead > fifoSize) {
+		toRead = fifoSize;
+	}
+	if (toRead <= 0) {
+		return 0;
+	}
+
+	Wire.beginTransmission(i2cAddress_);
+	Wire.write((SC16IS750_REG_RHR << 3 | ch << 1));
+	Wire.endTransmission(0);
+	int received = Wire.requestFrom(i2cAddress_, (uint8_t) toRead);
+	for (int i = 0; i < received; i++) {
+		buffer[i] = Wire.read();
+	}
+
+	return received;
+}
+
+void SC16IS752SerialAdapter::writeBytes(const uint8_t* buffer, int length) {
+	uint8_t ch = (channel_ == CHANNEL_A) ? SC16IS752_CHANNEL_A : SC16IS752_CHANNEL_B;
+
+	int written = 0;
+	while (written < length) {
+		// TXLVL reports free space in the TX FIFO. LUMP commands are at most a
+		// few bytes, so this is a single burst in practice; the loop only matters
+		// if the FIFO is still draining a previous command at 2400 baud.
+		int space = readRegisterDirect(ch, SC16IS750_REG_TXLVL);
+		if (space == 0) {
+			vTaskDelay(pdMS_TO_TICKS(1));
+			continue;
+		}
+		int chunk = length - written;
+		if (chunk > space) {
+			chunk = space;
+		}
+
+		Wire.beginTransmission(i2cAddress_);
+		Wire.write((SC16IS750_REG_THR << 3 | ch << 1));
+		Wire.write(&buffer[written], chunk);
+		Wire.endTransmission(1);
+		written += chunk;
+	}
+}
+
 void SC16IS752SerialAdapter::switchToBaudrate(long serialSpeed) {
-	hardwareserial_->flush(channel_ == CHANNEL_A ? SC16IS752_CHANNEL_A : SC16IS752_CHANNEL_B);
+	// No flush and no settle delay here: both would block the port service task,
+	// and with it every other port, for the duration of the switch. LegoDevice
+	// waits for txIdle() and lets the line settle between two loop() calls.
 	if (channel_ == CHANNEL_A) {
 		hardwareserial_->beginA(serialSpeed);
 	} else {
 		hardwareserial_->beginB(serialSpeed);
 	}
 
-	vTaskDelay(pdMS_TO_TICKS(10));
+	// begin() reprograms the channel, re-arm the RX interrupt if it was enabled.
+	if (rxInterruptEnabled_) {
+		enableRxInterrupt();
+	}
 
 	// Basic verification: ensure the call didn't cause a crash and log success.
 	INFO("Switched serial to %ld baud", serialSpeed);
@@ -89,6 +174,18 @@ void SC16IS752SerialAdapter::flush() {
 	hardwareserial_->flush(channel_ == CHANNEL_A ? SC16IS752_CHANNEL_A : SC16IS752_CHANNEL_B);
 }
 
+bool SC16IS752SerialAdapter::txIdle() {
+	uint8_t ch = (channel_ == CHANNEL_A) ? SC16IS752_CHANNEL_A : SC16IS752_CHANNEL_B;
+	uint8_t lsr = readRegisterDirect(ch, SC16IS750_REG_LSR);
+	// Reading LSR clears the sticky OE bit, count it here so pollDiagnostics()
+	// does not miss an overrun.
+	if (lsr & 0x02) {
+		fifoOverrunCount_++;
+	}
+	// LSR bit 6: THR and TSR empty, the last stop bit has been shifted out.
+	return (lsr & 0x40) != 0;
+}
+
 uint32_t SC16IS752SerialAdapter::uartOverrunCount() {
 	return fifoOverrunCount_;
 }
@@ -20,9 +20,14 @@ class SC16IS752SerialAdapter : public SerialIO {
 	virtual int available();
 	virtual int readByte();
 	virtual void sendByte(int byteData);
+	virtual int readBytes(uint8_t* buffer, int maxLength);
+	virtual void writeBytes(const uint8_t* buffer, int length);
 	virtual void switchToBaudrate(long serialSpeed);
 	virtual void flush();
+	virtual bool txIdle();
 	virtual uint32_t uartOverrunCount();
+	virtual void enableRxInterrupt();
+	virtual bool rxPending();
 	virtual void pollDiagnostics();
 
 	virtual void setM1(bool status);
@@ -39,12 +44,17 @@ class SC16IS752SerialAdapter : public SerialIO {
 	int m2pin_;
 	uint32_t fifoOverrunCount_;
 	uint8_t i2cAddress_;
+	bool rxInterruptEnabled_;
 
 	/**
 	 * Read a register directly via I2C without using the base class private methods.
 	 * This is needed to access the LSR register for overrun detection.
 	 */
 	uint8_t readRegisterDirect(uint8_t channel, uint8_t reg_addr);
+	void writeRegisterDirect(uint8_t channel, uint8_t reg_addr, uint8_t value);
+
+	// Size of the SC16IS752 RX and TX FIFOs, per channel.
+	static const int fifoSize = 64;
 };
 
 #endif
@@ -3,9 +3,12 @@
 #include "SC16IS752.h"
 #include "SC16IS752serialadapter.h"
 #include "btremote.h"
+#include "bytecodecache.h"
 #include "commands.h"
 #include "configuration.h"
+#include "descriptorcache.h"
 #include "hubwebserver.h"
+#include "i2csync.h"
 #include "imu.h"
 #include "inputdevices.h"
 #include "legodevice.h"
@@ -32,12 +35,68 @@ SerialLoggingOutput* loggingOutput = NULL;
 InputDevices* inputDevices = NULL;
 BTRemote* btremote = NULL;
 MotorPWMController* pwmController = NULL;
+BytecodeCache* bytecodeCache = NULL;
 
 #define GPIO_SPI_SS   GPIO_NUM_4
 #define GPIO_SPI_SCK  GPIO_NUM_18
 #define GPIO_SPI_MOSI GPIO_NUM_23
 #define GPIO_SPI_MISO GPIO_NUM_19
 
+// SC16IS752 IRQ outputs. The current PCB does not route them to the ESP32, so
+// LEGO port reception falls back to adaptive polling. Set to the GPIO the IRQ
+// line is wired to on boards that have it.
+#define GPIO_UART1_IRQ GPIO_NUM_NC
+#define GPIO_UART2_IRQ GPIO_NUM_NC
+
+// Device descriptors learned during LEGO handshakes are kept on the SD card, so
+// known devices are recognized right after boot. Remove to keep them in RAM only.
+#define DESCRIPTOR_CACHE_FILE "/lumpcache.bin"
+
+// Compiled Lua programs are kept on the SD card, so running a program again
+// skips parsing. Remove to compile every run.
+#define LUA_BYTECODE_CACHE_DIR "/luacache"
+
+// Define to run the loops started by hub.startthread() as coroutines of one
+// scheduler task with this stack size, instead of a FreeRTOS task for each of
+// them. Opt-in, as it changes how programs behave: a loop without wait()
+// then delays all other threads, and so do blocking calls such as
+// lego.selectmode() with a timeout.
+// #define LUA_SCHEDULER_STACK_SIZE 8192
+
+// Lua threads started with profiling enabled are sampled every this many VM
+// instructions, the IDE highlights the blocks of their hottest lines. Remove
+// to report only the iteration timing.
+#define LUA_LINE_PROFILER_INSTRUCTIONS 1000
+
+#ifdef DESCRIPTOR_CACHE_FILE
+static void loadDescriptorCache() {
+	File file = SD.open(DESCRIPTOR_CACHE_FILE, FILE_READ);
+	if (!file) {
+		INFO("No device descriptor cache on SD card");
+		return;
+	}
+	std::vector<uint8_t> image(file.size());
+	size_t read = file.read(image.data(), image.size());
+	file.close();
+	if (read != image.size() || !DescriptorCache::instance()->deserialize(image.data(), image.size())) {
+		SD.remove(DESCRIPTOR_CACHE_FILE);
+	}
+}
+
+static void saveDescriptorCache() {
+	std::vector<uint8_t> image;
+	DescriptorCache::instance()->serialize(image);
+	File file = SD.open(DESCRIPTOR_CACHE_FILE, FILE_WRITE, true);
+	if (!file) {
+		WARN("Cannot write device descriptor cache to SD card");
+		return;
+	}
+	file.write(image.data(), image.size());
+	file.close();
+	INFO("Saved device descriptor cache (%d bytes)", (int) image.size());
+}
+#endif
+
 void setup() {
 	Serial.begin(115200);
 
@@ -88,6 +147,10 @@ void setup() {
 
 			uint64_t cardSize = SD.cardSize() / (1024 * 1024);
 			INFO("SD Card Size: %lluMB", cardSize);
+
+#ifdef DESCRIPTOR_CACHE_FILE
+			loadDescriptorCache();
+#endif
 		}
 	}
 	INFO("Free HEAP  is %d", ESP.getFreeHeap());
@@ -133,6 +196,24 @@ void setup() {
 
 	INFO("Initializing Megahub...")
 	megahub = new Megahub(inputDevices, legodevice1, legodevice2, legodevice3, legodevice4, imu);
+	if (GPIO_UART1_IRQ != GPIO_NUM_NC) {
+		megahub->enablePortInterrupt(GPIO_UART1_IRQ, PORT1, PORT2);
+	}
+	if (GPIO_UART2_IRQ != GPIO_NUM_NC) {
+		megahub->enablePortInterrupt(GPIO_UART2_IRQ, PORT3, PORT4);
+	}
+#ifdef LUA_BYTECODE_CACHE_DIR
+	if (SD.cardType() != CARD_NONE) {
+		bytecodeCache = new BytecodeCache(&SD, LUA_BYTECODE_CACHE_DIR, megahub->version().c_str());
+		megahub->enableBytecodeCache(bytecodeCache);
+	}
+#endif
+#ifdef LUA_SCHEDULER_STACK_SIZE
+	megahub->enableCooperativeThreads(LUA_SCHEDULER_STACK_SIZE);
+#endif
+#ifdef LUA_LINE_PROFILER_INSTRUCTIONS
+	megahub->enableLineProfiler(LUA_LINE_PROFILER_INSTRUCTIONS);
+#endif
 	INFO("Free HEAP  is %d", ESP.getFreeHeap());
 
 	INFO("Loading configuration");
@@ -187,6 +268,31 @@ void loop() {
 		vTaskList(task_list_buffer);
 		printf("%s\n", task_list_buffer);
 
+		static const char* priorityNames[] = {"actuation", "reception", "diagnostics"};
+		for (int i = 0; i < 3; i++) {
+			I2CLatencyStats stats = I2CScheduler::instance()->stats(static_cast<I2CPriority>(i));
+			uint32_t avgWait = stats.transactions > 0 ? (uint32_t) (stats.totalWaitMicros / stats.transactions) : 0;
+			INFO("I2C %s: %u transactions, %u coalesced, wait avg %u us / max %u us, exec max %u us",
+			     priorityNames[i], stats.transactions, stats.coalesced, avgWait, stats.maxWaitMicros,
+			     stats.maxExecMicros);
+		}
+		I2CScheduler::instance()->resetStats();
+
+		DescriptorCacheStats cacheStats = DescriptorCache::instance()->stats();
+		INFO("Descriptor cache: %u hits, %u misses, %u mismatches", cacheStats.hits, cacheStats.misses,
+		     cacheStats.mismatches);
+		if (bytecodeCache != NULL) {
+			BytecodeCacheStats luaCacheStats = bytecodeCache->stats();
+			INFO("Bytecode cache: %u hits, %u misses, %u rejected, %u stored", luaCacheStats.hits, luaCacheStats.misses,
+			     luaCacheStats.rejected, luaCacheStats.stores);
+		}
+#ifdef DESCRIPTOR_CACHE_FILE
+		// Written from here rather than from the port service task, SD access is slow
+		if (DescriptorCache::instance()->dirty() && SD.cardType() != CARD_NONE) {
+			saveDescriptorCache();
+		}
+#endif
+
 		lastHeapLog = currentMillis;
 	}
 
@@ -194,7 +300,7 @@ void loop() {
 		btremote->loop();
 	}
 
-	megahub->loop();
+	// LEGO ports are serviced by the Megahub port service task
 
 	if (configuration->isWiFiEnabled()) {
 		if (WiFi.status() == WL_CONNECTED) {
@@ -207,4 +313,7 @@ void loop() {
 			}
 		}
 	}
+
+	// Nothing here is latency critical; yield the core to the port service and Lua tasks
+	vTaskDelay(pdMS_TO_TICKS(10));
 }
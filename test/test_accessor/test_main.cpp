@@ -0,0 +1,195 @@
+// ---------------------------------------------------------------------------
+// Unit tests for the pre-bound sensor readers — AC-01..AC-05
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native --filter test_accessor
+//
+// Creates readers like lego.accessor() on the real Lua 5.4 library at
+// lib/lua/ and calls them from Lua. The device is a stand-in with a layout
+// generation and a list of dataset values; the closure, its userdata upvalue
+// and the generation check are reproduced inline (mirrors liblualego.cpp).
+// ---------------------------------------------------------------------------
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <unity.h>
+#include <vector>
+
+extern "C" {
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+}
+
+// ---------------------------------------------------------------------------
+// Stand-in for LegoDevice: modes are a list of dataset values
+// ---------------------------------------------------------------------------
+struct FakeDevice {
+	std::atomic<uint32_t> layoutGeneration;
+	bool handshakeComplete;
+	std::vector<std::vector<double>> modes;
+	int resolves;
+};
+
+static FakeDevice device;
+
+static void replug(std::vector<std::vector<double>> modes) {
+	device.modes = modes;
+	device.handshakeComplete = true;
+	device.layoutGeneration++;
+}
+
+static void unplug() {
+	device.modes.clear();
+	device.handshakeComplete = false;
+	device.layoutGeneration++;
+}
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of the reader of lego.accessor()
+// ---------------------------------------------------------------------------
+struct Accessor {
+	FakeDevice* device;
+	int modeIndex;
+	int datasetIndex;
+	double* dataset;
+	std::atomic<uint32_t> generation;
+};
+
+static void resolve(Accessor* accessor, uint32_t generation) {
+	double* dataset = nullptr;
+	accessor->device->resolves++;
+	if (accessor->device->handshakeComplete && accessor->modeIndex >= 0 &&
+	    accessor->modeIndex < (int) accessor->device->modes.size()) {
+		std::vector<double>& mode = accessor->device->modes[accessor->modeIndex];
+		if (accessor->datasetIndex >= 0 && accessor->datasetIndex < (int) mode.size()) {
+			dataset = &mode[accessor->datasetIndex];
+		}
+	}
+	accessor->dataset = dataset;
+	accessor->generation.store(generation, std::memory_order_release);
+}
+
+static int readaccessor(lua_State* L) {
+	Accessor* accessor = (Accessor*) lua_touserdata(L, lua_upvalueindex(1));
+	uint32_t generation = accessor->device->layoutGeneration.load(std::memory_order_acquire);
+	if (accessor->generation.load(std::memory_order_acquire) != generation) {
+		resolve(accessor, generation);
+	}
+	if (accessor->dataset != nullptr) {
+		lua_pushnumber(L, *accessor->dataset);
+		return 1;
+	}
+	lua_pushinteger(L, 0);
+	return 1;
+}
+
+static int accessor(lua_State* L) {
+	int modeIndex = luaL_checkinteger(L, 1);
+	int datasetIndex = luaL_checkinteger(L, 2);
+
+	Accessor* accessor = (Accessor*) lua_newuserdatauv(L, sizeof(Accessor), 0);
+	new (accessor) Accessor();
+	accessor->device = &device;
+	accessor->modeIndex = modeIndex;
+	accessor->datasetIndex = datasetIndex;
+	resolve(accessor, device.layoutGeneration.load());
+
+	lua_pushcclosure(L, readaccessor, 1);
+	return 1;
+}
+
+static lua_State* L = nullptr;
+
+static double evalNumber(const char* expression) {
+	lua_State* thread = lua_newthread(L);
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_loadstring(thread, expression));
+	TEST_ASSERT_EQUAL_INT(LUA_OK, lua_pcall(thread, 0, 1, 0));
+	double value = lua_tonumber(thread, -1);
+	lua_pop(L, 1);
+	return value;
+}
+
+void setUp() {
+	device.layoutGeneration = 0;
+	device.resolves = 0;
+	replug({{1.0}, {2.0, 3.0}, {4.0}});
+	L = luaL_newstate();
+	luaL_openlibs(L);
+	lua_register(L, "accessor", accessor);
+}
+
+void tearDown() {
+	lua_close(L);
+	L = nullptr;
+}
+
+// ---------------------------------------------------------------------------
+// AC-01: a reader returns the dataset it was bound to, resolved only once
+// ---------------------------------------------------------------------------
+void test_AC01_reader_returns_bound_dataset() {
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, "speed = accessor(1, 1)"));
+	TEST_ASSERT_EQUAL_INT(1, device.resolves);
+
+	TEST_ASSERT_EQUAL_FLOAT(3.0, evalNumber("local s = 0 for i = 1, 100 do s = s + speed() end return s / 100"));
+	device.modes[1][1] = 7.0;
+	TEST_ASSERT_EQUAL_FLOAT(7.0, evalNumber("return speed()"));
+	TEST_ASSERT_EQUAL_INT(1, device.resolves);
+}
+
+// ---------------------------------------------------------------------------
+// AC-02: an unplugged device reads 0 and the reader resolves again on replug
+// ---------------------------------------------------------------------------
+void test_AC02_replug_resolves_again() {
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, "speed = accessor(1, 1)"));
+
+	unplug();
+	TEST_ASSERT_EQUAL_FLOAT(0.0, evalNumber("return speed()"));
+
+	replug({{5.0}, {6.0, 8.0}});
+	TEST_ASSERT_EQUAL_FLOAT(8.0, evalNumber("return speed()"));
+	TEST_ASSERT_EQUAL_INT(3, device.resolves);
+}
+
+// ---------------------------------------------------------------------------
+// AC-03: a reader created before the device is connected starts to work later
+// ---------------------------------------------------------------------------
+void test_AC03_created_before_connect() {
+	unplug();
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, "color = accessor(0, 0)"));
+	TEST_ASSERT_EQUAL_FLOAT(0.0, evalNumber("return color()"));
+
+	replug({{9.0}});
+	TEST_ASSERT_EQUAL_FLOAT(9.0, evalNumber("return color()"));
+}
+
+// ---------------------------------------------------------------------------
+// AC-04: a dataset the device does not have reads 0
+// ---------------------------------------------------------------------------
+void test_AC04_missing_dataset_reads_zero() {
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, "a = accessor(0, 3) b = accessor(12, 0)"));
+	TEST_ASSERT_EQUAL_FLOAT(0.0, evalNumber("return a() + b()"));
+}
+
+// ---------------------------------------------------------------------------
+// AC-05: readers are upvalues of thread functions like hoisted Blockly locals
+// ---------------------------------------------------------------------------
+void test_AC05_shared_by_threads() {
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, "local pos = accessor(2, 0)\n"
+	                                               "f1 = function() return pos() end\n"
+	                                               "f2 = function() return pos() * 2 end\n"));
+	TEST_ASSERT_EQUAL_FLOAT(4.0, evalNumber("return f1()"));
+	TEST_ASSERT_EQUAL_FLOAT(8.0, evalNumber("return f2()"));
+	TEST_ASSERT_EQUAL_INT(1, device.resolves);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_AC01_reader_returns_bound_dataset);
+	RUN_TEST(test_AC02_replug_resolves_again);
+	RUN_TEST(test_AC03_created_before_connect);
+	RUN_TEST(test_AC04_missing_dataset_reads_zero);
+	RUN_TEST(test_AC05_shared_by_threads);
+	return UNITY_END();
+}
@@ -15,7 +15,7 @@ void tearDown() {}
 // ALG-MAP: Stateless linear mapping
 // ---------------------------------------------------------------------------
 
-static double alg_map_impl(double value, double inMin, double inMax, double outMin, double outMax) {
+static float alg_map_impl(float value, float inMin, float inMax, float outMin, float outMax) {
 	if (inMax == inMin) {
 		return outMin;
 	}
@@ -0,0 +1,161 @@
+// ---------------------------------------------------------------------------
+// Benchmark for the call overhead of the Lua C bindings — BB-01..BB-02
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native-bench --filter test_binding_bench
+//
+// A Lua loop calls a binding that fetches the hub pointer and reads one
+// field of it, the way hub.setmotorspeed() or lego.getmodedataset() start.
+// Compared are the former registry lookup by string key, a light userdata
+// upvalue on the C closure and the extra space of the Lua state (mirrors
+// luabindings.h). An empty binding is the baseline for the call itself.
+//
+// Reported per variant: ns/call and the overhead above the baseline, the
+// fastest of several runs. Host timings say nothing absolute about the
+// ESP32; only the order of the variants is checked.
+// ---------------------------------------------------------------------------
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <unity.h>
+
+extern "C" {
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+}
+
+typedef std::chrono::steady_clock BenchClock;
+
+static const int callsPerRun = 2000000;
+static const int runs = 5;
+
+struct FakeHub {
+	int value;
+};
+
+static FakeHub hub = {42};
+
+// ---------------------------------------------------------------------------
+// Variants of the context lookup
+// ---------------------------------------------------------------------------
+#define MEGAHUBREF_NAME "MEGAHUBTHISREF"
+
+static int binding_empty(lua_State* L) {
+	lua_pushinteger(L, 42);
+	return 1;
+}
+
+static int binding_registry(lua_State* L) {
+	lua_getfield(L, LUA_REGISTRYINDEX, MEGAHUBREF_NAME);
+	void** userdata = (void**) lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	FakeHub* h = (FakeHub*) (userdata ? *userdata : NULL);
+	lua_pushinteger(L, h->value);
+	return 1;
+}
+
+static int binding_upvalue(lua_State* L) {
+	FakeHub* h = (FakeHub*) lua_touserdata(L, lua_upvalueindex(1));
+	lua_pushinteger(L, h->value);
+	return 1;
+}
+
+struct Context {
+	FakeHub* hub;
+};
+
+static Context context = {&hub};
+
+static int binding_extraspace(lua_State* L) {
+	FakeHub* h = (*(Context**) lua_getextraspace(L))->hub;
+	lua_pushinteger(L, h->value);
+	return 1;
+}
+
+static lua_State* newBenchState() {
+	lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	void** userdata = (void**) lua_newuserdata(L, sizeof(void*));
+	*userdata = &hub;
+	lua_setfield(L, LUA_REGISTRYINDEX, MEGAHUBREF_NAME);
+
+	*(Context**) lua_getextraspace(L) = &context;
+
+	lua_register(L, "empty", binding_empty);
+	lua_register(L, "registry", binding_registry);
+	lua_pushlightuserdata(L, &hub);
+	lua_pushcclosure(L, binding_upvalue, 1);
+	lua_setglobal(L, "upvalue");
+	lua_register(L, "extraspace", binding_extraspace);
+	return L;
+}
+
+// Fastest run in ns per call, the program runs in a thread like a Lua program on the hub
+static double measure(lua_State* L, const char* function) {
+	char program[256];
+	snprintf(program, sizeof(program),
+	         "local f = %s local sum = 0 for i = 1, %d do sum = sum + f() end assert(sum == %d * 42)", function,
+	         callsPerRun, callsPerRun);
+
+	double best = 1e30;
+	for (int run = 0; run < runs; run++) {
+		lua_State* thread = lua_newthread(L);
+		TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_loadstring(thread, program));
+		BenchClock::time_point start = BenchClock::now();
+		TEST_ASSERT_EQUAL_INT(LUA_OK, lua_pcall(thread, 0, 0, 0));
+		double nanos =
+		    (double) std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - start).count();
+		lua_pop(L, 1);
+		if (nanos / callsPerRun < best) {
+			best = nanos / callsPerRun;
+		}
+	}
+	return best;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+// ---------------------------------------------------------------------------
+// BB-01: threads inherit the context of the main state
+// ---------------------------------------------------------------------------
+void test_BB01_threads_inherit_context() {
+	lua_State* L = newBenchState();
+	lua_State* thread = lua_newthread(L);
+	lua_State* nested = lua_newthread(thread);
+	TEST_ASSERT_EQUAL_PTR(&context, *(Context**) lua_getextraspace(thread));
+	TEST_ASSERT_EQUAL_PTR(&context, *(Context**) lua_getextraspace(nested));
+	lua_close(L);
+}
+
+// ---------------------------------------------------------------------------
+// BB-02: call overhead of the lookup variants
+// ---------------------------------------------------------------------------
+void test_BB02_call_overhead() {
+	lua_State* L = newBenchState();
+
+	double empty = measure(L, "empty");
+	double registry = measure(L, "registry");
+	double upvalue = measure(L, "upvalue");
+	double extraspace = measure(L, "extraspace");
+	lua_close(L);
+
+	printf("binding/empty       %7.2f ns/call\n", empty);
+	printf("binding/registry    %7.2f ns/call  (+%.2f)\n", registry, registry - empty);
+	printf("binding/upvalue     %7.2f ns/call  (+%.2f)\n", upvalue, upvalue - empty);
+	printf("binding/extraspace  %7.2f ns/call  (+%.2f)\n", extraspace, extraspace - empty);
+
+	TEST_ASSERT_TRUE(extraspace < registry);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_BB01_threads_inherit_context);
+	RUN_TEST(test_BB02_call_overhead);
+	return UNITY_END();
+}
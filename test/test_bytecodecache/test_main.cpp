@@ -0,0 +1,525 @@
+// ---------------------------------------------------------------------------
+// Unit tests for the Lua bytecode cache — BC-01..BC-08
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native --filter test_bytecodecache
+//
+// This file reproduces BytecodeCache and the LuaSource classes it reads
+// inline on top of an in-memory file system (std::string instead of String,
+// no mutex) to avoid the Arduino FS dependency on host. lua_dump()/luaL_loadbufferx() are the real Lua 5.4
+// library at lib/lua/, same as test_lua.
+// ---------------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+extern "C" {
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+}
+
+#define INFO(msg, ...)                                                                                                 \
+	do {                                                                                                               \
+	} while (0)
+#define WARN(msg, ...)                                                                                                 \
+	do {                                                                                                               \
+	} while (0)
+
+// ---------------------------------------------------------------------------
+// In-memory file system, one flat map of path -> content
+// ---------------------------------------------------------------------------
+struct MemoryFS {
+	std::map<std::string, std::vector<uint8_t>> files;
+
+	bool exists(const std::string& path) { return files.count(path) > 0; }
+	bool read(const std::string& path, std::vector<uint8_t>& out) {
+		auto it = files.find(path);
+		if (it == files.end()) {
+			return false;
+		}
+		out = it->second;
+		return true;
+	}
+	void write(const std::string& path, const std::vector<uint8_t>& data) { files[path] = data; }
+	void remove(const std::string& path) { files.erase(path); }
+	std::vector<std::string> list(const std::string& directory) {
+		std::vector<std::string> result;
+		for (auto& f : files) {
+			if (f.first.compare(0, directory.size() + 1, directory + "/") == 0) {
+				result.push_back(f.first);
+			}
+		}
+		return result;
+	}
+};
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of LuaSource (mirrors luasource.h / luasource.cpp)
+// ---------------------------------------------------------------------------
+class LuaSource {
+  public:
+	virtual ~LuaSource() {}
+
+	// Starts over at the first piece; lua_load() and the bytecode cache key
+	// both walk the source
+	virtual void rewind() = 0;
+	// Returns the next non-empty piece, nullptr when the source is exhausted
+	virtual const char* next(size_t& size) = 0;
+	virtual size_t length() = 0;
+
+	// lua_Reader for lua_load(L, LuaSource::reader, &source, ...)
+	static const char* reader(lua_State* L, void* data, size_t* size);
+};
+
+// One contiguous buffer owned by the caller, e.g. a string inside a JsonDocument
+class LuaBufferSource : public LuaSource {
+  public:
+	LuaBufferSource(const char* data, size_t length);
+
+	void rewind() override;
+	const char* next(size_t& size) override;
+	size_t length() override;
+
+  private:
+	const char* data_;
+	size_t length_;
+	bool consumed_;
+};
+
+// Upload chunks in arrival order, each kept in its own allocation
+class LuaChunkSource : public LuaSource {
+  public:
+	LuaChunkSource();
+
+	// Throws std::bad_alloc when the heap is exhausted
+	void append(const char* data, size_t length);
+	// Drops all chunks and frees their memory
+	void clear();
+
+	void rewind() override;
+	const char* next(size_t& size) override;
+	size_t length() override;
+
+  private:
+	std::vector<std::vector<char>> chunks_;
+	size_t length_;
+	size_t position_;
+};
+
+const char* LuaSource::reader(lua_State* L, void* data, size_t* size) {
+	LuaSource* source = (LuaSource*) data;
+	const char* piece = source->next(*size);
+	if (piece == nullptr) {
+		*size = 0;
+	}
+	return piece;
+}
+
+LuaBufferSource::LuaBufferSource(const char* data, size_t length) : data_(data), length_(length), consumed_(false) {}
+
+void LuaBufferSource::rewind() {
+	consumed_ = false;
+}
+
+const char* LuaBufferSource::next(size_t& size) {
+	if (consumed_ || length_ == 0 || data_ == nullptr) {
+		size = 0;
+		return nullptr;
+	}
+	consumed_ = true;
+	size = length_;
+	return data_;
+}
+
+size_t LuaBufferSource::length() {
+	return length_;
+}
+
+LuaChunkSource::LuaChunkSource() : length_(0), position_(0) {}
+
+void LuaChunkSource::append(const char* data, size_t length) {
+	if (length == 0) {
+		return;
+	}
+	chunks_.emplace_back(data, data + length);
+	length_ += length;
+}
+
+void LuaChunkSource::clear() {
+	std::vector<std::vector<char>>().swap(chunks_);
+	length_ = 0;
+	position_ = 0;
+}
+
+void LuaChunkSource::rewind() {
+	position_ = 0;
+}
+
+const char* LuaChunkSource::next(size_t& size) {
+	if (position_ >= chunks_.size()) {
+		size = 0;
+		return nullptr;
+	}
+	const std::vector<char>& chunk = chunks_[position_++];
+	size = chunk.size();
+	return chunk.data();
+}
+
+size_t LuaChunkSource::length() {
+	return length_;
+}
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of BytecodeCache (mirrors bytecodecache.cpp)
+// ---------------------------------------------------------------------------
+struct BytecodeCacheStats {
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t rejected;
+	uint32_t stores;
+};
+
+static const uint8_t imageMagic[] = {'L', 'B', 'C'};
+static const uint64_t fnvOffsetBasis = 0xcbf29ce484222325ULL;
+static const uint64_t fnvPrime = 0x100000001b3ULL;
+
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t length) {
+	const uint8_t* p = (const uint8_t*) data;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= p[i];
+		hash *= fnvPrime;
+	}
+	return hash;
+}
+
+static int appendChunk(lua_State* L, const void* p, size_t size, void* ud) {
+	std::vector<uint8_t>* out = (std::vector<uint8_t>*) ud;
+	const uint8_t* bytes = (const uint8_t*) p;
+	out->insert(out->end(), bytes, bytes + size);
+	return 0;
+}
+
+class BytecodeCache {
+  public:
+	static const int maxEntries = 16;
+
+	BytecodeCache(MemoryFS* fs, const char* directory, const char* firmwareRevision)
+	    : fs_(fs), directory_(directory), firmwareRevision_(firmwareRevision) {
+		memset(&stats_, 0, sizeof(stats_));
+	}
+
+	bool load(lua_State* L, LuaSource& source) {
+		uint64_t key = keyOf(source);
+		std::string path = pathOf(key);
+		std::vector<uint8_t> image;
+		if (!fs_->read(path, image)) {
+			stats_.misses++;
+			return false;
+		}
+		std::vector<uint8_t> expected;
+		writeHeader(expected, key, source.length());
+		bool valid = image.size() > expected.size() && memcmp(image.data(), expected.data(), expected.size()) == 0;
+		if (valid) {
+			int status = luaL_loadbufferx(L, (const char*) image.data() + expected.size(),
+			                              image.size() - expected.size(), "=program", "b");
+			if (status != LUA_OK) {
+				lua_pop(L, 1);
+				valid = false;
+			}
+		}
+		if (valid) {
+			stats_.hits++;
+		} else {
+			fs_->remove(path);
+			stats_.rejected++;
+			stats_.misses++;
+		}
+		return valid;
+	}
+
+	void store(lua_State* L, LuaSource& source) {
+		uint64_t key = keyOf(source);
+		std::string path = pathOf(key);
+		std::vector<uint8_t> image;
+		writeHeader(image, key, source.length());
+		if (lua_dump(L, appendChunk, &image, 0) != 0) {
+			return;
+		}
+		evictIfFull(path);
+		fs_->write(path, image);
+		stats_.stores++;
+	}
+
+	BytecodeCacheStats stats() { return stats_; }
+
+	std::string pathFor(const char* text) {
+		LuaBufferSource source(text, strlen(text));
+		return pathOf(keyOf(source));
+	}
+	size_t headerSize(const char* text) {
+		LuaBufferSource source(text, strlen(text));
+		std::vector<uint8_t> header;
+		writeHeader(header, keyOf(source), source.length());
+		return header.size();
+	}
+
+  private:
+	uint64_t keyOf(LuaSource& source) {
+		uint64_t hash = fnv1a(fnvOffsetBasis, firmwareRevision_.c_str(), firmwareRevision_.length());
+		source.rewind();
+		size_t size;
+		for (const char* piece = source.next(size); piece != nullptr; piece = source.next(size)) {
+			hash = fnv1a(hash, piece, size);
+		}
+		source.rewind();
+		return hash;
+	}
+
+	std::string pathOf(uint64_t key) {
+		char name[20];
+		snprintf(name, sizeof(name), "/%08lx%08lx", (unsigned long) (key >> 32), (unsigned long) (key & 0xFFFFFFFF));
+		return directory_ + name;
+	}
+
+	void writeHeader(std::vector<uint8_t>& out, uint64_t key, size_t length) {
+		out.insert(out.end(), imageMagic, imageMagic + sizeof(imageMagic));
+		out.push_back((uint8_t) imageVersion);
+		out.push_back((uint8_t) firmwareRevision_.length());
+		out.insert(out.end(), firmwareRevision_.begin(), firmwareRevision_.end());
+		for (int i = 0; i < 4; i++) {
+			out.push_back((uint8_t) ((uint32_t) LUA_VERSION_NUM >> (i * 8)));
+		}
+		for (int i = 0; i < 4; i++) {
+			out.push_back((uint8_t) ((uint32_t) length >> (i * 8)));
+		}
+		for (int i = 0; i < 8; i++) {
+			out.push_back((uint8_t) (key >> (i * 8)));
+		}
+	}
+
+	void evictIfFull(const std::string& keep) {
+		int count = 0;
+		std::string victim;
+		for (const std::string& path : fs_->list(directory_)) {
+			if (path != keep) {
+				count++;
+				if (victim.empty()) {
+					victim = path;
+				}
+			}
+		}
+		if (count >= maxEntries && !victim.empty()) {
+			fs_->remove(victim);
+		}
+	}
+
+	static const uint8_t imageVersion = 1;
+
+	MemoryFS* fs_;
+	std::string directory_;
+	std::string firmwareRevision_;
+	BytecodeCacheStats stats_;
+};
+
+// ---------------------------------------------------------------------------
+// Helpers mirroring Megahub::executeLUACode(): load from the cache or compile
+// as text, run, then store the compiled main function
+// ---------------------------------------------------------------------------
+static lua_State* L = nullptr;
+
+static bool runSource(BytecodeCache& cache, LuaSource& source, bool* fromCache = nullptr) {
+	bool cached = cache.load(L, source);
+	int status = LUA_OK;
+	if (!cached) {
+		source.rewind();
+		status = lua_load(L, LuaSource::reader, &source, "=program", "t");
+	}
+	if (fromCache != nullptr) {
+		*fromCache = cached;
+	}
+	if (status != LUA_OK) {
+		lua_pop(L, 1);
+		return false;
+	}
+	bool compiled = !cached;
+	if (compiled) {
+		lua_pushvalue(L, -1);
+	}
+	status = lua_pcall(L, 0, 0, 0);
+	if (status != LUA_OK) {
+		lua_pop(L, 1);
+	}
+	if (compiled) {
+		if (status == LUA_OK) {
+			cache.store(L, source);
+		}
+		lua_pop(L, 1);
+	}
+	return status == LUA_OK;
+}
+
+static bool runProgram(BytecodeCache& cache, const char* text, bool* fromCache = nullptr) {
+	LuaBufferSource source(text, strlen(text));
+	return runSource(cache, source, fromCache);
+}
+
+static lua_Integer globalInt(const char* name) {
+	lua_getglobal(L, name);
+	lua_Integer v = lua_tointeger(L, -1);
+	lua_pop(L, 1);
+	return v;
+}
+
+static const char* program = "local function fib(n) if n < 2 then return n end return fib(n-1) + fib(n-2) end\n"
+                             "result = fib(15)\n";
+
+void setUp() {
+	L = luaL_newstate();
+	luaL_openlibs(L);
+}
+
+void tearDown() {
+	TEST_ASSERT_EQUAL_INT(0, lua_gettop(L));
+	lua_close(L);
+	L = nullptr;
+}
+
+// BC-01: First run compiles and stores, second run loads from the cache with the same result
+void test_BC01_store_then_hit() {
+	MemoryFS fs;
+	BytecodeCache cache(&fs, "/luacache", "abc1234");
+	bool fromCache = true;
+
+	TEST_ASSERT_TRUE(runProgram(cache, program, &fromCache));
+	TEST_ASSERT_FALSE(fromCache);
+	TEST_ASSERT_EQUAL_INT(610, (int) globalInt("result"));
+	TEST_ASSERT_EQUAL_UINT32(1, cache.stats().stores);
+	TEST_ASSERT_TRUE(fs.exists(cache.pathFor(program)));
+
+	lua_pushnil(L);
+	lua_setglobal(L, "result");
+	TEST_ASSERT_TRUE(runProgram(cache, program, &fromCache));
+	TEST_ASSERT_TRUE(fromCache);
+	TEST_ASSERT_EQUAL_INT(610, (int) globalInt("result"));
+	TEST_ASSERT_EQUAL_UINT32(1, cache.stats().hits);
+	TEST_ASSERT_EQUAL_UINT32(1, cache.stats().misses);
+}
+
+// BC-02: Another firmware revision never sees entries of the old one
+void test_BC02_firmware_revision_is_part_of_key() {
+	MemoryFS fs;
+	BytecodeCache oldFirmware(&fs, "/luacache", "abc1234");
+	BytecodeCache newFirmware(&fs, "/luacache", "def5678");
+
+	TEST_ASSERT_TRUE(runProgram(oldFirmware, program));
+	bool fromCache = true;
+	TEST_ASSERT_TRUE(runProgram(newFirmware, program, &fromCache));
+	TEST_ASSERT_FALSE(fromCache);
+	TEST_ASSERT_EQUAL_INT(2, (int) fs.files.size());
+}
+
+// BC-03: A changed program is a miss
+void test_BC03_changed_source_misses() {
+	MemoryFS fs;
+	BytecodeCache cache(&fs, "/luacache", "abc1234");
+
+	TEST_ASSERT_TRUE(runProgram(cache, "result = 1"));
+	bool fromCache = true;
+	TEST_ASSERT_TRUE(runProgram(cache, "result = 2", &fromCache));
+	TEST_ASSERT_FALSE(fromCache);
+	TEST_ASSERT_EQUAL_INT(2, (int) globalInt("result"));
+}
+
+// BC-04: Truncated bytecode is rejected, removed, and the program compiled again
+void test_BC04_truncated_entry_rejected() {
+	MemoryFS fs;
+	BytecodeCache cache(&fs, "/luacache", "abc1234");
+	TEST_ASSERT_TRUE(runProgram(cache, program));
+
+	std::vector<uint8_t>& image = fs.files[cache.pathFor(program)];
+	image.resize(cache.headerSize(program) + 10);
+
+	bool fromCache = true;
+	TEST_ASSERT_TRUE(runProgram(cache, program, &fromCache));
+	TEST_ASSERT_FALSE(fromCache);
+	TEST_ASSERT_EQUAL_UINT32(1, cache.stats().rejected);
+	TEST_ASSERT_EQUAL_INT(610, (int) globalInt("result"));
+	// Stored again after the successful run
+	TEST_ASSERT_TRUE(runProgram(cache, program, &fromCache));
+	TEST_ASSERT_TRUE(fromCache);
+}
+
+// BC-05: An entry whose header does not match (e.g. other Lua version) is rejected
+void test_BC05_header_mismatch_rejected() {
+	MemoryFS fs;
+	BytecodeCache cache(&fs, "/luacache", "abc1234");
+	TEST_ASSERT_TRUE(runProgram(cache, program));
+
+	std::string path = cache.pathFor(program);
+	fs.files[path][5 + 7] ^= 0x01; // first byte of LUA_VERSION_NUM after magic, version and revision
+	LuaBufferSource source(program, strlen(program));
+	TEST_ASSERT_FALSE(cache.load(L, source));
+	TEST_ASSERT_FALSE(fs.exists(path));
+	TEST_ASSERT_EQUAL_UINT32(1, cache.stats().rejected);
+}
+
+// BC-06: Programs failing at startup are not cached
+void test_BC06_failed_run_not_cached() {
+	MemoryFS fs;
+	BytecodeCache cache(&fs, "/luacache", "abc1234");
+
+	TEST_ASSERT_FALSE(runProgram(cache, "error('boom')"));
+	TEST_ASSERT_FALSE(runProgram(cache, "if true then"));
+	TEST_ASSERT_EQUAL_UINT32(0, cache.stats().stores);
+	TEST_ASSERT_EQUAL_INT(0, (int) fs.files.size());
+}
+
+// BC-07: The directory never grows past maxEntries
+void test_BC07_eviction() {
+	MemoryFS fs;
+	BytecodeCache cache(&fs, "/luacache", "abc1234");
+	char source[32];
+	for (int i = 0; i < BytecodeCache::maxEntries + 5; i++) {
+		snprintf(source, sizeof(source), "result = %d", i);
+		TEST_ASSERT_TRUE(runProgram(cache, source));
+	}
+	TEST_ASSERT_EQUAL_INT(BytecodeCache::maxEntries, (int) fs.list("/luacache").size());
+	// The most recent program is always kept
+	TEST_ASSERT_TRUE(fs.exists(cache.pathFor(source)));
+}
+
+// BC-08: A program uploaded in chunks hits the entry stored from one buffer
+void test_BC08_chunked_source_same_key() {
+	MemoryFS fs;
+	BytecodeCache cache(&fs, "/luacache", "abc1234");
+	TEST_ASSERT_TRUE(runProgram(cache, program));
+
+	LuaChunkSource chunked;
+	size_t length = strlen(program);
+	for (size_t pos = 0; pos < length; pos += 7) {
+		chunked.append(program + pos, length - pos < 7 ? length - pos : 7);
+	}
+	bool fromCache = false;
+	TEST_ASSERT_TRUE(runSource(cache, chunked, &fromCache));
+	TEST_ASSERT_TRUE(fromCache);
+	TEST_ASSERT_EQUAL_INT(610, (int) globalInt("result"));
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_BC01_store_then_hit);
+	RUN_TEST(test_BC02_firmware_revision_is_part_of_key);
+	RUN_TEST(test_BC03_changed_source_misses);
+	RUN_TEST(test_BC04_truncated_entry_rejected);
+	RUN_TEST(test_BC05_header_mismatch_rejected);
+	RUN_TEST(test_BC06_failed_run_not_cached);
+	RUN_TEST(test_BC07_eviction);
+	RUN_TEST(test_BC08_chunked_source_same_key);
+	return UNITY_END();
+}
@@ -0,0 +1,350 @@
+// ---------------------------------------------------------------------------
+// Benchmark for the DATA frame decode path — legacy runtime-switch decoder
+// (with per-frame hex string) vs. the compile-time FrameDecoder resolved at
+// setFormat().
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native --filter test_decode_bench
+//
+// Timings are printed, not asserted (host timings say nothing absolute about
+// the ESP32). Asserted are decode equivalence and zero heap allocations per
+// frame on the new path. Decoder and Dataset are reproduced inline (same
+// pattern as test_mode).
+// ---------------------------------------------------------------------------
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Heap allocation counter
+// ---------------------------------------------------------------------------
+static size_t allocationCount = 0;
+
+void* operator new(size_t size) {
+	allocationCount++;
+	void* p = malloc(size);
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	free(p);
+}
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of Format / Dataset
+// ---------------------------------------------------------------------------
+enum class FormatType {
+	DATA8 = 0x00,
+	DATA16 = 0x01,
+	DATA32 = 0x02,
+	DATAFLOAT = 0x03,
+	UNKNOWN = 0xff
+};
+
+class Dataset {
+  public:
+	Dataset() : formatType_(FormatType::UNKNOWN), intValue_(0), floatValue_(0.0f) {}
+
+	void setIntValue(FormatType type, int value) {
+		formatType_ = type;
+		intValue_ = value;
+	}
+	void setFloatValue(float value) {
+		formatType_ = FormatType::DATAFLOAT;
+		floatValue_ = value;
+	}
+
+	// Legacy per-dataset decoder (lib/lpfuart/src/dataset.cpp before FrameDecoder)
+	void readData(FormatType type, const uint8_t* payload) {
+		formatType_ = type;
+		switch (type) {
+			case FormatType::DATA8:
+				intValue_ = static_cast<int8_t>(payload[0]);
+				break;
+			case FormatType::DATA16: {
+				int16_t v;
+				memcpy(&v, payload, 2);
+				intValue_ = v;
+				break;
+			}
+			case FormatType::DATA32: {
+				int32_t v;
+				memcpy(&v, payload, 4);
+				intValue_ = v;
+				break;
+			}
+			case FormatType::DATAFLOAT: {
+				float v;
+				memcpy(&v, payload, 4);
+				floatValue_ = v;
+				break;
+			}
+			default:
+				break;
+		}
+	}
+
+	bool sameAs(const Dataset& other) const {
+		return formatType_ == other.formatType_ && intValue_ == other.intValue_ &&
+		       memcmp(&floatValue_, &other.floatValue_, sizeof(float)) == 0;
+	}
+
+  private:
+	FormatType formatType_;
+	int intValue_;
+	float floatValue_;
+};
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of the frame decoders (lib/lpfuart/include/framedecoder.h)
+// ---------------------------------------------------------------------------
+template <FormatType T>
+struct DatasetCodec;
+
+template <>
+struct DatasetCodec<FormatType::DATA8> {
+	static constexpr int size = 1;
+	static void decode(const uint8_t* p, Dataset& ds) { ds.setIntValue(FormatType::DATA8, (int8_t) p[0]); }
+};
+
+template <>
+struct DatasetCodec<FormatType::DATA16> {
+	static constexpr int size = 2;
+	static void decode(const uint8_t* p, Dataset& ds) {
+		int16_t v;
+		memcpy(&v, p, sizeof(v));
+		ds.setIntValue(FormatType::DATA16, v);
+	}
+};
+
+template <>
+struct DatasetCodec<FormatType::DATA32> {
+	static constexpr int size = 4;
+	static void decode(const uint8_t* p, Dataset& ds) {
+		int32_t v;
+		memcpy(&v, p, sizeof(v));
+		ds.setIntValue(FormatType::DATA32, v);
+	}
+};
+
+template <>
+struct DatasetCodec<FormatType::DATAFLOAT> {
+	static constexpr int size = 4;
+	static void decode(const uint8_t* p, Dataset& ds) {
+		float v;
+		memcpy(&v, p, sizeof(v));
+		ds.setFloatValue(v);
+	}
+};
+
+using FrameDecoder = void (*)(const uint8_t* payload, int datasets, Dataset* out);
+
+template <FormatType T>
+void decodeFrame(const uint8_t* payload, int datasets, Dataset* out) {
+	for (int i = 0; i < datasets; i++) {
+		DatasetCodec<T>::decode(payload, out[i]);
+		payload += DatasetCodec<T>::size;
+	}
+}
+
+struct FrameLayout {
+	FrameDecoder decoder;
+	int datasetSize;
+};
+
+static FrameLayout frameLayoutFor(FormatType type) {
+	switch (type) {
+		case FormatType::DATA8:
+			return {decodeFrame<FormatType::DATA8>, 1};
+		case FormatType::DATA16:
+			return {decodeFrame<FormatType::DATA16>, 2};
+		case FormatType::DATA32:
+			return {decodeFrame<FormatType::DATA32>, 4};
+		case FormatType::DATAFLOAT:
+			return {decodeFrame<FormatType::DATAFLOAT>, 4};
+		default:
+			return {nullptr, 0};
+	}
+}
+
+// ---------------------------------------------------------------------------
+// The two processDataPacket variants
+// ---------------------------------------------------------------------------
+struct ModeUnderTest {
+	FormatType type;
+	int datasets;
+	std::vector<Dataset> values;
+	FrameDecoder decoder;
+	int frameSize;
+
+	ModeUnderTest(FormatType t, int n) : type(t), datasets(n), values(n) {
+		FrameLayout layout = frameLayoutFor(t);
+		decoder = layout.decoder;
+		frameSize = n * layout.datasetSize;
+	}
+
+	// Legacy: lib/lpfuart/src/mode.cpp before the FrameDecoder change
+	void processLegacy(const uint8_t* payload, int payloadSize) {
+		const char hexChars[] = "0123456789ABCDEF";
+		std::string payloadHex;
+		payloadHex.reserve(payloadSize * 3);
+		for (int i = 0; i < payloadSize; ++i) {
+			int v = payload[i] & 0xFF;
+			payloadHex.push_back(hexChars[(v >> 4) & 0xF]);
+			payloadHex.push_back(hexChars[v & 0xF]);
+			if (i + 1 < payloadSize) {
+				payloadHex.push_back(' ');
+			}
+		}
+		int datasetSize = 0;
+		switch (type) {
+			case FormatType::DATA8:
+				datasetSize = 1;
+				break;
+			case FormatType::DATA16:
+				datasetSize = 2;
+				break;
+			case FormatType::DATA32:
+			case FormatType::DATAFLOAT:
+				datasetSize = 4;
+				break;
+			default:
+				return;
+		}
+		if (datasets * datasetSize != payloadSize) {
+			return;
+		}
+		const uint8_t* ptr = payload;
+		for (int i = 0; i < datasets; i++) {
+			values[i].readData(type, ptr);
+			ptr += datasetSize;
+		}
+	}
+
+	void processDecoder(const uint8_t* payload, int payloadSize) {
+		if (decoder == nullptr || payloadSize != frameSize) {
+			return;
+		}
+		decoder(payload, datasets, values.data());
+	}
+};
+
+// ---------------------------------------------------------------------------
+// Benchmark helpers
+// ---------------------------------------------------------------------------
+static const int benchFrames = 200000;
+
+struct BenchCase {
+	const char* name;
+	FormatType type;
+	int datasets;
+};
+
+static const BenchCase benchCases[] = {
+    {"1 x DATA8 (color)", FormatType::DATA8, 1},
+    {"4 x DATA8 (SPEC1)", FormatType::DATA8, 4},
+    {"3 x DATA16 (RGB)", FormatType::DATA16, 3},
+    {"1 x DATA32 (POS)", FormatType::DATA32, 1},
+    {"8 x DATA32 (32B)", FormatType::DATA32, 8},
+    {"4 x DATAFLOAT", FormatType::DATAFLOAT, 4},
+};
+
+static void fillPayload(uint8_t* payload, int size, int seed) {
+	for (int i = 0; i < size; i++) {
+		payload[i] = static_cast<uint8_t>((seed * 31 + i * 17) & 0xFF);
+	}
+}
+
+template <typename F>
+static double nanosPerFrame(F&& fn) {
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < benchFrames; i++) {
+		fn(i);
+	}
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(end - start).count() / benchFrames;
+}
+
+void setUp() {}
+void tearDown() {}
+
+// BENCH-01: both paths decode every format to identical dataset values
+static void test_BENCH01_decoder_matches_legacy() {
+	uint8_t payload[32];
+	for (const BenchCase& bc : benchCases) {
+		ModeUnderTest legacy(bc.type, bc.datasets);
+		ModeUnderTest fast(bc.type, bc.datasets);
+		for (int seed = 0; seed < 256; seed++) {
+			fillPayload(payload, fast.frameSize, seed);
+			legacy.processLegacy(payload, fast.frameSize);
+			fast.processDecoder(payload, fast.frameSize);
+			for (int i = 0; i < bc.datasets; i++) {
+				TEST_ASSERT_TRUE_MESSAGE(legacy.values[i].sameAs(fast.values[i]), bc.name);
+			}
+		}
+	}
+}
+
+// BENCH-02: the decoder path performs no heap allocation per frame
+static void test_BENCH02_decoder_allocation_free() {
+	uint8_t payload[32];
+	for (const BenchCase& bc : benchCases) {
+		ModeUnderTest mode(bc.type, bc.datasets);
+		fillPayload(payload, mode.frameSize, 7);
+
+		size_t before = allocationCount;
+		for (int i = 0; i < 1000; i++) {
+			mode.processDecoder(payload, mode.frameSize);
+		}
+		TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, (uint32_t) (allocationCount - before), bc.name);
+	}
+}
+
+// BENCH-03: per-frame decode time and allocations, legacy vs. decoder
+static void test_BENCH03_decode_time_per_frame() {
+	uint8_t payload[32];
+	printf("\n%-20s %14s %14s %12s\n", "frame", "legacy ns/frm", "decoder ns/frm", "legacy allocs");
+	for (const BenchCase& bc : benchCases) {
+		ModeUnderTest legacy(bc.type, bc.datasets);
+		ModeUnderTest fast(bc.type, bc.datasets);
+		fillPayload(payload, fast.frameSize, 3);
+		int size = fast.frameSize;
+
+		size_t before = allocationCount;
+		double legacyNs = nanosPerFrame([&](int i) {
+			payload[0] = static_cast<uint8_t>(i);
+			legacy.processLegacy(payload, size);
+		});
+		size_t legacyAllocs = allocationCount - before;
+
+		double decoderNs = nanosPerFrame([&](int i) {
+			payload[0] = static_cast<uint8_t>(i);
+			fast.processDecoder(payload, size);
+		});
+
+		printf("%-20s %14.1f %14.1f %12.2f\n", bc.name, legacyNs, decoderNs, (double) legacyAllocs / benchFrames);
+	}
+	TEST_PASS();
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_BENCH01_decoder_matches_legacy);
+	RUN_TEST(test_BENCH02_decoder_allocation_free);
+	RUN_TEST(test_BENCH03_decode_time_per_frame);
+	return UNITY_END();
+}
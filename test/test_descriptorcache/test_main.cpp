@@ -0,0 +1,593 @@
+// ---------------------------------------------------------------------------
+// Unit tests for DescriptorCache — handshake descriptor cache, DC-01..DC-07
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native --filter test_descriptorcache
+//
+// This file reproduces DescriptorCache inline to avoid the Arduino.h and
+// FreeRTOS dependencies on host (same pattern as test_samplering). The mutex
+// is left out, the tests are single threaded.
+// ---------------------------------------------------------------------------
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+#define INFO(msg, ...)                                                                                                 \
+	do {                                                                                                               \
+		printf("[INFO] " msg "\n", ##__VA_ARGS__);                                                                     \
+	} while (0)
+#define WARN(msg, ...)                                                                                                 \
+	do {                                                                                                               \
+		printf("[WARN] " msg "\n", ##__VA_ARGS__);                                                                     \
+	} while (0)
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of descriptorcache.h / descriptorcache.cpp
+// ---------------------------------------------------------------------------
+
+// One mode as described by the INFO frames of the handshake
+struct ModeDescriptor {
+	std::string name;
+	std::string units;
+	float pctMin;
+	float pctMax;
+	float siMin;
+	float siMax;
+	uint8_t inputTypes;  // bit n set = Mode::InputOutputType n supported
+	uint8_t outputTypes;
+	bool hasFormat;
+	uint8_t datasets;
+	uint8_t formatType;
+	uint8_t figures;
+	uint8_t decimals;
+
+	bool operator==(const ModeDescriptor& other) const;
+	bool operator!=(const ModeDescriptor& other) const { return !(*this == other); }
+};
+
+// Everything a device announces during the handshake after CMD_VERSION
+struct DeviceDescriptor {
+	static const int maxModes = 16;
+	static const int maxModeCombos = 8;
+
+	int deviceId;
+	std::string fwVersion;
+	int numModes;
+	int numModeCombos;
+	std::array<uint16_t, maxModeCombos> modeCombos;
+	std::array<ModeDescriptor, maxModes> modes;
+
+	bool operator==(const DeviceDescriptor& other) const;
+	bool operator!=(const DeviceDescriptor& other) const { return !(*this == other); }
+};
+
+struct DescriptorCacheStats {
+	uint32_t hits;       // handshakes that found an entry for their device and firmware
+	uint32_t misses;     // handshakes without an entry
+	uint32_t mismatches; // entries dropped because the device announced something else
+};
+
+// ---------------------------------------------------------------------------
+// DescriptorCache — remembers the mode descriptors of devices seen before,
+// keyed by device ID and firmware version. A device that re-attaches after a
+// cable glitch is fully described as soon as it has sent CMD_VERSION, so INFO
+// frames lost to checksum errors at 2400 baud no longer leave modes without a
+// format.
+//
+// The cache lives in RAM. serialize()/deserialize() produce and read back a
+// versioned binary image for persistence; the owner of the storage does the
+// file I/O, never the port service task.
+// ---------------------------------------------------------------------------
+class DescriptorCache {
+  public:
+	static const int maxEntries = 8;
+
+	static DescriptorCache* instance();
+
+	// Copies the entry for deviceId/fwVersion into out, returns false on a miss
+	bool lookup(int deviceId, const std::string& fwVersion, DeviceDescriptor& out);
+	// Adds or replaces the entry; the oldest entry is evicted when full
+	void store(const DeviceDescriptor& descriptor);
+	// Drops the entry after the device announced different descriptors
+	void invalidate(int deviceId, const std::string& fwVersion);
+	void clear();
+
+	// True if entries changed since the last serialize()
+	bool dirty();
+	void serialize(std::vector<uint8_t>& out);
+	// Replaces all entries with the given image. Returns false and leaves the
+	// cache untouched if the image is truncated, corrupt or of another version.
+	bool deserialize(const uint8_t* data, size_t size);
+
+	DescriptorCacheStats stats();
+
+  private:
+	DescriptorCache();
+	friend void resetCacheForTest();
+
+	int find(int deviceId, const std::string& fwVersion);
+
+	static const uint8_t imageVersion = 1;
+
+	std::vector<DeviceDescriptor> entries_; // oldest first
+	bool dirty_;
+	DescriptorCacheStats stats_;
+};
+
+namespace {
+
+const uint8_t imageMagic[] = {'L', 'D', 'C'};
+
+void writeU8(std::vector<uint8_t>& out, uint8_t v) {
+	out.push_back(v);
+}
+
+void writeU16(std::vector<uint8_t>& out, uint16_t v) {
+	out.push_back((uint8_t) (v & 0xFF));
+	out.push_back((uint8_t) (v >> 8));
+}
+
+void writeFloat(std::vector<uint8_t>& out, float f) {
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	for (int i = 0; i < 4; i++) {
+		out.push_back((uint8_t) (bits >> (i * 8)));
+	}
+}
+
+void writeString(std::vector<uint8_t>& out, const std::string& s) {
+	size_t len = s.size() < 255 ? s.size() : 255;
+	out.push_back((uint8_t) len);
+	out.insert(out.end(), s.begin(), s.begin() + len);
+}
+
+// Bounds-checked reader; once a read runs past the end, ok stays false and
+// every further read returns zero.
+struct ImageReader {
+	const uint8_t* data;
+	size_t size;
+	size_t pos;
+	bool ok;
+
+	uint8_t u8() {
+		if (pos + 1 > size) {
+			ok = false;
+			return 0;
+		}
+		return data[pos++];
+	}
+	uint16_t u16() {
+		uint16_t lo = u8();
+		uint16_t hi = u8();
+		return (uint16_t) (lo | (hi << 8));
+	}
+	float f32() {
+		uint32_t bits = 0;
+		for (int i = 0; i < 4; i++) {
+			bits |= (uint32_t) u8() << (i * 8);
+		}
+		float f;
+		memcpy(&f, &bits, sizeof(f));
+		return f;
+	}
+	std::string str() {
+		size_t len = u8();
+		if (!ok || pos + len > size) {
+			ok = false;
+			return "";
+		}
+		std::string s((const char*) &data[pos], len);
+		pos += len;
+		return s;
+	}
+};
+
+uint8_t imageChecksum(const uint8_t* data, size_t size) {
+	uint8_t sum = 0xFF;
+	for (size_t i = 0; i < size; i++) {
+		sum ^= data[i];
+	}
+	return sum;
+}
+
+} // namespace
+
+bool ModeDescriptor::operator==(const ModeDescriptor& other) const {
+	return name == other.name && units == other.units && pctMin == other.pctMin && pctMax == other.pctMax &&
+	       siMin == other.siMin && siMax == other.siMax && inputTypes == other.inputTypes &&
+	       outputTypes == other.outputTypes && hasFormat == other.hasFormat && datasets == other.datasets &&
+	       formatType == other.formatType && figures == other.figures && decimals == other.decimals;
+}
+
+bool DeviceDescriptor::operator==(const DeviceDescriptor& other) const {
+	if (deviceId != other.deviceId || fwVersion != other.fwVersion || numModes != other.numModes ||
+	    numModeCombos != other.numModeCombos) {
+		return false;
+	}
+	for (int i = 0; i < numModeCombos; i++) {
+		if (modeCombos[i] != other.modeCombos[i]) {
+			return false;
+		}
+	}
+	for (int i = 0; i < numModes; i++) {
+		if (modes[i] != other.modes[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+DescriptorCache::DescriptorCache() : dirty_(false) {
+	memset(&stats_, 0, sizeof(stats_));
+	entries_.reserve(maxEntries);
+}
+
+DescriptorCache* DescriptorCache::instance() {
+	static DescriptorCache instance;
+	return &instance;
+}
+
+int DescriptorCache::find(int deviceId, const std::string& fwVersion) {
+	for (size_t i = 0; i < entries_.size(); i++) {
+		if (entries_[i].deviceId == deviceId && entries_[i].fwVersion == fwVersion) {
+			return (int) i;
+		}
+	}
+	return -1;
+}
+
+bool DescriptorCache::lookup(int deviceId, const std::string& fwVersion, DeviceDescriptor& out) {
+	int index = find(deviceId, fwVersion);
+	if (index >= 0) {
+		out = entries_[index];
+		stats_.hits++;
+	} else {
+		stats_.misses++;
+	}
+	return index >= 0;
+}
+
+void DescriptorCache::store(const DeviceDescriptor& descriptor) {
+	int index = find(descriptor.deviceId, descriptor.fwVersion);
+	if (index >= 0) {
+		entries_.erase(entries_.begin() + index);
+	} else if ((int) entries_.size() >= maxEntries) {
+		entries_.erase(entries_.begin());
+	}
+	entries_.push_back(descriptor);
+	dirty_ = true;
+}
+
+void DescriptorCache::invalidate(int deviceId, const std::string& fwVersion) {
+	int index = find(deviceId, fwVersion);
+	if (index >= 0) {
+		entries_.erase(entries_.begin() + index);
+		stats_.mismatches++;
+		dirty_ = true;
+	}
+}
+
+void DescriptorCache::clear() {
+	dirty_ = dirty_ || !entries_.empty();
+	entries_.clear();
+}
+
+bool DescriptorCache::dirty() {
+	bool result = dirty_;
+	return result;
+}
+
+DescriptorCacheStats DescriptorCache::stats() {
+	DescriptorCacheStats result = stats_;
+	return result;
+}
+
+void DescriptorCache::serialize(std::vector<uint8_t>& out) {
+	out.clear();
+	out.insert(out.end(), imageMagic, imageMagic + sizeof(imageMagic));
+	writeU8(out, imageVersion);
+	writeU8(out, (uint8_t) entries_.size());
+	for (const DeviceDescriptor& d : entries_) {
+		writeU16(out, (uint16_t) d.deviceId);
+		writeString(out, d.fwVersion);
+		writeU8(out, (uint8_t) d.numModes);
+		writeU8(out, (uint8_t) d.numModeCombos);
+		for (int i = 0; i < d.numModeCombos; i++) {
+			writeU16(out, d.modeCombos[i]);
+		}
+		for (int i = 0; i < d.numModes; i++) {
+			const ModeDescriptor& m = d.modes[i];
+			writeString(out, m.name);
+			writeString(out, m.units);
+			writeFloat(out, m.pctMin);
+			writeFloat(out, m.pctMax);
+			writeFloat(out, m.siMin);
+			writeFloat(out, m.siMax);
+			writeU8(out, m.inputTypes);
+			writeU8(out, m.outputTypes);
+			writeU8(out, m.hasFormat ? 1 : 0);
+			writeU8(out, m.datasets);
+			writeU8(out, m.formatType);
+			writeU8(out, m.figures);
+			writeU8(out, m.decimals);
+		}
+	}
+	dirty_ = false;
+	writeU8(out, imageChecksum(out.data(), out.size()));
+}
+
+bool DescriptorCache::deserialize(const uint8_t* data, size_t size) {
+	if (size < sizeof(imageMagic) + 3 || memcmp(data, imageMagic, sizeof(imageMagic)) != 0) {
+		WARN("Descriptor cache image has no valid header, ignoring");
+		return false;
+	}
+	if (imageChecksum(data, size - 1) != data[size - 1]) {
+		WARN("Descriptor cache image checksum mismatch, ignoring");
+		return false;
+	}
+
+	ImageReader in{data, size - 1, sizeof(imageMagic), true};
+	if (in.u8() != imageVersion) {
+		WARN("Descriptor cache image has an unsupported version, ignoring");
+		return false;
+	}
+	int count = in.u8();
+	std::vector<DeviceDescriptor> loaded;
+	loaded.reserve(count);
+	for (int e = 0; e < count && in.ok; e++) {
+		DeviceDescriptor d{};
+		d.deviceId = in.u16();
+		d.fwVersion = in.str();
+		d.numModes = in.u8();
+		d.numModeCombos = in.u8();
+		if (d.numModes > DeviceDescriptor::maxModes || d.numModeCombos > DeviceDescriptor::maxModeCombos) {
+			in.ok = false;
+			break;
+		}
+		for (int i = 0; i < d.numModeCombos; i++) {
+			d.modeCombos[i] = in.u16();
+		}
+		for (int i = 0; i < d.numModes; i++) {
+			ModeDescriptor& m = d.modes[i];
+			m.name = in.str();
+			m.units = in.str();
+			m.pctMin = in.f32();
+			m.pctMax = in.f32();
+			m.siMin = in.f32();
+			m.siMax = in.f32();
+			m.inputTypes = in.u8();
+			m.outputTypes = in.u8();
+			m.hasFormat = in.u8() != 0;
+			m.datasets = in.u8();
+			m.formatType = in.u8();
+			m.figures = in.u8();
+			m.decimals = in.u8();
+		}
+		loaded.push_back(d);
+	}
+	if (!in.ok || in.pos != in.size || (int) loaded.size() > maxEntries) {
+		WARN("Descriptor cache image is truncated or corrupt, ignoring");
+		return false;
+	}
+
+	entries_ = std::move(loaded);
+	dirty_ = false;
+	INFO("Loaded %d cached device descriptors", count);
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+// Helpers
+// ---------------------------------------------------------------------------
+void resetCacheForTest() {
+	DescriptorCache* cache = DescriptorCache::instance();
+	cache->entries_.clear();
+	cache->dirty_ = false;
+	memset(&cache->stats_, 0, sizeof(cache->stats_));
+}
+
+static DeviceDescriptor makeMotor(int deviceId, const char* fw) {
+	DeviceDescriptor d{};
+	d.deviceId = deviceId;
+	d.fwVersion = fw;
+	d.numModes = 2;
+	d.numModeCombos = 1;
+	d.modeCombos[0] = 0x0003;
+	d.modes[0] = ModeDescriptor{"POWER", "PCT", -100.0f, 100.0f, -100.0f, 100.0f, 0x10, 0x10, true, 1, 0x00, 4, 0};
+	d.modes[1] = ModeDescriptor{"POS", "DEG", 0.0f, 100.0f, -360.0f, 360.0f, 0x04, 0x00, true, 1, 0x02, 11, 0};
+	return d;
+}
+
+void setUp() {
+	resetCacheForTest();
+}
+
+void tearDown() {}
+
+// ---------------------------------------------------------------------------
+// Tests
+// ---------------------------------------------------------------------------
+
+// DC-01: Lookup hits only for the same device ID and firmware version
+void test_DC01_lookup_by_id_and_firmware() {
+	DescriptorCache* cache = DescriptorCache::instance();
+	cache->store(makeMotor(48, "1.0.0.0"));
+
+	DeviceDescriptor out{};
+	TEST_ASSERT_TRUE(cache->lookup(48, "1.0.0.0", out));
+	TEST_ASSERT_TRUE(out == makeMotor(48, "1.0.0.0"));
+	TEST_ASSERT_FALSE(cache->lookup(48, "1.0.0.1", out));
+	TEST_ASSERT_FALSE(cache->lookup(49, "1.0.0.0", out));
+
+	DescriptorCacheStats stats = cache->stats();
+	TEST_ASSERT_EQUAL_UINT32(1, stats.hits);
+	TEST_ASSERT_EQUAL_UINT32(2, stats.misses);
+}
+
+// DC-02: Equality covers every announced field but ignores unused mode slots
+void test_DC02_descriptor_equality() {
+	DeviceDescriptor a = makeMotor(48, "1.0.0.0");
+	DeviceDescriptor b = makeMotor(48, "1.0.0.0");
+	b.modes[5].name = "UNUSED";
+	TEST_ASSERT_TRUE(a == b);
+
+	b.modes[1].siMax = 180.0f;
+	TEST_ASSERT_TRUE(a != b);
+	b = makeMotor(48, "1.0.0.0");
+	b.modes[0].formatType = 0x01;
+	TEST_ASSERT_TRUE(a != b);
+	b = makeMotor(48, "1.0.0.0");
+	b.modeCombos[0] = 0x0001;
+	TEST_ASSERT_TRUE(a != b);
+}
+
+// DC-03: Storing beyond maxEntries evicts the oldest entry, re-storing replaces
+void test_DC03_eviction_and_replace() {
+	DescriptorCache* cache = DescriptorCache::instance();
+	for (int i = 0; i < DescriptorCache::maxEntries + 1; i++) {
+		cache->store(makeMotor(100 + i, "1.0.0.0"));
+	}
+	DeviceDescriptor out{};
+	TEST_ASSERT_FALSE(cache->lookup(100, "1.0.0.0", out));
+	TEST_ASSERT_TRUE(cache->lookup(100 + DescriptorCache::maxEntries, "1.0.0.0", out));
+
+	DeviceDescriptor changed = makeMotor(101, "1.0.0.0");
+	changed.modes[0].name = "SPEED";
+	cache->store(changed);
+	TEST_ASSERT_TRUE(cache->lookup(101, "1.0.0.0", out));
+	TEST_ASSERT_EQUAL_STRING("SPEED", out.modes[0].name.c_str());
+}
+
+// DC-04: Invalidate drops the entry and counts a mismatch
+void test_DC04_invalidate() {
+	DescriptorCache* cache = DescriptorCache::instance();
+	cache->store(makeMotor(48, "1.0.0.0"));
+	cache->invalidate(48, "1.0.0.0");
+	cache->invalidate(48, "1.0.0.0");
+
+	DeviceDescriptor out{};
+	TEST_ASSERT_FALSE(cache->lookup(48, "1.0.0.0", out));
+	TEST_ASSERT_EQUAL_UINT32(1, cache->stats().mismatches);
+}
+
+// DC-05: serialize/deserialize round trip restores all entries and clears dirty
+void test_DC05_image_round_trip() {
+	DescriptorCache* cache = DescriptorCache::instance();
+	cache->store(makeMotor(48, "1.0.0.0"));
+	cache->store(makeMotor(75, "1.2.0.0"));
+	TEST_ASSERT_TRUE(cache->dirty());
+
+	std::vector<uint8_t> image;
+	cache->serialize(image);
+	TEST_ASSERT_FALSE(cache->dirty());
+
+	resetCacheForTest();
+	TEST_ASSERT_TRUE(cache->deserialize(image.data(), image.size()));
+	DeviceDescriptor out{};
+	TEST_ASSERT_TRUE(cache->lookup(48, "1.0.0.0", out));
+	TEST_ASSERT_TRUE(out == makeMotor(48, "1.0.0.0"));
+	TEST_ASSERT_TRUE(cache->lookup(75, "1.2.0.0", out));
+	TEST_ASSERT_TRUE(out == makeMotor(75, "1.2.0.0"));
+}
+
+// DC-06: Corrupt, truncated or foreign images are rejected and leave the cache as is
+void test_DC06_corrupt_images_rejected() {
+	DescriptorCache* cache = DescriptorCache::instance();
+	cache->store(makeMotor(48, "1.0.0.0"));
+	std::vector<uint8_t> image;
+	cache->serialize(image);
+	cache->store(makeMotor(61, "1.0.0.0"));
+
+	std::vector<uint8_t> flipped = image;
+	flipped[10] ^= 0x40;
+	TEST_ASSERT_FALSE(cache->deserialize(flipped.data(), flipped.size()));
+
+	TEST_ASSERT_FALSE(cache->deserialize(image.data(), image.size() - 5));
+
+	std::vector<uint8_t> foreign = image;
+	foreign[0] = 'X';
+	TEST_ASSERT_FALSE(cache->deserialize(foreign.data(), foreign.size()));
+
+	const uint8_t tiny[] = {'L', 'D'};
+	TEST_ASSERT_FALSE(cache->deserialize(tiny, sizeof(tiny)));
+
+	DeviceDescriptor out{};
+	TEST_ASSERT_TRUE(cache->lookup(61, "1.0.0.0", out));
+}
+
+// DC-07: Mode types announced by the device replace the cached ones, so a
+// cached set that is a subset or a superset shows up as a mismatch
+// (mirrors Mode::clearTypes, LegoDevice::applyDescriptor and INFO_MAPPING)
+struct ModeTypes {
+	uint8_t input;
+	uint8_t output;
+};
+
+static void applyTypes(ModeTypes& mode, const ModeDescriptor& m) {
+	mode.input = 0;
+	mode.output = 0;
+	mode.input |= m.inputTypes;
+	mode.output |= m.outputTypes;
+}
+
+// Flag bits of an INFO_MAPPING payload to InputOutputType bits
+static uint8_t mappingTypes(uint8_t flags) {
+	return ((flags & 64) ? 1 << 0 : 0) | ((flags & 16) ? 1 << 1 : 0) | ((flags & 8) ? 1 << 2 : 0) |
+	       ((flags & 4) ? 1 << 3 : 0) | ((flags & 128) ? 1 << 4 : 0);
+}
+
+static void mappingFrame(ModeTypes& mode, uint8_t inputFlags, uint8_t outputFlags) {
+	mode.input = 0;
+	mode.output = 0;
+	mode.input |= mappingTypes(inputFlags);
+	mode.output |= mappingTypes(outputFlags);
+}
+
+static bool reconciles(const DeviceDescriptor& cached, uint8_t inputFlags, uint8_t outputFlags) {
+	ModeTypes mode{};
+	applyTypes(mode, cached.modes[0]);
+	mappingFrame(mode, inputFlags, outputFlags);
+	DeviceDescriptor current = cached;
+	current.modes[0].inputTypes = mode.input;
+	current.modes[0].outputTypes = mode.output;
+	return current == cached;
+}
+
+void test_DC07_mode_types_replaced() {
+	// POWER has SUPPORTS_NULL in both directions, flag 128 of INFO_MAPPING
+	DeviceDescriptor cached = makeMotor(48, "1.0.0.0");
+	TEST_ASSERT_TRUE(reconciles(cached, 128, 128));
+
+	// Cached superset: the device announces less than the cache remembers
+	cached.modes[0].inputTypes = 0x10 | 0x02;
+	TEST_ASSERT_FALSE(reconciles(cached, 128, 128));
+
+	// Cached subset: the device announces more
+	cached = makeMotor(48, "1.0.0.0");
+	cached.modes[0].outputTypes = 0;
+	TEST_ASSERT_FALSE(reconciles(cached, 128, 128));
+
+	// Without the frame the cached set stays, a lost INFO_MAPPING is not a mismatch
+	cached = makeMotor(48, "1.0.0.0");
+	ModeTypes mode{};
+	applyTypes(mode, cached.modes[0]);
+	TEST_ASSERT_EQUAL_UINT8(cached.modes[0].inputTypes, mode.input);
+	TEST_ASSERT_EQUAL_UINT8(cached.modes[0].outputTypes, mode.output);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_DC01_lookup_by_id_and_firmware);
+	RUN_TEST(test_DC02_descriptor_equality);
+	RUN_TEST(test_DC03_eviction_and_replace);
+	RUN_TEST(test_DC04_invalidate);
+	RUN_TEST(test_DC05_image_round_trip);
+	RUN_TEST(test_DC06_corrupt_images_rejected);
+	RUN_TEST(test_DC07_mode_types_replaced);
+	return UNITY_END();
+}
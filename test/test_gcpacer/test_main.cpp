@@ -0,0 +1,275 @@
+// ---------------------------------------------------------------------------
+// Unit tests for the collector pacing between thread iterations — GP-01..GP-07
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native --filter test_gcpacer
+//
+// Runs allocating Lua loops on the real Lua 5.4 library at lib/lua/ and
+// advances the collector between the iterations like GcPacer. The pacing is
+// reproduced inline (mirrors gcpacer.cpp); the time budget is replaced by a
+// number of steps so the results do not depend on the host speed.
+// ---------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstring>
+#include <unity.h>
+
+extern "C" {
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+}
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of GcPacer
+// ---------------------------------------------------------------------------
+static const int pacedStepSize = 10;
+static const int maxBehindKb = 256;
+static const int maxPause = 1000;
+
+struct Pacer {
+	int pause;
+	bool inCycle;
+	int thresholdKb;
+	int cycles;
+	int steps;
+	int catchUps;
+};
+
+static void setBudget(lua_State* L, Pacer& pacer, int pause) {
+	pacer.pause = pause;
+	pacer.inCycle = false;
+	pacer.cycles = 0;
+	pacer.steps = 0;
+	pacer.catchUps = 0;
+	pacer.thresholdKb = lua_gc(L, LUA_GCCOUNT) * pause / 100;
+	lua_gc(L, LUA_GCINC, std::min(pause * 2, maxPause), 100, pacedStepSize);
+	lua_gc(L, LUA_GCRESTART);
+}
+
+static void afterIteration(lua_State* L, Pacer& pacer, int maxSteps) {
+	int countKb = lua_gc(L, LUA_GCCOUNT);
+	if (!pacer.inCycle && countKb >= pacer.thresholdKb) {
+		pacer.inCycle = true;
+	}
+	if (!pacer.inCycle) {
+		return;
+	}
+	int behindKb = std::min(pacer.thresholdKb * 2, pacer.thresholdKb + maxBehindKb);
+	bool behind = countKb >= behindKb;
+	if (behind) {
+		pacer.catchUps++;
+	}
+	for (int step = 0; behind || step < maxSteps; step++) {
+		pacer.steps++;
+		if (lua_gc(L, LUA_GCSTEP, 0)) {
+			pacer.inCycle = false;
+			pacer.cycles++;
+			pacer.thresholdKb = lua_gc(L, LUA_GCCOUNT) * pacer.pause / 100;
+			break;
+		}
+	}
+	if (pacer.inCycle) {
+		int roomKb = behindKb - lua_gc(L, LUA_GCCOUNT);
+		if (roomKb > 0) {
+			lua_gc(L, LUA_GCSTEP, -roomKb);
+		}
+	}
+}
+
+// Keeps a table of live data and drops a batch of strings and tables per call
+static const char* program = "live = {}\n"
+                             "for i = 1, 2000 do live[i] = {i, tostring(i)} end\n"
+                             "function iteration()\n"
+                             "  local garbage = {}\n"
+                             "  for i = 1, 50 do garbage[i] = {x = i, s = 'value ' .. i} end\n"
+                             "end\n";
+
+static lua_State* newState() {
+	lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, program));
+	lua_gc(L, LUA_GCCOLLECT);
+	return L;
+}
+
+static void iterate(lua_State* L) {
+	lua_getglobal(L, "iteration");
+	TEST_ASSERT_EQUAL_INT(LUA_OK, lua_pcall(L, 0, 0, 0));
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+// ---------------------------------------------------------------------------
+// GP-01: paced cycles keep the heap near the pause, below the backstop
+// ---------------------------------------------------------------------------
+void test_GP01_heap_bounded_by_pause() {
+	lua_State* L = newState();
+	int liveKb = lua_gc(L, LUA_GCCOUNT);
+	Pacer pacer;
+	setBudget(L, pacer, 150);
+
+	int maxKb = 0;
+	for (int i = 0; i < 3000; i++) {
+		iterate(L);
+		afterIteration(L, pacer, 8);
+		maxKb = std::max(maxKb, lua_gc(L, LUA_GCCOUNT));
+	}
+	lua_close(L);
+
+	TEST_ASSERT_TRUE(pacer.cycles > 5);
+	TEST_ASSERT_EQUAL_INT(0, pacer.catchUps);
+	// Pause 150% plus the garbage of the iterations a cycle is spread over
+	TEST_ASSERT_TRUE(maxKb < liveKb * 3);
+}
+
+// ---------------------------------------------------------------------------
+// GP-02: a cycle is spread over several iterations with a small budget
+// ---------------------------------------------------------------------------
+void test_GP02_cycle_spread_over_iterations() {
+	lua_State* L = newState();
+	Pacer pacer;
+	setBudget(L, pacer, 110);
+
+	int iterationsInCycle = 0;
+	int longestCycle = 0;
+	for (int i = 0; i < 2000; i++) {
+		iterate(L);
+		int cycles = pacer.cycles;
+		bool wasInCycle = pacer.inCycle;
+		afterIteration(L, pacer, 1);
+		if (wasInCycle || pacer.inCycle || pacer.cycles != cycles) {
+			iterationsInCycle++;
+		}
+		if (pacer.cycles != cycles) {
+			longestCycle = std::max(longestCycle, iterationsInCycle);
+			iterationsInCycle = 0;
+		}
+	}
+	lua_close(L);
+
+	TEST_ASSERT_TRUE(pacer.cycles > 0);
+	TEST_ASSERT_TRUE(longestCycle > 1);
+}
+
+// ---------------------------------------------------------------------------
+// GP-03: below the threshold no collector work is done between iterations
+// ---------------------------------------------------------------------------
+void test_GP03_no_work_below_threshold() {
+	lua_State* L = newState();
+	Pacer pacer;
+	setBudget(L, pacer, 1000);
+
+	for (int i = 0; i < 5; i++) {
+		afterIteration(L, pacer, 8);
+	}
+	lua_close(L);
+
+	TEST_ASSERT_EQUAL_INT(0, pacer.steps);
+	TEST_ASSERT_FALSE(pacer.inCycle);
+}
+
+// ---------------------------------------------------------------------------
+// GP-04: the mode can be switched at runtime and back
+// ---------------------------------------------------------------------------
+void test_GP04_switch_modes() {
+	lua_State* L = newState();
+	TEST_ASSERT_EQUAL_INT(LUA_GCINC, lua_gc(L, LUA_GCGEN, 0, 0));
+	for (int i = 0; i < 200; i++) {
+		iterate(L);
+	}
+	TEST_ASSERT_EQUAL_INT(LUA_GCGEN, lua_gc(L, LUA_GCINC, 200, 100, 13));
+	lua_getglobal(L, "live");
+	TEST_ASSERT_EQUAL_INT(2000, (int) luaL_len(L, -1));
+	lua_close(L);
+}
+
+// ---------------------------------------------------------------------------
+// GP-05: without any budget the backstop finishes the cycles at twice the
+// threshold, the automatic collector never gets to start one
+// ---------------------------------------------------------------------------
+void test_GP05_backstop_when_behind() {
+	lua_State* L = newState();
+	int liveKb = lua_gc(L, LUA_GCCOUNT);
+	Pacer pacer;
+	setBudget(L, pacer, 150);
+
+	int maxKb = 0;
+	for (int i = 0; i < 3000; i++) {
+		iterate(L);
+		afterIteration(L, pacer, 0);
+		maxKb = std::max(maxKb, lua_gc(L, LUA_GCCOUNT));
+	}
+	lua_close(L);
+
+	TEST_ASSERT_TRUE(pacer.catchUps > 0);
+	TEST_ASSERT_EQUAL_INT(pacer.catchUps, pacer.cycles);
+	// Twice the pause, plus the garbage of the iteration that crossed it
+	TEST_ASSERT_TRUE(maxKb < liveKb * 4);
+}
+
+// ---------------------------------------------------------------------------
+// GP-06: code that never ends an iteration is still collected by the
+// backstop, near twice the pause
+// ---------------------------------------------------------------------------
+void test_GP06_backstop_without_iterations() {
+	lua_State* L = newState();
+	int liveKb = lua_gc(L, LUA_GCCOUNT);
+	Pacer pacer;
+	setBudget(L, pacer, 150);
+
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, "maxKb = 0\n"
+	                                               "for n = 1, 3000 do\n"
+	                                               "  iteration()\n"
+	                                               "  maxKb = math.max(maxKb, collectgarbage('count'))\n"
+	                                               "end\n"));
+	lua_getglobal(L, "maxKb");
+	int maxKb = (int) lua_tonumber(L, -1);
+	lua_close(L);
+
+	TEST_ASSERT_EQUAL_INT(0, pacer.steps);
+	// Pause 300% plus the garbage allocated while the cycle runs
+	TEST_ASSERT_TRUE(maxKb < liveKb * 5);
+}
+
+// ---------------------------------------------------------------------------
+// GP-07: a cycle left open when the iterations stop is finished by the
+// automatic collector once the heap reaches the backstop
+// ---------------------------------------------------------------------------
+void test_GP07_open_cycle_finished_without_iterations() {
+	lua_State* L = newState();
+	int liveKb = lua_gc(L, LUA_GCCOUNT);
+	Pacer pacer;
+	setBudget(L, pacer, 150);
+
+	while (!pacer.inCycle) {
+		iterate(L);
+		afterIteration(L, pacer, 1);
+	}
+	int steps = pacer.steps;
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, "maxKb = 0\n"
+	                                               "for n = 1, 3000 do\n"
+	                                               "  iteration()\n"
+	                                               "  maxKb = math.max(maxKb, collectgarbage('count'))\n"
+	                                               "end\n"));
+	lua_getglobal(L, "maxKb");
+	int maxKb = (int) lua_tonumber(L, -1);
+	lua_close(L);
+
+	TEST_ASSERT_EQUAL_INT(steps, pacer.steps);
+	TEST_ASSERT_TRUE(maxKb < liveKb * 5);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_GP01_heap_bounded_by_pause);
+	RUN_TEST(test_GP02_cycle_spread_over_iterations);
+	RUN_TEST(test_GP03_no_work_below_threshold);
+	RUN_TEST(test_GP04_switch_modes);
+	RUN_TEST(test_GP05_backstop_when_behind);
+	RUN_TEST(test_GP06_backstop_without_iterations);
+	RUN_TEST(test_GP07_open_cycle_finished_without_iterations);
+	return UNITY_END();
+}
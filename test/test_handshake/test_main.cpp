@@ -0,0 +1,257 @@
+// ---------------------------------------------------------------------------
+// Unit tests for the non-blocking handshake completion in LegoDevice, HS-01..HS-05
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native --filter test_handshake
+//
+// This file reproduces the LegoDevice handshake steps inline to avoid the
+// Arduino.h dependency on host (same pattern as test_lumpparser).
+// ---------------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+static unsigned long g_millis = 0;
+unsigned long millis() {
+	return g_millis;
+}
+
+// ---------------------------------------------------------------------------
+// SerialIO stub recording every call with the time it was made
+// ---------------------------------------------------------------------------
+struct SerialEvent {
+	std::string what;
+	long arg;
+	unsigned long at;
+};
+
+class SerialIO {
+  public:
+	std::vector<SerialEvent> events;
+	int pendingRx = 0;
+	unsigned long txBusyUntil = 0;
+
+	int readBytes(uint8_t*, int maxLength) {
+		int n = pendingRx < maxLength ? pendingRx : maxLength;
+		pendingRx -= n;
+		return n;
+	}
+	void sendByte(int b) {
+		events.push_back({"send", b, g_millis});
+		// One byte at 2400 baud is on the wire for ~4.2 ms
+		txBusyUntil = g_millis + 5;
+	}
+	void flush() { events.push_back({"flush", 0, g_millis}); }
+	bool txIdle() { return g_millis >= txBusyUntil; }
+	void switchToBaudrate(long speed) { events.push_back({"baud", speed, g_millis}); }
+
+	int count(const char* what) {
+		int n = 0;
+		for (auto& e : events) {
+			if (e.what == what) {
+				n++;
+			}
+		}
+		return n;
+	}
+	const SerialEvent* find(const char* what) {
+		for (auto& e : events) {
+			if (e.what == what) {
+				return &e;
+			}
+		}
+		return nullptr;
+	}
+};
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of the LegoDevice handshake steps
+// (mirrors legodevice.cpp finishHandshake / advanceHandshake / loop)
+// ---------------------------------------------------------------------------
+class LegoDevice {
+  public:
+	enum class HandshakeStep {
+		IDLE,
+		ACK_SENT,
+		BAUD_SETTLING
+	};
+
+	static const int ackSettleMs = 10;
+	static const int ackTimeoutMs = 50;
+	static const int baudSettleMs = 10;
+
+	explicit LegoDevice(SerialIO* serialIO) : serialIO_(serialIO) {}
+
+	SerialIO* serialIO_;
+	long serialSpeed_ = 115200;
+	bool handshakeComplete_ = false;
+	bool inDataMode_ = false;
+	HandshakeStep handshakeStep_ = HandshakeStep::IDLE;
+	unsigned long handshakeStepSince_ = 0;
+	int parsedBytes = 0;
+	int discardedBytes = 0;
+	int clearBufferCalls = 0;
+	int selectedMode = -1;
+
+	void finishHandshake() {
+		serialIO_->sendByte(0x04);
+		handshakeStep_ = HandshakeStep::ACK_SENT;
+		handshakeStepSince_ = millis();
+	}
+
+	void advanceHandshake(unsigned long now) {
+		unsigned long elapsed = now - handshakeStepSince_;
+		switch (handshakeStep_) {
+			case HandshakeStep::IDLE:
+				finishHandshake();
+				break;
+			case HandshakeStep::ACK_SENT:
+				if (elapsed < ackSettleMs || (elapsed < ackTimeoutMs && !serialIO_->txIdle())) {
+					break;
+				}
+				serialIO_->switchToBaudrate(serialSpeed_);
+				handshakeStep_ = HandshakeStep::BAUD_SETTLING;
+				handshakeStepSince_ = now;
+				break;
+			case HandshakeStep::BAUD_SETTLING:
+				if (elapsed < baudSettleMs) {
+					break;
+				}
+				clearBufferCalls++;
+				handshakeStep_ = HandshakeStep::IDLE;
+				selectedMode = 0;
+				inDataMode_ = true;
+				break;
+		}
+	}
+
+	int loop(bool drainRx = true) {
+		int received = 0;
+		if (drainRx) {
+			uint8_t rx[64];
+			received = serialIO_->readBytes(rx, sizeof(rx));
+			if (handshakeStep_ == HandshakeStep::BAUD_SETTLING) {
+				discardedBytes += received;
+			} else {
+				parsedBytes += received;
+			}
+		}
+		if (handshakeComplete_ && !inDataMode_) {
+			advanceHandshake(millis());
+		}
+		return received;
+	}
+};
+
+// Drives loop() every periodMs until data mode or the time limit is reached.
+static void runUntilDataMode(LegoDevice& dev, unsigned long periodMs, unsigned long limitMs) {
+	unsigned long end = g_millis + limitMs;
+	while (!dev.inDataMode_ && g_millis < end) {
+		dev.loop();
+		g_millis += periodMs;
+	}
+}
+
+void setUp() {
+	g_millis = 1000;
+}
+
+void tearDown() {}
+
+// HS-01: No handshake step runs before the device has sent its ACK
+void test_HS01_nothing_before_handshake_complete() {
+	SerialIO io;
+	LegoDevice dev(&io);
+	for (int i = 0; i < 10; i++) {
+		dev.loop();
+		g_millis += 5;
+	}
+	TEST_ASSERT_EQUAL_INT(0, (int) io.events.size());
+	TEST_ASSERT_FALSE(dev.inDataMode_);
+}
+
+// HS-02: loop() returns after the ACK and never calls the blocking flush()
+void test_HS02_loop_never_blocks() {
+	SerialIO io;
+	LegoDevice dev(&io);
+	dev.handshakeComplete_ = true;
+
+	dev.loop();
+	TEST_ASSERT_EQUAL_INT(1, io.count("send"));
+	TEST_ASSERT_EQUAL_INT(0, io.count("baud"));
+	TEST_ASSERT_TRUE(dev.handshakeStep_ == LegoDevice::HandshakeStep::ACK_SENT);
+
+	runUntilDataMode(dev, 1, 100);
+	TEST_ASSERT_TRUE(dev.inDataMode_);
+	TEST_ASSERT_EQUAL_INT(0, io.count("flush"));
+}
+
+// HS-03: Baud switch waits for the ACK settle time, data mode for the baud settle time
+void test_HS03_step_timing() {
+	SerialIO io;
+	LegoDevice dev(&io);
+	dev.handshakeComplete_ = true;
+	unsigned long start = g_millis;
+
+	runUntilDataMode(dev, 1, 100);
+
+	const SerialEvent* baud = io.find("baud");
+	TEST_ASSERT_NOT_NULL(baud);
+	TEST_ASSERT_EQUAL_INT(115200, (int) baud->arg);
+	TEST_ASSERT_EQUAL_UINT32(start + LegoDevice::ackSettleMs, (uint32_t) baud->at);
+	TEST_ASSERT_EQUAL_INT(1, dev.clearBufferCalls);
+	TEST_ASSERT_EQUAL_INT(0, dev.selectedMode);
+	// Data mode is entered on the loop() call after the settle time elapsed
+	TEST_ASSERT_EQUAL_UINT32(baud->at + LegoDevice::baudSettleMs + 1, (uint32_t) g_millis);
+}
+
+// HS-04: A transmitter that never reports idle delays the switch only up to the timeout
+void test_HS04_tx_never_idle_times_out() {
+	SerialIO io;
+	LegoDevice dev(&io);
+	dev.handshakeComplete_ = true;
+	unsigned long start = g_millis;
+	dev.loop();
+	io.txBusyUntil = (unsigned long) -1;
+
+	runUntilDataMode(dev, 1, 200);
+
+	const SerialEvent* baud = io.find("baud");
+	TEST_ASSERT_NOT_NULL(baud);
+	TEST_ASSERT_EQUAL_UINT32(start + LegoDevice::ackTimeoutMs, (uint32_t) baud->at);
+	TEST_ASSERT_TRUE(dev.inDataMode_);
+}
+
+// HS-05: Bytes received while the line settles are discarded, not parsed
+void test_HS05_settling_bytes_discarded() {
+	SerialIO io;
+	LegoDevice dev(&io);
+	dev.handshakeComplete_ = true;
+
+	while (dev.handshakeStep_ != LegoDevice::HandshakeStep::BAUD_SETTLING) {
+		dev.loop();
+		g_millis++;
+	}
+	io.pendingRx = 7;
+	dev.loop();
+	TEST_ASSERT_EQUAL_INT(7, dev.discardedBytes);
+	TEST_ASSERT_EQUAL_INT(0, dev.parsedBytes);
+
+	runUntilDataMode(dev, 1, 100);
+	io.pendingRx = 3;
+	dev.loop();
+	TEST_ASSERT_EQUAL_INT(3, dev.parsedBytes);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_HS01_nothing_before_handshake_complete);
+	RUN_TEST(test_HS02_loop_never_blocks);
+	RUN_TEST(test_HS03_step_timing);
+	RUN_TEST(test_HS04_tx_never_idle_times_out);
+	RUN_TEST(test_HS05_settling_bytes_discarded);
+	return UNITY_END();
+}
@@ -0,0 +1,439 @@
+// ---------------------------------------------------------------------------
+// Unit tests for isolated Lua threads — IT-01..IT-07
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native --filter test_isolatedthread
+//
+// Moves functions from one Lua state into another the way hub.startisolated()
+// does: bytecode from lua_dump(), upvalues copied by value, the global table
+// of the program replaced by the one of the new state. LuaValueCopy is
+// reproduced inline (mirrors luamessage.cpp and libluahub.cpp).
+// ---------------------------------------------------------------------------
+
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unity.h>
+#include <vector>
+
+extern "C" {
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+}
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of LuaValueCopy
+// ---------------------------------------------------------------------------
+static const int maxDepth = 8;
+
+struct ValueCopy {
+	int type = LUA_TNIL;
+	bool boolean = false;
+	bool isInteger = false;
+	lua_Integer integer = 0;
+	lua_Number number = 0;
+	std::string string;
+	std::vector<ValueCopy> keys;
+	std::vector<ValueCopy> values;
+
+	const char* copyFrom(lua_State* L, int index, int depth = 0) {
+		index = lua_absindex(L, index);
+		type = lua_type(L, index);
+		switch (type) {
+			case LUA_TNIL:
+				return nullptr;
+			case LUA_TBOOLEAN:
+				boolean = lua_toboolean(L, index);
+				return nullptr;
+			case LUA_TNUMBER:
+				isInteger = lua_isinteger(L, index);
+				if (isInteger) {
+					integer = lua_tointeger(L, index);
+				} else {
+					number = lua_tonumber(L, index);
+				}
+				return nullptr;
+			case LUA_TSTRING: {
+				size_t length = 0;
+				const char* data = lua_tolstring(L, index, &length);
+				string.assign(data, length);
+				return nullptr;
+			}
+			case LUA_TTABLE:
+				break;
+			default:
+				type = LUA_TNIL;
+				return "only nil, booleans, numbers, strings and tables can be copied";
+		}
+		if (depth >= maxDepth) {
+			type = LUA_TNIL;
+			return "table nested too deep or cyclic";
+		}
+		luaL_checkstack(L, 2, "copying table");
+		lua_pushnil(L);
+		while (lua_next(L, index) != 0) {
+			int top = lua_gettop(L);
+			keys.emplace_back();
+			values.emplace_back();
+			const char* error = keys.back().copyFrom(L, top - 1, depth + 1);
+			if (error == nullptr) {
+				error = values.back().copyFrom(L, top, depth + 1);
+			}
+			if (error != nullptr) {
+				lua_pop(L, 2);
+				return error;
+			}
+			lua_pop(L, 1);
+		}
+		return nullptr;
+	}
+
+	void push(lua_State* L) const {
+		switch (type) {
+			case LUA_TBOOLEAN:
+				lua_pushboolean(L, boolean);
+				break;
+			case LUA_TNUMBER:
+				if (isInteger) {
+					lua_pushinteger(L, integer);
+				} else {
+					lua_pushnumber(L, number);
+				}
+				break;
+			case LUA_TSTRING:
+				lua_pushlstring(L, string.data(), string.size());
+				break;
+			case LUA_TTABLE:
+				luaL_checkstack(L, 3, "pushing table");
+				lua_createtable(L, 0, (int) keys.size());
+				for (size_t i = 0; i < keys.size(); i++) {
+					keys[i].push(L);
+					values[i].push(L);
+					lua_rawset(L, -3);
+				}
+				break;
+			default:
+				lua_pushnil(L);
+				break;
+		}
+	}
+};
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of the transfer of hub.startisolated()
+// ---------------------------------------------------------------------------
+static int dumpWriter(lua_State* L, const void* data, size_t size, void* ud) {
+	((std::string*) ud)->append((const char*) data, size);
+	return 0;
+}
+
+struct Transfer {
+	std::string bytecode;
+	std::vector<ValueCopy> upvalues;
+	std::vector<bool> environment;
+};
+
+// Runs protected in the new state: loads the function, sets its upvalues and
+// returns its reference in the registry
+static int setupIsolated(lua_State* to) {
+	Transfer* moved = (Transfer*) lua_touserdata(to, 1);
+	if (luaL_loadbufferx(to, moved->bytecode.data(), moved->bytecode.size(), "isolated", "b") != LUA_OK) {
+		return lua_error(to);
+	}
+	for (size_t i = 0; i < moved->upvalues.size(); i++) {
+		if (moved->environment[i]) {
+			lua_pushglobaltable(to);
+		} else {
+			moved->upvalues[i].push(to);
+		}
+		lua_setupvalue(to, -2, (int) i + 1);
+	}
+	lua_pushinteger(to, luaL_ref(to, LUA_REGISTRYINDEX));
+	return 1;
+}
+
+// Moves the function on top of from into to, where it is left on top. Returns
+// an empty string or the error message.
+static std::string transfer(lua_State* from, lua_State* to) {
+	Transfer moved;
+
+	lua_dump(from, dumpWriter, &moved.bytecode, 0);
+	for (int i = 1;; i++) {
+		const char* name = lua_getupvalue(from, -1, i);
+		if (name == nullptr) {
+			break;
+		}
+		lua_pushglobaltable(from);
+		bool isEnvironment = lua_rawequal(from, -1, -2);
+		lua_pop(from, 1);
+		moved.environment.push_back(isEnvironment);
+		moved.upvalues.emplace_back();
+		bool function = lua_isfunction(from, -1);
+		const char* error = isEnvironment ? nullptr : moved.upvalues.back().copyFrom(from, -1);
+		lua_pop(from, 1);
+		if (error != nullptr && function) {
+			return std::string("upvalue '") + name +
+			       "' is a function and cannot be copied, create functions and sensor readers inside the isolated "
+			       "function";
+		}
+		if (error != nullptr) {
+			return std::string("upvalue '") + name + "' cannot be copied, " + error;
+		}
+	}
+
+	lua_pushcfunction(to, setupIsolated);
+	lua_pushlightuserdata(to, &moved);
+	if (lua_pcall(to, 1, 1, 0) != LUA_OK) {
+		std::string error = lua_tostring(to, -1);
+		lua_pop(to, 1);
+		return error;
+	}
+	int reference = (int) lua_tointeger(to, -1);
+	lua_pop(to, 1);
+	lua_rawgeti(to, LUA_REGISTRYINDEX, reference);
+	luaL_unref(to, LUA_REGISTRYINDEX, reference);
+	return "";
+}
+
+static lua_State* newState() {
+	lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+	return L;
+}
+
+// Runs a chunk returning the function to move
+static void loadFunction(lua_State* L, const char* source) {
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_loadbuffer(L, source, strlen(source), "=program"));
+	TEST_ASSERT_EQUAL_INT(LUA_OK, lua_pcall(L, 0, 1, 0));
+	TEST_ASSERT_TRUE(lua_isfunction(L, -1));
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+// ---------------------------------------------------------------------------
+// IT-01: upvalues arrive as copies, globals are those of the new state
+// ---------------------------------------------------------------------------
+void test_IT01_upvalues_copied_globals_own() {
+	lua_State* program = newState();
+	lua_State* isolated = newState();
+
+	loadFunction(program, "shared = 'program'\n"
+	                      "local gain = 0.5\n"
+	                      "local limits = {low = -10, high = 10, name = 'pid'}\n"
+	                      "return function(x)\n"
+	                      "  shared = 'isolated'\n"
+	                      "  limits.low = limits.low - 1\n"
+	                      "  return x * gain, limits.low, limits.name, math.floor(2.5)\n"
+	                      "end\n");
+	TEST_ASSERT_EQUAL_STRING("", transfer(program, isolated).c_str());
+
+	lua_pushinteger(isolated, 8);
+	TEST_ASSERT_EQUAL_INT(LUA_OK, lua_pcall(isolated, 1, 4, 0));
+	TEST_ASSERT_EQUAL_FLOAT(4.0, (float) lua_tonumber(isolated, -4));
+	TEST_ASSERT_EQUAL_INT(-11, (int) lua_tointeger(isolated, -3));
+	TEST_ASSERT_EQUAL_STRING("pid", lua_tostring(isolated, -2));
+	TEST_ASSERT_EQUAL_INT(2, (int) lua_tointeger(isolated, -1));
+
+	// The global was set in the new state, the table changed there only
+	lua_getglobal(isolated, "shared");
+	TEST_ASSERT_EQUAL_STRING("isolated", lua_tostring(isolated, -1));
+	lua_getglobal(program, "shared");
+	TEST_ASSERT_EQUAL_STRING("program", lua_tostring(program, -1));
+	for (int i = 1; lua_getupvalue(program, 1, i) != nullptr; i++) {
+		if (lua_istable(program, -1) && lua_getfield(program, -1, "low") == LUA_TNUMBER) {
+			TEST_ASSERT_EQUAL_INT(-10, (int) lua_tointeger(program, -1));
+		}
+		lua_settop(program, 2);
+	}
+
+	lua_close(program);
+	lua_close(isolated);
+}
+
+// ---------------------------------------------------------------------------
+// IT-02: functions as upvalues cannot be moved, the message names them
+// ---------------------------------------------------------------------------
+void test_IT02_function_upvalue_rejected() {
+	lua_State* program = newState();
+	lua_State* isolated = newState();
+
+	loadFunction(program, "local function helper() return 1 end\n"
+	                      "return function() return helper() end\n");
+	std::string error = transfer(program, isolated);
+	TEST_ASSERT_NOT_NULL(strstr(error.c_str(), "upvalue 'helper' is a function"));
+	TEST_ASSERT_EQUAL_INT(0, lua_gettop(isolated));
+
+	// A sensor reader hoisted by Blockly is a C closure
+	lua_pushinteger(program, 3);
+	lua_pushcclosure(program, [](lua_State* L) {
+		lua_pushvalue(L, lua_upvalueindex(1));
+		lua_pushcclosure(L, [](lua_State* L) { return 0; }, 1);
+		return 1;
+	}, 1);
+	lua_setglobal(program, "accessor");
+	loadFunction(program, "local imu_YAW = accessor()\n"
+	                      "return function() return imu_YAW() end\n");
+	error = transfer(program, isolated);
+	TEST_ASSERT_NOT_NULL(strstr(error.c_str(), "upvalue 'imu_YAW' is a function"));
+	TEST_ASSERT_EQUAL_INT(0, lua_gettop(isolated));
+
+	lua_close(program);
+	lua_close(isolated);
+}
+
+// ---------------------------------------------------------------------------
+// IT-03: values keep their subtype through a copy, strings may hold zeros
+// ---------------------------------------------------------------------------
+void test_IT03_value_round_trip() {
+	lua_State* from = newState();
+	lua_State* to = newState();
+
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(from, "return {1, 2.0, 'a\\0b', true, nested = {deep = {x = 3}}}"));
+	ValueCopy copy;
+	TEST_ASSERT_NULL(copy.copyFrom(from, -1));
+	copy.push(to);
+	lua_setglobal(to, "t");
+
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(to, "return math.type(t[1]), math.type(t[2]), #t[3], t[4], t.nested.deep.x"));
+	TEST_ASSERT_EQUAL_STRING("integer", lua_tostring(to, -5));
+	TEST_ASSERT_EQUAL_STRING("float", lua_tostring(to, -4));
+	TEST_ASSERT_EQUAL_INT(3, (int) lua_tointeger(to, -3));
+	TEST_ASSERT_TRUE(lua_toboolean(to, -2));
+	TEST_ASSERT_EQUAL_INT(3, (int) lua_tointeger(to, -1));
+
+	lua_close(from);
+	lua_close(to);
+}
+
+// ---------------------------------------------------------------------------
+// IT-04: cyclic tables fail at the depth limit, userdata fails at once
+// ---------------------------------------------------------------------------
+void test_IT04_uncopyable_values() {
+	lua_State* L = newState();
+
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, "local t = {} t.self = t return t"));
+	ValueCopy cyclic;
+	TEST_ASSERT_EQUAL_STRING("table nested too deep or cyclic", cyclic.copyFrom(L, -1));
+	TEST_ASSERT_EQUAL_INT(1, lua_gettop(L));
+
+	lua_newuserdata(L, 4);
+	ValueCopy userdata;
+	TEST_ASSERT_NOT_NULL(userdata.copyFrom(L, -1));
+
+	lua_close(L);
+}
+
+// ---------------------------------------------------------------------------
+// IT-05: channel handles are plain integers and arrive unchanged, so the
+// isolated function reaches the same channels as the program
+// ---------------------------------------------------------------------------
+void test_IT05_channel_handles_copied() {
+	lua_State* program = newState();
+	lua_State* isolated = newState();
+
+	loadFunction(program, "local distances, estimates = 3, 16\n"
+	                      "return function() return distances, estimates, math.type(distances) end\n");
+	TEST_ASSERT_EQUAL_STRING("", transfer(program, isolated).c_str());
+	TEST_ASSERT_EQUAL_INT(LUA_OK, lua_pcall(isolated, 0, 3, 0));
+	TEST_ASSERT_EQUAL_INT(3, (int) lua_tointeger(isolated, -3));
+	TEST_ASSERT_EQUAL_INT(16, (int) lua_tointeger(isolated, -2));
+	TEST_ASSERT_EQUAL_STRING("integer", lua_tostring(isolated, -1));
+
+	lua_close(program);
+	lua_close(isolated);
+}
+
+// ---------------------------------------------------------------------------
+// IT-06: moved functions run in parallel, each on its own state
+// ---------------------------------------------------------------------------
+void test_IT06_parallel_states() {
+	lua_State* program = newState();
+	loadFunction(program, "local n = 200000\n"
+	                      "return function()\n"
+	                      "  local sum = 0\n"
+	                      "  for i = 1, n do sum = sum + i % 7 end\n"
+	                      "  result = sum\n"
+	                      "end\n");
+
+	lua_State* isolated[2];
+	for (int i = 0; i < 2; i++) {
+		isolated[i] = newState();
+		lua_pushvalue(program, -1);
+		TEST_ASSERT_EQUAL_STRING("", transfer(program, isolated[i]).c_str());
+	}
+
+	int results[2] = {LUA_ERRRUN, LUA_ERRRUN};
+	std::thread threads[2];
+	for (int i = 0; i < 2; i++) {
+		threads[i] = std::thread([&, i]() { results[i] = lua_pcall(isolated[i], 0, 0, 0); });
+	}
+	for (int i = 0; i < 2; i++) {
+		threads[i].join();
+		TEST_ASSERT_EQUAL_INT(LUA_OK, results[i]);
+		lua_getglobal(isolated[i], "result");
+		TEST_ASSERT_EQUAL_INT(599997, (int) lua_tointeger(isolated[i], -1));
+		lua_close(isolated[i]);
+	}
+
+	lua_getglobal(program, "result");
+	TEST_ASSERT_TRUE(lua_isnil(program, -1));
+	lua_close(program);
+}
+
+// ---------------------------------------------------------------------------
+// IT-07: running out of memory while setting up the new state is an error
+// of the transfer, the state can still be closed
+// ---------------------------------------------------------------------------
+static size_t limitBytes = 0;
+static size_t usedBytes = 0;
+
+static void* limitedAlloc(void* ud, void* ptr, size_t osize, size_t nsize) {
+	size_t oldBytes = ptr != nullptr ? osize : 0;
+	if (nsize == 0) {
+		usedBytes -= oldBytes;
+		free(ptr);
+		return nullptr;
+	}
+	if (usedBytes - oldBytes + nsize > limitBytes) {
+		return nullptr;
+	}
+	void* block = realloc(ptr, nsize);
+	if (block != nullptr) {
+		usedBytes = usedBytes - oldBytes + nsize;
+	}
+	return block;
+}
+
+void test_IT07_out_of_memory_in_new_state() {
+	lua_State* program = newState();
+	loadFunction(program, "local big = {}\n"
+	                      "for i = 1, 5000 do big[i] = 'entry ' .. i end\n"
+	                      "return function() return #big end\n");
+
+	usedBytes = 0;
+	limitBytes = 64 * 1024;
+	lua_State* isolated = lua_newstate(limitedAlloc, nullptr);
+	luaL_openlibs(isolated);
+	std::string error = transfer(program, isolated);
+	TEST_ASSERT_EQUAL_STRING("not enough memory", error.c_str());
+	TEST_ASSERT_EQUAL_INT(0, lua_gettop(isolated));
+	lua_close(isolated);
+	TEST_ASSERT_EQUAL_UINT32(0, usedBytes);
+
+	lua_close(program);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_IT01_upvalues_copied_globals_own);
+	RUN_TEST(test_IT02_function_upvalue_rejected);
+	RUN_TEST(test_IT03_value_round_trip);
+	RUN_TEST(test_IT04_uncopyable_values);
+	RUN_TEST(test_IT05_channel_handles_copied);
+	RUN_TEST(test_IT06_parallel_states);
+	RUN_TEST(test_IT07_out_of_memory_in_new_state);
+	return UNITY_END();
+}
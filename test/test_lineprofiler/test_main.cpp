@@ -0,0 +1,223 @@
+// ---------------------------------------------------------------------------
+// Unit tests for the sampling line profiler — LN-01..LN-05
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native --filter test_lineprofiler
+//
+// Runs Lua programs on the real Lua 5.4 library at lib/lua/ with the count
+// hook of LineProfiler installed. The sample table and the top-N selection
+// are reproduced inline (mirrors lineprofiler.cpp); the mutex and the JSON
+// report are left out.
+// ---------------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstring>
+#include <unity.h>
+
+extern "C" {
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+}
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of the sample table of LineProfiler
+// ---------------------------------------------------------------------------
+static const int tableSize = 32;
+static const int reportedLines = 8;
+
+struct Entry {
+	const char* source;
+	char chunk[24];
+	int line;
+	int function;
+	uint32_t samples;
+};
+
+static Entry entries[tableSize];
+static uint32_t totalSamples = 0;
+static uint32_t droppedSamples = 0;
+
+static void resetProfiler() {
+	memset(entries, 0, sizeof(entries));
+	totalSamples = 0;
+	droppedSamples = 0;
+}
+
+static void record(const char* source, const char* chunk, int line, int function) {
+	uint32_t hash = ((uint32_t) (uintptr_t) source >> 2) * 31u + (uint32_t) line;
+	for (int probe = 0; probe < tableSize; probe++) {
+		Entry& entry = entries[(hash + probe) % tableSize];
+		if (entry.source == source && entry.line == line) {
+			entry.samples++;
+			totalSamples++;
+			return;
+		}
+		if (entry.source == nullptr) {
+			entry.source = source;
+			strncpy(entry.chunk, chunk, sizeof(entry.chunk) - 1);
+			entry.chunk[sizeof(entry.chunk) - 1] = 0;
+			entry.line = line;
+			entry.function = function;
+			entry.samples = 1;
+			totalSamples++;
+			return;
+		}
+	}
+	droppedSamples++;
+}
+
+static int hottestLines(Entry* hottest) {
+	int count = 0;
+	for (int i = 0; i < tableSize; i++) {
+		const Entry& entry = entries[i];
+		if (entry.source == nullptr) {
+			continue;
+		}
+		int position = count < reportedLines ? count++ : reportedLines;
+		while (position > 0 && hottest[position - 1].samples < entry.samples) {
+			if (position < reportedLines) {
+				hottest[position] = hottest[position - 1];
+			}
+			position--;
+		}
+		if (position < reportedLines) {
+			hottest[position] = entry;
+		}
+	}
+	return count;
+}
+
+static void line_profiler_hook(lua_State* L, lua_Debug* ar) {
+	if (ar->event != LUA_HOOKCOUNT) {
+		return;
+	}
+	if (!lua_getinfo(L, "Sl", ar) || ar->currentline <= 0) {
+		return;
+	}
+	record(ar->source, ar->short_src, ar->currentline, ar->linedefined);
+}
+
+// Runs the program in a thread with the hook, like a thread started with profiling
+static void runProfiled(const char* program, int sampleInstructions) {
+	lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+	lua_State* thread = lua_newthread(L);
+	lua_sethook(thread, line_profiler_hook, LUA_MASKCOUNT, sampleInstructions);
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_loadbuffer(thread, program, strlen(program), "=program"));
+	TEST_ASSERT_EQUAL_INT(LUA_OK, lua_pcall(thread, 0, 0, 0));
+	lua_close(L);
+}
+
+void setUp() {
+	resetProfiler();
+}
+
+void tearDown() {}
+
+// ---------------------------------------------------------------------------
+// LN-01: the line of an inner loop gets most of the samples
+// ---------------------------------------------------------------------------
+void test_LN01_hot_line_found() {
+	runProfiled("local sum = 0\n"
+	            "for i = 1, 200 do\n"
+	            "  sum = sum + i\n"
+	            "end\n"
+	            "for i = 1, 2000 do\n"
+	            "  for j = 1, 100 do\n"
+	            "    sum = sum + (i * j) % 7\n"
+	            "  end\n"
+	            "end\n",
+	            100);
+
+	Entry hottest[reportedLines];
+	int count = hottestLines(hottest);
+	TEST_ASSERT_TRUE(count > 0);
+	TEST_ASSERT_EQUAL_STRING("program", hottest[0].chunk);
+	TEST_ASSERT_EQUAL_INT(7, hottest[0].line);
+	TEST_ASSERT_EQUAL_INT(0, hottest[0].function);
+	TEST_ASSERT_TRUE(hottest[0].samples * 2 > totalSamples);
+}
+
+// ---------------------------------------------------------------------------
+// LN-02: samples inside a function carry the line the function is defined at
+// ---------------------------------------------------------------------------
+void test_LN02_function_of_line() {
+	runProfiled("local function slow(n)\n"
+	            "  local x = 0\n"
+	            "  for i = 1, n do x = x + i % 3 end\n"
+	            "  return x\n"
+	            "end\n"
+	            "for k = 1, 500 do slow(200) end\n",
+	            100);
+
+	Entry hottest[reportedLines];
+	hottestLines(hottest);
+	TEST_ASSERT_EQUAL_INT(3, hottest[0].line);
+	TEST_ASSERT_EQUAL_INT(1, hottest[0].function);
+}
+
+// ---------------------------------------------------------------------------
+// LN-03: the hottest lines are reported in descending order, at most N
+// ---------------------------------------------------------------------------
+void test_LN03_top_lines_ordered() {
+	static const char source[] = "program";
+	for (int line = 1; line <= 20; line++) {
+		for (int n = 0; n < line; n++) {
+			record(source, "program", line, 0);
+		}
+	}
+
+	Entry hottest[reportedLines];
+	int count = hottestLines(hottest);
+	TEST_ASSERT_EQUAL_INT(reportedLines, count);
+	for (int i = 0; i < count; i++) {
+		TEST_ASSERT_EQUAL_INT(20 - i, hottest[i].line);
+		TEST_ASSERT_EQUAL_UINT32(20 - i, hottest[i].samples);
+	}
+	TEST_ASSERT_EQUAL_UINT32(210, totalSamples);
+}
+
+// ---------------------------------------------------------------------------
+// LN-04: lines beyond the table size are dropped, known lines still count
+// ---------------------------------------------------------------------------
+void test_LN04_table_full_drops() {
+	static const char source[] = "program";
+	for (int line = 1; line <= tableSize + 5; line++) {
+		record(source, "program", line, 0);
+	}
+	TEST_ASSERT_EQUAL_UINT32(tableSize, totalSamples);
+	TEST_ASSERT_EQUAL_UINT32(5, droppedSamples);
+
+	record(source, "program", 1, 0);
+	TEST_ASSERT_EQUAL_UINT32(tableSize + 1, totalSamples);
+	TEST_ASSERT_EQUAL_UINT32(5, droppedSamples);
+}
+
+// ---------------------------------------------------------------------------
+// LN-05: a thread without the hook is not sampled
+// ---------------------------------------------------------------------------
+void test_LN05_unprofiled_thread_not_sampled() {
+	lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+	lua_State* profiled = lua_newthread(L);
+	lua_sethook(profiled, line_profiler_hook, LUA_MASKCOUNT, 100);
+	lua_State* plain = lua_newthread(L);
+
+	const char* program = "local s = 0 for i = 1, 100000 do s = s + i end";
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_loadbuffer(plain, program, strlen(program), "=program"));
+	TEST_ASSERT_EQUAL_INT(LUA_OK, lua_pcall(plain, 0, 0, 0));
+	lua_close(L);
+
+	TEST_ASSERT_EQUAL_UINT32(0, totalSamples);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_LN01_hot_line_found);
+	RUN_TEST(test_LN02_function_of_line);
+	RUN_TEST(test_LN03_top_lines_ordered);
+	RUN_TEST(test_LN04_table_full_drops);
+	RUN_TEST(test_LN05_unprofiled_thread_not_sampled);
+	return UNITY_END();
+}
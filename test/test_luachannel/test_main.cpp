@@ -0,0 +1,377 @@
+// ---------------------------------------------------------------------------
+// Unit tests for the lock-free channels of hub.channel() — LC-01..LC-06
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native --filter test_luachannel
+//
+// The ring of LuaChannel is reproduced inline (mirrors luachannel.cpp):
+// slots with sequence numbers, positions claimed by compare-and-swap, the
+// latest mode dropping the oldest values. Producers and consumers run on
+// host threads. The blocking receive waits on a FreeRTOS task notification
+// and is not covered here.
+// ---------------------------------------------------------------------------
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <unity.h>
+#include <vector>
+
+extern "C" {
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+}
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of LuaChannel
+// ---------------------------------------------------------------------------
+static const size_t maxStringLength = 31;
+
+struct Value {
+	uint8_t type;
+	bool isInteger;
+	uint8_t length;
+	union {
+		lua_Integer integer;
+		lua_Number number;
+		bool boolean;
+	};
+	char string[maxStringLength];
+};
+
+class Channel {
+  public:
+	// start moves the positions, to test their wraparound
+	Channel(size_t capacity, bool latest, uint32_t start = 0)
+	    : latest_(latest), pushPos_(start), popPos_(start), dropped_(0) {
+		uint32_t size = 1;
+		while (size < capacity) {
+			size <<= 1;
+		}
+		slots_ = std::vector<Slot>(size);
+		for (uint32_t i = 0; i < size; i++) {
+			slots_[(start + i) & (size - 1)].sequence.store(2 * (start + i));
+		}
+		mask_ = size - 1;
+	}
+
+	size_t slots() const { return mask_ + 1; }
+	uint32_t dropped() const { return dropped_.load(); }
+
+	bool tryPush(const Value& value) {
+		uint32_t pos = pushPos_.load(std::memory_order_relaxed);
+		Slot* slot;
+		while (true) {
+			slot = &slots_[pos & mask_];
+			uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+			int32_t diff = (int32_t) (sequence - 2 * pos);
+			if (diff == 0) {
+				if (pushPos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = pushPos_.load(std::memory_order_relaxed);
+			}
+		}
+		slot->value = value;
+		slot->sequence.store(2 * pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool tryReceive(Value& value) {
+		uint32_t pos = popPos_.load(std::memory_order_relaxed);
+		Slot* slot;
+		while (true) {
+			slot = &slots_[pos & mask_];
+			uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+			int32_t diff = (int32_t) (sequence - (2 * pos + 1));
+			if (diff == 0) {
+				if (popPos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = popPos_.load(std::memory_order_relaxed);
+			}
+		}
+		value = slot->value;
+		slot->sequence.store(2 * (pos + mask_ + 1), std::memory_order_release);
+		return true;
+	}
+
+	bool send(const Value& value) {
+		while (!tryPush(value)) {
+			if (!latest_) {
+				return false;
+			}
+			Value oldest;
+			if (tryReceive(oldest)) {
+				dropped_++;
+			}
+		}
+		return true;
+	}
+
+  private:
+	struct Slot {
+		std::atomic<uint32_t> sequence;
+		Value value;
+
+		Slot() : sequence(0), value() {}
+		Slot(const Slot&) : sequence(0), value() {}
+	};
+
+	std::vector<Slot> slots_;
+	uint32_t mask_;
+	bool latest_;
+	std::atomic<uint32_t> pushPos_;
+	std::atomic<uint32_t> popPos_;
+	std::atomic<uint32_t> dropped_;
+};
+
+static const char* toValue(lua_State* L, int index, Value& value) {
+	switch (lua_type(L, index)) {
+		case LUA_TNUMBER:
+			value.type = LUA_TNUMBER;
+			value.isInteger = lua_isinteger(L, index);
+			if (value.isInteger) {
+				value.integer = lua_tointeger(L, index);
+			} else {
+				value.number = lua_tonumber(L, index);
+			}
+			return nullptr;
+		case LUA_TBOOLEAN:
+			value.type = LUA_TBOOLEAN;
+			value.boolean = lua_toboolean(L, index);
+			return nullptr;
+		case LUA_TSTRING: {
+			size_t length = 0;
+			const char* data = lua_tolstring(L, index, &length);
+			if (length > maxStringLength) {
+				return "string longer than 31 bytes";
+			}
+			value.type = LUA_TSTRING;
+			value.length = (uint8_t) length;
+			memcpy(value.string, data, length);
+			return nullptr;
+		}
+		default:
+			return "only numbers, booleans and short strings can be sent";
+	}
+}
+
+static void pushValue(lua_State* L, const Value& value) {
+	switch (value.type) {
+		case LUA_TNUMBER:
+			if (value.isInteger) {
+				lua_pushinteger(L, value.integer);
+			} else {
+				lua_pushnumber(L, value.number);
+			}
+			break;
+		case LUA_TBOOLEAN:
+			lua_pushboolean(L, value.boolean);
+			break;
+		default:
+			lua_pushlstring(L, value.string, value.length);
+			break;
+	}
+}
+
+static Value integerValue(lua_Integer integer) {
+	Value value;
+	value.type = LUA_TNUMBER;
+	value.isInteger = true;
+	value.integer = integer;
+	return value;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+// ---------------------------------------------------------------------------
+// LC-01: the capacity is rounded up to a power of two, a full ring refuses
+// ---------------------------------------------------------------------------
+void test_LC01_capacity_full_and_empty() {
+	Channel channel(5, false);
+	TEST_ASSERT_EQUAL_UINT32(8, channel.slots());
+
+	Value value;
+	TEST_ASSERT_FALSE(channel.tryReceive(value));
+	for (int i = 0; i < 8; i++) {
+		TEST_ASSERT_TRUE(channel.send(integerValue(i)));
+	}
+	TEST_ASSERT_FALSE(channel.send(integerValue(8)));
+	TEST_ASSERT_TRUE(channel.tryReceive(value));
+	TEST_ASSERT_EQUAL_INT(0, (int) value.integer);
+	TEST_ASSERT_TRUE(channel.send(integerValue(8)));
+	TEST_ASSERT_EQUAL_UINT32(0, channel.dropped());
+
+	Channel single(1, false);
+	TEST_ASSERT_EQUAL_UINT32(1, single.slots());
+}
+
+// ---------------------------------------------------------------------------
+// LC-02: values come out in order over many rounds of the ring
+// ---------------------------------------------------------------------------
+void test_LC02_fifo_over_rounds() {
+	Channel channel(4, false);
+	lua_Integer next = 0;
+	Value value;
+	for (lua_Integer i = 0; i < 1000; i++) {
+		TEST_ASSERT_TRUE(channel.send(integerValue(i)));
+		if (i % 3 == 2) {
+			while (channel.tryReceive(value)) {
+				TEST_ASSERT_EQUAL_INT((int) next, (int) value.integer);
+				next++;
+			}
+		}
+	}
+	while (channel.tryReceive(value)) {
+		TEST_ASSERT_EQUAL_INT((int) next, (int) value.integer);
+		next++;
+	}
+	TEST_ASSERT_EQUAL_INT(1000, (int) next);
+}
+
+// ---------------------------------------------------------------------------
+// LC-03: latest mode keeps the newest values, capacity 1 the last one
+// ---------------------------------------------------------------------------
+void test_LC03_latest_mode() {
+	Channel mailbox(1, true);
+	for (int i = 0; i < 10; i++) {
+		TEST_ASSERT_TRUE(mailbox.send(integerValue(i)));
+	}
+	Value value;
+	TEST_ASSERT_TRUE(mailbox.tryReceive(value));
+	TEST_ASSERT_EQUAL_INT(9, (int) value.integer);
+	TEST_ASSERT_FALSE(mailbox.tryReceive(value));
+	TEST_ASSERT_EQUAL_UINT32(9, mailbox.dropped());
+
+	Channel recent(4, true);
+	for (int i = 0; i < 10; i++) {
+		recent.send(integerValue(i));
+	}
+	for (int i = 6; i < 10; i++) {
+		TEST_ASSERT_TRUE(recent.tryReceive(value));
+		TEST_ASSERT_EQUAL_INT(i, (int) value.integer);
+	}
+}
+
+// ---------------------------------------------------------------------------
+// LC-04: several producers and one consumer, every value arrives once and in
+// the order of its producer
+// ---------------------------------------------------------------------------
+void test_LC04_multiple_producers() {
+	static const int producers = 3;
+	static const int perProducer = 100000;
+	Channel channel(64, false);
+
+	std::vector<std::thread> threads;
+	for (int p = 0; p < producers; p++) {
+		threads.emplace_back([&channel, p]() {
+			for (int i = 0; i < perProducer; i++) {
+				Value value = integerValue((lua_Integer) p * perProducer + i);
+				while (!channel.send(value)) {
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+
+	std::vector<int> nextOf(producers, 0);
+	int received = 0;
+	bool ordered = true;
+	Value value;
+	while (received < producers * perProducer) {
+		if (!channel.tryReceive(value)) {
+			std::this_thread::yield();
+			continue;
+		}
+		int p = (int) (value.integer / perProducer);
+		int i = (int) (value.integer % perProducer);
+		ordered = ordered && i == nextOf[p];
+		nextOf[p] = i + 1;
+		received++;
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	TEST_ASSERT_TRUE(ordered);
+	for (int p = 0; p < producers; p++) {
+		TEST_ASSERT_EQUAL_INT(perProducer, nextOf[p]);
+	}
+	TEST_ASSERT_FALSE(channel.tryReceive(value));
+}
+
+// ---------------------------------------------------------------------------
+// LC-05: positions wrap around 2^32 without losing or repeating a value
+// ---------------------------------------------------------------------------
+void test_LC05_position_wraparound() {
+	Channel channel(4, false, UINT32_MAX - 5);
+	Value value;
+	for (lua_Integer i = 0; i < 40; i++) {
+		TEST_ASSERT_TRUE(channel.send(integerValue(i)));
+		TEST_ASSERT_TRUE(channel.send(integerValue(i + 1000)));
+		TEST_ASSERT_TRUE(channel.tryReceive(value));
+		TEST_ASSERT_EQUAL_INT((int) i, (int) value.integer);
+		TEST_ASSERT_TRUE(channel.tryReceive(value));
+		TEST_ASSERT_EQUAL_INT((int) i + 1000, (int) value.integer);
+	}
+	TEST_ASSERT_FALSE(channel.tryReceive(value));
+}
+
+// ---------------------------------------------------------------------------
+// LC-06: numbers keep their subtype, strings up to 31 bytes, nothing else
+// ---------------------------------------------------------------------------
+void test_LC06_value_types() {
+	lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, "return 42, 0.5, true, 'a\\0b', string.rep('x', 31)"));
+
+	Channel channel(8, false);
+	for (int index = 1; index <= 5; index++) {
+		Value value;
+		TEST_ASSERT_NULL(toValue(L, index, value));
+		TEST_ASSERT_TRUE(channel.send(value));
+	}
+	lua_settop(L, 0);
+	Value value;
+	while (channel.tryReceive(value)) {
+		pushValue(L, value);
+	}
+	lua_setglobal(L, "long");
+	lua_setglobal(L, "zero");
+	lua_setglobal(L, "flag");
+	lua_setglobal(L, "half");
+	lua_setglobal(L, "answer");
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, "return math.type(answer) == 'integer' and answer == 42 and "
+	                                               "math.type(half) == 'float' and flag == true and "
+	                                               "zero == 'a\\0b' and #long == 31"));
+	TEST_ASSERT_TRUE(lua_toboolean(L, -1));
+
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, "return string.rep('x', 32), {}, nil"));
+	Value rejected;
+	TEST_ASSERT_EQUAL_STRING("string longer than 31 bytes", toValue(L, -3, rejected));
+	TEST_ASSERT_NOT_NULL(toValue(L, -2, rejected));
+	TEST_ASSERT_NOT_NULL(toValue(L, -1, rejected));
+	lua_close(L);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_LC01_capacity_full_and_empty);
+	RUN_TEST(test_LC02_fifo_over_rounds);
+	RUN_TEST(test_LC03_latest_mode);
+	RUN_TEST(test_LC04_multiple_producers);
+	RUN_TEST(test_LC05_position_wraparound);
+	RUN_TEST(test_LC06_value_types);
+	return UNITY_END();
+}
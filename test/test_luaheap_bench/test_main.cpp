@@ -0,0 +1,400 @@
+// ---------------------------------------------------------------------------
+// Benchmark for the size-class allocator of the Lua heap — LH-01..LH-03
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native-bench --filter test_luaheap_bench
+//
+// The arena, size classes and free lists of LuaHeap are reproduced inline
+// (mirrors luaheap.cpp); the spinlock is left out and malloc stands in for
+// the PSRAM heap. Lua programs typical for the hub run on the real Lua 5.4
+// library at lib/lua/ while their allocations are recorded. The trace is
+// then replayed against the former allocator (realloc/free, like
+// heap_caps_realloc into PSRAM) and against the size classes.
+//
+// Reported: ns per allocator call for both and the share of the calls the
+// arena serves, frees included. Host timings say nothing about PSRAM latency
+// on the ESP32; the checks are on correctness and on the arena share.
+// ---------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <unity.h>
+#include <vector>
+
+extern "C" {
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+}
+
+typedef std::chrono::steady_clock BenchClock;
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of LuaHeap
+// ---------------------------------------------------------------------------
+static const int numClasses = 8;
+static const size_t maxPooledSize = 128;
+static const size_t slabSize = 1024;
+static const size_t classSizes[numClasses] = {16, 24, 32, 40, 48, 64, 96, 128};
+static const uint8_t classBySteps[] = {0, 0, 0, 1, 2, 3, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7};
+static const int spilled = -1;
+
+struct Heap {
+	uint8_t* arena;
+	uint8_t* arenaEnd;
+	size_t arenaSize;
+	size_t arenaUsed;
+	void* freeLists[numClasses];
+	uint8_t* slabCursor[numClasses];
+	uint8_t* slabEnd[numClasses];
+	size_t classBytes[numClasses];
+	size_t spilledBytes;
+	size_t liveBytes;
+	size_t peakBytes;
+	uint32_t spills;
+	uint32_t pooledCalls;
+	uint32_t calls;
+};
+
+static void heapInit(Heap& heap, size_t arenaSize) {
+	memset(&heap, 0, sizeof(heap));
+	heap.arena = (uint8_t*) malloc(arenaSize);
+	heap.arenaEnd = heap.arena + arenaSize;
+	heap.arenaSize = arenaSize;
+}
+
+static void heapDestroy(Heap& heap) {
+	free(heap.arena);
+}
+
+static int sizeClassOf(size_t size) {
+	return classBySteps[(size + 7) >> 3];
+}
+
+static bool contains(Heap& heap, void* ptr) {
+	return ptr >= heap.arena && ptr < heap.arenaEnd;
+}
+
+static void account(Heap& heap, int sizeClass, size_t removed, size_t added) {
+	if (sizeClass >= 0) {
+		heap.classBytes[sizeClass] = heap.classBytes[sizeClass] - removed + added;
+	} else {
+		heap.spilledBytes = heap.spilledBytes - removed + added;
+	}
+	heap.liveBytes = heap.liveBytes - removed + added;
+	if (heap.liveBytes > heap.peakBytes) {
+		heap.peakBytes = heap.liveBytes;
+	}
+}
+
+static void* takeBlock(Heap& heap, int sizeClass) {
+	void* block = heap.freeLists[sizeClass];
+	if (block != nullptr) {
+		heap.freeLists[sizeClass] = *(void**) block;
+		return block;
+	}
+	size_t size = classSizes[sizeClass];
+	if (heap.slabCursor[sizeClass] == nullptr || heap.slabCursor[sizeClass] + size > heap.slabEnd[sizeClass]) {
+		if (heap.arenaUsed + slabSize > heap.arenaSize) {
+			return nullptr;
+		}
+		heap.slabCursor[sizeClass] = heap.arena + heap.arenaUsed;
+		heap.slabEnd[sizeClass] = heap.slabCursor[sizeClass] + slabSize;
+		heap.arenaUsed += slabSize;
+	}
+	block = heap.slabCursor[sizeClass];
+	heap.slabCursor[sizeClass] += size;
+	return block;
+}
+
+static void* allocateBlock(Heap& heap, size_t size) {
+	if (size <= maxPooledSize) {
+		int sizeClass = sizeClassOf(size);
+		void* block = takeBlock(heap, sizeClass);
+		if (block != nullptr) {
+			account(heap, sizeClass, 0, classSizes[sizeClass]);
+			heap.pooledCalls++;
+			return block;
+		}
+	}
+	void* block = malloc(size);
+	if (block != nullptr) {
+		account(heap, spilled, 0, size);
+		if (size <= maxPooledSize) {
+			heap.spills++;
+		}
+	}
+	return block;
+}
+
+static void freeBlock(Heap& heap, void* ptr, size_t size) {
+	if (!contains(heap, ptr)) {
+		free(ptr);
+		account(heap, spilled, size, 0);
+		return;
+	}
+	int sizeClass = sizeClassOf(size);
+	*(void**) ptr = heap.freeLists[sizeClass];
+	heap.freeLists[sizeClass] = ptr;
+	account(heap, sizeClass, classSizes[sizeClass], 0);
+	heap.pooledCalls++;
+}
+
+static void* reallocateBlock(Heap& heap, void* ptr, size_t osize, size_t nsize) {
+	if (contains(heap, ptr)) {
+		if (nsize <= maxPooledSize && sizeClassOf(nsize) == sizeClassOf(osize)) {
+			heap.pooledCalls++;
+			return ptr;
+		}
+	} else if (nsize > maxPooledSize) {
+		void* block = realloc(ptr, nsize);
+		if (block != nullptr) {
+			account(heap, spilled, osize, nsize);
+		}
+		return block;
+	}
+	void* block = allocateBlock(heap, nsize);
+	if (block == nullptr) {
+		return nsize <= osize ? ptr : nullptr;
+	}
+	memcpy(block, ptr, std::min(osize, nsize));
+	freeBlock(heap, ptr, osize);
+	return block;
+}
+
+static void* heapAllocate(void* ud, void* ptr, size_t osize, size_t nsize) {
+	Heap& heap = *(Heap*) ud;
+	heap.calls++;
+	if (ptr == nullptr) {
+		return nsize == 0 ? nullptr : allocateBlock(heap, nsize);
+	}
+	if (nsize == 0) {
+		freeBlock(heap, ptr, osize);
+		return nullptr;
+	}
+	return reallocateBlock(heap, ptr, osize, nsize);
+}
+
+// The former allocator, heap_caps_realloc() with malloc standing in for PSRAM
+static void* currentAllocate(void* ud, void* ptr, size_t osize, size_t nsize) {
+	(void) ud;
+	(void) osize;
+	if (nsize == 0) {
+		free(ptr);
+		return nullptr;
+	}
+	return realloc(ptr, nsize);
+}
+
+// ---------------------------------------------------------------------------
+// Allocation traces
+// ---------------------------------------------------------------------------
+struct TraceOp {
+	uint32_t slot; // identity of the block across reallocations
+	uint32_t osize;
+	uint32_t nsize;
+	bool fresh; // ptr was nullptr
+};
+
+struct Recorder {
+	std::vector<TraceOp> ops;
+	std::map<void*, uint32_t> slots;
+	uint32_t nextSlot;
+};
+
+static void* recordingAllocate(void* ud, void* ptr, size_t osize, size_t nsize) {
+	Recorder& recorder = *(Recorder*) ud;
+	TraceOp op = {0, (uint32_t) osize, (uint32_t) nsize, ptr == nullptr};
+	if (ptr == nullptr) {
+		op.slot = recorder.nextSlot++;
+	} else {
+		op.slot = recorder.slots[ptr];
+		recorder.slots.erase(ptr);
+	}
+	void* block = currentAllocate(nullptr, ptr, osize, nsize);
+	if (block != nullptr) {
+		recorder.slots[block] = op.slot;
+	}
+	if (ptr != nullptr || nsize != 0) {
+		recorder.ops.push_back(op);
+	}
+	return block;
+}
+
+// Blockly-style workloads: sensor loops with arithmetic, string building for
+// ui.showvalue(), tables of samples and closures
+static const char* workloads[] = {
+    "local pid = {kp = 2, ki = 0.1, kd = 0.05, i = 0, last = 0}\n"
+    "for n = 1, 3000 do\n"
+    "  local e = math.sin(n / 50) * 100\n"
+    "  pid.i = pid.i + e\n"
+    "  local out = pid.kp * e + pid.ki * pid.i + pid.kd * (e - pid.last)\n"
+    "  pid.last = e\n"
+    "  local label = 'speed ' .. tostring(math.floor(out))\n"
+    "end\n",
+    "local samples = {}\n"
+    "for n = 1, 2000 do\n"
+    "  samples[#samples + 1] = {t = n * 10, n}\n"
+    "  if #samples > 64 then samples = {} end\n"
+    "end\n",
+    "local handlers = {}\n"
+    "for n = 1, 2000 do\n"
+    "  local k = n % 16\n"
+    "  handlers[k] = function(x) return x + n end\n"
+    "  local s = string.format('%d:%d', k, handlers[k](1))\n"
+    "end\n"
+    "local parts = {}\n"
+    "for n = 1, 500 do parts[#parts + 1] = tostring(n) end\n"
+    "local joined = table.concat(parts, ',')\n",
+};
+
+static void runWorkloads(lua_State* L) {
+	luaL_openlibs(L);
+	for (const char* workload : workloads) {
+		TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, workload));
+	}
+	lua_gc(L, LUA_GCCOLLECT);
+}
+
+static std::vector<TraceOp> recordTrace() {
+	Recorder recorder;
+	recorder.nextSlot = 0;
+	lua_State* L = lua_newstate(recordingAllocate, &recorder);
+	runWorkloads(L);
+	lua_close(L);
+	return recorder.ops;
+}
+
+// Replays a trace against an allocator, returns ns per call
+static double replay(const std::vector<TraceOp>& trace, uint32_t slots, lua_Alloc allocator, void* ud) {
+	std::vector<void*> blocks(slots, nullptr);
+	BenchClock::time_point start = BenchClock::now();
+	for (const TraceOp& op : trace) {
+		void* ptr = op.fresh ? nullptr : blocks[op.slot];
+		void* block = allocator(ud, ptr, op.osize, op.nsize);
+		blocks[op.slot] = block;
+		if (block != nullptr) {
+			// Touch the block like Lua initializing the object
+			*(volatile uint8_t*) block = (uint8_t) op.slot;
+		}
+	}
+	double nanos = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - start).count();
+	return nanos / trace.size();
+}
+
+static uint32_t slotCount(const std::vector<TraceOp>& trace) {
+	uint32_t slots = 0;
+	for (const TraceOp& op : trace) {
+		slots = std::max(slots, op.slot + 1);
+	}
+	return slots;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+// ---------------------------------------------------------------------------
+// LH-01: Lua runs on the size classes and returns every byte on close
+// ---------------------------------------------------------------------------
+void test_LH01_lua_on_size_classes() {
+	// A small arena makes the workloads spill as well
+	Heap heap;
+	heapInit(heap, 8 * 1024);
+	lua_State* L = lua_newstate(heapAllocate, &heap);
+	runWorkloads(L);
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, "local t = {} for i = 1, 100 do t[i] = i * 2 end\n"
+	                                               "assert(#t == 100 and t[50] == 100)\n"
+	                                               "assert(table.concat({'a', 'b', 'c'}) == 'abc')"));
+	TEST_ASSERT_TRUE(heap.spills > 0);
+	TEST_ASSERT_EQUAL_UINT32(heap.arenaSize, heap.arenaUsed);
+	lua_close(L);
+
+	for (int i = 0; i < numClasses; i++) {
+		TEST_ASSERT_EQUAL_UINT32(0, heap.classBytes[i]);
+	}
+	TEST_ASSERT_EQUAL_UINT32(0, heap.spilledBytes);
+	TEST_ASSERT_EQUAL_UINT32(0, heap.liveBytes);
+	heapDestroy(heap);
+}
+
+// ---------------------------------------------------------------------------
+// LH-02: size classes round up to the next class, larger blocks spill
+// ---------------------------------------------------------------------------
+void test_LH02_size_classes() {
+	TEST_ASSERT_EQUAL_INT(0, sizeClassOf(1));
+	TEST_ASSERT_EQUAL_INT(0, sizeClassOf(16));
+	TEST_ASSERT_EQUAL_INT(1, sizeClassOf(17));
+	TEST_ASSERT_EQUAL_INT(5, sizeClassOf(49));
+	TEST_ASSERT_EQUAL_INT(6, sizeClassOf(65));
+	TEST_ASSERT_EQUAL_INT(7, sizeClassOf(128));
+	for (size_t size = 1; size <= maxPooledSize; size++) {
+		TEST_ASSERT_TRUE(classSizes[sizeClassOf(size)] >= size);
+	}
+
+	Heap heap;
+	heapInit(heap, 4 * 1024);
+	void* small = heapAllocate(&heap, nullptr, LUA_TSTRING, 20);
+	void* grown = heapAllocate(&heap, small, 20, 24);
+	TEST_ASSERT_EQUAL_PTR(small, grown);
+	void* large = heapAllocate(&heap, nullptr, LUA_TTABLE, 200);
+	TEST_ASSERT_FALSE(contains(heap, large));
+	TEST_ASSERT_EQUAL_UINT32(0, heap.spills);
+	heapAllocate(&heap, grown, 24, 0);
+	heapAllocate(&heap, large, 200, 0);
+	TEST_ASSERT_EQUAL_UINT32(0, heap.liveBytes);
+	heapDestroy(heap);
+}
+
+// ---------------------------------------------------------------------------
+// LH-03: replay of the recorded trace, former allocator vs size classes
+// ---------------------------------------------------------------------------
+void test_LH03_trace_replay() {
+	std::vector<TraceOp> trace = recordTrace();
+	uint32_t slots = slotCount(trace);
+	TEST_ASSERT_TRUE(trace.size() > 10000);
+
+	// Twice the firmware default, Lua objects of the 64-bit host are about twice as large
+	double current = 1e30;
+	double pooled = 1e30;
+	Heap heap;
+	for (int run = 0; run < 5; run++) {
+		current = std::min(current, replay(trace, slots, currentAllocate, nullptr));
+		heapInit(heap, 64 * 1024);
+		pooled = std::min(pooled, replay(trace, slots, heapAllocate, &heap));
+		if (run < 4) {
+			heapDestroy(heap);
+		}
+	}
+
+	size_t small = 0;
+	for (const TraceOp& op : trace) {
+		if (op.nsize > 0 && op.nsize <= maxPooledSize) {
+			small++;
+		}
+	}
+
+	printf("trace               %7u calls, %.1f%% for blocks up to %u bytes\n", (unsigned) trace.size(),
+	       100.0 * small / trace.size(), (unsigned) maxPooledSize);
+	printf("alloc/realloc       %7.2f ns/call\n", current);
+	printf("alloc/size classes  %7.2f ns/call\n", pooled);
+	printf("arena share         %7.1f%% of the calls, %u small spills, peak %u bytes, arena used %u bytes\n",
+	       100.0 * heap.pooledCalls / heap.calls, (unsigned) heap.spills, (unsigned) heap.peakBytes,
+	       (unsigned) heap.arenaUsed);
+
+	TEST_ASSERT_TRUE(heap.pooledCalls * 100 > heap.calls * 85);
+	heapDestroy(heap);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_LH01_lua_on_size_classes);
+	RUN_TEST(test_LH02_size_classes);
+	RUN_TEST(test_LH03_trace_replay);
+	return UNITY_END();
+}
@@ -0,0 +1,466 @@
+// ---------------------------------------------------------------------------
+// Conformance and benchmark suite for the Lua number profile — LP-01..LP-08
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native --filter test_luaprofile        (float32/int32)
+//           pio test -e native-lua64                           (double/int64)
+//
+// Both environments build the real Lua 5.4 library at lib/lua/ and run the
+// same Blockly-style control loops, the firmware default with LUA_32BITS and
+// native-lua64 with -D LUA_32BITS=0. Results are checked against a double
+// precision reference computed in C; timings are printed, not asserted (the
+// host FPU does doubles in hardware, the ESP32 FPU does not, so the soft-float
+// cost only shows on the target). The bindings touched by the profile
+// (alg.computePID, alg.map, alg.updateDR tick handling, millis(), number
+// output of ui.showvalue) are reproduced inline with a fake clock.
+// ---------------------------------------------------------------------------
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unity.h>
+
+extern "C" {
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+}
+
+#if LUA_32BITS
+static const char* profileName = "float32/int32";
+#else
+static const char* profileName = "double/int64";
+#endif
+
+// ---------------------------------------------------------------------------
+// Fake clock, milliseconds since boot
+// ---------------------------------------------------------------------------
+static uint64_t uptimeMs = 0;
+
+static uint32_t millis() {
+	return (uint32_t) uptimeMs;
+}
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of global_millis() (mirrors megahub.cpp)
+// ---------------------------------------------------------------------------
+static int global_millis(lua_State* luaState) {
+#if LUA_MAXINTEGER > INT32_MAX
+	lua_Integer ms = (lua_Integer) uptimeMs;
+#else
+	lua_Integer ms = (lua_Integer) (int32_t) millis();
+#endif
+	lua_pushinteger(luaState, ms);
+	return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of the PID binding (mirrors libluaalg.cpp), one
+// controller only
+// ---------------------------------------------------------------------------
+struct PIDState {
+	float integral;
+	float prevError;
+	uint32_t prevTimeMs;
+};
+
+static PIDState pidState;
+
+static int alg_init_pid(lua_State* luaState) {
+	pidState = PIDState{0.0f, 0.0f, (uint32_t) millis()};
+	lua_pushstring(luaState, "pid_0");
+	return 1;
+}
+
+static int alg_compute_pid(lua_State* luaState) {
+	luaL_checkstring(luaState, 1);
+	float setpoint = (float) luaL_checknumber(luaState, 2);
+	float pv = (float) luaL_checknumber(luaState, 3);
+	float kp = (float) luaL_checknumber(luaState, 4);
+	float ki = (float) luaL_checknumber(luaState, 5);
+	float kd = (float) luaL_checknumber(luaState, 6);
+	float outMin = (float) luaL_checknumber(luaState, 7);
+	float outMax = (float) luaL_checknumber(luaState, 8);
+
+	uint32_t now = millis();
+	PIDState& state = pidState;
+	uint32_t elapsedMs = now - state.prevTimeMs;
+	if (elapsedMs <= 1) {
+		lua_pushnumber(luaState, 0.0);
+		return 1;
+	}
+	float dt = (float) elapsedMs / 1000.0f;
+
+	float error = setpoint - pv;
+	float pTerm = kp * error;
+	state.integral += error * dt;
+	float preOutput = pTerm + ki * state.integral;
+	if (ki != 0.0f) {
+		if (preOutput > outMax) {
+			state.integral = (outMax - pTerm) / ki;
+		} else if (preOutput < outMin) {
+			state.integral = (outMin - pTerm) / ki;
+		}
+	}
+	float iTerm = ki * state.integral;
+	float derivative = (error - state.prevError) / dt;
+	float dTerm = kd * derivative;
+	float output = pTerm + iTerm + dTerm;
+	if (output > outMax) {
+		output = outMax;
+	} else if (output < outMin) {
+		output = outMin;
+	}
+	state.prevError = error;
+	state.prevTimeMs = now;
+
+	lua_pushnumber(luaState, output);
+	return 1;
+}
+
+static int alg_map(lua_State* luaState) {
+	float value = (float) luaL_checknumber(luaState, 1);
+	float inMin = (float) luaL_checknumber(luaState, 2);
+	float inMax = (float) luaL_checknumber(luaState, 3);
+	float outMin = (float) luaL_checknumber(luaState, 4);
+	float outMax = (float) luaL_checknumber(luaState, 5);
+	if (inMax == inMin) {
+		lua_pushnumber(luaState, outMin);
+		return 1;
+	}
+	float result = outMin + (value - inMin) * (outMax - outMin) / (inMax - inMin);
+	lua_pushnumber(luaState, result);
+	return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of the tick handling of alg.updateDR (mirrors libluaalg.cpp)
+// ---------------------------------------------------------------------------
+static int32_t checkTicks(lua_State* luaState, int index) {
+	if (lua_isinteger(luaState, index)) {
+		return (int32_t) lua_tointeger(luaState, index);
+	}
+	return (int32_t) luaL_checknumber(luaState, index);
+}
+
+static int32_t tickDelta(int32_t ticks, int32_t prevTicks) {
+	return (int32_t) ((uint32_t) ticks - (uint32_t) prevTicks);
+}
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of the number output of ui_show_value (mirrors
+// libluaui.cpp), returns the JSON text of the value
+// ---------------------------------------------------------------------------
+static std::string showValueJson(lua_State* luaState, int index) {
+	if (lua_isinteger(luaState, index)) {
+		return std::to_string((long long) lua_tointeger(luaState, index));
+	}
+	lua_Number numvalue = lua_tonumber(luaState, index);
+	if (std::isfinite(numvalue)) {
+		char buffer[32];
+		lua_number2str(buffer, sizeof(buffer), numvalue);
+		return buffer;
+	}
+	return "null";
+}
+
+// ---------------------------------------------------------------------------
+// Simulated LEGO motor: speed -100..100 turns the shaft by up to 600 deg/s
+// ---------------------------------------------------------------------------
+static const int stepMs = 20;
+static float motorPosition = 0.0f;
+static float motorSpeed = 0.0f;
+
+static int lego_getmodedataset(lua_State* luaState) {
+	lua_pushnumber(luaState, motorPosition);
+	return 1;
+}
+
+static int hub_setmotorspeed(lua_State* luaState) {
+	motorSpeed = (float) luaL_checknumber(luaState, 2);
+	return 0;
+}
+
+static void advancePlant() {
+	motorPosition += motorSpeed * 6.0f * stepMs / 1000.0f;
+	uptimeMs += stepMs;
+}
+
+// ---------------------------------------------------------------------------
+// Blockly-style programs. Each defines loop(), called once per 20 ms tick the
+// way hub_thread_task calls the thread function.
+// ---------------------------------------------------------------------------
+struct ControlProgram {
+	const char* name;
+	const char* source;
+};
+
+static const ControlProgram programs[] = {
+    {"alg.computePID", "pid = alg.initPID()\n"
+                       "function loop()\n"
+                       "  speed = alg.computePID(pid, 90, lego.getmodedataset(PORT1, 0), 1.0, 0.5, 0.05, -100, 100)\n"
+                       "  hub.setmotorspeed(PORT1, speed)\n"
+                       "end\n"},
+    {"Lua PID", "integral = 0\n"
+                "prevError = 0\n"
+                "last = millis()\n"
+                "function loop()\n"
+                "  local now = millis()\n"
+                "  local dt = (now - last) / 1000\n"
+                "  if dt <= 0 then return end\n"
+                "  last = now\n"
+                "  local error = 90 - lego.getmodedataset(PORT1, 0)\n"
+                "  integral = integral + error * dt\n"
+                "  local output = 1.0 * error + 0.5 * integral + 0.05 * ((error - prevError) / dt)\n"
+                "  prevError = error\n"
+                "  if output > 100 then output = 100 elseif output < -100 then output = -100 end\n"
+                "  hub.setmotorspeed(PORT1, output)\n"
+                "end\n"},
+    {"map + filter", "filtered = 0\n"
+                     "function loop()\n"
+                     "  local target = alg.map(90 - lego.getmodedataset(PORT1, 0), -180, 180, -100, 100)\n"
+                     "  filtered = filtered + 0.2 * (target - filtered)\n"
+                     "  if math.abs(filtered) < 0.5 then\n"
+                     "    hub.setmotorspeed(PORT1, 0)\n"
+                     "  else\n"
+                     "    hub.setmotorspeed(PORT1, filtered * 4)\n"
+                     "  end\n"
+                     "end\n"},
+};
+
+// Double precision reference of the three programs, same plant
+static double referencePosition(int program, int iterations) {
+	double position = 0.0;
+	double speed = 0.0;
+	double integral = 0.0;
+	double prevError = 0.0;
+	double filtered = 0.0;
+	for (int i = 0; i < iterations; i++) {
+		double dt = stepMs / 1000.0;
+		double error = 90.0 - position;
+		if (program == 0) {
+			integral += error * dt;
+			double pTerm = 1.0 * error;
+			if (pTerm + 0.5 * integral > 100.0) {
+				integral = (100.0 - pTerm) / 0.5;
+			} else if (pTerm + 0.5 * integral < -100.0) {
+				integral = (-100.0 - pTerm) / 0.5;
+			}
+			// The first call after initPID happens at the same millisecond and returns 0
+			if (i == 0) {
+				speed = 0.0;
+				integral = 0.0;
+				error = 0.0;
+			} else {
+				speed = std::fmax(-100.0, std::fmin(100.0, pTerm + 0.5 * integral + 0.05 * (error - prevError) / dt));
+			}
+		} else if (program == 1) {
+			// The first call happens at the same millisecond as the program start and returns early
+			if (i == 0) {
+				error = 0.0;
+			} else {
+				integral += error * dt;
+				speed = 1.0 * error + 0.5 * integral + 0.05 * ((error - prevError) / dt);
+				speed = std::fmax(-100.0, std::fmin(100.0, speed));
+			}
+		} else {
+			double target = -100.0 + (error + 180.0) * 200.0 / 360.0;
+			filtered += 0.2 * (target - filtered);
+			speed = std::fabs(filtered) < 0.5 ? 0.0 : filtered * 4.0;
+		}
+		prevError = error;
+		position += speed * 6.0 * stepMs / 1000.0;
+	}
+	return position;
+}
+
+static lua_State* L = nullptr;
+
+static void registerBindings(lua_State* luaState) {
+	lua_register(luaState, "millis", global_millis);
+	lua_pushinteger(luaState, 0);
+	lua_setglobal(luaState, "PORT1");
+
+	static const luaL_Reg algFunctions[] = {
+	    {"initPID", alg_init_pid}, {"computePID", alg_compute_pid}, {"map", alg_map}, {nullptr, nullptr}};
+	luaL_newlib(luaState, algFunctions);
+	lua_setglobal(luaState, "alg");
+
+	static const luaL_Reg legoFunctions[] = {{"getmodedataset", lego_getmodedataset}, {nullptr, nullptr}};
+	luaL_newlib(luaState, legoFunctions);
+	lua_setglobal(luaState, "lego");
+
+	static const luaL_Reg hubFunctions[] = {{"setmotorspeed", hub_setmotorspeed}, {nullptr, nullptr}};
+	luaL_newlib(luaState, hubFunctions);
+	lua_setglobal(luaState, "hub");
+}
+
+static void loadProgram(const ControlProgram& program) {
+	motorPosition = 0.0f;
+	motorSpeed = 0.0f;
+	int status = luaL_loadstring(L, program.source);
+	if (status == LUA_OK) {
+		status = lua_pcall(L, 0, 0, 0);
+	}
+	TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_OK, status, status == LUA_OK ? program.name : lua_tostring(L, -1));
+	lua_getglobal(L, "loop");
+	lua_setfield(L, LUA_REGISTRYINDEX, "loop");
+}
+
+// One thread iteration, like hub_thread_task: fetch the function, call it
+static void runIterations(int iterations) {
+	for (int i = 0; i < iterations; i++) {
+		lua_getfield(L, LUA_REGISTRYINDEX, "loop");
+		if (lua_pcall(L, 0, 0, 0) != LUA_OK) {
+			TEST_FAIL_MESSAGE(lua_tostring(L, -1));
+		}
+		advancePlant();
+	}
+}
+
+void setUp() {
+	uptimeMs = 0;
+	L = luaL_newstate();
+	luaL_openlibs(L);
+	registerBindings(L);
+}
+
+void tearDown() {
+	lua_settop(L, 0);
+	lua_close(L);
+	L = nullptr;
+}
+
+// LP-01: The library was built in the profile this suite claims to test
+void test_LP01_profile_types() {
+#if LUA_32BITS
+	TEST_ASSERT_EQUAL_INT(4, (int) sizeof(lua_Number));
+	TEST_ASSERT_EQUAL_INT(4, (int) sizeof(lua_Integer));
+#else
+	TEST_ASSERT_EQUAL_INT(8, (int) sizeof(lua_Number));
+	TEST_ASSERT_EQUAL_INT(8, (int) sizeof(lua_Integer));
+#endif
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, "return math.maxinteger + 1 == math.mininteger, 7 // 2, 7 / 2"));
+	TEST_ASSERT_TRUE(lua_toboolean(L, 1));
+	TEST_ASSERT_TRUE(lua_isinteger(L, 2));
+	TEST_ASSERT_EQUAL_INT(3, (int) lua_tointeger(L, 2));
+	TEST_ASSERT_FLOAT_WITHIN(0.0f, 3.5f, (float) lua_tonumber(L, 3));
+}
+
+// LP-02: Control loops settle where the double precision reference does
+void test_LP02_control_loops_match_reference() {
+	const int iterations = 500;
+	for (int p = 0; p < (int) (sizeof(programs) / sizeof(programs[0])); p++) {
+		lua_close(L);
+		L = luaL_newstate();
+		luaL_openlibs(L);
+		registerBindings(L);
+		uptimeMs = 0;
+
+		loadProgram(programs[p]);
+		runIterations(iterations);
+		double expected = referencePosition(p, iterations);
+		TEST_ASSERT_FLOAT_WITHIN_MESSAGE(0.05f, (float) expected, motorPosition, programs[p].name);
+		TEST_ASSERT_FLOAT_WITHIN_MESSAGE(1.0f, 90.0f, motorPosition, programs[p].name);
+	}
+}
+
+// LP-03: alg.computePID computes the same output right across the millis() wraparound
+void test_LP03_pid_across_millis_wraparound() {
+	loadProgram(programs[0]);
+	runIterations(200);
+	float positionFromBoot = motorPosition;
+
+	lua_close(L);
+	L = luaL_newstate();
+	luaL_openlibs(L);
+	registerBindings(L);
+	uptimeMs = 0xFFFFFFFFULL - 100 * stepMs; // wraps after 100 iterations
+	loadProgram(programs[0]);
+	runIterations(200);
+	TEST_ASSERT_FLOAT_WITHIN(0.0f, positionFromBoot, motorPosition);
+}
+
+// LP-04: millis() differences taken in Lua stay correct across the 32-bit wraps
+void test_LP04_millis_elapsed_across_wrap() {
+	const uint64_t boundaries[] = {0x7FFFFFFFULL, 0xFFFFFFFFULL};
+	for (uint64_t boundary : boundaries) {
+		uptimeMs = boundary - 40;
+		TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, "start = millis()"));
+		uptimeMs += 100;
+		TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, "return millis() - start"));
+		TEST_ASSERT_EQUAL_INT(100, (int) lua_tointeger(L, -1));
+		lua_pop(L, 1);
+	}
+}
+
+// LP-05: Encoder counts beyond float precision still give exact tick deltas
+void test_LP05_dr_ticks_exact() {
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, "return 16777217, 16777218, 2147483647, -2147483647 - 1, 12.0"));
+	int32_t a = checkTicks(L, 1);
+	int32_t b = checkTicks(L, 2);
+	TEST_ASSERT_EQUAL_INT32(16777217, a);
+	TEST_ASSERT_EQUAL_INT32(1, tickDelta(b, a));
+	// A counter wrapping from INT32_MAX to INT32_MIN moved by one tick
+	TEST_ASSERT_EQUAL_INT32(1, tickDelta(checkTicks(L, 4), checkTicks(L, 3)));
+	TEST_ASSERT_EQUAL_INT32(12, checkTicks(L, 5));
+}
+
+// LP-06: ui.showvalue sends numbers the way Lua prints them
+void test_LP06_showvalue_number_output() {
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, "return 0.1, 42, 1 / 3, -2.5, 1 / 0, 1e-3"));
+	TEST_ASSERT_EQUAL_STRING("0.1", showValueJson(L, 1).c_str());
+	TEST_ASSERT_EQUAL_STRING("42", showValueJson(L, 2).c_str());
+	TEST_ASSERT_EQUAL_STRING("0.333333", showValueJson(L, 3).substr(0, 8).c_str());
+	TEST_ASSERT_EQUAL_STRING("-2.5", showValueJson(L, 4).c_str());
+	TEST_ASSERT_EQUAL_STRING("null", showValueJson(L, 5).c_str());
+	TEST_ASSERT_EQUAL_STRING("0.001", showValueJson(L, 6).c_str());
+}
+
+// LP-07: Number formatting and conversions Blockly programs rely on
+void test_LP07_blockly_number_semantics() {
+	const char* checks = "assert(tostring(10 / 2) == '5.0')\n"
+	                     "assert(math.floor(3.7) == 3 and math.type(math.floor(3.7)) == 'integer')\n"
+	                     "assert(string.format('%.2f', 1 / 3) == '0.33')\n"
+	                     "assert(tonumber('12.5') == 12.5)\n"
+	                     "assert(-7 % 3 == 2 and 7 // -2 == -4)\n"
+	                     "assert(math.abs(math.sin(math.pi / 2) - 1) < 1e-6)\n";
+	int status = luaL_dostring(L, checks);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_OK, status, status == LUA_OK ? "" : lua_tostring(L, -1));
+}
+
+// LP-08: Time per loop iteration for each program in this profile
+void test_LP08_benchmark() {
+	const int iterations = 20000;
+	printf("\nLua profile %s\n%-16s %14s\n", profileName, "program", "ns/iteration");
+	for (const ControlProgram& program : programs) {
+		lua_close(L);
+		L = luaL_newstate();
+		luaL_openlibs(L);
+		registerBindings(L);
+		uptimeMs = 0;
+		loadProgram(program);
+
+		auto start = std::chrono::steady_clock::now();
+		runIterations(iterations);
+		auto end = std::chrono::steady_clock::now();
+		double ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+		printf("%-16s %14.1f\n", program.name, ns);
+	}
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_LP01_profile_types);
+	RUN_TEST(test_LP02_control_loops_match_reference);
+	RUN_TEST(test_LP03_pid_across_millis_wraparound);
+	RUN_TEST(test_LP04_millis_elapsed_across_wrap);
+	RUN_TEST(test_LP05_dr_ticks_exact);
+	RUN_TEST(test_LP06_showvalue_number_output);
+	RUN_TEST(test_LP07_blockly_number_semantics);
+	RUN_TEST(test_LP08_benchmark);
+	return UNITY_END();
+}
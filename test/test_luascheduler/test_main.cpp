@@ -0,0 +1,599 @@
+// ---------------------------------------------------------------------------
+// Unit tests for the cooperative Lua scheduler — LS-01..LS-10
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native --filter test_luascheduler
+//
+// This file reproduces the ready queue and the resume logic of LuaScheduler,
+// the yielding branches of global_wait() and hub.recv() and the coroutine
+// wake of LuaChannel inline with a fake clock. The
+// FreeRTOS task, its mutex and the task notifications are left out; the test
+// drives the scheduler loop one step at a time. Coroutines run on the real
+// Lua 5.4 library at lib/lua/, same as test_lua.
+// ---------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+extern "C" {
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+}
+
+// ---------------------------------------------------------------------------
+// Fake clock
+// ---------------------------------------------------------------------------
+static uint32_t nowMs = 0;
+
+static uint32_t millis() {
+	return nowMs;
+}
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of LuaScheduler (mirrors luascheduler.cpp)
+// ---------------------------------------------------------------------------
+class LuaScheduler {
+  public:
+	static const uint32_t iterationGapMs = 1;
+
+	struct Coroutine {
+		uint32_t id;
+		uint32_t sequence;
+		lua_State* thread;
+		int threadRef;
+		int functionRef;
+		std::string name;
+		bool stopRequested;
+		bool inIteration;
+		bool suspended;
+		bool woken;
+		uint32_t wakeAt;
+		int iterations;
+		int resumes;
+	};
+
+	~LuaScheduler() {
+		for (Coroutine* c : ready_) {
+			c->stopRequested = true;
+		}
+		stopPending_ = true;
+		removeStopped();
+	}
+
+	uint32_t add(lua_State* L, const std::string& name) {
+		Coroutine* coroutine = new Coroutine();
+		coroutine->name = name;
+		coroutine->stopRequested = false;
+		coroutine->inIteration = false;
+		coroutine->suspended = false;
+		coroutine->woken = false;
+		coroutine->wakeAt = millis();
+		coroutine->iterations = 0;
+		coroutine->resumes = 0;
+
+		coroutine->thread = lua_newthread(L);
+		coroutine->threadRef = luaL_ref(L, LUA_REGISTRYINDEX);
+		coroutine->functionRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+		coroutine->id = nextId_++;
+		push(coroutine);
+		return coroutine->id;
+	}
+
+	void stop(uint32_t id) {
+		for (Coroutine* c : ready_) {
+			if (c->id == id) {
+				c->stopRequested = true;
+			}
+		}
+		if (current_ != nullptr && current_->id == id) {
+			current_->stopRequested = true;
+		}
+		stopPending_ = true;
+	}
+
+	bool sleep(lua_State* L, uint32_t ms) {
+		if (current_ == nullptr || current_->thread != L || !lua_isyieldable(L)) {
+			return false;
+		}
+		current_->wakeAt = millis() + ms;
+		current_->suspended = false;
+		return true;
+	}
+
+	uint32_t suspend(lua_State* L, uint32_t timeoutMs) {
+		if (!sleep(L, timeoutMs)) {
+			return 0;
+		}
+		current_->suspended = true;
+		return current_->id;
+	}
+
+	void wake(uint32_t id) {
+		bool found = false;
+		for (Coroutine* c : ready_) {
+			if (c->id == id && c->suspended) {
+				c->wakeAt = millis();
+				found = true;
+			}
+		}
+		if (found) {
+			std::make_heap(ready_.begin(), ready_.end(), runsLater);
+		} else if (current_ != nullptr && current_->id == id) {
+			current_->woken = true;
+		}
+	}
+
+	// One pass of LuaScheduler::loop(). Returns false if nothing was due.
+	bool step() {
+		removeStopped();
+
+		Coroutine* coroutine = popDue(millis());
+		if (coroutine == nullptr) {
+			return false;
+		}
+
+		bool alive = resume(coroutine);
+
+		current_ = nullptr;
+		bool keep = alive && !coroutine->stopRequested;
+		if (keep) {
+			if (coroutine->woken && coroutine->suspended) {
+				coroutine->wakeAt = millis();
+			}
+			push(coroutine);
+		} else {
+			close(coroutine);
+			if (!alive) {
+				abnormalExits++;
+			}
+		}
+		return true;
+	}
+
+	// Runs everything due, then advances the clock to the next deadline
+	void runUntil(uint32_t endMs) {
+		while ((int32_t) (endMs - nowMs) >= 0) {
+			while (step()) {
+			}
+			if (ready_.empty()) {
+				nowMs = endMs;
+				return;
+			}
+			uint32_t next = ready_.front()->wakeAt;
+			if ((int32_t) (next - endMs) > 0) {
+				nowMs = endMs;
+				return;
+			}
+			nowMs = next;
+		}
+	}
+
+	Coroutine* find(uint32_t id) {
+		for (Coroutine* c : ready_) {
+			if (c->id == id) {
+				return c;
+			}
+		}
+		return nullptr;
+	}
+
+	size_t size() const { return ready_.size(); }
+
+	int abnormalExits = 0;
+	std::string lastError;
+
+  private:
+	static bool runsLater(const Coroutine* a, const Coroutine* b) {
+		int32_t diff = (int32_t) (a->wakeAt - b->wakeAt);
+		if (diff != 0) {
+			return diff > 0;
+		}
+		return (int32_t) (a->sequence - b->sequence) > 0;
+	}
+
+	void push(Coroutine* coroutine) {
+		coroutine->sequence = nextSequence_++;
+		ready_.push_back(coroutine);
+		std::push_heap(ready_.begin(), ready_.end(), runsLater);
+	}
+
+	Coroutine* popDue(uint32_t now) {
+		if (ready_.empty() || (int32_t) (ready_.front()->wakeAt - now) > 0) {
+			return nullptr;
+		}
+		std::pop_heap(ready_.begin(), ready_.end(), runsLater);
+		Coroutine* coroutine = ready_.back();
+		ready_.pop_back();
+		coroutine->woken = false;
+		current_ = coroutine;
+		return coroutine;
+	}
+
+	void removeStopped() {
+		if (!stopPending_) {
+			return;
+		}
+		stopPending_ = false;
+		auto end = std::partition(ready_.begin(), ready_.end(), [](Coroutine* c) { return !c->stopRequested; });
+		std::vector<Coroutine*> stopped(end, ready_.end());
+		ready_.erase(end, ready_.end());
+		std::make_heap(ready_.begin(), ready_.end(), runsLater);
+		for (Coroutine* c : stopped) {
+			close(c);
+		}
+	}
+
+	bool resume(Coroutine* coroutine) {
+		lua_State* thread = coroutine->thread;
+		if (!coroutine->inIteration) {
+			coroutine->inIteration = true;
+			lua_rawgeti(thread, LUA_REGISTRYINDEX, coroutine->functionRef);
+		}
+		coroutine->wakeAt = millis();
+		coroutine->resumes++;
+
+		int results = 0;
+		int result = lua_resume(thread, nullptr, 0, &results);
+		if (result == LUA_YIELD) {
+			lua_pop(thread, results);
+			return true;
+		}
+		if (result != LUA_OK) {
+			lastError = lua_tostring(thread, -1);
+			lua_pop(thread, 1);
+			return false;
+		}
+		lua_pop(thread, results);
+		coroutine->inIteration = false;
+		coroutine->suspended = false;
+		coroutine->iterations++;
+		coroutine->wakeAt = millis() + iterationGapMs;
+		return true;
+	}
+
+	void close(Coroutine* coroutine) {
+		lua_State* thread = coroutine->thread;
+		lua_closethread(thread, nullptr);
+		luaL_unref(thread, LUA_REGISTRYINDEX, coroutine->functionRef);
+		luaL_unref(thread, LUA_REGISTRYINDEX, coroutine->threadRef);
+		delete coroutine;
+	}
+
+	std::vector<Coroutine*> ready_;
+	Coroutine* current_ = nullptr;
+	uint32_t nextId_ = 1;
+	uint32_t nextSequence_ = 0;
+	bool stopPending_ = false;
+};
+
+// ---------------------------------------------------------------------------
+// Bindings: wait() (mirrors global_wait(), the blocking branch advances the
+// fake clock), hub.startthread()/hub.stopthread() reduced to the scheduler
+// path, and a log() collecting "name@time" entries.
+// ---------------------------------------------------------------------------
+static LuaScheduler* scheduler = nullptr;
+static std::vector<std::string> events;
+static int blockingWaits = 0;
+
+static int global_wait(lua_State* luaState) {
+	int delay = lua_tointeger(luaState, 1);
+	if (scheduler != nullptr && scheduler->sleep(luaState, delay > 0 ? delay : 0)) {
+		return lua_yield(luaState, 0);
+	}
+	blockingWaits++;
+	nowMs += delay;
+	return 0;
+}
+
+static int hub_startthread(lua_State* luaState) {
+	std::string name = luaL_checkstring(luaState, 1);
+	luaL_checktype(luaState, 2, LUA_TFUNCTION);
+	lua_pushvalue(luaState, 2);
+	lua_pushinteger(luaState, scheduler->add(luaState, name));
+	return 1;
+}
+
+static int hub_stopthread(lua_State* luaState) {
+	scheduler->stop((uint32_t) luaL_checkinteger(luaState, 1));
+	return 0;
+}
+
+// One channel of integers, the coroutine registration of LuaChannel and
+// hub.recv()/hub.push() reduced to it
+static std::vector<lua_Integer> channelValues;
+static uint32_t waitingCoroutine = 0;
+
+static bool channelTryReceive(lua_State* luaState) {
+	if (channelValues.empty()) {
+		return false;
+	}
+	lua_pushinteger(luaState, channelValues.front());
+	channelValues.erase(channelValues.begin());
+	return true;
+}
+
+static int hub_recv_continue(lua_State* luaState, int status, lua_KContext deadline);
+
+static int hub_recv_suspend(lua_State* luaState, uint32_t id, uint32_t deadline) {
+	waitingCoroutine = id;
+	if (channelTryReceive(luaState)) {
+		waitingCoroutine = waitingCoroutine == id ? 0 : waitingCoroutine;
+		return 1;
+	}
+	lua_settop(luaState, 1);
+	lua_pushinteger(luaState, id);
+	return lua_yieldk(luaState, 0, (lua_KContext) deadline, hub_recv_continue);
+}
+
+static int hub_recv_continue(lua_State* luaState, int status, lua_KContext deadline) {
+	uint32_t id = (uint32_t) lua_tointeger(luaState, 2);
+	waitingCoroutine = waitingCoroutine == id ? 0 : waitingCoroutine;
+	if (channelTryReceive(luaState)) {
+		return 1;
+	}
+	int32_t remaining = (int32_t) ((uint32_t) deadline - millis());
+	id = remaining > 0 ? scheduler->suspend(luaState, (uint32_t) remaining) : 0;
+	if (id != 0) {
+		return hub_recv_suspend(luaState, id, (uint32_t) deadline);
+	}
+	lua_pushnil(luaState);
+	return 1;
+}
+
+static int hub_recv(lua_State* luaState) {
+	lua_Integer timeoutMs = luaL_checkinteger(luaState, 1);
+	if (channelTryReceive(luaState)) {
+		return 1;
+	}
+	uint32_t id = timeoutMs > 0 ? scheduler->suspend(luaState, (uint32_t) timeoutMs) : 0;
+	if (id != 0) {
+		return hub_recv_suspend(luaState, id, millis() + (uint32_t) timeoutMs);
+	}
+	lua_pushnil(luaState);
+	return 1;
+}
+
+static int hub_push(lua_State* luaState) {
+	channelValues.push_back(luaL_checkinteger(luaState, 1));
+	uint32_t id = waitingCoroutine;
+	waitingCoroutine = 0;
+	if (id != 0) {
+		scheduler->wake(id);
+	}
+	return 0;
+}
+
+static int test_log(lua_State* luaState) {
+	events.push_back(std::string(luaL_checkstring(luaState, 1)) + "@" + std::to_string(nowMs));
+	return 0;
+}
+
+static lua_State* L = nullptr;
+
+static void run(const char* code) {
+	if (luaL_dostring(L, code) != LUA_OK) {
+		printf("Lua error: %s\n", lua_tostring(L, -1));
+		TEST_FAIL_MESSAGE("Lua program failed");
+	}
+}
+
+static std::string joined() {
+	std::string result;
+	for (const std::string& e : events) {
+		result += (result.empty() ? "" : " ") + e;
+	}
+	return result;
+}
+
+void setUp() {
+	nowMs = 0;
+	events.clear();
+	blockingWaits = 0;
+	channelValues.clear();
+	waitingCoroutine = 0;
+	L = luaL_newstate();
+	luaL_openlibs(L);
+	lua_register(L, "wait", global_wait);
+	lua_register(L, "startthread", hub_startthread);
+	lua_register(L, "stopthread", hub_stopthread);
+	lua_register(L, "log", test_log);
+	lua_register(L, "recv", hub_recv);
+	lua_register(L, "push", hub_push);
+	scheduler = new LuaScheduler();
+}
+
+void tearDown() {
+	delete scheduler;
+	scheduler = nullptr;
+	lua_close(L);
+	L = nullptr;
+}
+
+// ---------------------------------------------------------------------------
+// LS-01: wait() yields, the coroutine with the earliest deadline runs next
+// ---------------------------------------------------------------------------
+void test_LS01_wait_yields_in_deadline_order() {
+	run("startthread('slow', function() log('slow') wait(30) end)"
+	    "startthread('fast', function() log('fast') wait(10) end)");
+
+	scheduler->runUntil(35);
+
+	// Both start at 0; each iteration is queued again 1 ms after its wait() ends
+	TEST_ASSERT_EQUAL_STRING("slow@0 fast@0 fast@11 fast@22 slow@31 fast@33", joined().c_str());
+	TEST_ASSERT_EQUAL_INT(0, blockingWaits);
+}
+
+// ---------------------------------------------------------------------------
+// LS-02: equal deadlines run in the order they were queued
+// ---------------------------------------------------------------------------
+void test_LS02_equal_deadlines_fifo() {
+	run("for _, n in ipairs({'a', 'b', 'c', 'd'}) do startthread(n, function() log(n) wait(4) end) end");
+
+	scheduler->runUntil(5);
+
+	TEST_ASSERT_EQUAL_STRING("a@0 b@0 c@0 d@0 a@5 b@5 c@5 d@5", joined().c_str());
+}
+
+// ---------------------------------------------------------------------------
+// LS-03: a loop without wait() is called again after the iteration gap and
+// the local state of an iteration survives its yields
+// ---------------------------------------------------------------------------
+void test_LS03_iteration_gap_and_state() {
+	run("busy = startthread('busy', function() end)"
+	    "startthread('steps', function()"
+	    "  local x = 1 wait(2) x = x + 1 wait(2) x = x * 10 log('x' .. x)"
+	    "end)");
+
+	scheduler->runUntil(20);
+
+	LuaScheduler::Coroutine* busy = scheduler->find(1);
+	TEST_ASSERT_NOT_NULL(busy);
+	TEST_ASSERT_EQUAL_INT(21, busy->iterations);
+	// Iterations start at 0, 5, 10, 15 and end 4 ms later
+	TEST_ASSERT_EQUAL_STRING("x20@4 x20@9 x20@14 x20@19", joined().c_str());
+}
+
+// ---------------------------------------------------------------------------
+// LS-04: stop() removes a coroutine suspended in wait(), also when called by
+// another coroutine, and releases its registry references
+// ---------------------------------------------------------------------------
+void test_LS04_stop_suspended_coroutine() {
+	run("sleeper = startthread('sleeper', function() log('sleeper') wait(1000) end)"
+	    "startthread('stopper', function() wait(50) stopthread(sleeper) log('stopped') wait(1000) end)");
+
+	scheduler->runUntil(100);
+	TEST_ASSERT_EQUAL_STRING("sleeper@0 stopped@50", joined().c_str());
+	TEST_ASSERT_EQUAL_UINT32(1, scheduler->size());
+	TEST_ASSERT_NULL(scheduler->find(1));
+
+	// The stopped coroutine is garbage once its references are gone
+	int before = lua_gc(L, LUA_GCCOUNT, 0);
+	lua_gc(L, LUA_GCCOLLECT, 0);
+	TEST_ASSERT_TRUE(lua_gc(L, LUA_GCCOUNT, 0) <= before);
+
+	// Stopping it again is harmless, the sleeper never comes back
+	scheduler->runUntil(2000);
+	TEST_ASSERT_EQUAL_STRING("sleeper@0 stopped@50 stopped@1101", joined().c_str());
+}
+
+// ---------------------------------------------------------------------------
+// LS-05: a Lua error ends only the failing coroutine and is reported as an
+// abnormal exit
+// ---------------------------------------------------------------------------
+void test_LS05_error_removes_coroutine() {
+	run("startthread('ok', function() log('ok') wait(10) end)"
+	    "startthread('bad', function() wait(15) error('boom') end)");
+
+	scheduler->runUntil(30);
+
+	TEST_ASSERT_EQUAL_INT(1, scheduler->abnormalExits);
+	TEST_ASSERT_TRUE(scheduler->lastError.find("boom") != std::string::npos);
+	TEST_ASSERT_EQUAL_UINT32(1, scheduler->size());
+	TEST_ASSERT_EQUAL_STRING("ok@0 ok@11 ok@22", joined().c_str());
+}
+
+// ---------------------------------------------------------------------------
+// LS-06: wait() inside pcall yields; an error after the yield is still
+// caught by that pcall
+// ---------------------------------------------------------------------------
+void test_LS06_wait_inside_pcall() {
+	run("startthread('p', function()"
+	    "  local ok = pcall(function() wait(5) error('late') end)"
+	    "  log(ok and 'ok' or 'caught') wait(100)"
+	    "end)");
+
+	scheduler->runUntil(10);
+
+	TEST_ASSERT_EQUAL_STRING("caught@5", joined().c_str());
+	TEST_ASSERT_EQUAL_INT(0, scheduler->abnormalExits);
+	TEST_ASSERT_EQUAL_INT(0, blockingWaits);
+}
+
+// ---------------------------------------------------------------------------
+// LS-07: wait() that cannot yield to the scheduler blocks instead — from a
+// nested coroutine, across a C call boundary and outside any coroutine
+// ---------------------------------------------------------------------------
+void test_LS07_fallback_to_blocking_wait() {
+	run("wait(3)");
+	TEST_ASSERT_EQUAL_INT(1, blockingWaits);
+
+	run("startthread('nested', function()"
+	    "  coroutine.wrap(function() wait(2) end)()"
+	    "  local t = {3, 1, 2}"
+	    "  table.sort(t, function(a, b) wait(1) return a < b end)"
+	    "  log('sorted' .. t[1]) wait(100)"
+	    "end)");
+	int before = blockingWaits;
+	scheduler->runUntil(nowMs);
+
+	TEST_ASSERT_TRUE(blockingWaits >= before + 2);
+	TEST_ASSERT_EQUAL_INT(0, scheduler->abnormalExits);
+	TEST_ASSERT_EQUAL_UINT32(1, events.size());
+	TEST_ASSERT_TRUE(events[0].compare(0, 8, "sorted1@") == 0);
+}
+
+// ---------------------------------------------------------------------------
+// LS-08: deadlines stay ordered across the millis() wraparound
+// ---------------------------------------------------------------------------
+void test_LS08_deadlines_across_wrap() {
+	nowMs = 0xFFFFFFF0u;
+	run("startthread('late', function() log('late') wait(30) end)"
+	    "startthread('early', function() log('early') wait(5) end)");
+
+	scheduler->runUntil(20);
+
+	TEST_ASSERT_EQUAL_STRING("late@4294967280 early@4294967280 early@4294967286 early@4294967292 early@2 early@8 "
+	                         "early@14 late@15 early@20",
+	                         joined().c_str());
+}
+
+// ---------------------------------------------------------------------------
+// LS-09: recv() suspends the coroutine until a push makes it due, without
+// resuming it in between
+// ---------------------------------------------------------------------------
+void test_LS09_recv_woken_by_push() {
+	run("startthread('rx', function() log('rx ' .. tostring(recv(100))) wait(1000) end)"
+	    "startthread('tx', function() wait(7) push(42) log('tx') wait(1000) end)");
+
+	scheduler->runUntil(20);
+
+	TEST_ASSERT_EQUAL_STRING("tx@7 rx 42@7", joined().c_str());
+	// Started, then woken once
+	TEST_ASSERT_EQUAL_INT(2, scheduler->find(1)->resumes);
+}
+
+// ---------------------------------------------------------------------------
+// LS-10: without a push recv() ends at the timeout, a later push does not
+// wake the coroutine out of an unrelated wait()
+// ---------------------------------------------------------------------------
+void test_LS10_recv_timeout() {
+	run("startthread('rx', function() log('rx ' .. tostring(recv(5))) wait(50) log('rx done') end)"
+	    "startthread('tx', function() wait(10) push(1) wait(1000) end)");
+
+	scheduler->runUntil(55);
+
+	TEST_ASSERT_EQUAL_STRING("rx nil@5 rx done@55", joined().c_str());
+	TEST_ASSERT_EQUAL_INT(3, scheduler->find(1)->resumes);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_LS01_wait_yields_in_deadline_order);
+	RUN_TEST(test_LS02_equal_deadlines_fifo);
+	RUN_TEST(test_LS03_iteration_gap_and_state);
+	RUN_TEST(test_LS04_stop_suspended_coroutine);
+	RUN_TEST(test_LS05_error_removes_coroutine);
+	RUN_TEST(test_LS06_wait_inside_pcall);
+	RUN_TEST(test_LS07_fallback_to_blocking_wait);
+	RUN_TEST(test_LS08_deadlines_across_wrap);
+	RUN_TEST(test_LS09_recv_woken_by_push);
+	RUN_TEST(test_LS10_recv_timeout);
+	return UNITY_END();
+}
@@ -0,0 +1,272 @@
+// ---------------------------------------------------------------------------
+// Unit tests for LuaSource, the lua_load() reader behind syntax check and
+// program start — LS-01..LS-06
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native --filter test_luasource
+//
+// LuaSource, LuaBufferSource and LuaChunkSource are reproduced inline (same
+// pattern as test_lumpparser); lua_load() is the real Lua 5.4 library at
+// lib/lua/, same as test_lua.
+// ---------------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+extern "C" {
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+}
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of luasource.h / luasource.cpp
+// ---------------------------------------------------------------------------
+class LuaSource {
+  public:
+	virtual ~LuaSource() {}
+
+	// Starts over at the first piece; lua_load() and the bytecode cache key
+	// both walk the source
+	virtual void rewind() = 0;
+	// Returns the next non-empty piece, nullptr when the source is exhausted
+	virtual const char* next(size_t& size) = 0;
+	virtual size_t length() = 0;
+
+	// lua_Reader for lua_load(L, LuaSource::reader, &source, ...)
+	static const char* reader(lua_State* L, void* data, size_t* size);
+};
+
+// One contiguous buffer owned by the caller, e.g. a string inside a JsonDocument
+class LuaBufferSource : public LuaSource {
+  public:
+	LuaBufferSource(const char* data, size_t length);
+
+	void rewind() override;
+	const char* next(size_t& size) override;
+	size_t length() override;
+
+  private:
+	const char* data_;
+	size_t length_;
+	bool consumed_;
+};
+
+// Upload chunks in arrival order, each kept in its own allocation
+class LuaChunkSource : public LuaSource {
+  public:
+	LuaChunkSource();
+
+	// Throws std::bad_alloc when the heap is exhausted
+	void append(const char* data, size_t length);
+	// Drops all chunks and frees their memory
+	void clear();
+
+	void rewind() override;
+	const char* next(size_t& size) override;
+	size_t length() override;
+
+  private:
+	std::vector<std::vector<char>> chunks_;
+	size_t length_;
+	size_t position_;
+};
+
+const char* LuaSource::reader(lua_State* L, void* data, size_t* size) {
+	LuaSource* source = (LuaSource*) data;
+	const char* piece = source->next(*size);
+	if (piece == nullptr) {
+		*size = 0;
+	}
+	return piece;
+}
+
+LuaBufferSource::LuaBufferSource(const char* data, size_t length) : data_(data), length_(length), consumed_(false) {}
+
+void LuaBufferSource::rewind() {
+	consumed_ = false;
+}
+
+const char* LuaBufferSource::next(size_t& size) {
+	if (consumed_ || length_ == 0 || data_ == nullptr) {
+		size = 0;
+		return nullptr;
+	}
+	consumed_ = true;
+	size = length_;
+	return data_;
+}
+
+size_t LuaBufferSource::length() {
+	return length_;
+}
+
+LuaChunkSource::LuaChunkSource() : length_(0), position_(0) {}
+
+void LuaChunkSource::append(const char* data, size_t length) {
+	if (length == 0) {
+		return;
+	}
+	chunks_.emplace_back(data, data + length);
+	length_ += length;
+}
+
+void LuaChunkSource::clear() {
+	std::vector<std::vector<char>>().swap(chunks_);
+	length_ = 0;
+	position_ = 0;
+}
+
+void LuaChunkSource::rewind() {
+	position_ = 0;
+}
+
+const char* LuaChunkSource::next(size_t& size) {
+	if (position_ >= chunks_.size()) {
+		size = 0;
+		return nullptr;
+	}
+	const std::vector<char>& chunk = chunks_[position_++];
+	size = chunk.size();
+	return chunk.data();
+}
+
+size_t LuaChunkSource::length() {
+	return length_;
+}
+
+// ---------------------------------------------------------------------------
+// Helpers mirroring Megahub::checkLUACode()
+// ---------------------------------------------------------------------------
+static lua_State* L = nullptr;
+
+static int check(LuaSource& source, std::string* error = nullptr) {
+	source.rewind();
+	int status = lua_load(L, LuaSource::reader, &source, "=program", "t");
+	if (status != LUA_OK && error != nullptr) {
+		*error = lua_tostring(L, -1);
+	}
+	lua_pop(L, 1);
+	return status;
+}
+
+// Splits text into chunks of the given size, as an upload would arrive
+static void fillChunks(LuaChunkSource& source, const char* text, size_t chunkSize) {
+	size_t length = strlen(text);
+	for (size_t pos = 0; pos < length; pos += chunkSize) {
+		source.append(text + pos, length - pos < chunkSize ? length - pos : chunkSize);
+	}
+}
+
+static const char* program = "local function clamp(v, lo, hi)\n"
+                             "  if v < lo then return lo elseif v > hi then return hi end\n"
+                             "  return v\n"
+                             "end\n"
+                             "local speed = clamp(120, -100, 100)\n"
+                             "local text = \"a string literal spanning several chunks\"\n";
+
+void setUp() {
+	L = luaL_newstate();
+}
+
+void tearDown() {
+	lua_close(L);
+	L = nullptr;
+}
+
+// LS-01: A contiguous buffer compiles like luaL_loadstring()
+void test_LS01_buffer_source_compiles() {
+	LuaBufferSource source(program, strlen(program));
+	TEST_ASSERT_EQUAL_INT(LUA_OK, check(source));
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_loadstring(L, program));
+	lua_pop(L, 1);
+}
+
+// LS-02: Chunk boundaries inside tokens, numbers and strings do not matter
+void test_LS02_chunk_boundaries_anywhere() {
+	for (size_t chunkSize = 1; chunkSize <= 17; chunkSize++) {
+		LuaChunkSource source;
+		fillChunks(source, program, chunkSize);
+		TEST_ASSERT_EQUAL_UINT32((uint32_t) strlen(program), (uint32_t) source.length());
+		TEST_ASSERT_EQUAL_INT(LUA_OK, check(source));
+	}
+}
+
+// LS-03: Syntax errors report the same message whatever the chunking
+void test_LS03_error_independent_of_chunking() {
+	const char* broken = "x = 1\n"
+	                     "y = 2\n"
+	                     "local = 3\n";
+	LuaBufferSource whole(broken, strlen(broken));
+	std::string expected;
+	TEST_ASSERT_NOT_EQUAL(LUA_OK, check(whole, &expected));
+	TEST_ASSERT_NOT_NULL(strstr(expected.c_str(), "program:3:"));
+
+	LuaChunkSource chunked;
+	fillChunks(chunked, broken, 4);
+	std::string actual;
+	TEST_ASSERT_NOT_EQUAL(LUA_OK, check(chunked, &actual));
+	TEST_ASSERT_EQUAL_STRING(expected.c_str(), actual.c_str());
+}
+
+// LS-04: Empty appends are ignored, an empty source is an empty program
+void test_LS04_empty_input() {
+	LuaChunkSource source;
+	source.append("", 0);
+	TEST_ASSERT_EQUAL_UINT32(0, (uint32_t) source.length());
+	TEST_ASSERT_EQUAL_INT(LUA_OK, check(source));
+
+	LuaBufferSource missing(nullptr, 0);
+	TEST_ASSERT_EQUAL_INT(LUA_OK, check(missing));
+}
+
+// LS-05: A source can be read again after rewind(), e.g. hashed and then compiled
+void test_LS05_rewind() {
+	LuaChunkSource source;
+	fillChunks(source, program, 8);
+	TEST_ASSERT_EQUAL_INT(LUA_OK, check(source));
+	TEST_ASSERT_EQUAL_INT(LUA_OK, check(source));
+
+	std::string joined;
+	source.rewind();
+	size_t size;
+	for (const char* piece = source.next(size); piece != nullptr; piece = source.next(size)) {
+		joined.append(piece, size);
+	}
+	TEST_ASSERT_EQUAL_STRING(program, joined.c_str());
+}
+
+// LS-06: Precompiled chunks are refused, programs are accepted as text only
+void test_LS06_binary_chunks_refused() {
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_loadstring(L, "x = 1"));
+	std::vector<char> bytecode;
+	lua_dump(
+	    L,
+	    [](lua_State*, const void* p, size_t size, void* ud) {
+		    std::vector<char>* out = (std::vector<char>*) ud;
+		    out->insert(out->end(), (const char*) p, (const char*) p + size);
+		    return 0;
+	    },
+	    &bytecode, 1);
+	lua_pop(L, 1);
+
+	LuaBufferSource source(bytecode.data(), bytecode.size());
+	std::string error;
+	TEST_ASSERT_NOT_EQUAL(LUA_OK, check(source, &error));
+	TEST_ASSERT_NOT_NULL(strstr(error.c_str(), "binary"));
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_LS01_buffer_source_compiles);
+	RUN_TEST(test_LS02_chunk_boundaries_anywhere);
+	RUN_TEST(test_LS03_error_independent_of_chunking);
+	RUN_TEST(test_LS04_empty_input);
+	RUN_TEST(test_LS05_rewind);
+	RUN_TEST(test_LS06_binary_chunks_refused);
+	return UNITY_END();
+}
@@ -54,10 +54,27 @@ void delay(unsigned long) {}
 	} while (0)
 
 // ---------------------------------------------------------------------------
-// i2csync stub (legodevice.cpp includes it)
+// i2csync stub (legodevice.cpp includes it) — transactions run inline
 // ---------------------------------------------------------------------------
-static inline void i2c_lock() {}
-static inline void i2c_unlock() {}
+enum class I2CPriority {
+	ACTUATION = 0,
+	RECEPTION = 1,
+	DIAGNOSTICS = 2
+};
+struct I2CScheduler {
+	static I2CScheduler* instance() {
+		static I2CScheduler scheduler;
+		return &scheduler;
+	}
+	template <typename F>
+	void execute(I2CPriority, F op) {
+		op();
+	}
+	template <typename F>
+	void submit(I2CPriority, uintptr_t, F op) {
+		op();
+	}
+};
 
 // ---------------------------------------------------------------------------
 // Forward declarations needed before including mode.h/format.h on host
@@ -161,6 +178,7 @@ class Mode {
 	float getSiMax() const { return siMax_; }
 	Format* getFormat() const { return format_; }
 
+	void clearTypes() {}
 	void registerInputType(InputOutputType) {}
 	void registerOutputType(InputOutputType) {}
 
@@ -253,6 +271,8 @@ static constexpr uint32_t SYNC_LOSS_RESET_THRESHOLD = 50;
 // MockLegoDevice — records all calls from LumpParser
 // ---------------------------------------------------------------------------
 struct MockLegoDevice {
+	static const int maxModeCombos = 8;
+
 	// Record of calls
 	int setDeviceIdAndNameCalls = 0;
 	int lastDeviceId = -1;
@@ -325,6 +345,17 @@ struct MockLegoDevice {
 	int onDataFrameDispatchedCalls = 0;
 	void onDataFrameDispatched() { onDataFrameDispatchedCalls++; }
 
+	int setModeCombosCalls = 0;
+	uint16_t modeCombos[maxModeCombos] = {0};
+	int numModeCombos = 0;
+	void setModeCombos(const uint16_t* combos, int count) {
+		setModeCombosCalls++;
+		numModeCombos = count;
+		for (int i = 0; i < count; i++) {
+			modeCombos[i] = combos[i];
+		}
+	}
+
 	void clearCalls() {
 		setDeviceIdAndNameCalls = 0;
 		lastDeviceId = -1;
@@ -345,6 +376,8 @@ struct MockLegoDevice {
 		lastDataSize = 0;
 		memset(lastDataPayload, 0, sizeof(lastDataPayload));
 		onDataFrameDispatchedCalls = 0;
+		setModeCombosCalls = 0;
+		numModeCombos = 0;
 		for (int i = 0; i < 16; i++) {
 			modes_[i].reset();
 		}
@@ -729,6 +762,7 @@ class LumpParserT {
 						break;
 					}
 					uint8_t in = payload[1], out = payload[2];
+					m->clearTypes();
 					if (in & 128) {
 						m->registerInputType(Mode::InputOutputType::SUPPORTS_NULL);
 					}
@@ -769,6 +803,19 @@ class LumpParserT {
 					m->setFormat(f);
 					break;
 				}
+				case LP_INFO_MODE_COMBOS: {
+					uint16_t combos[MockLegoDevice::maxModeCombos];
+					int numCombos = 0;
+					for (int i = 1; i + 1 < payloadSize && numCombos < MockLegoDevice::maxModeCombos; i += 2) {
+						uint16_t mask = (uint16_t) (payload[i] | (payload[i + 1] << 8));
+						if (mask == 0) {
+							break;
+						}
+						combos[numCombos++] = mask;
+					}
+					device_->setModeCombos(combos, numCombos);
+					break;
+				}
 				default:
 					break;
 			}
@@ -1951,6 +1998,27 @@ static void test_LP26_enumeration_ext_mode_does_not_bleed_to_data() {
 // ---------------------------------------------------------------------------
 // main()
 // ---------------------------------------------------------------------------
+// LP27: INFO_MODE_COMBOS — uint16 LE bitmasks are handed to the device,
+// the list ends at the first zero mask
+static void test_LP27_info_mode_combos_parsed() {
+	// INFO|SIZE_8|MODE_0, info byte 0x06, masks 0x001E (modes 1-4), 0x000F, 0x0000, pad
+	uint8_t header = 0x98;
+	uint8_t payload[9] = {0x06, 0x1E, 0x00, 0x0F, 0x00, 0x00, 0x00, 0x00, 0x00};
+	uint8_t cs = computeChecksum(header, payload, 9);
+
+	uint8_t frame[11];
+	frame[0] = header;
+	memcpy(&frame[1], payload, 9);
+	frame[10] = cs;
+	parser->feedBytes(frame, 11);
+
+	TEST_ASSERT_EQUAL_UINT32(1, parser->stats().framesOk);
+	TEST_ASSERT_EQUAL_INT(1, dev->setModeCombosCalls);
+	TEST_ASSERT_EQUAL_INT(2, dev->numModeCombos);
+	TEST_ASSERT_EQUAL_UINT32(0x001E, dev->modeCombos[0]);
+	TEST_ASSERT_EQUAL_UINT32(0x000F, dev->modeCombos[1]);
+}
+
 int main() {
 	UNITY_BEGIN();
 
@@ -2011,6 +2079,7 @@ int main() {
 	// EXT_MODE offset consumed after INFO frames
 	RUN_TEST(test_LP25_ext_mode_consumed_after_info_frame);
 	RUN_TEST(test_LP26_enumeration_ext_mode_does_not_bleed_to_data);
+	RUN_TEST(test_LP27_info_mode_combos_parsed);
 
 	return UNITY_END();
 }
@@ -80,45 +80,45 @@ class Format {
 class Dataset {
   public:
 	Dataset() : formatType_(Format::FormatType::UNKNOWN), intValue_(0), floatValue_(0.0f) {}
+	void readData(Format::FormatType type, const uint8_t* payload);
 
-	Format::FormatType getType() { return formatType_; }
-	int getDataAsInt() { return intValue_; }
-	float getDataAsFloat() { return floatValue_; }
-
-	void readData(Format::FormatType type, const uint8_t* payload) {
+	// Store a decoded value; used by the DatasetCodec specializations
+	void setIntValue(Format::FormatType type, int value) {
 		formatType_ = type;
-		switch (type) {
+		intValue_ = value;
+	}
+	void setFloatValue(float value) {
+		formatType_ = Format::FormatType::DATAFLOAT;
+		floatValue_ = value;
+	}
+
+	int getDataAsInt() {
+		switch (formatType_) {
 			case Format::FormatType::DATA8:
-				intValue_ = static_cast<int>(static_cast<int8_t>(payload[0]));
-				floatValue_ = static_cast<float>(intValue_);
-				break;
-			case Format::FormatType::DATA16: {
-				int16_t v = static_cast<int16_t>(payload[0] | (payload[1] << 8));
-				intValue_ = v;
-				floatValue_ = static_cast<float>(v);
-				break;
-			}
-			case Format::FormatType::DATA32: {
-				int32_t v =
-				    static_cast<int32_t>(payload[0] | (payload[1] << 8) | (payload[2] << 16) | (payload[3] << 24));
-				intValue_ = v;
-				floatValue_ = static_cast<float>(v);
-				break;
-			}
-			case Format::FormatType::DATAFLOAT: {
-				union {
-					uint8_t b[4];
-					float f;
-				} u;
-				memcpy(u.b, payload, 4);
-				floatValue_ = u.f;
-				intValue_ = static_cast<int>(u.f);
-				break;
-			}
+			case Format::FormatType::DATA16:
+			case Format::FormatType::DATA32:
+				return intValue_;
+			case Format::FormatType::DATAFLOAT:
+				return (int) floatValue_;
 			default:
-				break;
+				WARN("Unsupported data format");
+				return 0;
 		}
 	}
+	float getDataAsFloat() {
+		switch (formatType_) {
+			case Format::FormatType::DATA8:
+			case Format::FormatType::DATA16:
+			case Format::FormatType::DATA32:
+				return (float) intValue_;
+			case Format::FormatType::DATAFLOAT:
+				return floatValue_;
+			default:
+				WARN("Unsupported data format");
+				return 0.0f;
+		}
+	}
+	Format::FormatType getType() { return formatType_; }
 
   private:
 	Format::FormatType formatType_;
@@ -126,6 +126,110 @@ class Dataset {
 	float floatValue_;
 };
 
+// ---------------------------------------------------------------------------
+// Inline reproduction of the frame decoders
+// (from lib/lpfuart/include/framedecoder.h + src/framedecoder.cpp)
+// ---------------------------------------------------------------------------
+template <Format::FormatType T>
+struct DatasetCodec;
+
+template <>
+struct DatasetCodec<Format::FormatType::DATA8> {
+	static constexpr int size = 1;
+	static void decode(const uint8_t* p, Dataset& ds) { ds.setIntValue(Format::FormatType::DATA8, (int8_t) p[0]); }
+};
+
+template <>
+struct DatasetCodec<Format::FormatType::DATA16> {
+	static constexpr int size = 2;
+	static void decode(const uint8_t* p, Dataset& ds) {
+		int16_t v;
+		memcpy(&v, p, sizeof(v));
+		ds.setIntValue(Format::FormatType::DATA16, v);
+	}
+};
+
+template <>
+struct DatasetCodec<Format::FormatType::DATA32> {
+	static constexpr int size = 4;
+	static void decode(const uint8_t* p, Dataset& ds) {
+		int32_t v;
+		memcpy(&v, p, sizeof(v));
+		ds.setIntValue(Format::FormatType::DATA32, v);
+	}
+};
+
+template <>
+struct DatasetCodec<Format::FormatType::DATAFLOAT> {
+	static constexpr int size = 4;
+	static void decode(const uint8_t* p, Dataset& ds) {
+		float v;
+		memcpy(&v, p, sizeof(v));
+		ds.setFloatValue(v);
+	}
+};
+
+using FrameDecoder = void (*)(const uint8_t* payload, int datasets, Dataset* out);
+
+template <Format::FormatType T>
+void decodeFrame(const uint8_t* payload, int datasets, Dataset* out) {
+	for (int i = 0; i < datasets; i++) {
+		DatasetCodec<T>::decode(payload, out[i]);
+		payload += DatasetCodec<T>::size;
+	}
+}
+
+struct FrameLayout {
+	FrameDecoder decoder;
+	int datasetSize;
+};
+
+static FrameLayout frameLayoutFor(Format::FormatType type) {
+	switch (type) {
+		case Format::FormatType::DATA8:
+			return {decodeFrame<Format::FormatType::DATA8>, 1};
+		case Format::FormatType::DATA16:
+			return {decodeFrame<Format::FormatType::DATA16>, 2};
+		case Format::FormatType::DATA32:
+			return {decodeFrame<Format::FormatType::DATA32>, 4};
+		case Format::FormatType::DATAFLOAT:
+			return {decodeFrame<Format::FormatType::DATAFLOAT>, 4};
+		default:
+			return {nullptr, 0};
+	}
+}
+
+void Dataset::readData(Format::FormatType type, const uint8_t* payload) {
+	formatType_ = type;
+	FrameLayout layout = frameLayoutFor(type);
+	if (layout.decoder == nullptr) {
+		WARN("Unsupported data format");
+		return;
+	}
+	layout.decoder(payload, 1, this);
+}
+
+static void formatPayloadHex(const uint8_t* payload, int payloadSize, char* out, int outSize) {
+	static const char hexChars[] = "0123456789ABCDEF";
+	if (outSize <= 0) {
+		return;
+	}
+	int pos = 0;
+	for (int i = 0; i < payloadSize; ++i) {
+		int needed = (i > 0) ? 3 : 2;
+		if (pos + needed >= outSize) {
+			break;
+		}
+		int v = payload[i] & 0xFF;
+		if (i > 0) {
+			out[pos++] = ' ';
+		}
+		out[pos++] = hexChars[(v >> 4) & 0xF];
+		out[pos++] = hexChars[v & 0xF];
+	}
+	out[pos] = '\0';
+}
+
 // ---------------------------------------------------------------------------
 // Inline reproduction of Mode
 // (from lib/lpfuart/include/mode.h + src/mode.cpp)
@@ -140,7 +244,9 @@ class Mode {
 		SUPPORTS_NULL
 	};
 
-	Mode() : name_(""), units_(""), pctMin_(0.0f), pctMax_(100.0f), siMin_(0.0f), siMax_(1023.0f) {
+	Mode()
+	    : name_(""), units_(""), pctMin_(0.0f), pctMax_(100.0f), siMin_(0.0f), siMax_(1023.0f), decoder_(nullptr),
+	      frameSize_(0) {
 		for (int i = 0; i < 5; i++) {
 			inputTypes_[i] = false;
 			outputTypes_[i] = false;
@@ -151,6 +257,8 @@ class Mode {
 	void reset() {
 		format_.reset();
 		datasets_.clear();
+		decoder_ = nullptr;
+		frameSize_ = 0;
 		pctMin_ = 0.0f;
 		pctMax_ = 100.0f;
 		siMin_ = 0.0f;
@@ -177,6 +285,9 @@ class Mode {
 	void setFormat(std::unique_ptr<Format> format) {
 		format_ = std::move(format);
 		datasets_.assign(format_->getDatasets(), Dataset{});
+		FrameLayout layout = frameLayoutFor(format_->getFormatType());
+		decoder_ = layout.decoder;
+		frameSize_ = format_->getDatasets() * layout.datasetSize;
 	}
 
 	const std::string& getName() { return name_; }
@@ -187,39 +298,21 @@ class Mode {
 	float getSiMax() { return siMax_; }
 	Format* getFormat() { return format_.get(); }
 
-	void processDataPacket(const uint8_t* payload, int payloadSize) {
-		if (format_ == nullptr) {
-			WARN("Not fully initialized yet!");
-			return;
-		}
-		int datasetSize = 0;
-		switch (format_->getFormatType()) {
-			case Format::FormatType::DATA8:
-				datasetSize = 1;
-				break;
-			case Format::FormatType::DATA16:
-				datasetSize = 2;
-				break;
-			case Format::FormatType::DATA32:
-				datasetSize = 4;
-				break;
-			case Format::FormatType::DATAFLOAT:
-				datasetSize = 4;
-				break;
-			default:
-				WARN("Unknown format type: %d", static_cast<int>(format_->getFormatType()));
-				return;
-		}
-		int expectedSize = format_->getDatasets() * datasetSize;
-		if (expectedSize != payloadSize) {
-			WARN("Wrong payload size. Expected %d, got %d", expectedSize, payloadSize);
-			return;
+	bool processDataPacket(const uint8_t* payload, int payloadSize) {
+		if (decoder_ == nullptr) {
+			if (format_ == nullptr) {
+				WARN("Not fully initialized yet!");
+			}
+			return false;
 		}
-		const uint8_t* ptr = payload;
-		for (int i = 0; i < format_->getDatasets(); i++) {
-			datasets_[i].readData(format_->getFormatType(), ptr);
-			ptr += datasetSize;
+		if (payloadSize != frameSize_) {
+			char payloadHex[32 * 3 + 1];
+			formatPayloadHex(payload, payloadSize, payloadHex, sizeof(payloadHex));
+			WARN("Got data %s, wrong payload size. Expected %d, got %d", payloadHex, frameSize_, payloadSize);
+			return false;
 		}
+		decoder_(payload, format_->getDatasets(), datasets_.data());
+		return true;
 	}
 
 	Dataset* getDataset(int index) { return &datasets_[index]; }
@@ -231,6 +324,8 @@ class Mode {
 	bool inputTypes_[5];
 	bool outputTypes_[5];
 	std::vector<Dataset> datasets_;
+	FrameDecoder decoder_;
+	int frameSize_;
 };
 
 // ---------------------------------------------------------------------------
@@ -336,7 +431,7 @@ static void test_MODE09_processDataPacket_wrong_size_no_crash() {
 	Mode m;
 	m.setFormat(std::make_unique<Format>(2, Format::FormatType::DATA8, 3, 0));
 	uint8_t payload[] = {0x01, 0x02, 0x03}; // 3 bytes, but expected 2
-	m.processDataPacket(payload, 3);
+	TEST_ASSERT_FALSE(m.processDataPacket(payload, 3));
 	// Dataset values stay at default (0)
 	TEST_ASSERT_EQUAL_INT(0, m.getDataset(0)->getDataAsInt());
 	TEST_ASSERT_EQUAL_INT(0, m.getDataset(1)->getDataAsInt());
@@ -372,6 +467,32 @@ static void test_MODE11_multiple_reconnect_cycles() {
 	}
 }
 
+// MODE-12: multi-dataset DATA32 frame decoded through the resolved decoder
+static void test_MODE12_processDataPacket_DATA32_multi() {
+	Mode m;
+	m.setFormat(std::make_unique<Format>(2, Format::FormatType::DATA32, 8, 0));
+	uint8_t payload[] = {0x01, 0x00, 0x00, 0x00, 0xFE, 0xFF, 0xFF, 0xFF}; // 1, -2
+	m.processDataPacket(payload, 8);
+	TEST_ASSERT_EQUAL_INT(1, m.getDataset(0)->getDataAsInt());
+	TEST_ASSERT_EQUAL_INT(-2, m.getDataset(1)->getDataAsInt());
+	TEST_ASSERT_EQUAL_INT((int) Format::FormatType::DATA32, (int) m.getDataset(1)->getType());
+}
+
+// MODE-13: hex rendering for diagnostics — separators and truncation
+static void test_MODE13_formatPayloadHex() {
+	uint8_t payload[] = {0x0A, 0xFF, 0x10};
+	char out[16];
+	formatPayloadHex(payload, 3, out, sizeof(out));
+	TEST_ASSERT_EQUAL_STRING("0A FF 10", out);
+
+	char small[6]; // room for "0A FF" only, the third byte is dropped
+	formatPayloadHex(payload, 3, small, sizeof(small));
+	TEST_ASSERT_EQUAL_STRING("0A FF", small);
+
+	formatPayloadHex(payload, 0, out, sizeof(out));
+	TEST_ASSERT_EQUAL_STRING("", out);
+}
+
 int main() {
 	UNITY_BEGIN();
 	RUN_TEST(test_MODE01_default_state);
@@ -385,5 +506,7 @@ int main() {
 	RUN_TEST(test_MODE09_processDataPacket_wrong_size_no_crash);
 	RUN_TEST(test_MODE10_processDataPacket_DATAFLOAT);
 	RUN_TEST(test_MODE11_multiple_reconnect_cycles);
+	RUN_TEST(test_MODE12_processDataPacket_DATA32_multi);
+	RUN_TEST(test_MODE13_formatPayloadHex);
 	return UNITY_END();
 }
@@ -0,0 +1,38 @@
+#ifndef PARSER_BENCH_BASELINE_H
+#define PARSER_BENCH_BASELINE_H
+
+// ---------------------------------------------------------------------------
+// Saved baseline for test_parser_bench. relativeCost is the scenario's cost
+// divided by the calibration loop's cost over the same bytes, so the values
+// carry over between hosts much better than raw nanoseconds.
+//
+// Regenerate after an intended change to the receive path:
+//   PLATFORMIO_BUILD_FLAGS="-D PARSER_BENCH_PRINT_BASELINE" pio test -e native-bench
+// and paste the printed rows below.
+// ---------------------------------------------------------------------------
+
+struct BenchBaseline {
+	const char* name;
+	double relativeCost;
+};
+
+// A scenario is reported when it costs more than baseline * tolerance, and
+// fails above baseline * fail tolerance. The latter is wide enough for host
+// and compiler differences; exceeding it means the receive path got slower.
+static const double parserBenchTolerance = 1.5;
+static const double parserBenchFailTolerance = 2.5;
+
+// x86-64 host, g++ -O2, highest value of four runs
+static const BenchBaseline parserBenchBaselines[] = {
+    {"clean/1",       8.79},
+    {"clean/8",       4.59},
+    {"clean/16",      4.24},
+    {"clean/32",      4.36},
+    {"clean/64",      4.04},
+    {"combi/64",      4.20},
+    {"noisy/64",      4.32},
+    {"overflow/192",  3.22},
+    {"device/frame",  1.20},
+};
+
+#endif // PARSER_BENCH_BASELINE_H
@@ -0,0 +1,804 @@
+// ---------------------------------------------------------------------------
+// Benchmark suite for the LUMP receive path — LumpParser::feedByte() /
+// feedBytes() / processBuffer() and LegoDevice::onDataFrame()
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native-bench
+//
+// Reported per scenario: ns/byte, frames/s and the worst single feed call.
+// Host timings say nothing absolute about the ESP32, so the cost is also
+// given relative to a calibration loop (a serial hash over the same bytes)
+// and compared against test/test_parser_bench/baseline.h. Scenarios above
+// 1.5x their baseline are reported, above 2.5x they fail; the margin absorbs
+// host and compiler differences. Build with -D PARSER_BENCH_PRINT_BASELINE to
+// print a fresh baseline table.
+//
+// A captured byte stream (raw UART bytes, e.g. dumped by a logic analyzer)
+// can be replayed by pointing LUMP_BENCH_CAPTURE at the file.
+//
+// Parser, Mode and the onDataFrame() path are reproduced inline (same
+// pattern as test_lumpparser and test_decode_bench), lumpparser.cpp needs
+// the Arduino side of LegoDevice. The numbers are those of the reproduction;
+// keep it in step with lib/lpfuart when the receive path changes. CMD and INFO frames
+// other than CMD_EXT_MODE are only counted; they occur during the
+// handshake and are not part of the streaming hot path.
+// ---------------------------------------------------------------------------
+
+#include "baseline.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+// Warnings are counted, printing them would dominate the noisy scenarios
+static uint32_t warnCount = 0;
+#define WARN(msg, ...)                                                                                                 \
+	do {                                                                                                               \
+		warnCount++;                                                                                                   \
+	} while (0)
+#define DEBUG(msg, ...)                                                                                                \
+	do {                                                                                                               \
+	} while (0)
+
+typedef std::chrono::steady_clock BenchClock;
+
+static uint64_t elapsedNanos(BenchClock::time_point since) {
+	return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - since).count();
+}
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of Format / Dataset / FrameDecoder / Mode (data path)
+// ---------------------------------------------------------------------------
+enum class FormatType {
+	DATA8 = 0x00,
+	DATA16 = 0x01,
+	DATA32 = 0x02,
+	DATAFLOAT = 0x03,
+	UNKNOWN = 0xff
+};
+
+class Dataset {
+  public:
+	void setIntValue(FormatType type, int value) {
+		formatType_ = type;
+		intValue_ = value;
+	}
+	void setFloatValue(float value) {
+		formatType_ = FormatType::DATAFLOAT;
+		floatValue_ = value;
+	}
+	int getIntValue() const { return intValue_; }
+
+  private:
+	FormatType formatType_ = FormatType::UNKNOWN;
+	int intValue_ = 0;
+	float floatValue_ = 0.0f;
+};
+
+template <FormatType T> struct DatasetCodec;
+
+template <> struct DatasetCodec<FormatType::DATA8> {
+	static constexpr int size = 1;
+	static void decode(const uint8_t* p, Dataset& d) { d.setIntValue(FormatType::DATA8, (int8_t) p[0]); }
+};
+
+template <> struct DatasetCodec<FormatType::DATA16> {
+	static constexpr int size = 2;
+	static void decode(const uint8_t* p, Dataset& d) {
+		d.setIntValue(FormatType::DATA16, (int16_t) (p[0] | (p[1] << 8)));
+	}
+};
+
+template <> struct DatasetCodec<FormatType::DATA32> {
+	static constexpr int size = 4;
+	static void decode(const uint8_t* p, Dataset& d) {
+		d.setIntValue(FormatType::DATA32,
+		              (int32_t) ((uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) |
+		                         ((uint32_t) p[3] << 24)));
+	}
+};
+
+template <> struct DatasetCodec<FormatType::DATAFLOAT> {
+	static constexpr int size = 4;
+	static void decode(const uint8_t* p, Dataset& d) {
+		uint32_t bits = (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+		float f;
+		memcpy(&f, &bits, sizeof(f));
+		d.setFloatValue(f);
+	}
+};
+
+typedef void (*FrameDecoder)(const uint8_t* payload, int datasets, Dataset* out);
+
+template <FormatType T> void decodeFrame(const uint8_t* payload, int datasets, Dataset* out) {
+	for (int i = 0; i < datasets; i++) {
+		DatasetCodec<T>::decode(payload + i * DatasetCodec<T>::size, out[i]);
+	}
+}
+
+class Mode {
+  public:
+	void setFormat(int datasets, FormatType type) {
+		datasets_.assign(datasets, Dataset{});
+		switch (type) {
+			case FormatType::DATA8:
+				decoder_ = decodeFrame<FormatType::DATA8>;
+				datasetSize_ = 1;
+				break;
+			case FormatType::DATA16:
+				decoder_ = decodeFrame<FormatType::DATA16>;
+				datasetSize_ = 2;
+				break;
+			case FormatType::DATA32:
+				decoder_ = decodeFrame<FormatType::DATA32>;
+				datasetSize_ = 4;
+				break;
+			default:
+				decoder_ = decodeFrame<FormatType::DATAFLOAT>;
+				datasetSize_ = 4;
+				break;
+		}
+		frameSize_ = datasets * datasetSize_;
+	}
+
+	bool processDataPacket(const uint8_t* payload, int payloadSize) {
+		if (decoder_ == nullptr) {
+			return false;
+		}
+		if (payloadSize != frameSize_) {
+			WARN("wrong size");
+			return false;
+		}
+		decoder_(payload, (int) datasets_.size(), datasets_.data());
+		return true;
+	}
+
+	// recordSample() with no sample ring enabled, the default
+	void recordSample(uint32_t) {
+		if (sampleRing_ == nullptr) {
+			return;
+		}
+	}
+
+	Dataset* getDataset(int i) { return &datasets_[i]; }
+
+  private:
+	FrameDecoder decoder_ = nullptr;
+	int datasetSize_ = 0;
+	int frameSize_ = 0;
+	std::vector<Dataset> datasets_;
+	void* sampleRing_ = nullptr;
+};
+
+// ---------------------------------------------------------------------------
+// Data path of LegoDevice (mirrors legodevice.cpp onDataFrame)
+// ---------------------------------------------------------------------------
+struct BenchDevice {
+	Mode modes_[16];
+	bool combiActive_ = false;
+	int combiFrameSize_ = 0;
+	uint32_t awaitingAckTicket_ = 0;
+	int awaitingAckMode_ = -1;
+	int deviceId_ = 48;
+	uint32_t dispatched = 0;
+	uint32_t otherFrames = 0;
+
+	bool isHandshakeComplete() { return true; }
+	bool fullyInitialized() { return true; }
+	void markAsHandshakeComplete() {}
+	void onDataFrameDispatched() { dispatched++; }
+
+	Mode* getMode(int index) {
+		if (index < 0 || index >= 16) {
+			return nullptr;
+		}
+		return &modes_[index];
+	}
+
+	bool distributeCombinedFrame(int, const uint8_t*, int, uint32_t) {
+		switch (deviceId_) {
+			case 37:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	void onDataFrame(int mode, const uint8_t* payload, int payloadSize) {
+		if (combiActive_ && payloadSize == combiFrameSize_) {
+			return;
+		}
+		if (awaitingAckTicket_ != 0 && !combiActive_ && mode == awaitingAckMode_) {
+			awaitingAckTicket_ = 0;
+		}
+		uint32_t timestamp = 0;
+		if (distributeCombinedFrame(mode, payload, payloadSize, timestamp)) {
+			return;
+		}
+		Mode* m = getMode(mode);
+		if (m == nullptr) {
+			WARN("onDataFrame: invalid mode %d", mode);
+			return;
+		}
+		if (m->processDataPacket(payload, payloadSize)) {
+			m->recordSample(timestamp);
+		}
+	}
+};
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of LumpParser (mirrors lumpparser.cpp)
+// ---------------------------------------------------------------------------
+struct LumpParserStats {
+	uint32_t framesOk;
+	uint32_t checksumErrors;
+	uint32_t bytesDiscarded;
+	uint32_t syncRecoveries;
+	uint32_t bufferOverflows;
+	uint32_t unknownSysBytes;
+	uint32_t invalidSizeBytes;
+};
+
+static constexpr uint8_t LUMP_MSG_TYPE_SYS = 0x00;
+static constexpr uint8_t LUMP_MSG_TYPE_CMD = 0x40;
+static constexpr uint8_t LUMP_MSG_TYPE_INFO = 0x80;
+static constexpr uint8_t LUMP_MSG_TYPE_DATA = 0xC0;
+static constexpr uint8_t LUMP_CMD_EXT_MODE = 0x6;
+static constexpr uint8_t LUMP_SYS_SYNC = 0x00;
+static constexpr uint8_t LUMP_SYS_NACK = 0x02;
+static constexpr uint8_t LUMP_SYS_ACK = 0x04;
+
+class LumpParser {
+  public:
+	static constexpr int ringBufSize = 128;
+	static constexpr uint32_t syncLossResetThreshold = 300;
+
+	explicit LumpParser(BenchDevice* device)
+	    : head_(0), count_(0), extModeOffset_(0), inSyncLoss_(false), consecutiveErrors_(0), syncLossDiscardStart_(0),
+	      discardCapCount_(0), resets_(0), device_(device) {
+		memset(buf_, 0, sizeof(buf_));
+		memset(&stats_, 0, sizeof(stats_));
+		memset(discardCap_, 0, sizeof(discardCap_));
+	}
+
+	void feedByte(uint8_t byte) {
+		if (count_ >= ringBufSize) {
+			stats_.bufferOverflows++;
+			head_ = (head_ + 1) % ringBufSize;
+			count_--;
+		}
+		uint16_t tail = (head_ + count_) % ringBufSize;
+		buf_[tail] = byte;
+		count_++;
+		processBuffer();
+	}
+
+	void feedBytes(const uint8_t* data, int len) {
+		for (int i = 0; i < len; i++) {
+			if (count_ >= ringBufSize) {
+				stats_.bufferOverflows++;
+				head_ = (head_ + 1) % ringBufSize;
+				count_--;
+			}
+			uint16_t tail = (head_ + count_) % ringBufSize;
+			buf_[tail] = data[i];
+			count_++;
+		}
+		processBuffer();
+	}
+
+	const LumpParserStats& stats() const { return stats_; }
+	uint32_t resets() const { return resets_; }
+
+  private:
+	static int decodePayloadSize(uint8_t header) {
+		uint8_t sizeEnc = (header >> 3) & 0x07;
+		switch (sizeEnc) {
+			case 0:
+				return 1;
+			case 1:
+				return 2;
+			case 2:
+				return 4;
+			case 3:
+				return 8;
+			case 4:
+				return 16;
+			case 5:
+				return 32;
+			default:
+				return -1;
+		}
+	}
+
+	void processBuffer() {
+		while (count_ > 0) {
+			uint8_t header = buf_[head_];
+			uint8_t type = header & 0xC0;
+
+			if (type == LUMP_MSG_TYPE_SYS) {
+				head_ = (head_ + 1) % ringBufSize;
+				count_--;
+				if (header == LUMP_SYS_SYNC || header == LUMP_SYS_NACK || header == LUMP_SYS_ACK) {
+					dispatchSystemByte(header);
+				} else {
+					stats_.unknownSysBytes++;
+				}
+				continue;
+			}
+
+			int payloadSize = decodePayloadSize(header);
+			if (payloadSize < 0) {
+				stats_.invalidSizeBytes++;
+				stats_.bytesDiscarded++;
+				head_ = (head_ + 1) % ringBufSize;
+				count_--;
+				continue;
+			}
+
+			int frameSize = 1 + payloadSize + 1;
+			if (type == LUMP_MSG_TYPE_INFO) {
+				frameSize += 1;
+			}
+			if (count_ < (uint16_t) frameSize) {
+				break;
+			}
+
+			uint8_t expected = 0xFF;
+			for (int i = 0; i < frameSize - 1; i++) {
+				expected ^= buf_[(head_ + i) % ringBufSize];
+			}
+			uint8_t actual = buf_[(head_ + frameSize - 1) % ringBufSize];
+
+			if (expected == actual) {
+				int bytesToExtract = payloadSize;
+				if (type == LUMP_MSG_TYPE_INFO) {
+					bytesToExtract += 1;
+				}
+				uint8_t payload[33];
+				for (int i = 0; i < bytesToExtract; i++) {
+					payload[i] = buf_[(head_ + 1 + i) % ringBufSize];
+				}
+				head_ = (head_ + frameSize) % ringBufSize;
+				count_ -= frameSize;
+
+				if (inSyncLoss_) {
+					stats_.syncRecoveries++;
+					inSyncLoss_ = false;
+					discardCapCount_ = 0;
+				}
+				consecutiveErrors_ = 0;
+				stats_.framesOk++;
+				dispatchFrame(header, payload, bytesToExtract);
+			} else {
+				if (!inSyncLoss_) {
+					inSyncLoss_ = true;
+					syncLossDiscardStart_ = stats_.bytesDiscarded;
+					discardCapCount_ = 0;
+				}
+				consecutiveErrors_++;
+				stats_.checksumErrors++;
+				stats_.bytesDiscarded++;
+				if (discardCapCount_ < discardCapSize) {
+					discardCap_[discardCapCount_++] = buf_[head_];
+				}
+				head_ = (head_ + 1) % ringBufSize;
+				count_--;
+
+				if (consecutiveErrors_ > syncLossResetThreshold) {
+					// device_->reset() in the firmware; the benchmark keeps streaming
+					resets_++;
+					head_ = 0;
+					count_ = 0;
+					extModeOffset_ = 0;
+					inSyncLoss_ = false;
+					consecutiveErrors_ = 0;
+					return;
+				}
+			}
+		}
+	}
+
+	void dispatchSystemByte(uint8_t sysByte) {
+		if (sysByte == LUMP_SYS_ACK) {
+			if (!device_->isHandshakeComplete() && device_->fullyInitialized()) {
+				device_->markAsHandshakeComplete();
+			}
+		}
+	}
+
+	void dispatchFrame(uint8_t header, const uint8_t* payload, int payloadSize) {
+		uint8_t type = header & 0xC0;
+		if (type == LUMP_MSG_TYPE_CMD) {
+			if ((header & 0x07) == LUMP_CMD_EXT_MODE && payloadSize >= 1) {
+				extModeOffset_ = payload[0];
+			} else {
+				device_->otherFrames++;
+			}
+			return;
+		}
+		if (type == LUMP_MSG_TYPE_INFO) {
+			device_->otherFrames++;
+			extModeOffset_ = 0;
+			return;
+		}
+		if (type == LUMP_MSG_TYPE_DATA) {
+			int mode = (header & 0x07) + extModeOffset_;
+			extModeOffset_ = 0;
+			if (mode < 0 || mode >= 16) {
+				WARN("DATA frame with invalid mode index %d, skipping", mode);
+				return;
+			}
+			device_->onDataFrame(mode, payload, payloadSize);
+			if (count_ == 0) {
+				device_->onDataFrameDispatched();
+			}
+		}
+	}
+
+	uint8_t buf_[ringBufSize];
+	uint16_t head_;
+	uint16_t count_;
+	uint8_t extModeOffset_;
+	bool inSyncLoss_;
+	uint32_t consecutiveErrors_;
+	uint32_t syncLossDiscardStart_;
+	static constexpr uint8_t discardCapSize = 64;
+	uint8_t discardCap_[discardCapSize];
+	uint8_t discardCapCount_;
+	uint32_t resets_;
+	LumpParserStats stats_;
+	BenchDevice* device_;
+};
+
+// ---------------------------------------------------------------------------
+// Stream generators
+// ---------------------------------------------------------------------------
+static uint32_t lcgState = 1;
+static uint32_t nextRandom() {
+	lcgState = lcgState * 1664525u + 1013904223u;
+	return lcgState >> 8;
+}
+
+static void appendFrame(std::vector<uint8_t>& out, uint8_t header, const uint8_t* payload, int payloadSize) {
+	uint8_t checksum = 0xFF ^ header;
+	out.push_back(header);
+	for (int i = 0; i < payloadSize; i++) {
+		out.push_back(payload[i]);
+		checksum ^= payload[i];
+	}
+	out.push_back(checksum);
+}
+
+static uint8_t dataHeader(int mode, int payloadSize) {
+	int sizeCode = 0;
+	while ((1 << sizeCode) < payloadSize) {
+		sizeCode++;
+	}
+	return (uint8_t) (LUMP_MSG_TYPE_DATA | (sizeCode << 3) | (mode & 0x07));
+}
+
+// Powered Up motor streaming one mode: CMD_EXT_MODE 0, then a DATA frame.
+// Alternates POS (mode 2, 1 x DATA32) and SPEED (mode 1, 1 x DATA8) frames
+// like a program switching between them.
+static std::vector<uint8_t> motorStream(int frames) {
+	std::vector<uint8_t> out;
+	const uint8_t extMode0[] = {0x00};
+	for (int i = 0; i < frames; i++) {
+		appendFrame(out, LUMP_MSG_TYPE_CMD | LUMP_CMD_EXT_MODE, extMode0, 1);
+		if (i % 4 == 3) {
+			uint8_t speed[] = {(uint8_t) (nextRandom() & 0x7F)};
+			appendFrame(out, dataHeader(1, 1), speed, 1);
+		} else {
+			int32_t pos = (int32_t) (nextRandom() & 0xFFFF) - 0x8000;
+			uint8_t p[4];
+			memcpy(p, &pos, 4);
+			appendFrame(out, dataHeader(2, 4), p, 4);
+		}
+	}
+	return out;
+}
+
+// Combi mode: SPEED (DATA8), POS (DATA32), APOS (DATA16) packed into one
+// 8 byte DATA frame, the biggest frames a motor sends
+static std::vector<uint8_t> combiStream(int frames) {
+	std::vector<uint8_t> out;
+	for (int i = 0; i < frames; i++) {
+		uint8_t p[8];
+		for (int b = 0; b < 8; b++) {
+			p[b] = (uint8_t) nextRandom();
+		}
+		appendFrame(out, dataHeader(0, 8), p, 8);
+	}
+	return out;
+}
+
+// Motor stream with a fraction of bytes corrupted by line noise, which
+// forces the parser into its slide-by-one resynchronisation
+static std::vector<uint8_t> noisyStream(int frames, int corruptPerMille) {
+	std::vector<uint8_t> out = motorStream(frames);
+	for (uint8_t& b : out) {
+		if ((int) (nextRandom() % 1000) < corruptPerMille) {
+			b ^= (uint8_t) (1 + nextRandom() % 255);
+		}
+	}
+	return out;
+}
+
+static std::vector<uint8_t> loadCapture(const char* path) {
+	std::vector<uint8_t> out;
+	FILE* f = fopen(path, "rb");
+	if (f == nullptr) {
+		return out;
+	}
+	uint8_t chunk[256];
+	size_t n;
+	while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+		out.insert(out.end(), chunk, chunk + n);
+	}
+	fclose(f);
+	return out;
+}
+
+// ---------------------------------------------------------------------------
+// Runner
+// ---------------------------------------------------------------------------
+// Each measurement is the fastest of benchRounds rounds of benchRepetitions
+// passes over the stream, which filters out most host scheduling noise
+static const int benchRounds = 5;
+static const int benchRepetitions = 40;
+static volatile uint32_t calibrationSink = 0;
+
+// Serial per-byte work with a loop-carried dependency, so it cannot be
+// vectorised: the yardstick that makes numbers comparable across hosts
+static double calibrationNsPerByte(const std::vector<uint8_t>& stream) {
+	uint64_t best = UINT64_MAX;
+	for (int round = 0; round < benchRounds; round++) {
+		uint32_t h = 0;
+		BenchClock::time_point start = BenchClock::now();
+		for (int r = 0; r < benchRepetitions; r++) {
+			for (uint8_t b : stream) {
+				h = (h * 31u) ^ b;
+			}
+		}
+		uint64_t ns = elapsedNanos(start);
+		calibrationSink = h;
+		if (ns < best) {
+			best = ns;
+		}
+	}
+	return (double) best / ((double) stream.size() * benchRepetitions);
+}
+
+struct BenchResult {
+	double nsPerByte;
+	double framesPerSecond;
+	uint64_t worstCallNs;
+	double relativeCost;
+	LumpParserStats stats;
+	uint32_t resets;
+};
+
+static void setupMotorModes(BenchDevice& device) {
+	device.modes_[0].setFormat(8, FormatType::DATA8);
+	device.modes_[1].setFormat(1, FormatType::DATA8);
+	device.modes_[2].setFormat(1, FormatType::DATA32);
+	device.modes_[3].setFormat(1, FormatType::DATA16);
+}
+
+// Feeds the stream once. chunk == 1 goes byte by byte through feedByte(),
+// anything else through feedBytes() in slices of that size (the SC16IS752
+// FIFO is read in up to 64 byte bursts). With worst != nullptr every call is
+// timed individually, which costs two clock reads per call and is therefore
+// kept out of the throughput pass.
+static void feedStream(LumpParser& parser, const std::vector<uint8_t>& stream, int chunk, uint64_t* worst) {
+	for (size_t pos = 0; pos < stream.size(); pos += chunk) {
+		int len = (int) (stream.size() - pos < (size_t) chunk ? stream.size() - pos : (size_t) chunk);
+		BenchClock::time_point callStart;
+		if (worst != nullptr) {
+			callStart = BenchClock::now();
+		}
+		if (chunk == 1) {
+			parser.feedByte(stream[pos]);
+		} else {
+			parser.feedBytes(&stream[pos], len);
+		}
+		if (worst != nullptr) {
+			uint64_t callNs = elapsedNanos(callStart);
+			if (callNs > *worst) {
+				*worst = callNs;
+			}
+		}
+	}
+}
+
+static BenchResult runParser(const std::vector<uint8_t>& stream, int chunk) {
+	BenchDevice device;
+	setupMotorModes(device);
+	LumpParser parser(&device);
+
+	uint64_t totalNs = UINT64_MAX;
+	for (int round = 0; round < benchRounds; round++) {
+		BenchClock::time_point start = BenchClock::now();
+		for (int r = 0; r < benchRepetitions; r++) {
+			feedStream(parser, stream, chunk, nullptr);
+		}
+		uint64_t ns = elapsedNanos(start);
+		if (ns < totalNs) {
+			totalNs = ns;
+		}
+	}
+
+	BenchResult result;
+	result.nsPerByte = (double) totalNs / ((double) stream.size() * benchRepetitions);
+	double framesPerRound = (double) parser.stats().framesOk / benchRounds;
+	result.framesPerSecond = totalNs > 0 ? framesPerRound * 1e9 / (double) totalNs : 0.0;
+	result.relativeCost = result.nsPerByte / calibrationNsPerByte(stream);
+	result.stats = parser.stats();
+	result.resets = parser.resets();
+
+	// Latency pass on a fresh parser; the worst call includes host scheduling
+	// noise, so it is reported but not compared against the baseline
+	BenchDevice latencyDevice;
+	setupMotorModes(latencyDevice);
+	LumpParser latencyParser(&latencyDevice);
+	result.worstCallNs = 0;
+	feedStream(latencyParser, stream, chunk, &result.worstCallNs);
+	return result;
+}
+
+static const BenchBaseline* findBaseline(const char* name) {
+	for (const BenchBaseline& b : parserBenchBaselines) {
+		if (strcmp(b.name, name) == 0) {
+			return &b;
+		}
+	}
+	return nullptr;
+}
+
+static void report(const char* name, const BenchResult& r) {
+	char line[256];
+	snprintf(line, sizeof(line),
+	         "%-12s %7.2f ns/byte %10.0f frames/s worst call %6llu ns, relative cost %5.2f "
+	         "(ok=%u csErr=%u overflow=%u resets=%u)",
+	         name, r.nsPerByte, r.framesPerSecond, (unsigned long long) r.worstCallNs, r.relativeCost,
+	         r.stats.framesOk, r.stats.checksumErrors, r.stats.bufferOverflows, r.resets);
+	TEST_MESSAGE(line);
+
+#ifdef PARSER_BENCH_PRINT_BASELINE
+	printf("    {%-16s %.2f},\n", (std::string("\"") + name + "\",").c_str(), r.relativeCost);
+#else
+	const BenchBaseline* baseline = findBaseline(name);
+	if (baseline == nullptr) {
+		return;
+	}
+	if (r.relativeCost > baseline->relativeCost * parserBenchTolerance) {
+		snprintf(line, sizeof(line), "%s above baseline: relative cost %.2f, baseline %.2f", name, r.relativeCost,
+		         baseline->relativeCost);
+		if (r.relativeCost > baseline->relativeCost * parserBenchFailTolerance) {
+			TEST_FAIL_MESSAGE(line);
+		}
+		TEST_MESSAGE(line);
+	}
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// Scenarios
+// ---------------------------------------------------------------------------
+
+// PB-01: clean motor stream through feedByte() and feedBytes() at several batch sizes
+void test_PB01_clean_stream_batch_sizes() {
+	lcgState = 1;
+	std::vector<uint8_t> stream = motorStream(2000);
+	const int chunks[] = {1, 8, 16, 32, 64};
+	uint32_t expectedFrames = 2000 * 2;
+	for (int chunk : chunks) {
+		BenchResult r = runParser(stream, chunk);
+		char name[24];
+		snprintf(name, sizeof(name), "clean/%d", chunk);
+		report(name, r);
+		TEST_ASSERT_EQUAL_UINT32(expectedFrames * benchRounds * benchRepetitions, r.stats.framesOk);
+		TEST_ASSERT_EQUAL_UINT32(0, r.stats.checksumErrors);
+	}
+}
+
+// PB-02: combi frames, the largest payloads on the hot path
+void test_PB02_combi_stream() {
+	lcgState = 2;
+	std::vector<uint8_t> stream = combiStream(2000);
+	BenchResult r = runParser(stream, 64);
+	report("combi/64", r);
+	TEST_ASSERT_EQUAL_UINT32(2000u * benchRounds * benchRepetitions, r.stats.framesOk);
+}
+
+// PB-03: noisy stream, resynchronisation dominates
+void test_PB03_noisy_stream() {
+	lcgState = 3;
+	std::vector<uint8_t> stream = noisyStream(2000, 20);
+	BenchResult r = runParser(stream, 64);
+	report("noisy/64", r);
+	TEST_ASSERT_GREATER_THAN_UINT32(0, r.stats.checksumErrors);
+	TEST_ASSERT_GREATER_THAN_UINT32(0, r.stats.syncRecoveries);
+}
+
+// PB-04: bursts larger than the ring buffer, the oldest bytes are dropped
+void test_PB04_ring_overflow() {
+	lcgState = 4;
+	std::vector<uint8_t> stream = motorStream(2000);
+	BenchResult r = runParser(stream, 192);
+	report("overflow/192", r);
+	TEST_ASSERT_GREATER_THAN_UINT32(0, r.stats.bufferOverflows);
+}
+
+// PB-05: LegoDevice::onDataFrame() alone, per DATA frame
+void test_PB05_device_data_path() {
+	BenchDevice device;
+	setupMotorModes(device);
+	const uint8_t pos[] = {0x10, 0x27, 0x00, 0x00};
+	const uint8_t raw[] = {1, 2, 3, 4, 5, 6, 7, 8};
+	const int frames = 50000;
+
+	uint64_t ns = UINT64_MAX;
+	for (int round = 0; round < benchRounds; round++) {
+		BenchClock::time_point start = BenchClock::now();
+		for (int i = 0; i < frames; i++) {
+			device.onDataFrame(2, pos, sizeof(pos));
+			device.onDataFrame(0, raw, sizeof(raw));
+		}
+		uint64_t roundNs = elapsedNanos(start);
+		if (roundNs < ns) {
+			ns = roundNs;
+		}
+	}
+	TEST_ASSERT_EQUAL_INT(10000, device.modes_[2].getDataset(0)->getIntValue());
+
+	// Normalised against the calibration loop over the same number of payload bytes
+	std::vector<uint8_t> payloadBytes((sizeof(pos) + sizeof(raw)) * 1000, 0x5A);
+	double nsPerFrame = (double) ns / (2.0 * frames);
+	double calibration = calibrationNsPerByte(payloadBytes) * (sizeof(pos) + sizeof(raw)) / 2.0;
+
+	BenchResult r;
+	memset(&r, 0, sizeof(r));
+	r.nsPerByte = nsPerFrame / ((sizeof(pos) + sizeof(raw)) / 2.0);
+	r.framesPerSecond = 1e9 / nsPerFrame;
+	r.relativeCost = nsPerFrame / calibration;
+	r.stats.framesOk = 2 * frames;
+	report("device/frame", r);
+}
+
+// PB-06: replay of a captured stream, if one was supplied
+void test_PB06_captured_stream() {
+	const char* path = getenv("LUMP_BENCH_CAPTURE");
+	if (path == nullptr) {
+		TEST_IGNORE_MESSAGE("LUMP_BENCH_CAPTURE not set, no captured stream to replay");
+	}
+	std::vector<uint8_t> stream = loadCapture(path);
+	if (stream.empty()) {
+		TEST_FAIL_MESSAGE("LUMP_BENCH_CAPTURE points to a missing or empty file");
+	}
+	BenchResult r = runParser(stream, 64);
+	report("capture/64", r);
+}
+
+void setUp() {
+	warnCount = 0;
+}
+
+void tearDown() {}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_PB01_clean_stream_batch_sizes);
+	RUN_TEST(test_PB02_combi_stream);
+	RUN_TEST(test_PB03_noisy_stream);
+	RUN_TEST(test_PB04_ring_overflow);
+	RUN_TEST(test_PB05_device_data_path);
+	RUN_TEST(test_PB06_captured_stream);
+	return UNITY_END();
+}
@@ -0,0 +1,303 @@
+// ---------------------------------------------------------------------------
+// Unit tests for periodic Lua threads — PT-01..PT-08
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native --filter test_periodic
+//
+// This file reproduces the release loop of hub_periodic_task(), the release
+// counters of ThreadStatistics and the rate-monotonic priority assignment of
+// Megahub inline. FreeRTOS ticks, xTaskNotifyWait() and vTaskPrioritySet()
+// are replaced by a fake 1 ms tick clock, a fake notification and a priority
+// map.
+// ---------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <unity.h>
+#include <vector>
+
+#define LUA_PERIODIC_PRIORITY_MIN 2
+#define LUA_PERIODIC_PRIORITY_MAX 4
+
+// ---------------------------------------------------------------------------
+// Fake tick clock, 1 tick = 1 ms = 1000 µs
+// ---------------------------------------------------------------------------
+typedef uint32_t TickType_t;
+static TickType_t ticks = 0;
+static unsigned long extraMicros = 0; // offset within the current tick
+
+static TickType_t xTaskGetTickCount() {
+	return ticks;
+}
+
+static unsigned long micros() {
+	return ticks * 1000UL + extraMicros;
+}
+
+// A notification arrives at notifyAt with notifyValue, 0 for never
+static TickType_t notifyAt = 0;
+static uint32_t notifyValue = 0;
+
+static bool xTaskNotifyWait(uint32_t* value, TickType_t timeout) {
+	extraMicros = 0;
+	if (notifyAt != 0 && (int32_t) (notifyAt - ticks) <= (int32_t) timeout) {
+		if ((int32_t) (notifyAt - ticks) > 0) {
+			ticks = notifyAt;
+		}
+		notifyAt = 0;
+		*value = notifyValue;
+		return true;
+	}
+	ticks += timeout;
+	return false;
+}
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of the release counters of ThreadStatistics (mirrors
+// threadstatistics.cpp)
+// ---------------------------------------------------------------------------
+static const float averageAlpha = 0.01f;
+
+struct ReleaseStatistics {
+	unsigned long periodMicros = 0;
+	unsigned long releases = 0;
+	unsigned long missedDeadlines = 0;
+	unsigned long maxJitter = 0;
+	float avgJitter = 0.0f;
+
+	void recordRelease(unsigned long startMicros, unsigned long previousStartMicros, unsigned long periods) {
+		releases++;
+		if (releases == 1) {
+			return;
+		}
+		long deviation = (long) (startMicros - previousStartMicros - periods * periodMicros);
+		unsigned long jitter = deviation < 0 ? -deviation : deviation;
+		if (jitter > maxJitter) {
+			maxJitter = jitter;
+		}
+		if (releases == 2) {
+			avgJitter = (float) jitter;
+		} else {
+			avgJitter = averageAlpha * (float) jitter + (1.0f - averageAlpha) * avgJitter;
+		}
+	}
+
+	void recordMissedDeadlines(unsigned long count) { missedDeadlines += count; }
+};
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of the hub_periodic_task() loop. body(n) returns the
+// execution time of iteration n in µs. Ends early on a stop.
+// ---------------------------------------------------------------------------
+template <typename Body> static std::vector<unsigned long> runPeriodic(ReleaseStatistics& stats, TickType_t period,
+                                                                       int iterations, Body body) {
+	std::vector<unsigned long> starts;
+	stats.periodMicros = period * 1000;
+	TickType_t lastWake = xTaskGetTickCount();
+	unsigned long previousStart = 0;
+	unsigned long periodsSincePrevious = 1;
+
+	for (int i = 0; i < iterations; i++) {
+		unsigned long start = micros();
+		stats.recordRelease(start, previousStart, periodsSincePrevious);
+		previousStart = start;
+		periodsSincePrevious = 1;
+		starts.push_back(start);
+
+		unsigned long end = start + body(i);
+		ticks = end / 1000;
+		extraMicros = end % 1000;
+
+		TickType_t elapsed = xTaskGetTickCount() - lastWake;
+		if (elapsed >= period) {
+			TickType_t missed = elapsed / period;
+			stats.recordMissedDeadlines(missed);
+			lastWake += missed * period;
+			periodsSincePrevious += missed;
+		}
+		lastWake += period;
+
+		bool stopped = false;
+		while (!stopped) {
+			TickType_t remaining = lastWake - xTaskGetTickCount();
+			if ((int32_t) remaining <= 0) {
+				break;
+			}
+			uint32_t value = 0;
+			stopped = xTaskNotifyWait(&value, remaining) && value == 1;
+		}
+		if (stopped) {
+			break;
+		}
+	}
+	return starts;
+}
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of Megahub::assignPeriodicPriorities()
+// ---------------------------------------------------------------------------
+struct PeriodicThread {
+	int handle;
+	unsigned long periodMs;
+};
+
+static std::map<int, unsigned> priorities;
+
+static void assignPeriodicPriorities(const std::vector<PeriodicThread>& periodicThreads) {
+	std::vector<PeriodicThread> byPeriod = periodicThreads;
+	std::sort(byPeriod.begin(), byPeriod.end(),
+	          [](const PeriodicThread& a, const PeriodicThread& b) { return a.periodMs < b.periodMs; });
+
+	unsigned priority = LUA_PERIODIC_PRIORITY_MAX;
+	for (size_t i = 0; i < byPeriod.size(); i++) {
+		if (i > 0 && byPeriod[i].periodMs != byPeriod[i - 1].periodMs && priority > LUA_PERIODIC_PRIORITY_MIN) {
+			priority--;
+		}
+		priorities[byPeriod[i].handle] = priority;
+	}
+}
+
+void setUp() {
+	ticks = 1000;
+	extraMicros = 0;
+	notifyAt = 0;
+	priorities.clear();
+}
+
+void tearDown() {}
+
+// ---------------------------------------------------------------------------
+// PT-01: releases are period apart regardless of the execution time
+// ---------------------------------------------------------------------------
+void test_PT01_fixed_rate_independent_of_body() {
+	ReleaseStatistics stats;
+	std::vector<unsigned long> starts =
+	    runPeriodic(stats, 10, 20, [](int i) { return (unsigned long) (500 + (i % 4) * 2000); });
+
+	for (size_t i = 1; i < starts.size(); i++) {
+		TEST_ASSERT_EQUAL_UINT32(10000, starts[i] - starts[i - 1]);
+	}
+	TEST_ASSERT_EQUAL_UINT32(20, stats.releases);
+	TEST_ASSERT_EQUAL_UINT32(0, stats.missedDeadlines);
+	TEST_ASSERT_EQUAL_UINT32(0, stats.maxJitter);
+}
+
+// ---------------------------------------------------------------------------
+// PT-02: an overrun counts the releases it ran past and skips them, the
+// following releases stay on the original grid
+// ---------------------------------------------------------------------------
+void test_PT02_overrun_skips_missed_releases() {
+	ReleaseStatistics stats;
+	std::vector<unsigned long> starts =
+	    runPeriodic(stats, 10, 6, [](int i) { return (unsigned long) (i == 2 ? 25500 : 1000); });
+
+	TEST_ASSERT_EQUAL_UINT32(2, stats.missedDeadlines);
+	unsigned long origin = starts[0];
+	TEST_ASSERT_EQUAL_UINT32(20000, starts[2] - origin);
+	TEST_ASSERT_EQUAL_UINT32(50000, starts[3] - origin);
+	TEST_ASSERT_EQUAL_UINT32(60000, starts[4] - origin);
+	// The skipped releases are missed deadlines, not jitter
+	TEST_ASSERT_EQUAL_UINT32(0, stats.maxJitter);
+}
+
+// ---------------------------------------------------------------------------
+// PT-03: finishing exactly at the next release is a missed deadline
+// ---------------------------------------------------------------------------
+void test_PT03_deadline_is_next_release() {
+	ReleaseStatistics stats;
+	runPeriodic(stats, 5, 2, [](int i) { return (unsigned long) (i == 0 ? 4999 : 5000); });
+	TEST_ASSERT_EQUAL_UINT32(1, stats.missedDeadlines);
+}
+
+// ---------------------------------------------------------------------------
+// PT-04: jitter is the deviation of the observed period, late or early
+// ---------------------------------------------------------------------------
+void test_PT04_jitter_both_directions() {
+	ReleaseStatistics stats;
+	stats.periodMicros = 10000;
+	stats.recordRelease(100000, 0, 1);
+	stats.recordRelease(110300, 100000, 1);
+	stats.recordRelease(119900, 110300, 1);
+
+	TEST_ASSERT_EQUAL_UINT32(3, stats.releases);
+	TEST_ASSERT_EQUAL_UINT32(400, stats.maxJitter);
+	TEST_ASSERT_FLOAT_WITHIN(0.01f, 301.0f, stats.avgJitter);
+}
+
+// ---------------------------------------------------------------------------
+// PT-05: rate-monotonic priorities, shortest period highest, equal periods
+// share a level
+// ---------------------------------------------------------------------------
+void test_PT05_rate_monotonic_priorities() {
+	assignPeriodicPriorities({{1, 50}, {2, 10}, {3, 20}, {4, 10}});
+
+	TEST_ASSERT_EQUAL_UINT32(4, priorities[2]);
+	TEST_ASSERT_EQUAL_UINT32(4, priorities[4]);
+	TEST_ASSERT_EQUAL_UINT32(3, priorities[3]);
+	TEST_ASSERT_EQUAL_UINT32(2, priorities[1]);
+}
+
+// ---------------------------------------------------------------------------
+// PT-06: more distinct periods than levels share the lowest one, and a
+// removed thread lets the others move up
+// ---------------------------------------------------------------------------
+void test_PT06_priority_band_clamped() {
+	std::vector<PeriodicThread> threads = {{1, 5}, {2, 10}, {3, 20}, {4, 40}, {5, 100}};
+	assignPeriodicPriorities(threads);
+
+	TEST_ASSERT_EQUAL_UINT32(4, priorities[1]);
+	TEST_ASSERT_EQUAL_UINT32(3, priorities[2]);
+	TEST_ASSERT_EQUAL_UINT32(2, priorities[3]);
+	TEST_ASSERT_EQUAL_UINT32(2, priorities[4]);
+	TEST_ASSERT_EQUAL_UINT32(2, priorities[5]);
+
+	threads.erase(threads.begin());
+	assignPeriodicPriorities(threads);
+	TEST_ASSERT_EQUAL_UINT32(4, priorities[2]);
+	TEST_ASSERT_EQUAL_UINT32(3, priorities[3]);
+}
+
+// ---------------------------------------------------------------------------
+// PT-07: a stop ends the wait for the next release at once, even with a
+// period longer than the stop timeout of Megahub
+// ---------------------------------------------------------------------------
+void test_PT07_stop_ends_wait() {
+	ReleaseStatistics stats;
+	notifyAt = ticks + 1500;
+	notifyValue = 1;
+	TickType_t begin = ticks;
+	std::vector<unsigned long> starts = runPeriodic(stats, 5000, 10, [](int i) { return (unsigned long) 1000; });
+
+	TEST_ASSERT_EQUAL_UINT32(1, starts.size());
+	TEST_ASSERT_EQUAL_UINT32(1500, ticks - begin);
+}
+
+// ---------------------------------------------------------------------------
+// PT-08: a channel wake ends the wait early, the release stays on time
+// ---------------------------------------------------------------------------
+void test_PT08_other_notification_keeps_waiting() {
+	ReleaseStatistics stats;
+	notifyAt = ticks + 3;
+	notifyValue = 2;
+	std::vector<unsigned long> starts = runPeriodic(stats, 10, 3, [](int i) { return (unsigned long) 1000; });
+
+	TEST_ASSERT_EQUAL_UINT32(3, starts.size());
+	TEST_ASSERT_EQUAL_UINT32(10000, starts[1] - starts[0]);
+	TEST_ASSERT_EQUAL_UINT32(10000, starts[2] - starts[1]);
+	TEST_ASSERT_EQUAL_UINT32(0, stats.maxJitter);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_PT01_fixed_rate_independent_of_body);
+	RUN_TEST(test_PT02_overrun_skips_missed_releases);
+	RUN_TEST(test_PT03_deadline_is_next_release);
+	RUN_TEST(test_PT04_jitter_both_directions);
+	RUN_TEST(test_PT05_rate_monotonic_priorities);
+	RUN_TEST(test_PT06_priority_band_clamped);
+	RUN_TEST(test_PT07_stop_ends_wait);
+	RUN_TEST(test_PT08_other_notification_keeps_waiting);
+	return UNITY_END();
+}
@@ -0,0 +1,182 @@
+// ---------------------------------------------------------------------------
+// Unit tests for the per-program Lua state — PS-01..PS-04
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native --filter test_programstate
+//
+// Runs programs on the real Lua 5.4 library at lib/lua/ the way
+// Megahub::executeLUACode() does: formerly as a thread of one shared state,
+// now each on a fresh state that is closed when the next one starts. The
+// accounting of LuaHeap (live bytes and blocks, objects created per type) is
+// reproduced inline around malloc (mirrors luaheap.cpp).
+// ---------------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unity.h>
+
+extern "C" {
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+}
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of the LuaHeap accounting
+// ---------------------------------------------------------------------------
+struct Accounting {
+	size_t liveBytes;
+	size_t peakBytes;
+	uint32_t liveBlocks;
+	uint32_t objects[LUA_NUMTYPES];
+};
+
+static void countBlock(Accounting* accounting, int tag) {
+	accounting->liveBlocks++;
+	int type = tag & 0x0F;
+	if (tag > 0 && type < LUA_NUMTYPES) {
+		accounting->objects[type]++;
+	}
+}
+
+static void* countingAlloc(void* ud, void* ptr, size_t osize, size_t nsize) {
+	Accounting* accounting = (Accounting*) ud;
+	if (nsize == 0) {
+		if (ptr != nullptr) {
+			accounting->liveBytes -= osize;
+			accounting->liveBlocks--;
+		}
+		free(ptr);
+		return nullptr;
+	}
+	void* block = realloc(ptr, nsize);
+	if (block == nullptr) {
+		return nullptr;
+	}
+	if (ptr == nullptr) {
+		countBlock(accounting, (int) osize);
+		accounting->liveBytes += nsize;
+	} else {
+		accounting->liveBytes = accounting->liveBytes - osize + nsize;
+	}
+	if (accounting->liveBytes > accounting->peakBytes) {
+		accounting->peakBytes = accounting->liveBytes;
+	}
+	return block;
+}
+
+static lua_State* newState(Accounting& accounting) {
+	memset(&accounting, 0, sizeof(accounting));
+	lua_State* L = lua_newstate(countingAlloc, &accounting);
+	luaL_openlibs(L);
+	return L;
+}
+
+// Leaves what an edited program typically leaves behind: globals under new
+// names, registry references of threads that were never stopped, tables
+// hanging off a library
+static void runProgram(lua_State* program, int run) {
+	char source[512];
+	snprintf(source, sizeof(source),
+	         "state%d = {}\n"
+	         "for i = 1, 200 do state%d[i] = 'value ' .. i .. ' of run %d' end\n"
+	         "string.cache%d = {1, 2, 3}\n"
+	         "return function() return state%d end\n",
+	         run, run, run, run, run);
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_loadstring(program, source));
+	TEST_ASSERT_EQUAL_INT(LUA_OK, lua_pcall(program, 0, 1, 0));
+	luaL_ref(program, LUA_REGISTRYINDEX);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+// ---------------------------------------------------------------------------
+// PS-01: programs run as threads of one shared state leave their memory behind
+// ---------------------------------------------------------------------------
+void test_PS01_shared_state_grows() {
+	Accounting accounting;
+	lua_State* L = newState(accounting);
+	lua_gc(L, LUA_GCCOLLECT);
+	size_t baseBytes = accounting.liveBytes;
+
+	for (int run = 0; run < 20; run++) {
+		lua_State* program = lua_newthread(L);
+		runProgram(program, run);
+		lua_closethread(program, L);
+		lua_pop(L, 1);
+	}
+	lua_gc(L, LUA_GCCOLLECT);
+	size_t afterBytes = accounting.liveBytes;
+	lua_close(L);
+
+	// About 10 KB per run on the host
+	TEST_ASSERT_TRUE(afterBytes > baseBytes + 20 * 4096);
+}
+
+// ---------------------------------------------------------------------------
+// PS-02: a fresh state per program returns all memory and starts at the same base
+// ---------------------------------------------------------------------------
+void test_PS02_fresh_state_reclaims_everything() {
+	Accounting accounting;
+	size_t firstBase = 0;
+	for (int run = 0; run < 20; run++) {
+		lua_State* L = newState(accounting);
+		if (run == 0) {
+			firstBase = accounting.liveBytes;
+		}
+		TEST_ASSERT_EQUAL_UINT32(firstBase, accounting.liveBytes);
+		runProgram(L, run);
+		TEST_ASSERT_TRUE(accounting.peakBytes > firstBase);
+		lua_close(L);
+
+		TEST_ASSERT_EQUAL_UINT32(0, accounting.liveBytes);
+		TEST_ASSERT_EQUAL_UINT32(0, accounting.liveBlocks);
+	}
+}
+
+// ---------------------------------------------------------------------------
+// PS-03: objects are counted by the type Lua passes for new objects
+// ---------------------------------------------------------------------------
+void test_PS03_objects_per_type() {
+	Accounting accounting;
+	lua_State* L = newState(accounting);
+	uint32_t tables = accounting.objects[LUA_TTABLE];
+	uint32_t functions = accounting.objects[LUA_TFUNCTION];
+	uint32_t threads = accounting.objects[LUA_TTHREAD];
+
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, "local t = {}\n"
+	                                               "for i = 1, 100 do t[i] = {} end\n"
+	                                               "local f = function() return t end\n"
+	                                               "coroutine.create(f)\n"));
+
+	TEST_ASSERT_TRUE(accounting.objects[LUA_TTABLE] - tables >= 101);
+	TEST_ASSERT_TRUE(accounting.objects[LUA_TFUNCTION] - functions >= 2);
+	TEST_ASSERT_EQUAL_UINT32(1, accounting.objects[LUA_TTHREAD] - threads);
+	TEST_ASSERT_TRUE(accounting.objects[LUA_TSTRING] > 0);
+	lua_close(L);
+}
+
+// ---------------------------------------------------------------------------
+// PS-04: the syntax check parses in a bare state without libraries
+// ---------------------------------------------------------------------------
+void test_PS04_syntax_check_in_bare_state() {
+	lua_State* L = luaL_newstate();
+	TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_loadstring(L, "hub.startthread('t', 'b', 4096, false, function() end)"));
+	lua_pop(L, 1);
+	TEST_ASSERT_EQUAL_INT(LUA_ERRSYNTAX, luaL_loadstring(L, "for i = 1 do"));
+	TEST_ASSERT_NOT_NULL(strstr(lua_tostring(L, -1), "expected near 'do'"));
+	lua_close(L);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_PS01_shared_state_grows);
+	RUN_TEST(test_PS02_fresh_state_reclaims_everything);
+	RUN_TEST(test_PS03_objects_per_type);
+	RUN_TEST(test_PS04_syntax_check_in_bare_state);
+	return UNITY_END();
+}
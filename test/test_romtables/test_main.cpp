@@ -0,0 +1,583 @@
+// ---------------------------------------------------------------------------
+// Unit tests for the flash-resident library tables — RT-01..RT-07
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native --filter test_romtables
+//
+// Compares the two ways Megahub::openLuaState() sets up the firmware
+// libraries and constants on the real Lua 5.4 library at lib/lua/: formerly
+// every library table and constant was created in each new state, now
+// LuaRom installs an __index hook on the global table that resolves them
+// from sorted const arrays on first use and keeps the result (mirrors
+// luarom.cpp).
+// Libraries and constants carry the firmware's names, the functions are
+// stubs. Memory is counted by a malloc wrapper like the LuaHeap accounting.
+// ---------------------------------------------------------------------------
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unity.h>
+
+extern "C" {
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+}
+
+typedef std::chrono::steady_clock TestClock;
+
+static size_t liveBytes = 0;
+
+static void* countingAlloc(void* ud, void* ptr, size_t osize, size_t nsize) {
+	if (nsize == 0) {
+		if (ptr != nullptr) {
+			liveBytes -= osize;
+		}
+		free(ptr);
+		return nullptr;
+	}
+	void* block = realloc(ptr, nsize);
+	if (block == nullptr) {
+		return nullptr;
+	}
+	liveBytes = liveBytes - (ptr != nullptr ? osize : 0) + nsize;
+	return block;
+}
+
+// Returns the number of arguments, enough to see which value was called
+static int stub(lua_State* L) {
+	lua_pushinteger(L, lua_gettop(L));
+	return 1;
+}
+
+struct RomLibrary {
+	const char* name;
+	const luaL_Reg* functions;
+};
+
+struct RomConstant {
+	const char* name;
+	lua_Integer value;
+};
+
+static const luaL_Reg hubFunctions[] = {
+    {  "startthread",    stub},
+    {"startperiodic",    stub},
+    {"startisolated",    stub},
+    {   "stopthread",    stub},
+    {      "channel",    stub},
+    {         "push",    stub},
+    {          "pop",    stub},
+    {         "recv",    stub},
+    {         "init",    stub},
+    {"setmotorspeed",    stub},
+    {      "pinMode",    stub},
+    {  "digitalRead",    stub},
+    { "digitalWrite",    stub},
+    {       "gcmode",    stub},
+    {       "gcpace",    stub},
+    {        nullptr, nullptr}
+};
+
+static const luaL_Reg fastledFunctions[] = {
+    {   "show",    stub},
+    {  "clear",    stub},
+    {"addleds",    stub},
+    {    "set",    stub},
+    {  nullptr, nullptr}
+};
+
+static const luaL_Reg imuFunctions[] = {
+    {   "value",    stub},
+    {"accessor",    stub},
+    {   nullptr, nullptr}
+};
+
+static const luaL_Reg uiFunctions[] = {
+    {"showvalue",    stub},
+    { "mappoint",    stub},
+    { "mapclear",    stub},
+    {    nullptr, nullptr}
+};
+
+static const luaL_Reg debugFunctions[] = {
+    {"freeHeap",    stub},
+    { "luaHeap",    stub},
+    {   nullptr, nullptr}
+};
+
+static const luaL_Reg legoFunctions[] = {
+    { "getdevicemode",    stub},
+    {"getmodedataset",    stub},
+    {      "accessor",    stub},
+    {    "selectmode",    stub},
+    {   "selectcombi",    stub},
+    { "recordsamples",    stub},
+    {   "readsamples",    stub},
+    {         nullptr, nullptr}
+};
+
+static const luaL_Reg gamepadFunctions[] = {
+    {        "value",    stub},
+    {    "connected",    stub},
+    {"buttonpressed",    stub},
+    {   "buttonsraw",    stub},
+    {     "accessor",    stub},
+    {        nullptr, nullptr}
+};
+
+static const luaL_Reg algFunctions[] = {
+    {           "initPID",    stub},
+    {        "computePID",    stub},
+    {          "resetPID",    stub},
+    {       "clearAllPID",    stub},
+    {            "initDR",    stub},
+    {          "updateDR",    stub},
+    {             "drGet",    stub},
+    {           "drReset",    stub},
+    {         "drSetPose",    stub},
+    {        "clearAllDR",    stub},
+    {     "initMovingAvg",    stub},
+    {         "movingAvg",    stub},
+    { "clearAllMovingAvg",    stub},
+    {               "map",    stub},
+    {    "initHysteresis",    stub},
+    {        "hysteresis",    stub},
+    {"clearAllHysteresis",    stub},
+    {      "initDebounce",    stub},
+    {          "debounce",    stub},
+    {  "clearAllDebounce",    stub},
+    {     "initRateLimit",    stub},
+    {         "rateLimit",    stub},
+    { "clearAllRateLimit",    stub},
+    {        "initKalman",    stub},
+    {            "kalman",    stub},
+    {    "clearAllKalman",    stub},
+    {             nullptr, nullptr}
+};
+
+// Sorted by name like in openLuaState()
+static const RomLibrary libraries[] = {
+    {    "alg",     algFunctions},
+    {    "deb",   debugFunctions},
+    {"fastled", fastledFunctions},
+    {"gamepad", gamepadFunctions},
+    {    "hub",     hubFunctions},
+    {    "imu",     imuFunctions},
+    {   "lego",    legoFunctions},
+    {     "ui",      uiFunctions},
+    {  nullptr,          nullptr}
+};
+
+static const RomConstant constants[] = {
+    {        "ACCELERATION_X", 32},
+    {        "ACCELERATION_Y", 33},
+    {        "ACCELERATION_Z", 34},
+    {         "FORMAT_SIMPLE", 36},
+    {              "GAMEPAD1", 37},
+    {      "GAMEPAD_BUTTON_1", 38},
+    {     "GAMEPAD_BUTTON_10", 47},
+    {     "GAMEPAD_BUTTON_11", 48},
+    {     "GAMEPAD_BUTTON_12", 49},
+    {     "GAMEPAD_BUTTON_13", 50},
+    {     "GAMEPAD_BUTTON_14", 51},
+    {     "GAMEPAD_BUTTON_15", 52},
+    {     "GAMEPAD_BUTTON_16", 53},
+    {      "GAMEPAD_BUTTON_2", 39},
+    {      "GAMEPAD_BUTTON_3", 40},
+    {      "GAMEPAD_BUTTON_4", 41},
+    {      "GAMEPAD_BUTTON_5", 42},
+    {      "GAMEPAD_BUTTON_6", 43},
+    {      "GAMEPAD_BUTTON_7", 44},
+    {      "GAMEPAD_BUTTON_8", 45},
+    {      "GAMEPAD_BUTTON_9", 46},
+    {          "GAMEPAD_DPAD", 58},
+    {        "GAMEPAD_LEFT_X", 54},
+    {        "GAMEPAD_LEFT_Y", 55},
+    {       "GAMEPAD_RIGHT_X", 56},
+    {       "GAMEPAD_RIGHT_Y", 57},
+    {                "GPIO13",  5},
+    {                "GPIO16",  6},
+    {                "GPIO17",  7},
+    {                "GPIO25",  8},
+    {                "GPIO26",  9},
+    {                "GPIO27", 10},
+    {                "GPIO32", 11},
+    {                "GPIO33", 12},
+    {                "GPIO34", 13},
+    {                "GPIO35", 14},
+    {                "GPIO36", 15},
+    {                "GPIO39", 16},
+    {              "NEOPIXEL", 35},
+    {         "PINMODE_INPUT", 25},
+    {"PINMODE_INPUT_PULLDOWN", 27},
+    {  "PINMODE_INPUT_PULLUP", 26},
+    {        "PINMODE_OUTPUT", 28},
+    {                 "PITCH", 30},
+    {                 "PORT1",  1},
+    {                 "PORT2",  2},
+    {                 "PORT3",  3},
+    {                 "PORT4",  4},
+    {                  "ROLL", 31},
+    {             "UART1_GP4", 17},
+    {             "UART1_GP5", 18},
+    {             "UART1_GP6", 19},
+    {             "UART1_GP7", 20},
+    {             "UART2_GP4", 21},
+    {             "UART2_GP5", 22},
+    {             "UART2_GP6", 23},
+    {             "UART2_GP7", 24},
+    {                   "YAW", 29},
+    {                 nullptr,  0}
+};
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of LuaRom
+// ---------------------------------------------------------------------------
+static int romLibraryIndex(lua_State* L) {
+	if (lua_type(L, 2) != LUA_TSTRING) {
+		return 0;
+	}
+	const char* key = lua_tostring(L, 2);
+	const luaL_Reg* functions = (const luaL_Reg*) lua_touserdata(L, lua_upvalueindex(1));
+	for (const luaL_Reg* function = functions; function->name != nullptr; function++) {
+		if (strcmp(function->name, key) == 0) {
+			lua_pushcfunction(L, function->func);
+			lua_pushvalue(L, 2);
+			lua_pushvalue(L, -2);
+			lua_rawset(L, 1);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void romPushLibrary(lua_State* L, const char* name, const luaL_Reg* functions) {
+	lua_createtable(L, 0, 0);
+	lua_createtable(L, 0, 1);
+	lua_pushlightuserdata(L, (void*) functions);
+	lua_pushcclosure(L, romLibraryIndex, 1);
+	lua_setfield(L, -2, "__index");
+	lua_setmetatable(L, -2);
+
+	luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+	lua_pushvalue(L, -2);
+	lua_setfield(L, -2, name);
+	lua_pop(L, 1);
+}
+
+static int romCompares = 0;
+
+template <typename Entry> static int romCountSorted(const Entry* entries) {
+	int count = 0;
+	for (; entries[count].name != nullptr; count++) {
+		if (count > 0 && strcmp(entries[count - 1].name, entries[count].name) >= 0) {
+			return -1;
+		}
+	}
+	return count;
+}
+
+template <typename Entry> static int romFindSorted(const Entry* entries, int count, const char* name) {
+	int low = 0;
+	int high = count - 1;
+	while (low <= high) {
+		int middle = (low + high) / 2;
+		romCompares++;
+		int order = strcmp(entries[middle].name, name);
+		if (order == 0) {
+			return middle;
+		}
+		if (order < 0) {
+			low = middle + 1;
+		} else {
+			high = middle - 1;
+		}
+	}
+	return -1;
+}
+
+static int romGlobalIndex(lua_State* L) {
+	if (lua_type(L, 2) != LUA_TSTRING) {
+		return 0;
+	}
+	const char* key = lua_tostring(L, 2);
+
+	const RomLibrary* libraries = (const RomLibrary*) lua_touserdata(L, lua_upvalueindex(1));
+	int library = romFindSorted(libraries, (int) lua_tointeger(L, lua_upvalueindex(2)), key);
+	if (library >= 0) {
+		romPushLibrary(L, libraries[library].name, libraries[library].functions);
+	} else {
+		const RomConstant* constants = (const RomConstant*) lua_touserdata(L, lua_upvalueindex(3));
+		int constant = romFindSorted(constants, (int) lua_tointeger(L, lua_upvalueindex(4)), key);
+		if (constant < 0) {
+			return 0;
+		}
+		lua_pushinteger(L, constants[constant].value);
+	}
+
+	lua_pushvalue(L, 2);
+	lua_pushvalue(L, -2);
+	lua_rawset(L, 1);
+	return 1;
+}
+
+static int romRequireLibrary(lua_State* L) {
+	lua_getglobal(L, luaL_checkstring(L, 1));
+	return 1;
+}
+
+static void romInstall(lua_State* L) {
+	int libraryCount = romCountSorted(libraries);
+	int constantCount = romCountSorted(constants);
+	TEST_ASSERT_TRUE(libraryCount > 0 && constantCount > 0);
+
+	lua_pushglobaltable(L);
+	lua_createtable(L, 0, 1);
+	lua_pushlightuserdata(L, (void*) libraries);
+	lua_pushinteger(L, libraryCount);
+	lua_pushlightuserdata(L, (void*) constants);
+	lua_pushinteger(L, constantCount);
+	lua_pushcclosure(L, romGlobalIndex, 4);
+	lua_setfield(L, -2, "__index");
+	lua_setmetatable(L, -2);
+	lua_pop(L, 1);
+
+	luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+	for (int i = 0; i < libraryCount; i++) {
+		lua_pushcfunction(L, romRequireLibrary);
+		lua_setfield(L, -2, libraries[i].name);
+	}
+	lua_pop(L, 1);
+}
+
+// ---------------------------------------------------------------------------
+// The former setup: luaL_requiref per library, setglobal per constant
+// ---------------------------------------------------------------------------
+static const luaL_Reg* eagerFunctions = nullptr;
+
+static int eagerOpen(lua_State* L) {
+	int count = 0;
+	while (eagerFunctions[count].name != nullptr) {
+		count++;
+	}
+	lua_createtable(L, 0, count);
+	luaL_setfuncs(L, eagerFunctions, 0);
+	return 1;
+}
+
+static void eagerInstall(lua_State* L) {
+	for (const RomLibrary* library = libraries; library->name != nullptr; library++) {
+		eagerFunctions = library->functions;
+		luaL_requiref(L, library->name, eagerOpen, 1);
+		lua_pop(L, 1);
+	}
+	for (const RomConstant* constant = constants; constant->name != nullptr; constant++) {
+		lua_pushinteger(L, constant->value);
+		lua_setglobal(L, constant->name);
+	}
+}
+
+static lua_State* newState(bool rom) {
+	lua_State* L = lua_newstate(countingAlloc, nullptr);
+	luaL_openlibs(L);
+	if (rom) {
+		romInstall(L);
+	} else {
+		eagerInstall(L);
+	}
+	lua_gc(L, LUA_GCCOLLECT);
+	return L;
+}
+
+static void runLua(lua_State* L, const char* source) {
+	int status = luaL_dostring(L, source);
+	if (status != LUA_OK) {
+		TEST_FAIL_MESSAGE(lua_tostring(L, -1));
+	}
+}
+
+static bool rawGlobal(lua_State* L, const char* name) {
+	lua_pushglobaltable(L);
+	lua_pushstring(L, name);
+	bool present = lua_rawget(L, -2) != LUA_TNIL;
+	lua_pop(L, 2);
+	return present;
+}
+
+void setUp() {}
+void tearDown() {}
+
+// ---------------------------------------------------------------------------
+// RT-01: a new state starts with less memory in use
+// ---------------------------------------------------------------------------
+void test_RT01_lower_baseline() {
+	liveBytes = 0;
+	lua_State* eager = newState(false);
+	size_t eagerBytes = liveBytes;
+	lua_close(eager);
+	TEST_ASSERT_EQUAL_UINT32(0, liveBytes);
+
+	lua_State* rom = newState(true);
+	size_t romBytes = liveBytes;
+	lua_close(rom);
+	TEST_ASSERT_EQUAL_UINT32(0, liveBytes);
+
+	char line[96];
+	snprintf(line, sizeof(line), "baseline eager %u bytes, from flash %u bytes", (unsigned) eagerBytes,
+	         (unsigned) romBytes);
+	TEST_MESSAGE(line);
+	TEST_ASSERT_TRUE(romBytes + 2048 < eagerBytes);
+}
+
+// ---------------------------------------------------------------------------
+// RT-02: libraries and constants read the same as before
+// ---------------------------------------------------------------------------
+void test_RT02_lookups() {
+	lua_State* L = newState(true);
+	runLua(L, "assert(type(hub) == 'table')\n"
+	          "assert(type(hub.startthread) == 'function')\n"
+	          "assert(hub.push(1, 2) == 2)\n"
+	          "assert(alg.kalman(1, 2, 3) == 3)\n"
+	          "assert(deb.luaHeap() == 0)\n"
+	          "assert(PORT1 == 1 and GAMEPAD_DPAD == 58)\n"
+	          "assert(math.type(PINMODE_OUTPUT) == 'integer')\n"
+	          "assert(hub.nothing == nil and NOTHING == nil and debug ~= deb)\n"
+	          "assert(string.format('%d', 7) == '7')\n");
+	lua_close(L);
+}
+
+// ---------------------------------------------------------------------------
+// RT-03: the first read is kept, later reads are table hits
+// ---------------------------------------------------------------------------
+void test_RT03_cached_on_first_use() {
+	lua_State* L = newState(true);
+	TEST_ASSERT_FALSE(rawGlobal(L, "hub"));
+	TEST_ASSERT_FALSE(rawGlobal(L, "PORT2"));
+	runLua(L, "local t = hub\n"
+	          "assert(rawget(_G, 'hub') == t and hub == t)\n"
+	          "assert(rawget(t, 'pop') == nil)\n"
+	          "local f = t.pop\n"
+	          "assert(rawget(t, 'pop') == f and rawget(t, 'push') == nil)\n"
+	          "assert(PORT2 == 2)\n");
+	TEST_ASSERT_TRUE(rawGlobal(L, "hub"));
+	TEST_ASSERT_TRUE(rawGlobal(L, "PORT2"));
+	TEST_ASSERT_FALSE(rawGlobal(L, "PORT3"));
+	TEST_ASSERT_FALSE(rawGlobal(L, "lego"));
+
+	// The hook is not called again for a kept name
+	size_t before = liveBytes;
+	runLua(L, "for i = 1, 1000 do local x = hub.pop; local y = PORT2 end");
+	lua_gc(L, LUA_GCCOLLECT);
+	TEST_ASSERT_TRUE(liveBytes <= before);
+	lua_close(L);
+}
+
+// ---------------------------------------------------------------------------
+// RT-04: a program's own globals win over the flash tables
+// ---------------------------------------------------------------------------
+void test_RT04_program_globals_win() {
+	lua_State* L = newState(true);
+	runLua(L, "PORT1 = 9\n"
+	          "assert(PORT1 == 9)\n"
+	          "lego = { mine = true }\n"
+	          "assert(lego.mine and lego.selectmode == nil)\n"
+	          "hub.pop = 5\n"
+	          "assert(hub.pop == 5)\n"
+	          "local names = 0\n"
+	          "for k in pairs(_G) do if k == 'imu' then names = names + 1 end end\n"
+	          "assert(names == 0)\n");
+	lua_close(L);
+}
+
+// ---------------------------------------------------------------------------
+// RT-05: time to create a state, for the record (not asserted, hosts differ)
+// ---------------------------------------------------------------------------
+void test_RT05_creation_time() {
+	const int rounds = 200;
+	double nanos[2];
+	for (int rom = 0; rom < 2; rom++) {
+		TestClock::time_point start = TestClock::now();
+		for (int i = 0; i < rounds; i++) {
+			lua_close(newState(rom == 1));
+		}
+		nanos[rom] =
+		    (double) std::chrono::duration_cast<std::chrono::nanoseconds>(TestClock::now() - start).count() / rounds;
+	}
+	char line[96];
+	snprintf(line, sizeof(line), "new state eager %.1f us, from flash %.1f us", nanos[0] / 1000.0,
+	         nanos[1] / 1000.0);
+	TEST_MESSAGE(line);
+	TEST_ASSERT_EQUAL_UINT32(0, liveBytes);
+}
+
+// ---------------------------------------------------------------------------
+// RT-06: libraries are registered like luaL_requiref did, errors and
+// tracebacks name their functions, require() finds them
+// ---------------------------------------------------------------------------
+static int checkInteger(lua_State* L) {
+	luaL_checkinteger(L, 1);
+	return 0;
+}
+
+void test_RT06_loaded_and_require() {
+	lua_State* L = newState(true);
+	runLua(L, "assert(package.loaded.hub == nil)\n"
+	          "local t = hub\n"
+	          "assert(package.loaded.hub == t)\n"
+	          "assert(require('hub') == t)\n"
+	          "local g = require('gamepad')\n"
+	          "assert(g == gamepad and rawget(_G, 'gamepad') == g and package.loaded.gamepad == g)\n");
+
+	// A function called without a name, luaL_argerror falls back to package.loaded
+	runLua(L, "hub.check = 0");
+	lua_getglobal(L, "hub");
+	lua_pushcfunction(L, checkInteger);
+	lua_setfield(L, -2, "check");
+	lua_pop(L, 1);
+	runLua(L, "local ok, message = pcall(hub.check, 'x')\n"
+	          "assert(not ok and message:find(\"'hub.check'\"), message)\n"
+	          "local trace\n"
+	          "xpcall(hub.check, function(m) trace = debug.traceback(m) end, 'x')\n"
+	          "assert(trace:find(\"function 'hub.check'\"), trace)\n");
+	lua_close(L);
+}
+
+// ---------------------------------------------------------------------------
+// RT-07: every name is found by the binary search, a miss is not kept and
+// costs a few compares per array
+// ---------------------------------------------------------------------------
+void test_RT07_binary_search() {
+	lua_State* L = newState(true);
+	for (const RomConstant* constant = constants; constant->name != nullptr; constant++) {
+		lua_getglobal(L, constant->name);
+		TEST_ASSERT_EQUAL_INT_MESSAGE(constant->value, (int) lua_tointeger(L, -1), constant->name);
+		lua_pop(L, 1);
+	}
+	for (const RomLibrary* library = libraries; library->name != nullptr; library++) {
+		TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TTABLE, lua_getglobal(L, library->name), library->name);
+		lua_pop(L, 1);
+	}
+
+	romCompares = 0;
+	runLua(L, "for i = 1, 100 do local x = undefinedName end");
+	TEST_ASSERT_FALSE(rawGlobal(L, "undefinedName"));
+	// log2 of 8 libraries and 58 constants, rounded up
+	TEST_ASSERT_TRUE(romCompares <= 100 * (4 + 6));
+	lua_close(L);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_RT01_lower_baseline);
+	RUN_TEST(test_RT02_lookups);
+	RUN_TEST(test_RT03_cached_on_first_use);
+	RUN_TEST(test_RT04_program_globals_win);
+	RUN_TEST(test_RT05_creation_time);
+	RUN_TEST(test_RT06_loaded_and_require);
+	RUN_TEST(test_RT07_binary_search);
+	return UNITY_END();
+}
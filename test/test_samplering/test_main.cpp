@@ -0,0 +1,382 @@
+// ---------------------------------------------------------------------------
+// Unit tests for SampleRing — per-mode timestamped sample history, SR-01..SR-09
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native --filter test_samplering
+//
+// This file reproduces SampleRing/Sample/Dataset logic inline to avoid
+// Arduino.h dependency on host (same pattern as test_mode).
+// ---------------------------------------------------------------------------
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <unity.h>
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of Format::FormatType / Dataset
+// ---------------------------------------------------------------------------
+struct Format {
+	enum class FormatType {
+		DATA8 = 0x00,
+		DATA16 = 0x01,
+		DATA32 = 0x02,
+		DATAFLOAT = 0x03,
+		UNKNOWN = 0xff
+	};
+};
+
+class Dataset {
+  public:
+	Dataset() : formatType_(Format::FormatType::UNKNOWN), intValue_(0), floatValue_(0.0f) {}
+	void setIntValue(Format::FormatType type, int value) {
+		formatType_ = type;
+		intValue_ = value;
+	}
+	void setFloatValue(float value) {
+		formatType_ = Format::FormatType::DATAFLOAT;
+		floatValue_ = value;
+	}
+	int getDataAsInt() { return formatType_ == Format::FormatType::DATAFLOAT ? (int) floatValue_ : intValue_; }
+	float getDataAsFloat() { return formatType_ == Format::FormatType::DATAFLOAT ? floatValue_ : (float) intValue_; }
+
+  private:
+	Format::FormatType formatType_;
+	int intValue_;
+	float floatValue_;
+};
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of Sample / SampleRing
+// (from lib/lpfuart/include/samplering.h + src/samplering.cpp)
+// ---------------------------------------------------------------------------
+struct Sample {
+	static const int maxValues = 8;
+
+	uint32_t index;
+	uint32_t timestampMicros;
+	uint32_t intervalMicros;
+	Format::FormatType type;
+	uint8_t count;
+	int32_t raw[maxValues];
+
+	bool isFloat() const { return type == Format::FormatType::DATAFLOAT; }
+	int intValue(int i) const { return isFloat() ? (int) floatValue(i) : raw[i]; }
+	float floatValue(int i) const {
+		if (isFloat()) {
+			float value;
+			memcpy(&value, &raw[i], sizeof(value));
+			return value;
+		}
+		return (float) raw[i];
+	}
+};
+
+class SampleRing {
+  public:
+	static const int defaultCapacity = 32;
+	static const int maxCapacity = 256;
+
+	explicit SampleRing(int capacity)
+	    : slots_(new Slot[capacity]), capacity_(capacity), head_(0), hasPrevious_(false), previousMicros_(0) {
+		for (int i = 0; i < capacity_; i++) {
+			slots_[i].sequence.store(0, std::memory_order_relaxed);
+			slots_[i].sample.index = 0;
+			slots_[i].sample.count = 0;
+		}
+	}
+
+	void push(uint32_t timestampMicros, Format::FormatType type, Dataset* datasets, int count) {
+		uint32_t index = head_.load(std::memory_order_relaxed);
+		Slot& slot = slots_[index % capacity_];
+		uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+		slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		Sample& sample = slot.sample;
+		sample.index = index;
+		sample.timestampMicros = timestampMicros;
+		sample.intervalMicros = hasPrevious_ ? timestampMicros - previousMicros_ : 0;
+		sample.type = type;
+		sample.count = count > Sample::maxValues ? Sample::maxValues : count;
+		for (int i = 0; i < sample.count; i++) {
+			if (type == Format::FormatType::DATAFLOAT) {
+				float value = datasets[i].getDataAsFloat();
+				memcpy(&sample.raw[i], &value, sizeof(value));
+			} else {
+				sample.raw[i] = datasets[i].getDataAsInt();
+			}
+		}
+
+		slot.sequence.store(sequence + 2, std::memory_order_release);
+		head_.store(index + 1, std::memory_order_release);
+		hasPrevious_ = true;
+		previousMicros_ = timestampMicros;
+	}
+
+	int read(uint32_t& cursor, Sample* out, int maxSamples, uint32_t& lost) {
+		uint32_t head = head_.load(std::memory_order_acquire);
+		uint32_t from = cursor;
+		uint32_t pending = head - from;
+		if (pending > (uint32_t) INT32_MAX) {
+			from = head;
+			pending = 0;
+		}
+		if (pending > (uint32_t) capacity_) {
+			lost += pending - capacity_;
+			from = head - capacity_;
+		}
+		int copied = 0;
+		while (from != head && copied < maxSamples) {
+			Slot& slot = slots_[from % capacity_];
+			bool ok = false;
+			for (int attempt = 0; attempt < maxReadRetries && !ok; attempt++) {
+				uint32_t before = slot.sequence.load(std::memory_order_acquire);
+				if (before & 1) {
+					continue;
+				}
+				out[copied] = slot.sample;
+				std::atomic_thread_fence(std::memory_order_acquire);
+				uint32_t after = slot.sequence.load(std::memory_order_relaxed);
+				ok = before == after;
+			}
+			if (ok && out[copied].index == from) {
+				copied++;
+			} else {
+				lost++;
+			}
+			from++;
+		}
+		cursor = from;
+		return copied;
+	}
+
+	uint32_t head() const { return head_.load(std::memory_order_acquire); }
+	int capacity() const { return capacity_; }
+
+	// Test hook: start the sample counter just below the 32 bit wrap
+	void presetHead(uint32_t head) { head_.store(head); }
+
+  private:
+	struct Slot {
+		std::atomic<uint32_t> sequence;
+		Sample sample;
+	};
+	static const int maxReadRetries = 4;
+
+	std::unique_ptr<Slot[]> slots_;
+	int capacity_;
+	std::atomic<uint32_t> head_;
+	bool hasPrevious_;
+	uint32_t previousMicros_;
+};
+
+// ---------------------------------------------------------------------------
+// Helpers
+// ---------------------------------------------------------------------------
+static void pushInts(SampleRing& ring, uint32_t t, int a, int b, int c) {
+	Dataset ds[3];
+	ds[0].setIntValue(Format::FormatType::DATA16, a);
+	ds[1].setIntValue(Format::FormatType::DATA16, b);
+	ds[2].setIntValue(Format::FormatType::DATA16, c);
+	ring.push(t, Format::FormatType::DATA16, ds, 3);
+}
+
+void setUp() {}
+void tearDown() {}
+
+// SR-01: empty ring reads nothing and keeps the cursor
+static void test_SR01_empty_ring() {
+	SampleRing ring(4);
+	Sample out[4];
+	uint32_t cursor = 0;
+	uint32_t lost = 0;
+	TEST_ASSERT_EQUAL_INT(0, ring.read(cursor, out, 4, lost));
+	TEST_ASSERT_EQUAL_UINT32(0, cursor);
+	TEST_ASSERT_EQUAL_UINT32(0, lost);
+}
+
+// SR-02: samples come back oldest first with timestamps and all datasets
+static void test_SR02_push_read_in_order() {
+	SampleRing ring(8);
+	pushInts(ring, 1000, 1, 2, 3);
+	pushInts(ring, 2000, 4, 5, 6);
+
+	Sample out[8];
+	uint32_t cursor = 0;
+	uint32_t lost = 0;
+	TEST_ASSERT_EQUAL_INT(2, ring.read(cursor, out, 8, lost));
+	TEST_ASSERT_EQUAL_UINT32(2, cursor);
+	TEST_ASSERT_EQUAL_UINT32(1000, out[0].timestampMicros);
+	TEST_ASSERT_EQUAL_INT(3, out[0].count);
+	TEST_ASSERT_EQUAL_INT(3, out[0].intValue(2));
+	TEST_ASSERT_EQUAL_UINT32(2000, out[1].timestampMicros);
+	TEST_ASSERT_EQUAL_INT(4, out[1].intValue(0));
+}
+
+// SR-03: a second read only returns what arrived after the cursor
+static void test_SR03_cursor_drains_only_new() {
+	SampleRing ring(8);
+	Sample out[8];
+	uint32_t cursor = 0;
+	uint32_t lost = 0;
+	pushInts(ring, 1, 1, 1, 1);
+	ring.read(cursor, out, 8, lost);
+	pushInts(ring, 2, 2, 2, 2);
+	TEST_ASSERT_EQUAL_INT(1, ring.read(cursor, out, 8, lost));
+	TEST_ASSERT_EQUAL_INT(2, out[0].intValue(0));
+	TEST_ASSERT_EQUAL_INT(0, ring.read(cursor, out, 8, lost));
+	TEST_ASSERT_EQUAL_UINT32(0, lost);
+}
+
+// SR-04: overwritten samples are reported as lost, newest capacity samples survive
+static void test_SR04_overrun_counts_lost() {
+	SampleRing ring(4);
+	for (int i = 0; i < 10; i++) {
+		pushInts(ring, i, i, 0, 0);
+	}
+	Sample out[8];
+	uint32_t cursor = 0;
+	uint32_t lost = 0;
+	TEST_ASSERT_EQUAL_INT(4, ring.read(cursor, out, 8, lost));
+	TEST_ASSERT_EQUAL_UINT32(6, lost);
+	TEST_ASSERT_EQUAL_INT(6, out[0].intValue(0));
+	TEST_ASSERT_EQUAL_INT(9, out[3].intValue(0));
+	TEST_ASSERT_EQUAL_UINT32(10, cursor);
+}
+
+// SR-05: maxSamples limits one read, the rest follows on the next call
+static void test_SR05_partial_reads() {
+	SampleRing ring(8);
+	for (int i = 0; i < 5; i++) {
+		pushInts(ring, i, i, 0, 0);
+	}
+	Sample out[2];
+	uint32_t cursor = 0;
+	uint32_t lost = 0;
+	TEST_ASSERT_EQUAL_INT(2, ring.read(cursor, out, 2, lost));
+	TEST_ASSERT_EQUAL_INT(2, ring.read(cursor, out, 2, lost));
+	TEST_ASSERT_EQUAL_INT(3, out[1].intValue(0));
+	TEST_ASSERT_EQUAL_INT(1, ring.read(cursor, out, 2, lost));
+	TEST_ASSERT_EQUAL_UINT32(5, cursor);
+}
+
+// SR-06: DATAFLOAT values round-trip bit exact, frames wider than maxValues are truncated
+static void test_SR06_float_and_truncation() {
+	SampleRing ring(2);
+	Dataset ds[10];
+	for (int i = 0; i < 10; i++) {
+		ds[i].setFloatValue(0.5f * i - 1.25f);
+	}
+	ring.push(42, Format::FormatType::DATAFLOAT, ds, 10);
+	Sample out[2];
+	uint32_t cursor = 0;
+	uint32_t lost = 0;
+	TEST_ASSERT_EQUAL_INT(1, ring.read(cursor, out, 2, lost));
+	TEST_ASSERT_EQUAL_INT(Sample::maxValues, out[0].count);
+	TEST_ASSERT_EQUAL_FLOAT(-1.25f, out[0].floatValue(0));
+	TEST_ASSERT_EQUAL_FLOAT(2.25f, out[0].floatValue(7));
+	TEST_ASSERT_EQUAL_INT(2, out[0].intValue(7));
+}
+
+// SR-07: the 32 bit sample counter wraps without losing or repeating samples,
+// a cursor ahead of head restarts at head
+static void test_SR07_counter_wrap_and_bogus_cursor() {
+	SampleRing ring(4);
+	ring.presetHead(0xFFFFFFFEu);
+	uint32_t cursor = ring.head();
+	for (int i = 0; i < 3; i++) {
+		pushInts(ring, i, i, 0, 0);
+	}
+	Sample out[4];
+	uint32_t lost = 0;
+	TEST_ASSERT_EQUAL_INT(3, ring.read(cursor, out, 4, lost));
+	TEST_ASSERT_EQUAL_UINT32(1, cursor);
+	TEST_ASSERT_EQUAL_INT(2, out[2].intValue(0));
+	TEST_ASSERT_EQUAL_UINT32(0, lost);
+
+	uint32_t bogus = 1000;
+	TEST_ASSERT_EQUAL_INT(0, ring.read(bogus, out, 4, lost));
+	TEST_ASSERT_EQUAL_UINT32(1, bogus);
+}
+
+// SR-08: a concurrent reader never observes a torn frame (all datasets of a
+// sample must come from the same push)
+static void test_SR08_concurrent_reader_never_torn() {
+	SampleRing ring(4);
+	std::atomic<bool> done(false);
+	const int pushes = 200000;
+
+	std::thread writer([&]() {
+		for (int i = 1; i <= pushes; i++) {
+			pushInts(ring, i, i, -i, i * 2);
+		}
+		done = true;
+	});
+
+	Sample out[4];
+	uint32_t cursor = 0;
+	uint32_t lost = 0;
+	uint32_t seen = 0;
+	int torn = 0;
+	while (!done || cursor != ring.head()) {
+		int n = ring.read(cursor, out, 4, lost);
+		for (int i = 0; i < n; i++) {
+			int v = out[i].intValue(0);
+			if (out[i].intValue(1) != -v || out[i].intValue(2) != v * 2 || out[i].timestampMicros != (uint32_t) v) {
+				torn++;
+			}
+		}
+		seen += n;
+	}
+	writer.join();
+
+	TEST_ASSERT_EQUAL_INT(0, torn);
+	TEST_ASSERT_EQUAL_UINT32((uint32_t) pushes, seen + lost);
+}
+
+// SR-09: the interval to the previous sample stays correct across the wrap of
+// micros(), also for a reader that starts after the wrap or lost samples
+static void test_SR09_interval_across_micros_wrap() {
+	SampleRing ring(4);
+	pushInts(ring, 0xFFFFFC18u, 1, 0, 0); // 1000 us before the wrap
+	pushInts(ring, 0xFFFFFFFFu, 2, 0, 0);
+	pushInts(ring, 500, 3, 0, 0);
+	pushInts(ring, 2500, 4, 0, 0);
+	pushInts(ring, 4500, 5, 0, 0);
+
+	Sample out[4];
+	uint32_t cursor = 0;
+	uint32_t lost = 0;
+	TEST_ASSERT_EQUAL_INT(4, ring.read(cursor, out, 4, lost));
+	TEST_ASSERT_EQUAL_UINT32(1, lost);
+	TEST_ASSERT_EQUAL_UINT32(999, out[0].intervalMicros);
+	TEST_ASSERT_EQUAL_UINT32(501, out[1].intervalMicros);
+	TEST_ASSERT_EQUAL_UINT32(2000, out[2].intervalMicros);
+	TEST_ASSERT_EQUAL_UINT32(2000, out[3].intervalMicros);
+	// Fits a 32 bit Lua integer without turning negative
+	TEST_ASSERT_TRUE((int32_t) out[1].intervalMicros > 0);
+
+	SampleRing fresh(4);
+	pushInts(fresh, 0xFFFFFFF0u, 1, 0, 0);
+	cursor = 0;
+	TEST_ASSERT_EQUAL_INT(1, fresh.read(cursor, out, 4, lost));
+	TEST_ASSERT_EQUAL_UINT32(0, out[0].intervalMicros);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_SR01_empty_ring);
+	RUN_TEST(test_SR02_push_read_in_order);
+	RUN_TEST(test_SR03_cursor_drains_only_new);
+	RUN_TEST(test_SR04_overrun_counts_lost);
+	RUN_TEST(test_SR05_partial_reads);
+	RUN_TEST(test_SR06_float_and_truncation);
+	RUN_TEST(test_SR07_counter_wrap_and_bogus_cursor);
+	RUN_TEST(test_SR08_concurrent_reader_never_torn);
+	RUN_TEST(test_SR09_interval_across_micros_wrap);
+	return UNITY_END();
+}
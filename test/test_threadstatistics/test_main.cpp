@@ -0,0 +1,262 @@
+// ---------------------------------------------------------------------------
+// Unit tests for the latency histogram of ThreadStatistics — TS-01..TS-06
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native --filter test_threadstatistics
+//
+// This file reproduces LatencyHistogram and the reset generation of
+// ThreadStatistics inline (mirrors threadstatistics.cpp). The JSON
+// serialization is replaced by a plain vector.
+// ---------------------------------------------------------------------------
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <unity.h>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of LatencyHistogram
+// ---------------------------------------------------------------------------
+class LatencyHistogram {
+  public:
+	static const int linearBuckets = 16;
+	static const int subBucketBits = 3;
+	static const int maxExponent = 26;
+	static const int bucketCount = linearBuckets + (maxExponent - 3) * (1 << subBucketBits);
+
+	LatencyHistogram() : counts_(bucketCount, 0), total_(0), max_(0) {}
+
+	static int bucketOf(uint32_t micros) {
+		if (micros < (uint32_t) linearBuckets) {
+			return (int) micros;
+		}
+		int exponent = 31 - __builtin_clz(micros);
+		if (exponent > maxExponent) {
+			return bucketCount - 1;
+		}
+		int subBucket = (micros >> (exponent - subBucketBits)) & ((1 << subBucketBits) - 1);
+		return linearBuckets + (exponent - 4) * (1 << subBucketBits) + subBucket;
+	}
+
+	static uint32_t bucketLowest(int bucket) {
+		if (bucket < linearBuckets) {
+			return (uint32_t) bucket;
+		}
+		int exponent = 4 + (bucket - linearBuckets) / (1 << subBucketBits);
+		uint32_t subBucket = (bucket - linearBuckets) % (1 << subBucketBits);
+		return ((1u << subBucketBits) + subBucket) << (exponent - subBucketBits);
+	}
+
+	static uint32_t bucketHighest(int bucket) {
+		if (bucket < linearBuckets) {
+			return (uint32_t) bucket;
+		}
+		if (bucket == bucketCount - 1) {
+			return UINT32_MAX;
+		}
+		return bucketLowest(bucket + 1) - 1;
+	}
+
+	void record(uint32_t micros) {
+		counts_[bucketOf(micros)]++;
+		total_++;
+		if (micros > max_) {
+			max_ = micros;
+		}
+	}
+
+	void reset() {
+		std::fill(counts_.begin(), counts_.end(), 0);
+		total_ = 0;
+		max_ = 0;
+	}
+
+	uint32_t count() const { return total_; }
+
+	uint32_t percentile(uint32_t perMille) const {
+		if (total_ == 0) {
+			return 0;
+		}
+		uint32_t rank = (uint32_t) (((uint64_t) total_ * perMille + 999) / 1000);
+		if (rank < 1) {
+			rank = 1;
+		}
+		uint32_t seen = 0;
+		for (int i = 0; i < bucketCount; i++) {
+			seen += counts_[i];
+			if (seen >= rank) {
+				uint32_t highest = bucketHighest(i);
+				return highest < max_ ? highest : max_;
+			}
+		}
+		return max_;
+	}
+
+	std::vector<uint32_t> serialize() const {
+		std::vector<uint32_t> target;
+		for (int i = 0; i < bucketCount; i++) {
+			if (counts_[i] > 0) {
+				target.push_back(bucketLowest(i));
+				target.push_back(counts_[i]);
+			}
+		}
+		return target;
+	}
+
+  private:
+	std::vector<uint32_t> counts_;
+	uint32_t total_;
+	uint32_t max_;
+};
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of the reset generation of ThreadStatistics
+// ---------------------------------------------------------------------------
+static std::atomic<uint32_t> resetGeneration(0);
+
+struct Statistics {
+	uint32_t generation = resetGeneration.load();
+	unsigned long maxDuration = 0;
+	LatencyHistogram histogram;
+
+	void record(unsigned long durationMicros) {
+		uint32_t current = resetGeneration.load();
+		if (current != generation) {
+			generation = current;
+			maxDuration = 0;
+			histogram.reset();
+		}
+		if (durationMicros > maxDuration) {
+			maxDuration = durationMicros;
+		}
+		histogram.record(durationMicros);
+	}
+};
+
+void setUp() {}
+
+void tearDown() {}
+
+// ---------------------------------------------------------------------------
+// TS-01: bucket boundaries are contiguous, every value lies within its bucket
+// ---------------------------------------------------------------------------
+void test_TS01_buckets_contiguous() {
+	TEST_ASSERT_EQUAL_INT(200, LatencyHistogram::bucketCount);
+	TEST_ASSERT_EQUAL_UINT32(0, LatencyHistogram::bucketLowest(0));
+	for (int i = 1; i < LatencyHistogram::bucketCount; i++) {
+		TEST_ASSERT_EQUAL_UINT32(LatencyHistogram::bucketHighest(i - 1) + 1, LatencyHistogram::bucketLowest(i));
+	}
+
+	const uint32_t values[] = {0, 15, 16, 17, 31, 32, 100, 1000, 1023, 1024, 65535, 1000000, 134217727};
+	for (uint32_t value : values) {
+		int bucket = LatencyHistogram::bucketOf(value);
+		TEST_ASSERT_TRUE(LatencyHistogram::bucketLowest(bucket) <= value);
+		TEST_ASSERT_TRUE(LatencyHistogram::bucketHighest(bucket) >= value);
+	}
+}
+
+// ---------------------------------------------------------------------------
+// TS-02: above the linear range a bucket is at most 12.5% wide, values beyond
+// the range fall into the last bucket
+// ---------------------------------------------------------------------------
+void test_TS02_relative_precision() {
+	for (int i = LatencyHistogram::linearBuckets; i < LatencyHistogram::bucketCount - 1; i++) {
+		uint32_t lowest = LatencyHistogram::bucketLowest(i);
+		uint32_t width = LatencyHistogram::bucketHighest(i) - lowest + 1;
+		TEST_ASSERT_TRUE(width * 8 <= lowest);
+	}
+	TEST_ASSERT_EQUAL_INT(LatencyHistogram::bucketCount - 1, LatencyHistogram::bucketOf(UINT32_MAX));
+	TEST_ASSERT_EQUAL_INT(LatencyHistogram::bucketCount - 1, LatencyHistogram::bucketOf(300000000));
+}
+
+// ---------------------------------------------------------------------------
+// TS-03: percentiles of a uniform distribution are within one bucket
+// ---------------------------------------------------------------------------
+void test_TS03_uniform_percentiles() {
+	LatencyHistogram histogram;
+	for (uint32_t i = 1; i <= 10000; i++) {
+		histogram.record(i);
+	}
+	TEST_ASSERT_EQUAL_UINT32(10000, histogram.count());
+
+	uint32_t p50 = histogram.percentile(500);
+	uint32_t p99 = histogram.percentile(990);
+	TEST_ASSERT_TRUE(p50 >= 5000 && p50 <= 5000 + 5000 / 8);
+	TEST_ASSERT_TRUE(p99 >= 9900 && p99 <= 10000);
+	// Capped at the recorded maximum
+	TEST_ASSERT_EQUAL_UINT32(10000, histogram.percentile(1000));
+}
+
+// ---------------------------------------------------------------------------
+// TS-04: a rare spike is invisible in p50/p90 but shows up in p99.9
+// ---------------------------------------------------------------------------
+void test_TS04_tail_spike_visible() {
+	LatencyHistogram histogram;
+	for (int i = 0; i < 9980; i++) {
+		histogram.record(1000);
+	}
+	for (int i = 0; i < 20; i++) {
+		histogram.record(40000);
+	}
+
+	TEST_ASSERT_EQUAL_UINT32(1023, histogram.percentile(500));
+	TEST_ASSERT_EQUAL_UINT32(1023, histogram.percentile(990));
+	TEST_ASSERT_EQUAL_UINT32(40000, histogram.percentile(999));
+}
+
+// ---------------------------------------------------------------------------
+// TS-05: serialization lists only non-empty buckets as lowest/count pairs
+// ---------------------------------------------------------------------------
+void test_TS05_serialize_compact() {
+	LatencyHistogram histogram;
+	histogram.record(5);
+	histogram.record(5);
+	histogram.record(1000);
+
+	std::vector<uint32_t> serialized = histogram.serialize();
+	TEST_ASSERT_EQUAL_UINT32(4, (uint32_t) serialized.size());
+	TEST_ASSERT_EQUAL_UINT32(5, serialized[0]);
+	TEST_ASSERT_EQUAL_UINT32(2, serialized[1]);
+	TEST_ASSERT_EQUAL_UINT32(960, serialized[2]);
+	TEST_ASSERT_EQUAL_UINT32(1, serialized[3]);
+
+	LatencyHistogram empty;
+	TEST_ASSERT_EQUAL_UINT32(0, (uint32_t) empty.serialize().size());
+	TEST_ASSERT_EQUAL_UINT32(0, empty.percentile(990));
+}
+
+// ---------------------------------------------------------------------------
+// TS-06: a requested reset clears the statistics with the next iteration
+// ---------------------------------------------------------------------------
+void test_TS06_reset_on_request() {
+	Statistics a;
+	Statistics b;
+	a.record(50000);
+	b.record(70000);
+
+	resetGeneration++;
+	TEST_ASSERT_EQUAL_UINT32(1, a.histogram.count());
+
+	a.record(100);
+	TEST_ASSERT_EQUAL_UINT32(1, a.histogram.count());
+	TEST_ASSERT_EQUAL_UINT32(100, a.maxDuration);
+	TEST_ASSERT_EQUAL_UINT32(100, a.histogram.percentile(999));
+
+	b.record(200);
+	b.record(300);
+	TEST_ASSERT_EQUAL_UINT32(2, b.histogram.count());
+	TEST_ASSERT_EQUAL_UINT32(300, b.maxDuration);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_TS01_buckets_contiguous);
+	RUN_TEST(test_TS02_relative_precision);
+	RUN_TEST(test_TS03_uniform_percentiles);
+	RUN_TEST(test_TS04_tail_spike_visible);
+	RUN_TEST(test_TS05_serialize_compact);
+	RUN_TEST(test_TS06_reset_on_request);
+	return UNITY_END();
+}
@@ -0,0 +1,383 @@
+// ---------------------------------------------------------------------------
+// Unit tests for the LegoDevice outbound command queue, TQ-01..TQ-06
+// Uses Unity test framework (PlatformIO native environment)
+//
+// Run with: pio test -e native --filter test_txqueue
+//
+// This file reproduces the queue part of LegoDevice inline to avoid the
+// Arduino.h / FreeRTOS dependency on host (same pattern as test_handshake).
+// The critical section is a no-op, waitForCommand() runs the port service
+// from its delay hook instead of sleeping.
+// ---------------------------------------------------------------------------
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <unity.h>
+#include <vector>
+
+static unsigned long g_millis = 0;
+unsigned long millis() {
+	return g_millis;
+}
+
+// Called by the vTaskDelay() stub; lets a test act as the port service task
+static std::function<void()> g_onDelay;
+static void vTaskDelayMs(int ms) {
+	g_millis += ms;
+	if (g_onDelay) {
+		g_onDelay();
+	}
+}
+
+#define WARN(msg, ...)                                                                                                 \
+	do {                                                                                                               \
+		printf("[WARN] " msg "\n", ##__VA_ARGS__);                                                                     \
+	} while (0)
+
+// ---------------------------------------------------------------------------
+// SerialIO stub recording written commands
+// ---------------------------------------------------------------------------
+struct SerialIO {
+	std::vector<std::vector<uint8_t>> writes;
+	std::vector<unsigned long> writtenAt;
+	void writeBytes(const uint8_t* buffer, int length) {
+		writes.emplace_back(buffer, buffer + length);
+		writtenAt.push_back(g_millis);
+	}
+};
+
+// ---------------------------------------------------------------------------
+// Inline reproduction of the LegoDevice command queue
+// (mirrors legodevice.cpp enqueueCommand / serviceTxQueue / writeCommand /
+// acknowledgeCommand / dropQueuedCommands / waitForCommand)
+// ---------------------------------------------------------------------------
+class LegoDevice {
+  public:
+	static const int maxCombiEntries = 15;
+	struct CombiEntry {
+		uint8_t mode;
+		uint8_t dataset;
+	};
+	enum class TxAction : uint8_t {
+		NONE,
+		SELECT_MODE,
+		SELECT_COMBI
+	};
+	static const int maxTxCommandLength = 1 + 16 + 1;
+	struct TxCommand {
+		uint32_t ticket;
+		unsigned long queuedAt;
+		TxAction action;
+		int8_t mode;
+		uint8_t length;
+		uint8_t bytes[maxTxCommandLength];
+		uint8_t numCombiEntries;
+		uint8_t combiFrameSize;
+		std::array<CombiEntry, maxCombiEntries> combiEntries;
+	};
+	static const int txQueueCapacity = 8;
+	static const int txGapMs = 4;
+	static const int txMaxDelayMs = 20;
+
+	explicit LegoDevice(SerialIO* serialIO) : serialIO_(serialIO) {}
+
+	SerialIO* serialIO_;
+	unsigned long lastReceivedDataInMillis_ = 0;
+	int selectedMode_ = -1;
+	bool combiActive_ = false;
+	int combiFrameSize_ = 0;
+	std::array<TxCommand, txQueueCapacity> txQueue_;
+	int txHead_ = 0;
+	int txCount_ = 0;
+	uint32_t nextTicket_ = 1;
+	std::atomic<uint32_t> txWrittenTicket_{0};
+	std::atomic<uint32_t> txAckedTicket_{0};
+	std::atomic<uint32_t> txDroppedTicket_{0};
+	uint32_t awaitingAckTicket_ = 0;
+	int awaitingAckMode_ = -1;
+	uint32_t ackFollowerTicket_ = 0;
+
+	uint32_t selectMode(int modeIndex) {
+		TxCommand command;
+		command.action = TxAction::SELECT_MODE;
+		command.mode = (int8_t) modeIndex;
+		uint8_t header = 0x43;
+		command.bytes[0] = header;
+		command.bytes[1] = (uint8_t) modeIndex;
+		command.bytes[2] = 0xff ^ header ^ modeIndex;
+		command.length = 3;
+		return enqueueCommand(command);
+	}
+
+	uint32_t selectCombi(int frameSize) {
+		TxCommand command;
+		command.action = TxAction::SELECT_COMBI;
+		command.mode = -1;
+		command.bytes[0] = 0x4C;
+		command.length = 1;
+		command.numCombiEntries = 0;
+		command.combiFrameSize = (uint8_t) frameSize;
+		return enqueueCommand(command);
+	}
+
+	uint32_t selectSpeed() {
+		TxCommand command;
+		command.action = TxAction::NONE;
+		command.mode = -1;
+		command.bytes[0] = 0x52;
+		command.length = 1;
+		return enqueueCommand(command);
+	}
+
+	uint32_t enqueueCommand(TxCommand& command) {
+		uint32_t ticket = 0;
+		if (txCount_ < txQueueCapacity) {
+			ticket = nextTicket_++;
+			command.ticket = ticket;
+			command.queuedAt = millis();
+			txQueue_[(txHead_ + txCount_) % txQueueCapacity] = command;
+			txCount_++;
+		}
+		if (ticket == 0) {
+			WARN("Command queue full, dropping command 0x%02X", command.bytes[0]);
+		}
+		return ticket;
+	}
+
+	void serviceTxQueue(unsigned long now) {
+		TxCommand command;
+		bool ready = false;
+		if (txCount_ > 0) {
+			long waited = (long) (now - txQueue_[txHead_].queuedAt);
+			if (now - lastReceivedDataInMillis_ >= txGapMs || waited >= txMaxDelayMs) {
+				command = txQueue_[txHead_];
+				txHead_ = (txHead_ + 1) % txQueueCapacity;
+				txCount_--;
+				ready = true;
+			}
+		}
+		if (ready) {
+			writeCommand(command);
+		}
+	}
+
+	void writeCommand(const TxCommand& command) {
+		switch (command.action) {
+			case TxAction::SELECT_MODE:
+				selectedMode_ = command.mode;
+				combiActive_ = false;
+				break;
+			case TxAction::SELECT_COMBI:
+				combiFrameSize_ = command.combiFrameSize;
+				combiActive_ = true;
+				break;
+			case TxAction::NONE:
+				break;
+		}
+		serialIO_->writeBytes(command.bytes, command.length);
+
+		if (command.ticket == 0) {
+			return;
+		}
+		txWrittenTicket_ = command.ticket;
+		if (command.action == TxAction::NONE) {
+			if (awaitingAckTicket_ == 0) {
+				txAckedTicket_ = command.ticket;
+			} else {
+				ackFollowerTicket_ = command.ticket;
+			}
+		} else {
+			awaitingAckTicket_ = command.ticket;
+			awaitingAckMode_ = command.mode;
+			ackFollowerTicket_ = 0;
+		}
+	}
+
+	void acknowledgeCommand() {
+		txAckedTicket_ = ackFollowerTicket_ > awaitingAckTicket_ ? ackFollowerTicket_ : awaitingAckTicket_;
+		awaitingAckTicket_ = 0;
+		ackFollowerTicket_ = 0;
+	}
+
+	void dropQueuedCommands() {
+		txHead_ = 0;
+		txCount_ = 0;
+		txDroppedTicket_ = nextTicket_ - 1;
+		awaitingAckTicket_ = 0;
+		ackFollowerTicket_ = 0;
+	}
+
+	bool waitForCommand(uint32_t ticket, uint32_t timeoutMs, bool acknowledged) {
+		if (ticket == 0) {
+			return false;
+		}
+		const std::atomic<uint32_t>& done = acknowledged ? txAckedTicket_ : txWrittenTicket_;
+		unsigned long start = millis();
+		while (done.load() < ticket) {
+			if (txDroppedTicket_.load() >= ticket || millis() - start >= timeoutMs) {
+				return false;
+			}
+			vTaskDelayMs(1);
+		}
+		return true;
+	}
+
+	// Ack part of onDataFrame()
+	void onDataFrame(int mode, int payloadSize) {
+		lastReceivedDataInMillis_ = millis();
+		if (combiActive_ && payloadSize == combiFrameSize_) {
+			if (awaitingAckTicket_ != 0 && awaitingAckMode_ == -1) {
+				acknowledgeCommand();
+			}
+			return;
+		}
+		if (awaitingAckTicket_ != 0 && !combiActive_ && mode == awaitingAckMode_) {
+			acknowledgeCommand();
+		}
+	}
+};
+
+void setUp() {
+	g_millis = 1000;
+	g_onDelay = nullptr;
+}
+
+void tearDown() {}
+
+// TQ-01: select only queues; nothing is written and no state changes until serviced
+void test_TQ01_select_does_not_write() {
+	SerialIO io;
+	LegoDevice dev(&io);
+	uint32_t ticket = dev.selectMode(2);
+	TEST_ASSERT_NOT_EQUAL(0, ticket);
+	TEST_ASSERT_EQUAL_INT(0, (int) io.writes.size());
+	TEST_ASSERT_EQUAL_INT(-1, dev.selectedMode_);
+
+	dev.serviceTxQueue(g_millis);
+	TEST_ASSERT_EQUAL_INT(1, (int) io.writes.size());
+	TEST_ASSERT_EQUAL_INT(2, dev.selectedMode_);
+	TEST_ASSERT_EQUAL_UINT8(0xff ^ 0x43 ^ 2, io.writes[0][2]);
+}
+
+// TQ-02: while DATA is arriving the command waits for the gap, at most txMaxDelayMs
+void test_TQ02_written_in_gap_or_after_max_delay() {
+	SerialIO io;
+	LegoDevice dev(&io);
+	dev.lastReceivedDataInMillis_ = g_millis;
+	dev.selectMode(1);
+
+	dev.serviceTxQueue(g_millis + 2);
+	TEST_ASSERT_EQUAL_INT(0, (int) io.writes.size());
+	g_millis += LegoDevice::txGapMs;
+	dev.serviceTxQueue(g_millis);
+	TEST_ASSERT_EQUAL_INT(1, (int) io.writes.size());
+
+	// A device streaming without pause still gets the command after txMaxDelayMs
+	dev.selectMode(3);
+	unsigned long queuedAt = g_millis;
+	while (io.writes.size() < 2) {
+		g_millis++;
+		dev.lastReceivedDataInMillis_ = g_millis;
+		dev.serviceTxQueue(g_millis);
+	}
+	TEST_ASSERT_EQUAL_UINT32(queuedAt + LegoDevice::txMaxDelayMs, (uint32_t) io.writtenAt[1]);
+}
+
+// TQ-03: commands are written one per service call, in order; a full queue rejects
+void test_TQ03_fifo_order_and_capacity() {
+	SerialIO io;
+	LegoDevice dev(&io);
+	for (int i = 0; i < LegoDevice::txQueueCapacity; i++) {
+		TEST_ASSERT_NOT_EQUAL(0, dev.selectMode(i));
+	}
+	TEST_ASSERT_EQUAL_UINT32(0, dev.selectMode(9));
+
+	for (int i = 0; i < LegoDevice::txQueueCapacity; i++) {
+		dev.serviceTxQueue(g_millis);
+		TEST_ASSERT_EQUAL_INT(i + 1, (int) io.writes.size());
+		TEST_ASSERT_EQUAL_UINT8(i, io.writes[i][1]);
+	}
+	TEST_ASSERT_EQUAL_INT(LegoDevice::txQueueCapacity - 1, dev.selectedMode_);
+}
+
+// TQ-04: written vs acknowledged waits; the ack is the first frame in the selected mode
+void test_TQ04_wait_written_and_acknowledged() {
+	SerialIO io;
+	LegoDevice dev(&io);
+	uint32_t ticket = dev.selectMode(2);
+
+	int frames = 0;
+	g_onDelay = [&]() {
+		dev.serviceTxQueue(g_millis);
+		// Device keeps sending mode 0 for 5 ms before it switches
+		if (!io.writes.empty()) {
+			frames++;
+			dev.onDataFrame(frames < 5 ? 0 : 2, 2);
+		}
+	};
+	TEST_ASSERT_TRUE(dev.waitForCommand(ticket, 100, false));
+	TEST_ASSERT_EQUAL_UINT32(0, dev.txAckedTicket_.load());
+	TEST_ASSERT_TRUE(dev.waitForCommand(ticket, 100, true));
+	TEST_ASSERT_EQUAL_INT(5, frames);
+
+	// A command without device ack written behind an unacknowledged select is
+	// acknowledged together with it
+	uint32_t select = dev.selectMode(1);
+	uint32_t speed = dev.selectSpeed();
+	g_onDelay = nullptr;
+	g_millis += LegoDevice::txGapMs;
+	dev.serviceTxQueue(g_millis);
+	dev.serviceTxQueue(g_millis);
+	TEST_ASSERT_LESS_THAN_UINT32(select, dev.txAckedTicket_.load());
+	dev.onDataFrame(1, 2);
+	TEST_ASSERT_EQUAL_UINT32(speed, dev.txAckedTicket_.load());
+}
+
+// TQ-05: combi select is acknowledged by the first frame of the combined size
+void test_TQ05_combi_ack() {
+	SerialIO io;
+	LegoDevice dev(&io);
+	uint32_t ticket = dev.selectCombi(8);
+	dev.serviceTxQueue(g_millis);
+	TEST_ASSERT_TRUE(dev.combiActive_);
+
+	dev.onDataFrame(1, 2);
+	TEST_ASSERT_FALSE(dev.waitForCommand(ticket, 0, true));
+	dev.onDataFrame(1, 8);
+	TEST_ASSERT_TRUE(dev.waitForCommand(ticket, 0, true));
+}
+
+// TQ-06: a reset drops queued commands and fails their waits without a timeout
+void test_TQ06_reset_fails_waits() {
+	SerialIO io;
+	LegoDevice dev(&io);
+	uint32_t written = dev.selectMode(1);
+	dev.serviceTxQueue(g_millis);
+	uint32_t queued = dev.selectMode(2);
+
+	dev.dropQueuedCommands();
+	unsigned long start = g_millis;
+	TEST_ASSERT_FALSE(dev.waitForCommand(queued, 1000, false));
+	TEST_ASSERT_FALSE(dev.waitForCommand(written, 1000, true));
+	TEST_ASSERT_TRUE(dev.waitForCommand(written, 1000, false));
+	TEST_ASSERT_EQUAL_UINT32(start, (uint32_t) g_millis);
+
+	dev.serviceTxQueue(g_millis);
+	TEST_ASSERT_EQUAL_INT(1, (int) io.writes.size());
+	TEST_ASSERT_FALSE(dev.waitForCommand(0, 10, false));
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_TQ01_select_does_not_write);
+	RUN_TEST(test_TQ02_written_in_gap_or_after_max_delay);
+	RUN_TEST(test_TQ03_fifo_order_and_capacity);
+	RUN_TEST(test_TQ04_wait_written_and_acknowledged);
+	RUN_TEST(test_TQ05_combi_ack);
+	RUN_TEST(test_TQ06_reset_fails_waits);
+	return UNITY_END();
+}